@@ -5,6 +5,8 @@
 #include <map>
 #include <string>
 #include <cstdint>
+#include <ctime>
+#include <functional>
 #include <boost/optional.hpp>
 #include <mutex>
 #ifndef NO_THREADS
@@ -12,14 +14,12 @@
 #include <atomic>
 #endif
 #include <set>
+#include <memory>
+#include <unordered_map>
 #include <unordered_set>
+#include "TileConfig.hpp"
 #include "Util.hpp"
 
-#ifdef FUZZ_SAFETY_CHECK
-
-#include <boost/interprocess/sync/file_lock.hpp>
-
-#endif
 
 using namespace std;
 namespace Trellis {
@@ -265,8 +265,65 @@ ostream &operator<<(ostream &out, const FixedConnection &es);
 // Read fixed connection from input
 istream &operator>>(istream &out, FixedConnection &es);
 
+/*
+A SymbolicTileConfig is a TileConfig resolved against the TileBitDatabase of its tile type, with every name replaced by
+an index. Sinks, words and enums are numbered in name order, as are the sources of each mux and the options of each
+enum. Symbolic configs are converted to and from tile CRAM without any string handling, which suits tools that
+encode or decode the same tile types many times over, such as fuzzers.
+
+A symbolic config is only valid for the database it was resolved against, and only until that database is next
+modified; using it after that is an error. Configs built directly must have their revision set to the database's
+current symbolic revision.
+ */
+struct SymbolicArc
+{
+    int mux = -1;
+    int source = -1;
+};
+
+struct SymbolicWord
+{
+    int word = -1;
+    vector<bool> value;
+};
+
+struct SymbolicEnum
+{
+    int cenum = -1;
+    int option = none; // or SymbolicEnum::none for _NONE_
+
+    static const int none = -1;
+};
+
+struct SymbolicTileConfig
+{
+    vector<SymbolicArc> carcs;
+    vector<SymbolicWord> cwords;
+    vector<SymbolicEnum> cenums;
+    vector<ConfigUnknown> cunknowns;
+    int total_known_bits = 0;
+    // Identifies the database contents the config was resolved against
+    uint64_t revision = 0;
+};
+
+
+// The wires connected to a wire within a tile, as pair<wire, configurable>
+struct WireConnections
+{
+    string wire;
+    vector<pair<string, bool>> uphill;
+    vector<pair<string, bool>> downhill;
+};
+
+// A set of additions to a TileBitDatabase, made all at once by TileBitDatabase::add_update
+struct BitDatabaseUpdate
+{
+    vector<ArcData> arcs;
+    vector<WordSettingBits> words;
+    vector<EnumSettingBits> enums;
+    vector<FixedConnection> fixed_conns;
+};
 
-struct TileConfig;
 struct TileLocator;
 struct TileInfo;
 
@@ -282,6 +339,24 @@ public:
 
     TileConfig tile_cram_to_config(const CRAMView &tile) const;
 
+    // Convert between TileConfigs and SymbolicTileConfigs. All names are checked when resolving, so errors in a config
+    // are reported here rather than when it is converted to CRAM
+    SymbolicTileConfig resolve_config(const TileConfig &cfg) const;
+
+    TileConfig symbolic_to_config(const SymbolicTileConfig &cfg) const;
+
+    // Convert SymbolicTileConfigs to and from actual Tile CRAM
+    void symbolic_config_to_tile_cram(const SymbolicTileConfig &cfg, CRAMView &tile) const;
+
+    SymbolicTileConfig tile_cram_to_symbolic_config(const CRAMView &tile) const;
+
+    // The revision of the current database contents, which symbolic configs must match
+    uint64_t get_symbolic_revision() const;
+
+    // A hash of everything that affects converting configs to and from CRAM (muxes, words and enums, but not fixed
+    // connections), for use in cache keys
+    uint64_t get_content_hash() const;
+
     // All these functions are designed to be thread safe during fuzzing and database modification
     // Maybe we should have faster unsafe versions too, as that will be the majority of the use cases?
     vector<string> get_sinks() const;
@@ -303,6 +378,13 @@ public:
     // Returns pair<wire, configurable>
     vector<pair<string, bool>> get_downhill_wires(const string &wire) const;
 
+    // Get a list of wires uphill in the tile of a given wire
+    // Returns pair<wire, configurable>
+    vector<pair<string, bool>> get_uphill_wires(const string &wire) const;
+
+    // Get the uphill and downhill wires of many wires at once, in the same order as the wires given
+    vector<WireConnections> get_wire_connections(const vector<string> &wires) const;
+
     // Add the bit database for a tile to the routing graph
     void add_routing(const TileInfo &tile, RoutingGraph &graph) const;
 
@@ -315,13 +397,25 @@ public:
 
     void add_fixed_conn(const FixedConnection &conn);
 
+    // Add everything in an update, or nothing if any of it conflicts with the database or with the rest of the update
+    void add_update(const BitDatabaseUpdate &update);
+
+    // Throw the DatabaseConflictError that add_update would, without changing the database
+    void check_update(const BitDatabaseUpdate &update) const;
+
     void remove_fixed_sink(const string &sink);
     void remove_setting_enum(const string &enum_name);
     void remove_setting_word(const string &word_name);
 
-    // Save the bit database to file
+    // Save the bit database to file. Every change is appended to a journal next to the database file as it is made, and
+    // replayed when the database is next loaded. Saving merges the journal, including any changes other processes have
+    // made to the same database, into the database file, replacing the file in one step and removing the journal. The
+    // database is reloaded from the result. This is also done when the database is destroyed, if it has been changed
     void save();
 
+    // Save the bit database, but only once its journal has grown large
+    void compact_if_large();
+
     // Function to obtain the singleton BitDatabase for a given tile
     friend shared_ptr<TileBitDatabase> get_tile_bitdata(const TileLocator &tile);
 
@@ -345,11 +439,84 @@ private:
     map<string, set<FixedConnection>> fixed_conns;
     string filename;
 
+    // Sizes and modification time of the database files, used to spot changes made to them by other processes
+    struct FileState
+    {
+        uintmax_t db_size = 0;
+        time_t db_time = 0;
+        uintmax_t journal_size = 0;
+
+        inline bool operator==(const FileState &other) const
+        {
+            return db_size == other.db_size && db_time == other.db_time && journal_size == other.journal_size;
+        }
+    };
+    // State of the files when they were last read or written
+    FileState file_state;
+
+    // Reverse indexes of mux arcs and fixed connections for the wire queries, maintained as the database is modified.
+    // Entries are pair<fixed, wire>, so that configurable arcs come first and each kind is ordered by wire name
+    unordered_map<string, set<pair<bool, string>>> downhill_index;
+    unordered_map<string, set<pair<bool, string>>> uphill_index;
+
     void load();
 
-#ifdef FUZZ_SAFETY_CHECK
-    boost::interprocess::file_lock ip_db_lock;
+    // These must be called with db_mutex held. Processes using the same database share its files, so these take a
+    // lock on them too
+    void read_files();
+
+    // The caller must also hold the exclusive file lock, which journal_change takes
+    void append_journal(const string &entries);
+
+    FileState get_file_state() const;
+
+    // Make a change with apply, which returns whether it changed the database, and journal it as entries if it did.
+    // Changes already in the database need no file access. Otherwise, if other processes have changed the files, the
+    // database is reloaded and the change applied again, so that conflicts with their changes are thrown to the writer
+    // rather than left in the journal
+    void journal_change(const function<bool()> &apply, const string &entries);
+
+    void write_compacted();
+
+    // Read database entries, replacing existing entries or, for the journal, adding to them as add_mux_arc etc. do
+    void read_entries(istream &in, const string &source, bool merge);
+
+    string journal_filename() const;
+
+    // Add to the given copy of part of the database, throwing DatabaseConflictError on conflicts. These return true if
+    // the copy was changed
+    static bool merge_mux_arc(map<string, MuxBits> &muxes, const ArcData &arc);
+
+    static bool merge_setting_word(map<string, WordSettingBits> &words, const WordSettingBits &wsb);
+
+    static bool merge_setting_enum(map<string, EnumSettingBits> &enums, const EnumSettingBits &esb);
+
+    // These must be called with db_mutex held
+    void index_wire_conn(const string &source, const string &sink, bool fixed);
+
+    void get_indexed_wires(const unordered_map<string, set<pair<bool, string>>> &index, const string &wire,
+                           vector<pair<string, bool>> &result) const;
+
+    // Copy the parts of the database an update adds to and apply the update to the copies, listing the new arcs. Returns
+    // true if the update changes the database
+    bool stage_update(const BitDatabaseUpdate &update, map<string, MuxBits> &new_muxes,
+                      map<string, WordSettingBits> &new_words, map<string, EnumSettingBits> &new_enums,
+                      vector<const ArcData *> &new_arcs) const;
+
+    // Index-based copy of the database used for symbolic configs, built on first use and discarded whenever the
+    // database is modified. These must be called with db_mutex held
+    struct SymbolicIndex;
+    mutable shared_ptr<const SymbolicIndex> symbolic_index;
+#ifndef NO_THREADS
+    mutable mutex symbolic_index_mutex;
 #endif
+
+    shared_ptr<const SymbolicIndex> get_symbolic_index() const;
+
+    shared_ptr<const SymbolicIndex> get_symbolic_index(const SymbolicTileConfig &cfg) const;
+
+    void invalidate_symbolic_index();
+
 };
 
 // Represents a conflict while adding something to the database
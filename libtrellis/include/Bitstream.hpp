@@ -34,7 +34,7 @@ enum class BitstreamCommand : uint8_t {
 };
 
 class Chip;
-
+class PackCache;
 
 // This represents a low level bitstream, as nothing more than an
 // array of bytes and helper functions for common tasks
@@ -47,8 +47,8 @@ public:
     // Python variant of the above, takes filename instead of istream
     static Bitstream read_bit_py(string file);
 
-    // Serialise a Chip back to a bitstream
-    static Bitstream serialise_chip(const Chip &chip, const map<string, string> options);
+    // Serialise a Chip back to a bitstream, optionally reusing compressed frames from a PackCache
+    static Bitstream serialise_chip(const Chip &chip, const map<string, string> options, PackCache *cache = nullptr);
     static Bitstream serialise_chip_partial(const Chip &chip, const vector<uint32_t> &frames, const map<string, string> options);
     static Bitstream generate_jump(uint32_t address);
 
@@ -59,6 +59,16 @@ public:
     Chip deserialise_chip();
     Chip deserialise_chip(boost::optional<uint32_t> idcode = boost::optional<uint32_t>());
 
+    // Read the BRAM initialisation data from the bitstream, without decoding the configuration frames
+    map<uint16_t, vector<uint16_t>> get_bram_data(boost::optional<uint32_t> idcode = boost::optional<uint32_t>()) const;
+
+    // Replace BRAM initialisation data in place. Only the EBR data, and the CRCs covering it, are rewritten; the
+    // configuration frames and the size of the bitstream are unchanged. Every BRAM in bram_data must already be
+    // initialised by the bitstream and have 2048 entries, otherwise nothing is changed. Returns the number of EBR
+    // writes that changed
+    int patch_bram_data(const map<uint16_t, vector<uint16_t>> &bram_data,
+                        boost::optional<uint32_t> idcode = boost::optional<uint32_t>());
+
     // Write a Lattice .bit file (metadata + bitstream)
     void write_bit(ostream &out);
 
@@ -19,6 +19,17 @@ struct ChangedBit {
 
 typedef vector<ChangedBit> CRAMDelta;
 
+// A compact form of CRAMDelta, as parallel arrays sorted by (frame, bit)
+struct CRAMDiff {
+    vector<int> frames;
+    vector<int> bits;
+    vector<int8_t> deltas; // as ChangedBit::delta
+
+    size_t size() const { return frames.size(); }
+
+    CRAMDelta to_delta() const;
+};
+
 // This represents a view into the configuration memory, typically used to represent a tile
 class CRAMView {
 public:
@@ -39,6 +50,11 @@ public:
     // Clear the CRAM region
     void clear();
 
+    // Copy the whole view to or from a buffer of frames() * bits() bytes, in frame-major order
+    void get_bits(uint8_t *dest) const;
+
+    void set_bits(const uint8_t *src);
+
     friend CRAMDelta operator-(const CRAMView &a, const CRAMView &b);
 
 private:
@@ -57,6 +73,9 @@ private:
 
 CRAMDelta operator-(const CRAMView &a, const CRAMView &b);
 
+// True if two views have the same size and contents; the views may be of different CRAMs or regions
+bool operator==(const CRAMView &a, const CRAMView &b);
+
 // This represents the chip configuration RAM, and allows views of it to be made (for tile accesses)
 // N.B. all accesses are in the format (frame, bit)
 class CRAM {
@@ -78,6 +97,11 @@ public:
     // Return number of bits per frame in CRAM
     int bits() const;
 
+    // Copy the whole CRAM to or from a buffer of frames() * bits() bytes, in frame-major order
+    void get_bits(uint8_t *dest) const;
+
+    void set_bits(const uint8_t *src);
+
     // Make a view to the CRAM given frame and bit offset; and frames and bits per frame in the view
     CRAMView make_view(int frame_offset, int bit_offset, int frame_count, int bit_count);
 
@@ -85,5 +109,9 @@ public:
     // A vector of type char is used as the optimisations in vector<bool> are not worth the loss of bool& etc
     shared_ptr<vector<vector<char>>> data;
 };
+
+// Difference between two CRAMs of the same size, in whole-CRAM coordinates. Unchanged frames and runs of bits are
+// skipped a word at a time, so this is much faster than comparing views bit by bit
+CRAMDiff diff_cram(const CRAM &a, const CRAM &b);
 }
 #endif //LIBTRELLIS_CRAM_HPP
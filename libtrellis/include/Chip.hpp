@@ -130,6 +130,9 @@ class Tile;
 // A list of pairs mapping between tile identifier (name:type) and tile difference
 typedef map<string, CRAMDelta> ChipDelta;
 
+// The same, with the difference for each tile in compact form
+typedef map<string, CRAMDiff> CompactChipDelta;
+
 class RoutingGraph;
 
 class Chip
@@ -179,6 +182,12 @@ public:
     // Build the routing graph for the chip
     shared_ptr<RoutingGraph> get_routing_graph(bool include_lutperm_pips = false);
 
+    // Bring a routing graph from get_routing_graph up to date after the bit database for one tile type has changed.
+    // Only the database-derived arcs at locations containing a tile of that type are removed and re-added, Bels
+    // and LUT permutation pips are left untouched. The result has the same wires, arcs and Bels as a fresh
+    // get_routing_graph, but the re-added arcs come last in the uphill and downhill lists of their wires
+    void update_routing_graph(RoutingGraph &graph, const string &tiletype);
+
     vector<vector<vector<pair<string, string>>>> tiles_at_location;
 
     // Block RAM initialisation (WIP)
@@ -190,12 +199,19 @@ public:
     MachXO2GlobalsInfo global_data_machxo2;
 
 private:
+    // Tile names of each type, in name order
+    map<string, vector<string>> tiles_by_type;
+
     // Factory functions
     shared_ptr<RoutingGraph> get_routing_graph_ecp5(bool include_lutperm_pips = false);
     shared_ptr<RoutingGraph> get_routing_graph_machxo2();
 };
 
 ChipDelta operator-(const Chip &a, const Chip &b);
+
+// Compare the whole CRAMs of two chips of the same device, then assign the changed bits to the tiles they belong to
+// (in tile coordinates). Tiles without changes are omitted
+CompactChipDelta diff_chips(const Chip &a, const Chip &b);
 }
 
 #endif //LIBTRELLIS_CHIP_HPP
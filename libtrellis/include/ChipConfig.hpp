@@ -5,12 +5,14 @@
 #include <map>
 #include <vector>
 #include <string>
+#include <cstdint>
 
 using namespace std;
 
 namespace Trellis {
 
 class Chip;
+class PackCache;
 
 // A group of tiles to configure at once for a particular feature that is split across tiles
 // TileGroups are currently for non-routing configuration only
@@ -34,9 +36,38 @@ public:
     map<uint16_t, vector<uint16_t>> bram_data;
 
     string to_string() const;
+    // Write the text form to a file, in large chunks rather than building the whole of it in memory first
+    void to_file(const string &filename) const;
     static ChipConfig from_string(const string &config);
-    Chip to_chip() const;
+    // Parse a config file, mapping it into memory rather than reading it into a string first
+    static ChipConfig from_file(const string &filename);
+    // Encode the config into a Chip, optionally reusing previously encoded tiles from a PackCache
+    Chip to_chip(PackCache *cache = nullptr) const;
     static ChipConfig from_chip(const Chip &chip);
+
+    /*
+    Compact binary encoding, for passing configs between tools faster than the text format. Integers are unsigned
+    LEB128 varints unless noted, and every name is an index into a string table.
+
+     - "TRCONFIG" magic, then the format version
+     - String table: count, then the length and bytes of each string
+     - Chip name; metadata (count, strings); sysconfig (count, key and value pairs)
+     - Tiles: count, then the name and tile config of each tile, where a tile config is
+         - arcs: count, then sink and source names
+         - words: count, then name, number of bits and the bits packed LSB first into bytes
+         - enums: count, then name and value names
+         - unknowns: count, then frame and bit
+     - BRAM data: count, then the BRAM index, number of values and each value as a 16-bit little endian integer
+     - Tile groups: count, then the number of tiles, tile names and the tile config of each group
+
+    total_known_bits is not stored, as in the text format.
+     */
+    vector<uint8_t> to_binary() const;
+    static ChipConfig from_binary(const uint8_t *data, size_t size);
+    static ChipConfig from_binary(const vector<uint8_t> &data);
+
+    void to_binary_file(const string &filename) const;
+    static ChipConfig from_binary_file(const string &filename);
 };
 
 }
@@ -0,0 +1,204 @@
+#ifndef LIBTRELLIS_CHIPDB_BINARY_HPP
+#define LIBTRELLIS_CHIPDB_BINARY_HPP
+
+#include "DedupChipdb.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace Trellis {
+namespace DDChipDb {
+/*
+Binary serialisation of a DedupChipdb or OptimizedChipdb, intended to be mapped directly into memory by place-and-route
+tools instead of walking the database through Python.
+
+ - The blob is relocatable: every reference is a byte offset from the start of the blob, so it can be mapped at any
+   address, or embedded in an executable
+ - All records are fixed-size PODs in host byte order, aligned to 8 bytes; the header records the byte order used
+ - Identifiers are stored in a string table, indexed by the same ident_t values as the source database
+ - Location types are stored once each, together with a grid mapping every location to its type. For an
+   OptimizedChipdb every tile is its own type, and coordinates are absolute rather than relative
+
+Readers should check `version` and reject blobs they do not understand.
+ */
+
+const char chipdb_binary_magic[8] = {'T', 'R', 'C', 'H', 'I', 'P', 'D', 'B'};
+const uint32_t chipdb_binary_version = 1;
+const uint32_t chipdb_binary_byte_order = 0x01020304;
+
+enum ChipdbBinaryKind : uint32_t
+{
+    CHIPDB_DEDUP = 0,
+    CHIPDB_OPTIMIZED = 1
+};
+
+// A counted array of T, stored at a byte offset from the start of the blob
+template <typename T>
+struct BinArray
+{
+    uint32_t count;
+    uint32_t offset;
+};
+
+struct BinRelId
+{
+    int16_t x, y;
+    int32_t id;
+};
+
+struct BinBelPort
+{
+    BinRelId bel;
+    int32_t pin;
+};
+
+struct BinBelWire
+{
+    BinRelId wire;
+    int32_t pin;
+    int32_t dir;
+};
+
+struct BinArcData
+{
+    BinRelId srcWire;
+    BinRelId sinkWire;
+    int32_t delay;
+    int32_t tiletype;
+    int16_t lutperm_flags;
+    int8_t cls;
+    int8_t padding;
+};
+
+struct BinWireData
+{
+    int32_t name;
+    BinArray<BinRelId> arcsDownhill, arcsUphill;
+    BinArray<BinBelPort> belPins;
+};
+
+struct BinBelData
+{
+    int32_t name, type, z;
+    BinArray<BinBelWire> wires;
+};
+
+struct BinLocationType
+{
+    uint64_t checksum[2];
+    BinArray<BinWireData> wires;
+    BinArray<BinArcData> arcs;
+    BinArray<BinBelData> bels;
+};
+
+// A location outside the 0..grid_width-1, 0..grid_height-1 grid, such as GlobalLoc
+struct BinExtraLocation
+{
+    int16_t x, y;
+    int32_t type;
+};
+
+struct BinHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t kind;
+    uint32_t total_size;
+    // Offsets of the NUL-terminated identifier strings
+    BinArray<uint32_t> idents;
+    BinArray<BinLocationType> types;
+    // Type index at (x, y) is grid[y * grid_width + x], or -1 if there is nothing at that location
+    int32_t grid_width, grid_height;
+    BinArray<int32_t> grid;
+    // Sorted by (y, x)
+    BinArray<BinExtraLocation> extra_locations;
+};
+
+// Serialise a database to a binary blob
+vector<uint8_t> chipdb_to_binary(const DedupChipdb &db);
+vector<uint8_t> chipdb_to_binary(const OptimizedChipdb &db);
+
+void write_chipdb_binary(const DedupChipdb &db, const string &filename);
+void write_chipdb_binary(const OptimizedChipdb &db, const string &filename);
+
+/*
+A read-only view of a binary chip database. Opening a file maps it into memory and only validates the header, so
+startup cost does not depend on the size of the database. Accessors check offsets against the blob size and throw
+runtime_error on a corrupt blob.
+ */
+class ChipdbBinary
+{
+public:
+    // Map a file written by write_chipdb_binary
+    static shared_ptr<ChipdbBinary> open(const string &filename);
+
+    // Use a blob already in memory, taking ownership of it
+    static shared_ptr<ChipdbBinary> from_bytes(vector<uint8_t> data);
+
+    // Use a blob already in memory, which must outlive the returned object
+    static shared_ptr<ChipdbBinary> from_memory(const void *data, size_t size);
+
+    ~ChipdbBinary();
+
+    const BinHeader &header() const
+    { return *hdr; }
+
+    ChipdbBinaryKind kind() const
+    { return ChipdbBinaryKind(hdr->kind); }
+
+    size_t num_idents() const
+    { return hdr->idents.count; }
+
+    const char *ident_str(ident_t id) const;
+
+    size_t num_location_types() const
+    { return hdr->types.count; }
+
+    const BinLocationType &location_type(int32_t index) const;
+
+    // Index of the location type at loc, or -1 if the database has nothing there
+    int32_t type_at(Location loc) const;
+
+    // All locations present in the database, in the same order as DedupChipdb::typeAtLocation
+    vector<Location> locations() const;
+
+    template <typename T>
+    const T *get(const BinArray<T> &arr) const
+    {
+        check_range(arr.offset, size_t(arr.count) * sizeof(T));
+        return reinterpret_cast<const T *>(base + arr.offset);
+    }
+
+    // Unpack into the heap-based database structures
+    shared_ptr<DedupChipdb> to_dedup_chipdb() const;
+    shared_ptr<OptimizedChipdb> to_optimized_chipdb() const;
+
+    LocationData get_location_data(int32_t type_index) const;
+
+private:
+    ChipdbBinary() = default;
+    ChipdbBinary(const ChipdbBinary &) = delete;
+    ChipdbBinary &operator=(const ChipdbBinary &) = delete;
+
+    void attach(const uint8_t *data, size_t size);
+
+    void check_range(size_t offset, size_t length) const;
+
+    void load_idents(IdStore &store) const;
+
+    struct Mapping;
+    unique_ptr<Mapping> mapping;
+    vector<uint8_t> owned;
+    const uint8_t *base = nullptr;
+    size_t size = 0;
+    const BinHeader *hdr = nullptr;
+};
+
+}
+}
+
+#endif //LIBTRELLIS_CHIPDB_BINARY_HPP
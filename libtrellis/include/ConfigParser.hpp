@@ -0,0 +1,54 @@
+#ifndef LIBTRELLIS_CONFIGPARSER_HPP
+#define LIBTRELLIS_CONFIGPARSER_HPP
+
+#include "ChipConfig.hpp"
+#include "TileConfig.hpp"
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+namespace Trellis {
+// Parser for the textual .config format, working directly on a buffer in memory (such as a mapped file) instead of
+// through an istream. Syntax errors are reported as runtime_error, giving the line and column of the problem
+class ConfigParser
+{
+public:
+    // The buffer must outlive the parser
+    ConfigParser(const char *data, size_t size);
+
+    // Parse a complete chip configuration
+    ChipConfig parse_chip_config();
+
+    // Parse tile configuration entries, up to the next record (a line starting with '.') or the end of the buffer
+    TileConfig parse_tile_config();
+
+private:
+    const char *begin, *pos, *end;
+
+    // Skip spaces and tabs, and optionally newlines
+    void skip_blank(bool nl);
+
+    // Skip past blank lines and comments
+    void skip();
+
+    // Return true if at the end of a record (or the buffer)
+    bool check_eor();
+
+    // Return true if at the end of the line (or the buffer), skipping any comment
+    bool check_eol();
+
+    // Read the next whitespace-delimited token, which may be on a following line
+    string next_token(const char *what);
+
+    void read_word(vector<bool> &value);
+
+    void read_unknown(ConfigUnknown &cu);
+
+    uint16_t read_uint16(int base, const char *what);
+
+    [[noreturn]] void error(const char *at, const string &msg) const;
+};
+}
+
+#endif //LIBTRELLIS_CONFIGPARSER_HPP
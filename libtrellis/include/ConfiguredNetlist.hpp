@@ -0,0 +1,57 @@
+#ifndef LIBTRELLIS_CONFIGUREDNETLIST_HPP
+#define LIBTRELLIS_CONFIGUREDNETLIST_HPP
+
+#include "RoutingGraph.hpp"
+#include "TileConfig.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace Trellis {
+class Chip;
+
+/*
+The connectivity actually configured in a chip, as used to turn a bitstream back into a netlist. Starting from the arcs
+enabled in the tile configs, this follows:
+
+ - fixed connections up and downhill of every wire reached
+ - zero-bit arcs (the default input of a mux with no bits set) into wires not driven by a configured arc
+ - for ECP5, the global clock connections missing from the routing graph: TAP_DRIVE to PLB, spine to TAP_DRIVE and
+   centre mux to spine
+ - every pin of the Bels touched by the configured arcs
+
+The result is stored as flat arrays, indexed by wire, arc and Bel pin, so it can be passed to Python cheaply. Nets are
+the connected components of the wires joined by the arcs.
+ */
+struct ConfiguredNetlist
+{
+    // Decoded config of every tile, by tile name
+    map<string, TileConfig> tile_configs;
+
+    // Wires reached, and the net (numbered from zero) each is part of
+    vector<RoutingId> wires;
+    vector<int> wire_nets;
+    int num_nets = 0;
+
+    // Enabled arcs, with their source and sink as indices into wires. Global clock connections that are not in the
+    // routing graph have an id of -1
+    vector<RoutingId> arcs;
+    vector<int> arc_sources;
+    vector<int> arc_sinks;
+    vector<bool> arc_configurable;
+
+    // Bel pins on the wires reached, with their wire as an index into wires. Output pins drive their wire
+    vector<RoutingId> bel_pin_bels;
+    vector<ident_t> bel_pin_names;
+    vector<int> bel_pin_wires;
+    vector<bool> bel_pin_outputs;
+};
+
+// Extract the configured netlist of a chip, given its routing graph. Tile configs are decoded using up to `threads`
+// threads (0 for the default)
+ConfiguredNetlist extract_configured_netlist(const Chip &chip, RoutingGraph &graph, unsigned threads = 0);
+}
+
+#endif //LIBTRELLIS_CONFIGUREDNETLIST_HPP
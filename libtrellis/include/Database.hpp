@@ -10,7 +10,7 @@ using namespace std;
 
 namespace Trellis {
 // This MUST be called before any operations (such as creating a Chip or reading a bitstream)
-// that require database access.
+// that require database access. It is not thread safe, so must not be called while other threads are using the database.
 void load_database(string root);
 
 // Locator for a given FPGA (formed of family and device)
@@ -60,6 +60,15 @@ vector<TileInfo> get_device_tilegrid(const DeviceLocator &part);
 class TileBitDatabase;
 shared_ptr<TileBitDatabase> get_tile_bitdata(const TileLocator &tile);
 
+// Obtain the BitDatabase for a tile of a device. For a tile from get_device_tilegrid (so any tile of a Chip), once the
+// BitDatabase is loaded this takes no lock and allocates nothing. Tile types missing from the device's tilegrid, as
+// in a TileInfo made by hand, are loaded as by get_tile_bitdata(TileLocator). The reference remains valid until exit
+const shared_ptr<TileBitDatabase> &get_tile_bitdata(const TileInfo &tile);
+
+// Load the BitDatabases of every tile type used by a device, up to `threads` at once (0 for the default thread count),
+// so that converting a design for the device doesn't wait for them one at a time
+void preload_device(const string &family, const string &device, unsigned threads = 0);
+
 }
 
 // Hash function for TileLocator
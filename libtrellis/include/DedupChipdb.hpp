@@ -345,6 +345,42 @@ class Chip;
 namespace DDChipDb {
 
 
+/*
+A flat index over a RoutingGraph, used while building the databases below. Each location in the graph gets a slot,
+holding the sorted wire, arc and bel identifiers found there; the sequential id of an object is its position in the
+matching vector. This resolves references without nested map lookups, and is read-only once built so it can be
+shared between threads.
+ */
+class RoutingGraphIndex
+{
+public:
+    explicit RoutingGraphIndex(const RoutingGraph &graph);
+
+    // Locations in the graph, in the same order as RoutingGraph::tiles
+    const vector<Location> &locations() const
+    { return locs; }
+
+    int wire_id(const RoutingId &wire) const;
+
+    int arc_id(const RoutingId &arc) const;
+
+    int bel_id(const RoutingId &bel) const;
+
+private:
+    struct Slot
+    {
+        vector<ident_t> wires, arcs, bels;
+    };
+    vector<Location> locs;
+    vector<Slot> slots;
+    // Locations inside the device grid are found directly, anything else (such as GlobalLoc) via the map
+    int grid_width = 0, grid_height = 0;
+    vector<int> grid_slot;
+    map<Location, int> other_slot;
+
+    const Slot &slot_at(Location loc) const;
+};
+
 struct DedupChipdb : public IdStore
 {
     DedupChipdb();
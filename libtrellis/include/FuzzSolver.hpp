@@ -0,0 +1,67 @@
+#ifndef LIBTRELLIS_FUZZSOLVER_HPP
+#define LIBTRELLIS_FUZZSOLVER_HPP
+
+#include "BitDatabase.hpp"
+#include "Database.hpp"
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace Trellis {
+class Chip;
+
+/*
+Solvers that work out the bits of a feature from the chips built while fuzzing it, as done by util/fuzz/nonrouting.py
+and util/fuzz/interconnect.py. Each solver is given every chip for a feature at once, compares them a word at a time
+against the baseline (or each other) on several threads, and builds the database entries for the tiles of interest.
+
+Nothing is written to the database until the result is committed. Committing checks every tile database for conflicts
+before adding anything, then adds each tile database's entries in a single transaction, so a conflict leaves the
+databases as they were.
+ */
+struct FuzzResult
+{
+    // Entries to add, by tile name, and the database of each tile
+    map<string, BitDatabaseUpdate> tile_updates;
+    map<string, TileLocator> tile_dbs;
+
+    // Add the entries to the tile databases, throwing DatabaseConflictError if any conflict. The entries are journalled,
+    // and a database is only rewritten once its journal has grown large or it is saved
+    void commit() const;
+};
+
+// An arc being fuzzed, as named in each tile of interest
+struct FuzzArc
+{
+    // Source and sink of the arc in each tile, by tile name
+    map<string, pair<string, string>> tile_names;
+    // Fixed connection to add to the first tile if the arc changes no bits at all; none if source and sink are empty
+    FixedConnection fixed_conn;
+};
+
+// Solve a word setting of bit_chips.size() bits, where bit_chips[i] is built with only bit i set and baseline with no
+// bits set. If empty is given, it is a chip built without the setting, used to find the default value. Tiles with no
+// changed bits are left out
+FuzzResult solve_word_setting(const string &name, const Chip &baseline, const vector<Chip> &bit_chips,
+                              const vector<string> &tiles, const Chip *empty = nullptr, unsigned threads = 0);
+
+// Solve an enum setting, where chips[i] is built with the setting equal to values[i]. The bits of each option are all
+// the bits that differ between any two options, except those that also differ between any two of the ignore chips.
+// Unless include_zeros is set, bits that are clear both in an option and in the empty chip are left out of the option,
+// unless they are only ever set by options in pref_options. Tiles in which no options differ are left out
+FuzzResult solve_enum_setting(const string &name, const vector<string> &values, const vector<Chip> &chips,
+                              const vector<string> &tiles, const Chip *empty = nullptr, bool include_zeros = true,
+                              const vector<Chip> &ignore = vector<Chip>(),
+                              const vector<string> &pref_options = vector<string>(), unsigned threads = 0);
+
+// Solve the arcs of a mux, where arc_chips[i] is built with arcs[i] routed and baseline with none of them. Each arc is
+// given the bits it changes in each tile, or becomes a fixed connection if it changes none. For a full mux, where the
+// state with no bits set is also an arc, each arc is instead given the state of every bit changed by any of the arcs
+FuzzResult solve_arcs(const Chip &baseline, const vector<FuzzArc> &arcs, const vector<Chip> &arc_chips,
+                      const vector<string> &tiles, bool full_mux = false, unsigned threads = 0);
+}
+
+#endif //LIBTRELLIS_FUZZSOLVER_HPP
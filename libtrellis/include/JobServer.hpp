@@ -0,0 +1,148 @@
+#ifndef LIBTRELLIS_JOBSERVER_HPP
+#define LIBTRELLIS_JOBSERVER_HPP
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <vector>
+#ifndef NO_THREADS
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+using namespace std;
+
+namespace Trellis {
+
+/*
+Command line tools such as ecppack spend much of each run loading the database: parsing devices.json, tilegrids and
+bit databases. A JobServer runs the tools as jobs inside one long-lived process instead, so that everything loaded
+stays loaded between jobs, and runs several jobs at once on a pool of threads.
+
+A tool is written as a job function taking its arguments and a JobContext, which it uses for output, to resolve file
+names relative to the directory it was started in, and to load the database. run_tool is the tool's main function: it
+sends the job to a server if one was given with --server or the TRELLIS_SERVER environment variable, and otherwise,
+or if the server can't be reached or won't run the job, runs it in the tool's own process.
+
+Requests and responses are frames: a little-endian uint32 count of strings, then each string as a little-endian
+uint32 length and its bytes. A request is {"trellis-job-1", id, tool, working directory, default database, argv...}
+and its response is {"trellis-job-1", id, served ("1" or "0"), exit code, stdout, stderr}. Over a Unix socket, each
+connection carries one request and its response. Over a stream pair, such as a server's stdin and stdout, any number
+of requests may be sent without waiting, and responses, which may be in a different order, are matched up by id.
+ */
+
+// Thrown by a job that can't be run in a server, such as one asking for a different database than the server has
+// loaded; the client then runs the job itself
+class JobNotServed : public exception
+{
+public:
+    explicit JobNotServed(string reason) : reason(move(reason))
+    {}
+
+    const char *what() const noexcept override
+    {
+        return reason.c_str();
+    }
+
+private:
+    string reason;
+};
+
+class JobContext
+{
+public:
+    // A context for running in the tool's own process, using the current directory
+    JobContext(ostream &out, ostream &err, string default_database);
+    // A context for running in a server with `server_database` loaded, for a client in `cwd`
+    JobContext(ostream &out, ostream &err, string default_database, string cwd, string server_database);
+
+    ostream &out;
+    ostream &err;
+    // Database to use if the job doesn't ask for one
+    const string default_database;
+
+    // A file name given by the client, relative to the client's working directory
+    string path(const string &name) const;
+
+    // Load the database, or in a server check it is the one already loaded, throwing JobNotServed if not
+    void load_database(const string &root) const;
+
+    bool in_server() const;
+
+private:
+    string cwd, server_database;
+};
+
+// A tool's main function; must not use the standard streams or change process-wide state
+typedef function<int(int argc, char *argv[], JobContext &ctx)> JobFunction;
+
+struct JobRequest
+{
+    string tool;
+    string cwd;
+    string default_database;
+    // Including argv[0]
+    vector<string> args;
+};
+
+struct JobResult
+{
+    bool served = false;
+    int exit_code = 0;
+    string out;
+    string err;
+};
+
+class JobServer
+{
+public:
+    // The database must already be loaded. `threads` jobs are run at once, 0 for the default thread count
+    JobServer(string database, map<string, JobFunction> tools, unsigned threads = 0);
+    ~JobServer();
+
+    JobServer(const JobServer &) = delete;
+    JobServer &operator=(const JobServer &) = delete;
+
+    // Run one job on the calling thread
+    JobResult run(const JobRequest &request) const;
+
+    // Accept jobs on a Unix socket until the process is stopped. A socket file left behind by a server that has
+    // exited is replaced
+    void serve_socket(const string &socket_path);
+
+    // Read requests from `in` until it ends, writing responses to `out`, then wait for the jobs still running
+    void serve_stream(istream &in, ostream &out);
+
+private:
+    string database;
+    map<string, JobFunction> tools;
+
+    // Run on the thread pool, or immediately if there are no threads
+    void submit(function<void()> task);
+    void wait_idle();
+#ifndef NO_THREADS
+    mutex queue_mutex;
+    condition_variable queue_ready, queue_idle;
+    queue<function<void()>> tasks;
+    size_t active = 0;
+    bool stopping = false;
+    vector<thread> workers;
+
+    void worker();
+#endif
+};
+
+// Send a job to the server listening on `socket_path`, returning false if it couldn't be reached
+bool send_job(const string &socket_path, const JobRequest &request, JobResult &result);
+
+// Main function of a tool that can be run by a server; see above
+int run_tool(const string &tool, const JobFunction &func, int argc, char *argv[], const string &default_database);
+}
+
+#endif //LIBTRELLIS_JOBSERVER_HPP
@@ -0,0 +1,144 @@
+#ifndef LIBTRELLIS_LOG_HPP
+#define LIBTRELLIS_LOG_HPP
+
+#include "Util.hpp"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifndef NO_THREADS
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+using namespace std;
+
+namespace Trellis {
+
+/*
+Diagnostic messages from libtrellis, such as the progress of bitstream parsing, are passed to a log sink rather than
+written to stderr directly. By default the sink writes each message to stderr as a single line; set_log_sink replaces
+it for the whole process, and a ScopedLogSink replaces it for the current thread only, which allows the messages of
+each request in a server to be captured separately. Work spread over threads by parallel_for logs to the sink of the
+thread that started it.
+
+Messages above the global verbosity level are discarded before they are formatted. Sinks may be called from several
+threads at once, so must be thread-safe; LogBuffer and AsyncLogSink are thread-safe sinks that never block on output,
+the first keeping messages for the caller to collect, the second passing them to another sink on a background thread.
+ */
+struct LogMessage
+{
+    VerbosityLevel level;
+    // Part of libtrellis the message is from, e.g. "bitstream"
+    string component;
+    string text;
+};
+
+typedef function<void(const LogMessage &)> LogSink;
+
+inline bool log_enabled(VerbosityLevel level)
+{
+    return verbosity >= level;
+}
+
+// Pass a message to the current sink, if enabled by the verbosity level
+void log_message(VerbosityLevel level, const string &component, const string &text);
+
+// Replace the sink for all threads; an empty sink restores the default of writing to stderr
+void set_log_sink(LogSink sink);
+
+// The sink messages logged on this thread go to if set by a ScopedLogSink, otherwise null
+shared_ptr<const LogSink> thread_log_sink();
+
+// Send messages logged on this thread to a sink until destroyed. Must be destroyed on the thread that created it
+class ScopedLogSink
+{
+public:
+    explicit ScopedLogSink(LogSink sink);
+    explicit ScopedLogSink(shared_ptr<const LogSink> sink);
+    ~ScopedLogSink();
+
+    ScopedLogSink(const ScopedLogSink &) = delete;
+    ScopedLogSink &operator=(const ScopedLogSink &) = delete;
+
+private:
+    shared_ptr<const LogSink> previous;
+};
+
+// The most recent messages, up to a fixed number; once full, the oldest message is dropped for each new one
+class LogBuffer
+{
+public:
+    explicit LogBuffer(size_t capacity = 4096);
+
+    void push(const LogMessage &msg);
+
+    // Remove and return all messages held, oldest first
+    vector<LogMessage> drain();
+
+    // Number of messages dropped because the buffer was full
+    uint64_t dropped() const;
+
+    // A sink adding messages to a buffer, which it keeps alive
+    static LogSink sink(shared_ptr<LogBuffer> buffer);
+
+private:
+    size_t capacity;
+    deque<LogMessage> messages;
+    uint64_t dropped_count = 0;
+#ifndef NO_THREADS
+    mutable mutex buffer_mutex;
+#endif
+};
+
+// A sink that buffers messages and passes them to another sink on a background thread, so that logging never waits
+// for output. Messages are passed on in order; if more than `capacity` are waiting, the oldest are dropped. Without
+// thread support, messages are passed on immediately
+class AsyncLogSink
+{
+public:
+    explicit AsyncLogSink(LogSink downstream, size_t capacity = 4096);
+    // Passes on all waiting messages before returning
+    ~AsyncLogSink();
+
+    AsyncLogSink(const AsyncLogSink &) = delete;
+    AsyncLogSink &operator=(const AsyncLogSink &) = delete;
+
+    void push(const LogMessage &msg);
+
+    // Wait until every message pushed so far has been passed on
+    void flush();
+
+    // A sink pushing messages to an AsyncLogSink, which it keeps alive
+    static LogSink sink(shared_ptr<AsyncLogSink> async);
+
+private:
+    LogSink downstream;
+#ifndef NO_THREADS
+    LogBuffer buffer;
+    mutex state_mutex;
+    condition_variable wake, drained;
+    uint64_t pushed = 0, passed = 0;
+    bool stopping = false;
+    thread worker;
+
+    void run();
+#endif
+};
+}
+
+// Log a message built with <<, e.g. TRELLIS_LOG(VerbosityLevel::NOTE, "bitstream", "read " << n << " frames")
+#define TRELLIS_LOG(level, component, x) \
+    do { \
+        if (Trellis::log_enabled(level)) { \
+            std::ostringstream log_ss_; \
+            log_ss_ << x; \
+            Trellis::log_message(level, component, log_ss_.str()); \
+        } \
+    } while (0)
+
+#endif //LIBTRELLIS_LOG_HPP
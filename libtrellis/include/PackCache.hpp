@@ -0,0 +1,70 @@
+#ifndef LIBTRELLIS_PACKCACHE_HPP
+#define LIBTRELLIS_PACKCACHE_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace Trellis {
+class TileBitDatabase;
+class CRAMView;
+struct TileConfig;
+
+/*
+An on-disk cache for bitstream packing, so that packing a design that has changed only a little since the last run
+only re-encodes what changed. It holds two kinds of entry:
+
+ - encoded tiles: the bits written by TileBitDatabase::config_to_tile_cram, for a given tile type, tile size, bit
+   database contents and tile config. As encoding only ever writes bits, never reads them, replaying these writes is
+   the same as encoding again, and tiles of the same type with the same config share an entry.
+ - compressed frames: the compressed form of a frame for a given compression dictionary.
+
+Entries are looked up by their complete key (only the bit database is represented by a hash), so the output is
+always identical to packing without a cache; a stale, missing or unreadable cache file only costs time.
+ */
+class PackCache
+{
+public:
+    // Load a cache file, starting empty if it does not exist or cannot be read
+    explicit PackCache(const string &filename);
+
+    // Write the entries used since loading back to the cache file, dropping the rest
+    void save() const;
+
+    // As TileBitDatabase::config_to_tile_cram for a tile (not a tile group)
+    void config_to_tile_cram(const string &tiletype, const TileBitDatabase &db, const TileConfig &cfg, CRAMView &tile);
+
+    // Get the compressed form of a frame, or nullptr if not cached
+    const vector<uint8_t> *find_compressed_frame(const array<uint8_t, 8> &dict, const vector<uint8_t> &frame);
+
+    void add_compressed_frame(const array<uint8_t, 8> &dict, const vector<uint8_t> &frame,
+                              const vector<uint8_t> &compressed);
+
+    int tile_hits = 0, tile_misses = 0;
+    int frame_hits = 0, frame_misses = 0;
+
+private:
+    struct Entry
+    {
+        // For tiles, the bits written as (frame * bits + bit) << 1 | value; for frames, the compressed bytes
+        vector<uint32_t> writes;
+        vector<uint8_t> data;
+        bool used = false;
+    };
+
+    string filename;
+    unordered_map<string, Entry> tiles;
+    unordered_map<string, Entry> frames;
+    unordered_map<const TileBitDatabase *, uint64_t> db_hashes;
+
+    void load();
+
+    uint64_t get_db_hash(const TileBitDatabase &db);
+};
+}
+
+#endif //LIBTRELLIS_PACKCACHE_HPP
@@ -0,0 +1,83 @@
+#ifndef LIBTRELLIS_PARALLEL_HPP
+#define LIBTRELLIS_PARALLEL_HPP
+
+#include "Log.hpp"
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+#include <exception>
+#ifndef NO_THREADS
+#include <thread>
+#include <atomic>
+#include <mutex>
+#endif
+
+using namespace std;
+
+namespace Trellis {
+// Number of worker threads to use when a caller doesn't ask for a specific number.
+// Like the Python fuzzing scripts, this honours TRELLIS_JOBS; otherwise one thread per hardware thread is used.
+inline unsigned default_thread_count()
+{
+#ifdef NO_THREADS
+    return 1;
+#else
+    const char *jobs = getenv("TRELLIS_JOBS");
+    if (jobs != nullptr && atoi(jobs) > 0)
+        return unsigned(atoi(jobs));
+    unsigned hw = thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+#endif
+}
+
+// Call func(i) for every i in [0, count), spread over up to `threads` worker threads (0 for the default).
+// Indices are handed out dynamically, so func must be safe to call concurrently for different indices.
+// If func throws, remaining work is abandoned and the first exception is rethrown in the calling thread.
+// Messages logged by func go to the calling thread's log sink.
+template <typename F>
+void parallel_for(size_t count, const F &func, unsigned threads = 0)
+{
+    if (threads == 0)
+        threads = default_thread_count();
+    if (threads > count)
+        threads = unsigned(count);
+#ifndef NO_THREADS
+    if (threads > 1) {
+        atomic<size_t> next{0};
+        atomic<bool> failed{false};
+        exception_ptr error;
+        mutex error_mutex;
+        shared_ptr<const LogSink> log_sink = thread_log_sink();
+        auto worker = [&]() {
+            ScopedLogSink scoped_sink(log_sink);
+            while (!failed) {
+                size_t i = next++;
+                if (i >= count)
+                    return;
+                try {
+                    func(i);
+                } catch (...) {
+                    lock_guard<mutex> lock(error_mutex);
+                    if (!error)
+                        error = current_exception();
+                    failed = true;
+                }
+            }
+        };
+        vector<thread> workers;
+        for (unsigned t = 1; t < threads; t++)
+            workers.emplace_back(worker);
+        worker();
+        for (auto &w : workers)
+            w.join();
+        if (error)
+            rethrow_exception(error);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; i++)
+        func(i);
+}
+}
+
+#endif //LIBTRELLIS_PARALLEL_HPP
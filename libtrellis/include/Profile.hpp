@@ -0,0 +1,93 @@
+#ifndef LIBTRELLIS_PROFILE_HPP
+#define LIBTRELLIS_PROFILE_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#ifndef NO_THREADS
+#include <atomic>
+#endif
+
+using namespace std;
+
+namespace Trellis {
+
+/*
+Timers and counters around the expensive parts of libtrellis (database loads, tile encoding and decoding, bitstream
+reading and writing, building the routing graph and deduplicating it), so that it can be seen where time goes without
+a profiler.
+
+Profiling is off by default; when off, a timer or counter is a single check of a flag. When on, each thread records
+into its own buffer, so threads don't contend. Results can be written as a JSON summary, with the number of calls and
+time of each timer and the total of each counter, or as a Chrome trace (chrome://tracing or https://ui.perfetto.dev)
+showing every timed call on every thread. Only the first million calls on each running thread, and on all exited
+threads together, are kept for the trace, but all calls are included in the summary. The record of a thread is merged
+into these totals and freed when the thread exits.
+
+Timer and counter names must be string literals (or otherwise outlive the profile), as only the pointer is stored.
+ */
+namespace Profile {
+#ifdef NO_THREADS
+extern bool enabled_flag;
+inline bool enabled()
+{
+    return enabled_flag;
+}
+#else
+extern atomic<bool> enabled_flag;
+inline bool enabled()
+{
+    return enabled_flag.load(memory_order_relaxed);
+}
+#endif
+
+// Start or stop recording; results recorded so far are kept
+void set_enabled(bool enabled);
+
+// Discard everything recorded so far
+void reset();
+
+// Time from construction to destruction, if profiling is enabled on construction
+class Timer
+{
+public:
+    explicit Timer(const char *name) : name(enabled() ? name : nullptr), start(this->name ? now() : 0)
+    {}
+
+    ~Timer()
+    {
+        if (name != nullptr)
+            record(name, start, now());
+    }
+
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+    // Nanoseconds on a steady clock
+    static int64_t now();
+
+private:
+    const char *name;
+    int64_t start;
+
+    static void record(const char *name, int64_t start, int64_t end);
+};
+
+// Add to a counter, if profiling is enabled
+void add_count_enabled(const char *name, uint64_t count);
+inline void add_count(const char *name, uint64_t count = 1)
+{
+    if (enabled())
+        add_count_enabled(name, count);
+}
+
+// Write the results so far. Calls still being timed are left out
+void write_summary(ostream &out);
+void write_trace(ostream &out);
+
+// Write the summary and trace to files, skipping either if its filename is empty
+void write_files(const string &summary_filename, const string &trace_filename);
+}
+}
+
+#endif //LIBTRELLIS_PROFILE_HPP
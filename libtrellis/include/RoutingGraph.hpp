@@ -65,7 +65,6 @@ struct RoutingArc
     RoutingId sink;
     bool configurable = false;
     uint16_t lutperm_flags = 0;
-    mutable int cdb_id = 0;
 };
 
 struct RoutingWire
@@ -75,7 +74,6 @@ struct RoutingWire
     vector<RoutingId> downhill;
     vector<pair<RoutingId, ident_t>> belsUphill;
     vector<pair<RoutingId, ident_t>> belsDownhill;
-    mutable int cdb_id = 0;
 };
 
 inline bool operator==(const RoutingWire &a, const RoutingWire &b)
@@ -95,7 +93,22 @@ struct RoutingBel
     Location loc;
     int z;
     map<ident_t, pair<RoutingId, PortDirection>> pins;
-    mutable int cdb_id = 0;
+};
+
+// A Bel with its name, type and pins already interned, so an instance only needs a location to be added to a graph.
+// Pin wires are at the Bel's own location, unless `relative` is false in which case they are global wires at 0, 0
+struct BelTemplate
+{
+    struct Pin
+    {
+        ident_t pin;
+        ident_t wire;
+        bool relative;
+        PortDirection dir;
+    };
+    ident_t name = -1, type = -1;
+    int z = 0;
+    vector<Pin> pins;
 };
 
 struct RoutingTileLoc
@@ -123,6 +136,9 @@ public:
     std::string to_str(ident_t id) const;
 
     RoutingId id_at_loc(int16_t x, int16_t y, const std::string &str) const;
+
+    // Number of identifiers allocated so far; valid ids are 0..num_idents()-1
+    size_t num_idents() const;
 private:
 
 private:
@@ -144,6 +160,10 @@ public:
     // Routing tiles
     std::map<Location, RoutingTileLoc> tiles;
 
+    // Templates for the Bels in this graph, keyed by Bel kind and variant. Identifiers are specific to a graph, so
+    // these are built on first use by the functions in Bels.cpp
+    std::unordered_map<std::string, BelTemplate> bel_templates;
+
     // Obtain the unique, global identifier for a net inside a tile using the database name
     // Returns an empty RoutingId if net is to be ignored
     RoutingId globalise_net(int row, int col, const std::string &db_name);
@@ -154,9 +174,17 @@ public:
     // Add a wire to the graph by id (ignoring it if already existing)
     void add_wire(RoutingId wire);
 
+    // Remove an arc and its cross-references, if present. Wires left with no arcs or Bel pins are removed too, so
+    // that removing and re-adding a set of arcs gives the same wires and arcs as only adding them, although the
+    // re-added arcs move to the end of the uphill and downhill lists of their wires
+    void remove_arc(Location loc, ident_t arc_id);
+
     // Add a Bel to the graph
     void add_bel(RoutingBel &bel);
 
+    // Add an instance of a Bel template at a given location
+    void add_bel(const BelTemplate &tmpl, int x, int y);
+
     // Add a Bel input or output pin
     void add_bel_input(RoutingBel &bel, ident_t pin, int wire_x, int wire_y, ident_t wire_name);
     void add_bel_output(RoutingBel &bel, ident_t pin, int wire_x, int wire_y, ident_t wire_name);
@@ -200,6 +228,16 @@ template <> struct hash <Trellis::Location>
         return seed;
     }
 };
+
+template <> struct hash <Trellis::RoutingId>
+{
+    std::size_t operator()(const Trellis::RoutingId &rid) const noexcept
+    {
+        std::size_t seed = hash<Trellis::Location>()(rid.loc);
+        boost::hash_combine(seed, hash<int>()(rid.id));
+        return seed;
+    }
+};
 }
 
 
@@ -0,0 +1,84 @@
+#ifndef LIBTRELLIS_ROUTINGQUERY_HPP
+#define LIBTRELLIS_ROUTINGQUERY_HPP
+
+#include "RoutingGraph.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace Trellis {
+
+/*
+Connectivity queries over a RoutingGraph: fan-in and fan-out, bounded reachability up or downhill, shortest paths and
+arcs near a location.
+
+The graph is copied into a compact form when the RoutingQuery is created. Wires and arcs are numbered from zero, in
+location then identifier order, and the arcs up and downhill of each wire are stored contiguously. Later changes to the
+RoutingGraph are not seen. Queries do not modify the RoutingQuery, so may be run from several threads at once; the
+batch functions do this themselves.
+ */
+class RoutingQuery
+{
+public:
+    explicit RoutingQuery(const RoutingGraph &graph);
+
+    size_t num_wires() const;
+    size_t num_arcs() const;
+
+    // Index of a wire, or -1 if it is not in the graph
+    int wire_index(const RoutingId &wire) const;
+    RoutingId wire_id(int wire) const;
+
+    // Arcs are identified by their location and name, as in RoutingTileLoc::arcs
+    RoutingId arc_id(int arc) const;
+    int arc_source(int arc) const;
+    int arc_sink(int arc) const;
+    bool arc_configurable(int arc) const;
+
+    // Arcs driving a wire, and arcs driven by it
+    vector<int> uphill_arcs(int wire) const;
+    vector<int> downhill_arcs(int wire) const;
+
+    // Wires reachable from a wire by following arcs downhill (or uphill), in order of distance and starting with the
+    // wire itself, up to max_hops arcs away (-1 for no limit). If hops is given, the distance of each wire is stored
+    vector<int> reachable(int wire, int max_hops = -1, bool uphill = false, vector<int> *hops = nullptr) const;
+
+    // The wires along a path with the fewest arcs from source to sink, including both; empty if there is none within
+    // max_hops arcs (-1 for no limit)
+    vector<int> shortest_path(int source, int sink, int max_hops = -1) const;
+
+    // Arcs located in tiles within distance tiles of loc in both x and y. distance must not be negative
+    vector<int> arcs_within(Location loc, int distance, bool configurable_only = false) const;
+
+    // Batch versions of the above, spread over up to `threads` threads (0 for the default)
+    vector<vector<int>> reachable_batch(const vector<int> &sources, int max_hops = -1, bool uphill = false,
+                                        unsigned threads = 0) const;
+
+    vector<vector<int>> shortest_path_batch(const vector<pair<int, int>> &endpoints, int max_hops = -1,
+                                            unsigned threads = 0) const;
+
+private:
+    vector<RoutingId> wires;
+    unordered_map<RoutingId, int> wire_indices;
+
+    vector<RoutingId> arcs;
+    vector<int> arc_sources, arc_sinks;
+    vector<bool> arc_configurable_flags;
+    // Arcs located at each location, as a range of arc indices, and the bounds of those locations
+    unordered_map<Location, pair<int, int>> loc_arcs;
+    Location arcs_min, arcs_max;
+
+    // Arcs up and downhill of wire w are up_arcs[up_start[w]:up_start[w + 1]], and likewise for down_arcs
+    vector<int> up_start, up_arcs;
+    vector<int> down_start, down_arcs;
+
+    void check_wire(int wire) const;
+
+    void check_arc(int arc) const;
+};
+}
+
+#endif //LIBTRELLIS_ROUTINGQUERY_HPP
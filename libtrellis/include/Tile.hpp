@@ -26,6 +26,8 @@ struct SiteInfo {
     }
 };
 
+class DeviceBitDatabases;
+
 // Basic information about a tile
 struct TileInfo {
     string family;
@@ -42,7 +44,16 @@ struct TileInfo {
     size_t bit_offset;
     vector<SiteInfo> sites;
 
+    // Position, cached when the tilegrid is loaded; -1 if not known
+    int row = -1, col = -1;
+
+    // Where to find the tile's bit database without a lookup by name, set when the tilegrid is loaded
+    DeviceBitDatabases *bitdbs = nullptr;
+    int type_id = -1;
+
     inline pair<int, int> get_row_col() const {
+        if (row >= 0 && col >= 0)
+            return make_pair(row, col);
         auto chip_size = make_pair(int(max_row), int(max_col));
         auto row_col = get_row_col_pair_from_chipsize(name, chip_size, col_bias);
         assert(row_col <= chip_size);
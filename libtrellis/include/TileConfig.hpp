@@ -79,6 +79,9 @@ struct TileConfig {
     string to_string() const;
     static TileConfig from_string(const string &str);
 
+    // Append the text form, as given by to_string, to out
+    void write(string &out) const;
+
     bool empty() const;
 };
 
@@ -94,6 +94,38 @@ inline bool skip_check_eof(istream &in) {
     return (c == EOF);
 }
 
+// 64-bit FNV-1a, so that hashes are the same on every platform
+class ContentHasher
+{
+public:
+    void add(const void *data, size_t size)
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; i++)
+            h = (h ^ p[i]) * UINT64_C(0x100000001b3);
+    }
+
+    void add(const string &str)
+    {
+        add_int(int64_t(str.size()));
+        add(str.data(), str.size());
+    }
+
+    // Integers are added as 8 little endian bytes, whatever the byte order of the platform
+    void add_int(int64_t value)
+    {
+        uint8_t bytes[8];
+        for (int i = 0; i < 8; i++)
+            bytes[i] = uint8_t(uint64_t(value) >> (8 * i));
+        add(bytes, sizeof(bytes));
+    }
+
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+};
+
+// Write a string as a quoted JSON string
+void write_json_string(ostream &out, const string &str);
+
 
 }
 #define fmt(x) (static_cast<const std::ostringstream&>(std::ostringstream() << x).str())
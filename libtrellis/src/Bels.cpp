@@ -3,758 +3,768 @@
 #include "Database.hpp"
 #include "BitDatabase.hpp"
 namespace Trellis {
+
+namespace {
+// Collects the pins of a Bel template, interning names as it goes
+struct BelTemplateBuilder
+{
+    BelTemplateBuilder(RoutingGraph &graph, const string &name, const string &type, int z) : graph(graph)
+    {
+        tmpl.name = graph.ident(name);
+        tmpl.type = graph.ident(type);
+        tmpl.z = z;
+    }
+
+    // Pins connected to a wire in the Bel's own tile
+    void input(const string &pin, const string &wire)
+    { add_pin(pin, wire, PORT_IN, true); }
+
+    void output(const string &pin, const string &wire)
+    { add_pin(pin, wire, PORT_OUT, true); }
+
+    // Pins connected to a global wire at (0, 0)
+    void global_input(const string &pin, const string &wire)
+    { add_pin(pin, wire, PORT_IN, false); }
+
+    void global_output(const string &pin, const string &wire)
+    { add_pin(pin, wire, PORT_OUT, false); }
+
+    void add_pin(const string &pin, const string &wire, PortDirection dir, bool relative)
+    {
+        BelTemplate::Pin p;
+        p.pin = graph.ident(pin);
+        p.wire = graph.ident(wire);
+        p.relative = relative;
+        p.dir = dir;
+        tmpl.pins.push_back(p);
+    }
+
+    RoutingGraph &graph;
+    BelTemplate tmpl;
+};
+
+// Add a Bel at (x, y) from the graph's template for `key`, calling build to create the template on first use
+template <typename F>
+void add_templated_bel(RoutingGraph &graph, const string &key, int x, int y, F build)
+{
+    auto found = graph.bel_templates.find(key);
+    if (found == graph.bel_templates.end())
+        found = graph.bel_templates.emplace(key, build()).first;
+    graph.add_bel(found->second, x, y);
+}
+}
+
 namespace Ecp5Bels {
 
 void add_lc(RoutingGraph &graph, int x, int y, int z) {
-    char l = "ABCD"[z];
-    string name = string("SLICE") + l;
-    int lc0 = z * 2;
-    int lc1 = z * 2 + 1;
-    RoutingBel bel;
-    bel.name = graph.ident(name);
-    bel.type = graph.ident("SLICE");
-    bel.loc.x = x;
-    bel.loc.y = y;
-    bel.z = z;
-    graph.add_bel_input(bel, graph.ident("A0"), x, y, graph.ident(fmt("A" << lc0 << "_SLICE")));
-    graph.add_bel_input(bel, graph.ident("B0"), x, y, graph.ident(fmt("B" << lc0 << "_SLICE")));
-    graph.add_bel_input(bel, graph.ident("C0"), x, y, graph.ident(fmt("C" << lc0 << "_SLICE")));
-    graph.add_bel_input(bel, graph.ident("D0"), x, y, graph.ident(fmt("D" << lc0 << "_SLICE")));
-    graph.add_bel_input(bel, graph.ident("M0"), x, y, graph.ident(fmt("M" << lc0 << "_SLICE")));
-
-    graph.add_bel_input(bel, graph.ident("A1"), x, y, graph.ident(fmt("A" << lc1 << "_SLICE")));
-    graph.add_bel_input(bel, graph.ident("B1"), x, y, graph.ident(fmt("B" << lc1 << "_SLICE")));
-    graph.add_bel_input(bel, graph.ident("C1"), x, y, graph.ident(fmt("C" << lc1 << "_SLICE")));
-    graph.add_bel_input(bel, graph.ident("D1"), x, y, graph.ident(fmt("D" << lc1 << "_SLICE")));
-    graph.add_bel_input(bel, graph.ident("M1"), x, y, graph.ident(fmt("M" << lc1 << "_SLICE")));
-    if (z == 0)
-        graph.add_bel_input(bel, graph.ident("FCI"), x, y, graph.ident("FCI_SLICE"));
-    else
-        graph.add_bel_input(bel, graph.ident("FCI"), x, y, graph.ident(fmt("FCI" << l << "_SLICE")));
-
-    graph.add_bel_input(bel, graph.ident("FXA"), x, y, graph.ident(fmt("FXA" << l << "_SLICE")));
-    graph.add_bel_input(bel, graph.ident("FXB"), x, y, graph.ident(fmt("FXB" << l << "_SLICE")));
-
-    graph.add_bel_input(bel, graph.ident("CLK"), x, y, graph.ident(fmt("CLK" << z << "_SLICE")));
-    graph.add_bel_input(bel, graph.ident("LSR"), x, y, graph.ident(fmt("LSR" << z << "_SLICE")));
-    graph.add_bel_input(bel, graph.ident("CE"), x, y, graph.ident(fmt("CE" << z << "_SLICE")));
-
-    graph.add_bel_input(bel, graph.ident("DI0"), x, y, graph.ident(fmt("DI" << lc0 << "_SLICE")));
-    graph.add_bel_input(bel, graph.ident("DI1"), x, y, graph.ident(fmt("DI" << lc1 << "_SLICE")));
-
-    if (z == 0 || z == 1) {
-        graph.add_bel_input(bel, graph.ident("WD0"), x, y, graph.ident(fmt("WD0" << l << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("WD1"), x, y, graph.ident(fmt("WD1" << l << "_SLICE")));
-
-        graph.add_bel_input(bel, graph.ident("WAD0"), x, y, graph.ident(fmt("WAD0" << l << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("WAD1"), x, y, graph.ident(fmt("WAD1" << l << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("WAD2"), x, y, graph.ident(fmt("WAD2" << l << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("WAD3"), x, y, graph.ident(fmt("WAD3" << l << "_SLICE")));
-
-        graph.add_bel_input(bel, graph.ident("WRE"), x, y, graph.ident(fmt("WRE" << z << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("WCK"), x, y, graph.ident(fmt("WCK" << z << "_SLICE")));
-    }
+    add_templated_bel(graph, "SLICE" + std::to_string(z), x, y, [&]() {
+        char l = "ABCD"[z];
+        string name = string("SLICE") + l;
+        int lc0 = z * 2;
+        int lc1 = z * 2 + 1;
+        BelTemplateBuilder b(graph, name, "SLICE", z);
+        b.input("A0", fmt("A" << lc0 << "_SLICE"));
+        b.input("B0", fmt("B" << lc0 << "_SLICE"));
+        b.input("C0", fmt("C" << lc0 << "_SLICE"));
+        b.input("D0", fmt("D" << lc0 << "_SLICE"));
+        b.input("M0", fmt("M" << lc0 << "_SLICE"));
+
+        b.input("A1", fmt("A" << lc1 << "_SLICE"));
+        b.input("B1", fmt("B" << lc1 << "_SLICE"));
+        b.input("C1", fmt("C" << lc1 << "_SLICE"));
+        b.input("D1", fmt("D" << lc1 << "_SLICE"));
+        b.input("M1", fmt("M" << lc1 << "_SLICE"));
+        if (z == 0)
+            b.input("FCI", "FCI_SLICE");
+        else
+            b.input("FCI", fmt("FCI" << l << "_SLICE"));
+
+        b.input("FXA", fmt("FXA" << l << "_SLICE"));
+        b.input("FXB", fmt("FXB" << l << "_SLICE"));
+
+        b.input("CLK", fmt("CLK" << z << "_SLICE"));
+        b.input("LSR", fmt("LSR" << z << "_SLICE"));
+        b.input("CE", fmt("CE" << z << "_SLICE"));
+
+        b.input("DI0", fmt("DI" << lc0 << "_SLICE"));
+        b.input("DI1", fmt("DI" << lc1 << "_SLICE"));
+
+        if (z == 0 || z == 1) {
+            b.input("WD0", fmt("WD0" << l << "_SLICE"));
+            b.input("WD1", fmt("WD1" << l << "_SLICE"));
+
+            b.input("WAD0", fmt("WAD0" << l << "_SLICE"));
+            b.input("WAD1", fmt("WAD1" << l << "_SLICE"));
+            b.input("WAD2", fmt("WAD2" << l << "_SLICE"));
+            b.input("WAD3", fmt("WAD3" << l << "_SLICE"));
+
+            b.input("WRE", fmt("WRE" << z << "_SLICE"));
+            b.input("WCK", fmt("WCK" << z << "_SLICE"));
+        }
 
-    graph.add_bel_output(bel, graph.ident("F0"), x, y, graph.ident(fmt("F" << lc0 << "_SLICE")));
-    graph.add_bel_output(bel, graph.ident("Q0"), x, y, graph.ident(fmt("Q" << lc0 << "_SLICE")));
+        b.output("F0", fmt("F" << lc0 << "_SLICE"));
+        b.output("Q0", fmt("Q" << lc0 << "_SLICE"));
 
-    graph.add_bel_output(bel, graph.ident("F1"), x, y, graph.ident(fmt("F" << lc1 << "_SLICE")));
-    graph.add_bel_output(bel, graph.ident("Q1"), x, y, graph.ident(fmt("Q" << lc1 << "_SLICE")));
+        b.output("F1", fmt("F" << lc1 << "_SLICE"));
+        b.output("Q1", fmt("Q" << lc1 << "_SLICE"));
 
-    graph.add_bel_output(bel, graph.ident("OFX0"), x, y, graph.ident(fmt("F5" << l << "_SLICE")));
-    graph.add_bel_output(bel, graph.ident("OFX1"), x, y, graph.ident(fmt("FX" << l << "_SLICE")));
+        b.output("OFX0", fmt("F5" << l << "_SLICE"));
+        b.output("OFX1", fmt("FX" << l << "_SLICE"));
 
-    if (z == 3)
-        graph.add_bel_output(bel, graph.ident("FCO"), x, y, graph.ident("FCO_SLICE"));
-    else
-        graph.add_bel_output(bel, graph.ident("FCO"), x, y, graph.ident(fmt("FCO" << l << "_SLICE")));
+        if (z == 3)
+            b.output("FCO", "FCO_SLICE");
+        else
+            b.output("FCO", fmt("FCO" << l << "_SLICE"));
 
-    if (z == 2) {
-        graph.add_bel_output(bel, graph.ident("WDO0"), x, y, graph.ident("WDO0C_SLICE"));
-        graph.add_bel_output(bel, graph.ident("WDO1"), x, y, graph.ident("WDO1C_SLICE"));
-        graph.add_bel_output(bel, graph.ident("WDO2"), x, y, graph.ident("WDO2C_SLICE"));
-        graph.add_bel_output(bel, graph.ident("WDO3"), x, y, graph.ident("WDO3C_SLICE"));
+        if (z == 2) {
+            b.output("WDO0", "WDO0C_SLICE");
+            b.output("WDO1", "WDO1C_SLICE");
+            b.output("WDO2", "WDO2C_SLICE");
+            b.output("WDO3", "WDO3C_SLICE");
 
-        graph.add_bel_output(bel, graph.ident("WADO0"), x, y, graph.ident("WADO0C_SLICE"));
-        graph.add_bel_output(bel, graph.ident("WADO1"), x, y, graph.ident("WADO1C_SLICE"));
-        graph.add_bel_output(bel, graph.ident("WADO2"), x, y, graph.ident("WADO2C_SLICE"));
-        graph.add_bel_output(bel, graph.ident("WADO3"), x, y, graph.ident("WADO3C_SLICE"));
-    }
-    graph.add_bel(bel);
+            b.output("WADO0", "WADO0C_SLICE");
+            b.output("WADO1", "WADO1C_SLICE");
+            b.output("WADO2", "WADO2C_SLICE");
+            b.output("WADO3", "WADO3C_SLICE");
+        }
+        return b.tmpl;
+    });
 }
 
 void add_pio(RoutingGraph &graph, int x, int y, int z) {
-    char l = "ABCD"[z];
-    string name = string("PIO") + l;
-    RoutingBel bel;
-    bel.name = graph.ident(name);
-    bel.type = graph.ident("PIO");
-    bel.loc.x = x;
-    bel.loc.y = y;
-    bel.z = z;
-
-    graph.add_bel_input(bel, graph.ident("I"), x, y, graph.ident(fmt("PADDO" << l << "_PIO")));
-    graph.add_bel_input(bel, graph.ident("T"), x, y, graph.ident(fmt("PADDT" << l << "_PIO")));
-    graph.add_bel_output(bel, graph.ident("O"), x, y, graph.ident(fmt("JPADDI" << l << "_PIO")));
-
-    graph.add_bel_input(bel, graph.ident("IOLDO"), x, y, graph.ident(fmt("IOLDO" << l << "_PIO")));
-    graph.add_bel_input(bel, graph.ident("IOLTO"), x, y, graph.ident(fmt("IOLTO" << l << "_PIO")));
-
-    graph.add_bel(bel);
+    add_templated_bel(graph, "PIO" + std::to_string(z), x, y, [&]() {
+        char l = "ABCD"[z];
+        string name = string("PIO") + l;
+        BelTemplateBuilder b(graph, name, "PIO", z);
+
+        b.input("I", fmt("PADDO" << l << "_PIO"));
+        b.input("T", fmt("PADDT" << l << "_PIO"));
+        b.output("O", fmt("JPADDI" << l << "_PIO"));
+
+        b.input("IOLDO", fmt("IOLDO" << l << "_PIO"));
+        b.input("IOLTO", fmt("IOLTO" << l << "_PIO"));
+        return b.tmpl;
+    });
 }
 
 void add_dcc(RoutingGraph &graph, int x, int y, string side, string z) {
-    string name = side + string("DCC") + z;
-    RoutingBel bel;
-    bel.name = graph.ident(name);
-    bel.type = graph.ident("DCCA");
-    bel.loc.x = x;
-    bel.loc.y = y;
-    if (z == "BL")
-        bel.z = 0;
-    else if (z == "BR")
-        bel.z = 1;
-    else if (z == "TL")
-        bel.z = 2;
-    else if (z == "TR")
-        bel.z = 3;
-    else
-        bel.z = stoi(z);
-    graph.add_bel_input(bel, graph.ident("CLKI"), 0, 0, graph.ident(fmt("G_CLKI_" << side << "DCC" << z)));
-    graph.add_bel_input(bel, graph.ident("CE"), 0, 0, graph.ident(fmt("G_JCE_" << side << "DCC" << z)));
-    graph.add_bel_output(bel, graph.ident("CLKO"), 0, 0, graph.ident(fmt("G_CLKO_" << side << "DCC" << z)));
-
-    graph.add_bel(bel);
-
+    add_templated_bel(graph, side + "DCC" + z, x, y, [&]() {
+        string name = side + string("DCC") + z;
+        int bel_z;
+        if (z == "BL")
+            bel_z = 0;
+        else if (z == "BR")
+            bel_z = 1;
+        else if (z == "TL")
+            bel_z = 2;
+        else if (z == "TR")
+            bel_z = 3;
+        else
+            bel_z = stoi(z);
+        BelTemplateBuilder b(graph, name, "DCCA", bel_z);
+        b.global_input("CLKI", fmt("G_CLKI_" << side << "DCC" << z));
+        b.global_input("CE", fmt("G_JCE_" << side << "DCC" << z));
+        b.global_output("CLKO", fmt("G_CLKO_" << side << "DCC" << z));
+        return b.tmpl;
+    });
 }
 
 void add_dcs(RoutingGraph &graph, int x, int y, int z) {
-    string name = string("DCS") + std::to_string(z);
-    RoutingBel bel;
-    bel.name = graph.ident(name);
-    bel.type = graph.ident("DCSC");
-    bel.loc.x = x;
-    bel.loc.y = y;
-    bel.z = z + 4;
-    graph.add_bel_input(bel, graph.ident("CLK0"), 0, 0, graph.ident(fmt("G_CLK0_" << "DCS" << z)));
-    graph.add_bel_input(bel, graph.ident("CLK1"), 0, 0, graph.ident(fmt("G_CLK1_" << "DCS" << z)));
-    graph.add_bel_output(bel, graph.ident("DCSOUT"), 0, 0, graph.ident(fmt("G_DCSOUT_" << "DCS" << z)));
-    graph.add_bel_input(bel, graph.ident("MODESEL"), 0, 0, graph.ident(fmt("G_JMODESEL_" << "DCS" << z)));
-    graph.add_bel_input(bel, graph.ident("SEL0"), 0, 0, graph.ident(fmt("G_JSEL0_" << "DCS" << z)));
-    graph.add_bel_input(bel, graph.ident("SEL1"), 0, 0, graph.ident(fmt("G_JSEL1_" << "DCS" << z)));
-    graph.add_bel(bel);
-
+    add_templated_bel(graph, "DCS" + std::to_string(z), x, y, [&]() {
+        string name = string("DCS") + std::to_string(z);
+        BelTemplateBuilder b(graph, name, "DCSC", z + 4);
+        b.global_input("CLK0", fmt("G_CLK0_" << "DCS" << z));
+        b.global_input("CLK1", fmt("G_CLK1_" << "DCS" << z));
+        b.global_output("DCSOUT", fmt("G_DCSOUT_" << "DCS" << z));
+        b.global_input("MODESEL", fmt("G_JMODESEL_" << "DCS" << z));
+        b.global_input("SEL0", fmt("G_JSEL0_" << "DCS" << z));
+        b.global_input("SEL1", fmt("G_JSEL1_" << "DCS" << z));
+        return b.tmpl;
+    });
 }
 
 void add_bram(RoutingGraph &graph, int x, int y, int z) {
-    string name = string("EBR") + std::to_string(z);
-    RoutingBel bel;
-    bel.name = graph.ident(name);
-    bel.type = graph.ident("DP16KD");
-    bel.loc.x = x;
-    bel.loc.y = y;
-    bel.z = z;
-
-    for (int i = 0; i < 14; i++) {
-        graph.add_bel_input(bel, graph.ident(fmt("ADA" << i)), x, y, graph.ident(fmt("JADA" << i << "_EBR")));
-        graph.add_bel_input(bel, graph.ident(fmt("ADB" << i)), x, y, graph.ident(fmt("JADB" << i << "_EBR")));
-    }
-
-    graph.add_bel_input(bel, graph.ident("CEA"), x, y, graph.ident("JCEA_EBR"));
-    graph.add_bel_input(bel, graph.ident("CEB"), x, y, graph.ident("JCEB_EBR"));
-    graph.add_bel_input(bel, graph.ident("CLKA"), x, y, graph.ident("JCLKA_EBR"));
-    graph.add_bel_input(bel, graph.ident("CLKB"), x, y, graph.ident("JCLKB_EBR"));
-    graph.add_bel_input(bel, graph.ident("CSA0"), x, y, graph.ident("JCSA0_EBR"));
-    graph.add_bel_input(bel, graph.ident("CSA1"), x, y, graph.ident("JCSA1_EBR"));
-    graph.add_bel_input(bel, graph.ident("CSA2"), x, y, graph.ident("JCSA2_EBR"));
-    graph.add_bel_input(bel, graph.ident("CSB0"), x, y, graph.ident("JCSB0_EBR"));
-    graph.add_bel_input(bel, graph.ident("CSB1"), x, y, graph.ident("JCSB1_EBR"));
-    graph.add_bel_input(bel, graph.ident("CSB2"), x, y, graph.ident("JCSB2_EBR"));
-
-    for (int i = 0; i < 18; i++) {
-        graph.add_bel_input(bel, graph.ident(fmt("DIA" << i)), x, y, graph.ident(fmt("JDIA" << i << "_EBR")));
-        graph.add_bel_input(bel, graph.ident(fmt("DIB" << i)), x, y, graph.ident(fmt("JDIB" << i << "_EBR")));
-        graph.add_bel_output(bel, graph.ident(fmt("DOA" << i)), x, y, graph.ident(fmt("JDOA" << i << "_EBR")));
-        graph.add_bel_output(bel, graph.ident(fmt("DOB" << i)), x, y, graph.ident(fmt("JDOB" << i << "_EBR")));
-    }
-
+    add_templated_bel(graph, "EBR" + std::to_string(z), x, y, [&]() {
+        string name = string("EBR") + std::to_string(z);
+        BelTemplateBuilder b(graph, name, "DP16KD", z);
 
-    graph.add_bel_input(bel, graph.ident("OCEA"), x, y, graph.ident("JOCEA_EBR"));
-    graph.add_bel_input(bel, graph.ident("OCEB"), x, y, graph.ident("JOCEB_EBR"));
-    graph.add_bel_input(bel, graph.ident("RSTA"), x, y, graph.ident("JRSTA_EBR"));
-    graph.add_bel_input(bel, graph.ident("RSTB"), x, y, graph.ident("JRSTB_EBR"));
-    graph.add_bel_input(bel, graph.ident("WEA"), x, y, graph.ident("JWEA_EBR"));
-    graph.add_bel_input(bel, graph.ident("WEB"), x, y, graph.ident("JWEB_EBR"));
+        for (int i = 0; i < 14; i++) {
+            b.input(fmt("ADA" << i), fmt("JADA" << i << "_EBR"));
+            b.input(fmt("ADB" << i), fmt("JADB" << i << "_EBR"));
+        }
 
-    graph.add_bel(bel);
+        b.input("CEA", "JCEA_EBR");
+        b.input("CEB", "JCEB_EBR");
+        b.input("CLKA", "JCLKA_EBR");
+        b.input("CLKB", "JCLKB_EBR");
+        b.input("CSA0", "JCSA0_EBR");
+        b.input("CSA1", "JCSA1_EBR");
+        b.input("CSA2", "JCSA2_EBR");
+        b.input("CSB0", "JCSB0_EBR");
+        b.input("CSB1", "JCSB1_EBR");
+        b.input("CSB2", "JCSB2_EBR");
+
+        for (int i = 0; i < 18; i++) {
+            b.input(fmt("DIA" << i), fmt("JDIA" << i << "_EBR"));
+            b.input(fmt("DIB" << i), fmt("JDIB" << i << "_EBR"));
+            b.output(fmt("DOA" << i), fmt("JDOA" << i << "_EBR"));
+            b.output(fmt("DOB" << i), fmt("JDOB" << i << "_EBR"));
+        }
 
+        b.input("OCEA", "JOCEA_EBR");
+        b.input("OCEB", "JOCEB_EBR");
+        b.input("RSTA", "JRSTA_EBR");
+        b.input("RSTB", "JRSTB_EBR");
+        b.input("WEA", "JWEA_EBR");
+        b.input("WEB", "JWEB_EBR");
+        return b.tmpl;
+    });
 }
 
 void add_mult18(RoutingGraph &graph, int x, int y, int z) {
-    string name = string("MULT18_") + std::to_string(z);
-    RoutingBel bel;
-    bel.name = graph.ident(name);
-    bel.type = graph.ident("MULT18X18D");
-    bel.loc.x = x;
-    bel.loc.y = y;
-    bel.z = z;
-    auto add_input = [&](const std::string &pin) {
-        graph.add_bel_input(bel, graph.ident(pin), x, y, graph.ident(fmt("J" << pin << "_MULT18")));
-    };
-    auto add_output = [&](const std::string &pin) {
-        graph.add_bel_output(bel, graph.ident(pin), x, y, graph.ident(fmt("J" << pin << "_MULT18")));
-    };
-    for (auto sig : {"CLK", "CE", "RST"})
-        for (int i = 0; i < 4; i++)
-            add_input(fmt(sig << i));
-    for (auto sig : {"SIGNED", "SOURCE"})
-        for (auto c : {"A", "B"})
-            add_input(fmt(sig << c));
-    for (auto port : {"A", "B", "C"})
-        for (int i = 0; i < 18; i++)
-            add_input(fmt(port << i));
-    for (auto port : {"SRIA", "SRIB"})
-        for (int i = 0; i < 18; i++)
-            add_input(fmt(port << i));
-    for (auto port : {"ROA", "ROB", "ROC"})
-        for (int i = 0; i < 18; i++)
-            add_output(fmt(port << i));
-    for (auto port : {"SROA", "SROB"})
-        for (int i = 0; i < 18; i++)
-            add_output(fmt(port << i));
-    for (int i = 0; i < 36; i++)
-        add_output(fmt("P" << i));
-    add_output("SIGNEDP");
-    graph.add_bel(bel);
+    add_templated_bel(graph, "MULT18_" + std::to_string(z), x, y, [&]() {
+        string name = string("MULT18_") + std::to_string(z);
+        BelTemplateBuilder b(graph, name, "MULT18X18D", z);
+        auto add_input = [&](const std::string &pin) {
+            b.input(pin, fmt("J" << pin << "_MULT18"));
+        };
+        auto add_output = [&](const std::string &pin) {
+            b.output(pin, fmt("J" << pin << "_MULT18"));
+        };
+        for (auto sig : {"CLK", "CE", "RST"})
+            for (int i = 0; i < 4; i++)
+                add_input(fmt(sig << i));
+        for (auto sig : {"SIGNED", "SOURCE"})
+            for (auto c : {"A", "B"})
+                add_input(fmt(sig << c));
+        for (auto port : {"A", "B", "C"})
+            for (int i = 0; i < 18; i++)
+                add_input(fmt(port << i));
+        for (auto port : {"SRIA", "SRIB"})
+            for (int i = 0; i < 18; i++)
+                add_input(fmt(port << i));
+        for (auto port : {"ROA", "ROB", "ROC"})
+            for (int i = 0; i < 18; i++)
+                add_output(fmt(port << i));
+        for (auto port : {"SROA", "SROB"})
+            for (int i = 0; i < 18; i++)
+                add_output(fmt(port << i));
+        for (int i = 0; i < 36; i++)
+            add_output(fmt("P" << i));
+        add_output("SIGNEDP");
+        return b.tmpl;
+    });
 }
 
 void add_alu54b(RoutingGraph &graph, int x, int y, int z) {
-    string name = string("ALU54_") + std::to_string(z);
-    RoutingBel bel;
-    bel.name = graph.ident(name);
-    bel.type = graph.ident("ALU54B");
-    bel.loc.x = x;
-    bel.loc.y = y;
-    bel.z = z;
-    auto add_input = [&](const std::string &pin) {
-        graph.add_bel_input(bel, graph.ident(pin), x, y, graph.ident(fmt("J" << pin << "_ALU54")));
-    };
-    auto add_output = [&](const std::string &pin) {
-        graph.add_bel_output(bel, graph.ident(pin), x, y, graph.ident(fmt("J" << pin << "_ALU54")));
-    };
-    for (auto sig : {"CLK", "CE", "RST"})
-        for (int i = 0; i < 4; i++)
-            add_input(fmt(sig << i));
-    add_input("SIGNEDIA");
-    add_input("SIGNEDIB");
-    add_input("SIGNEDCIN");
-    for (auto port : {"A", "B", "MA", "MB"})
-        for (int i = 0; i < 36; i++)
-            add_input(fmt(port << i));
-    for (auto port : {"C", "CFB", "CIN"})
-        for (int i = 0; i < 54; i++)
-            add_input(fmt(port << i));
-    for (int i = 0; i < 11; i++)
-        add_input(fmt("OP" << i));
-
-    for (auto port : {"R", "CO"})
-        for (int i = 0; i < 54; i++)
-            add_output(fmt(port << i));
-    add_output("EQZ");
-    add_output("EQZM");
-    add_output("EQOM");
-    add_output("EQPAT");
-    add_output("EQPATB");
-    add_output("OVER");
-    add_output("UNDER");
-    add_output("OVERUNDER");
-    add_output("SIGNEDR");
-    graph.add_bel(bel);
+    add_templated_bel(graph, "ALU54_" + std::to_string(z), x, y, [&]() {
+        string name = string("ALU54_") + std::to_string(z);
+        BelTemplateBuilder b(graph, name, "ALU54B", z);
+        auto add_input = [&](const std::string &pin) {
+            b.input(pin, fmt("J" << pin << "_ALU54"));
+        };
+        auto add_output = [&](const std::string &pin) {
+            b.output(pin, fmt("J" << pin << "_ALU54"));
+        };
+        for (auto sig : {"CLK", "CE", "RST"})
+            for (int i = 0; i < 4; i++)
+                add_input(fmt(sig << i));
+        add_input("SIGNEDIA");
+        add_input("SIGNEDIB");
+        add_input("SIGNEDCIN");
+        for (auto port : {"A", "B", "MA", "MB"})
+            for (int i = 0; i < 36; i++)
+                add_input(fmt(port << i));
+        for (auto port : {"C", "CFB", "CIN"})
+            for (int i = 0; i < 54; i++)
+                add_input(fmt(port << i));
+        for (int i = 0; i < 11; i++)
+            add_input(fmt("OP" << i));
+
+        for (auto port : {"R", "CO"})
+            for (int i = 0; i < 54; i++)
+                add_output(fmt(port << i));
+        add_output("EQZ");
+        add_output("EQZM");
+        add_output("EQOM");
+        add_output("EQPAT");
+        add_output("EQPATB");
+        add_output("OVER");
+        add_output("UNDER");
+        add_output("OVERUNDER");
+        add_output("SIGNEDR");
+        return b.tmpl;
+    });
 }
 
 void add_pll(RoutingGraph &graph, std::string quad, int x, int y) {
-    string name = string("EHXPLL_") + (quad);
-    RoutingBel bel;
-    bel.name = graph.ident(name);
-    bel.type = graph.ident("EHXPLLL");
-    bel.loc.x = x;
-    bel.loc.y = y;
-    bel.z = 0;
-    auto add_input = [&](const std::string &pin) {
-        graph.add_bel_input(bel, graph.ident(pin), x, y, graph.ident(fmt("J" << pin << "_PLL")));
-    };
-    auto add_output = [&](const std::string &pin) {
-        graph.add_bel_output(bel, graph.ident(pin), x, y, graph.ident(fmt("J" << pin << "_PLL")));
-    };
-
-    add_input("REFCLK");
-    add_input("RST");
-    add_input("STDBY");
-
-    add_input("PHASEDIR");
-    add_input("PHASELOADREG");
-    add_input("PHASESEL0");
-    add_input("PHASESEL1");
-    add_input("PHASESTEP");
-    add_input("PLLWAKESYNC");
-
-    add_input("ENCLKOP");
-    add_input("ENCLKOS2");
-    add_input("ENCLKOS3");
-    add_input("ENCLKOS");
-
-    graph.add_bel_input(bel, graph.ident("CLKI"), x, y, graph.ident("CLKI_PLL"));
-    graph.add_bel_input(bel, graph.ident("CLKFB"), x, y, graph.ident("CLKFB_PLL"));
-    graph.add_bel_output(bel, graph.ident("CLKINTFB"), x, y, graph.ident("CLKINTFB_PLL"));
-
-    add_output("LOCK");
-    add_output("INTLOCK");
-    add_output("CLKOP");
-    add_output("CLKOS");
-    add_output("CLKOS2");
-    add_output("CLKOS3");
-
-    graph.add_bel(bel);
+    add_templated_bel(graph, "EHXPLL_" + quad, x, y, [&]() {
+        string name = string("EHXPLL_") + (quad);
+        BelTemplateBuilder b(graph, name, "EHXPLLL", 0);
+        auto add_input = [&](const std::string &pin) {
+            b.input(pin, fmt("J" << pin << "_PLL"));
+        };
+        auto add_output = [&](const std::string &pin) {
+            b.output(pin, fmt("J" << pin << "_PLL"));
+        };
+
+        add_input("REFCLK");
+        add_input("RST");
+        add_input("STDBY");
+
+        add_input("PHASEDIR");
+        add_input("PHASELOADREG");
+        add_input("PHASESEL0");
+        add_input("PHASESEL1");
+        add_input("PHASESTEP");
+        add_input("PLLWAKESYNC");
+
+        add_input("ENCLKOP");
+        add_input("ENCLKOS2");
+        add_input("ENCLKOS3");
+        add_input("ENCLKOS");
+
+        b.input("CLKI", "CLKI_PLL");
+        b.input("CLKFB", "CLKFB_PLL");
+        b.output("CLKINTFB", "CLKINTFB_PLL");
+
+        add_output("LOCK");
+        add_output("INTLOCK");
+        add_output("CLKOP");
+        add_output("CLKOS");
+        add_output("CLKOS2");
+        add_output("CLKOS3");
+        return b.tmpl;
+    });
 }
 
 void add_dcu(RoutingGraph &graph, int x, int y) {
-    // Just import from routing db
-    auto tdb = get_tile_bitdata(TileLocator{"ECP5", "LFE5UM5G-45F", "DCU0"});
-    string name = string("DCU");
-    RoutingBel bel;
-    bel.name = graph.ident(name);
-    bel.type = graph.ident("DCUA");
-    bel.loc.x = x;
-    bel.loc.y = y;
-    bel.z = 0;
-
-    auto endswith = [](const std::string &net, const std::string &ending) {
-        return net.substr(net.size()-ending.size(), ending.size()) == ending;
-    };
-
-    auto is_pin = [endswith](const std::string &net) {
-        if(!endswith(net, "_DCU"))
-            return false;
-        char c = net.front();
-        return c != 'N' && c != 'E' && c != 'W' && c != 'S';
-    };
-
-    auto net_to_pin = [endswith](std::string net) {
-        if (endswith(net, "_DCU"))
-            net.erase(net.size()-4, 4);
-        if (net.front() == 'J')
-            net.erase(0, 1);
-        return net;
-    };
-
-    for (const auto &conn : tdb->get_fixed_conns()) {
-        if (is_pin(conn.source))
-            graph.add_bel_output(bel, graph.ident(net_to_pin(conn.source)), x, y, graph.ident(conn.source));
-        if (is_pin(conn.sink))
-            graph.add_bel_input(bel, graph.ident(net_to_pin(conn.sink)), x, y, graph.ident(conn.sink));
-    }
-
-    graph.add_bel(bel);
+    add_templated_bel(graph, "DCU", x, y, [&]() {
+        // Just import from routing db
+        auto tdb = get_tile_bitdata(TileLocator{"ECP5", "LFE5UM5G-45F", "DCU0"});
+        string name = string("DCU");
+        BelTemplateBuilder b(graph, name, "DCUA", 0);
+
+        auto endswith = [](const std::string &net, const std::string &ending) {
+            return net.substr(net.size()-ending.size(), ending.size()) == ending;
+        };
+
+        auto is_pin = [endswith](const std::string &net) {
+            if(!endswith(net, "_DCU"))
+                return false;
+            char c = net.front();
+            return c != 'N' && c != 'E' && c != 'W' && c != 'S';
+        };
+
+        auto net_to_pin = [endswith](std::string net) {
+            if (endswith(net, "_DCU"))
+                net.erase(net.size()-4, 4);
+            if (net.front() == 'J')
+                net.erase(0, 1);
+            return net;
+        };
+
+        for (const auto &conn : tdb->get_fixed_conns()) {
+            if (is_pin(conn.source))
+                b.output(net_to_pin(conn.source), conn.source);
+            if (is_pin(conn.sink))
+                b.input(net_to_pin(conn.sink), conn.sink);
+        }
+        return b.tmpl;
+    });
 }
 
 void add_extref(RoutingGraph &graph, int x, int y) {
-    string name = string("EXTREF");
-    RoutingBel bel;
-    bel.name = graph.ident(name);
-    bel.type = graph.ident("EXTREFB");
-    bel.loc.x = x;
-    bel.loc.y = y;
-    bel.z = 1;
-    graph.add_bel_input(bel, graph.ident("REFCLKP"), x, y, graph.ident("REFCLKP_EXTREF"));
-    graph.add_bel_input(bel, graph.ident("REFCLKN"), x, y, graph.ident("REFCLKN_EXTREF"));
-    graph.add_bel_output(bel, graph.ident("REFCLKO"), x, y, graph.ident("JREFCLKO_EXTREF"));
-    graph.add_bel(bel);
+    add_templated_bel(graph, "EXTREF", x, y, [&]() {
+        string name = string("EXTREF");
+        BelTemplateBuilder b(graph, name, "EXTREFB", 1);
+        b.input("REFCLKP", "REFCLKP_EXTREF");
+        b.input("REFCLKN", "REFCLKN_EXTREF");
+        b.output("REFCLKO", "JREFCLKO_EXTREF");
+        return b.tmpl;
+    });
 }
 
 void add_pcsclkdiv(RoutingGraph &graph, int x, int y, int z) {
     string name = string("PCSCLKDIV" + std::to_string(z));
-    RoutingBel bel;
-    bel.name = graph.ident(name);
-    bel.type = graph.ident("PCSCLKDIV");
-    bel.loc.x = x;
-    bel.loc.y = y;
-    bel.z = z;
-    graph.add_bel_input(bel, graph.ident("CLKI"), x, y, graph.ident("CLKI_" + name));
-    graph.add_bel_input(bel, graph.ident("RST"), x, y, graph.ident("JRST_" + name));
-    graph.add_bel_input(bel, graph.ident("SEL0"), x, y, graph.ident("JSEL0_" + name));
-    graph.add_bel_input(bel, graph.ident("SEL1"), x, y, graph.ident("JSEL1_" + name));
-    graph.add_bel_input(bel, graph.ident("SEL2"), x, y, graph.ident("JSEL2_" + name));
-    graph.add_bel_output(bel, graph.ident("CDIV1"), x, y, graph.ident("CDIV1_" + name));
-    graph.add_bel_output(bel, graph.ident("CDIVX"), x, y, graph.ident("CDIVX_" + name));
-    graph.add_bel(bel);
+    add_templated_bel(graph, name, x, y, [&]() {
+        BelTemplateBuilder b(graph, name, "PCSCLKDIV", z);
+        b.input("CLKI", "CLKI_" + name);
+        b.input("RST", "JRST_" + name);
+        b.input("SEL0", "JSEL0_" + name);
+        b.input("SEL1", "JSEL1_" + name);
+        b.input("SEL2", "JSEL2_" + name);
+        b.output("CDIV1", "CDIV1_" + name);
+        b.output("CDIVX", "CDIVX_" + name);
+        return b.tmpl;
+    });
 }
 
 void add_iologic(RoutingGraph &graph, int x, int y, int z, bool s) {
     char l = "ABCD"[z];
     std::string ss = s ? "S" : "";
     string name = ss + string("IOLOGIC") + l;
-    RoutingBel bel;
-    bel.name = graph.ident(name);
-    bel.type = graph.ident(ss + "IOLOGIC");
-    bel.loc.x = x;
-    bel.loc.y = y;
-    bel.z = z + (s ? 2 : 4);
-
-    auto add_input = [&](const std::string &pin, bool j = true) {
-        graph.add_bel_input(bel, graph.ident(pin), x, y, graph.ident(fmt((j ? "J" : "") << pin << l << "_" << ss << "IOLOGIC")));
-    };
-    auto add_output = [&](const std::string &pin, bool j = true) {
-        graph.add_bel_output(bel, graph.ident(pin), x, y, graph.ident(fmt((j ? "J" : "") << pin << l << "_" << ss << "IOLOGIC")));
-    };
-
-    add_input("DI", false);
-    add_output("IOLDO", false);
-    add_output("IOLDOD", false);
-    add_input("IOLDOI", false);
-    add_output("IOLTO", false);
-    add_output("INDD", false);
-
-    add_input("PADDI", false);
-
-    add_input("CLK");
-    add_input("CE");
-    add_input("LSR");
-
-    add_input("LOADN");
-    add_input("MOVE");
-    add_input("DIRECTION");
-
-    add_input("TSDATA0");
-    add_input("TXDATA0");
-    add_input("TXDATA1");
-
-    add_output("RXDATA0");
-    add_output("RXDATA1");
-    add_output("INFF");
-    add_output("CFLAG");
-
-    if (!s) {
-        add_input("ECLK", false);
-
-        add_input("TSDATA1");
-        add_input("TXDATA2");
-        add_input("TXDATA3");
-        add_output("RXDATA2");
-        add_output("RXDATA3");
-        if (z % 2 == 0) {
-            add_input("TXDATA4");
-            add_input("TXDATA5");
-            add_input("TXDATA6");
-            add_input("SLIP");
-            add_output("RXDATA4");
-            add_output("RXDATA5");
-            add_output("RXDATA6");
-        }
+    add_templated_bel(graph, name, x, y, [&]() {
+        BelTemplateBuilder b(graph, name, ss + "IOLOGIC", z + (s ? 2 : 4));
 
-        add_input("DQSR90", false);
-        add_input("DQSW270", false);
-        add_input("DQSW", false);
+        auto add_input = [&](const std::string &pin, bool j = true) {
+            b.input(pin, fmt((j ? "J" : "") << pin << l << "_" << ss << "IOLOGIC"));
+        };
+        auto add_output = [&](const std::string &pin, bool j = true) {
+            b.output(pin, fmt((j ? "J" : "") << pin << l << "_" << ss << "IOLOGIC"));
+        };
 
-        add_input("RDPNTR0", false);
-        add_input("RDPNTR1", false);
-        add_input("RDPNTR2", false);
-        add_input("WRPNTR0", false);
-        add_input("WRPNTR1", false);
-        add_input("WRPNTR2", false);
-    }
+        add_input("DI", false);
+        add_output("IOLDO", false);
+        add_output("IOLDOD", false);
+        add_input("IOLDOI", false);
+        add_output("IOLTO", false);
+        add_output("INDD", false);
 
-    graph.add_bel(bel);
-}
+        add_input("PADDI", false);
 
-void add_misc(RoutingGraph &graph, const std::string &name, int x, int y) {
-    std::string postfix;
-    RoutingBel bel;
-
-    auto add_input = [&](const std::string &pin, bool j = true) {
-        graph.add_bel_input(bel, graph.ident(pin), x, y, graph.ident(fmt((j ? "J" : "") << pin << "_" << postfix)));
-    };
-    auto add_output = [&](const std::string &pin, bool j = true) {
-        graph.add_bel_output(bel, graph.ident(pin), x, y, graph.ident(fmt((j ? "J" : "") << pin << "_" << postfix)));
-    };
-    bel.name = graph.ident(name);
-    bel.type = graph.ident(name);
-    bel.loc.x = x;
-    bel.loc.y = y;
-
-    if (name == "GSR") {
-        postfix = "GSR";
-        bel.z = 0;
-        add_input("GSR");
         add_input("CLK");
-    } else if (name == "JTAGG") {
-        postfix = "JTAG";
-        bel.z = 1;
-        add_input("TCK");
-        add_input("TMS");
-        add_input("TDI");
-        add_input("JTDO2");
-        add_input("JTDO1");
-        add_output("TDO");
-        add_output("JTDI");
-        add_output("JTCK");
-        add_output("JRTI2");
-        add_output("JRTI1");
-        add_output("JSHIFT");
-        add_output("JUPDATE");
-        add_output("JRSTN");
-        add_output("JCE2");
-        add_output("JCE1");
-    } else if (name == "OSCG") {
-        postfix = "OSC";
-        bel.z = 2;
-        graph.add_bel_output(bel, graph.ident("OSC"), 0, 0, graph.ident("G_JOSC_OSC"));
-        add_output("SEDSTDBY", false);
-    } else if (name == "SEDGA") {
-        postfix = "SED";
-        bel.z = 3;
-        add_input("SEDENABLE");
-        add_input("SEDSTART");
-        add_input("SEDFRCERR");
-        add_output("SEDDONE");
-        add_output("SEDINPROG");
-        add_output("SEDERR");
-        add_input("SEDSTDBY", false);
-    } else if (name == "DTR") {
-        postfix = "DTR";
-        bel.z = 0;
-        add_input("STARTPULSE");
-        for (int i = 0; i < 8; i++)
-            add_output("DTROUT" + std::to_string(i));
-    } else if (name == "USRMCLK") {
-        postfix = "CCLK";
-        bel.z = 1;
-        add_input("PADDO");
-        add_input("PADDT");
-        add_output("PADDI");
-    } else {
-        throw runtime_error("unknown Bel " + name);
-    }
-    graph.add_bel(bel);
-}
+        add_input("CE");
+        add_input("LSR");
 
-void add_ioclk_bel(RoutingGraph &graph, const std::string &name, int x, int y, int i, int bank) {
-    std::string postfix;
-    RoutingBel bel;
-
-    auto add_input = [&](const std::string &pin, bool j = true) {
-        graph.add_bel_input(bel, graph.ident(pin), x, y, graph.ident(fmt((j ? "J" : "") << pin << "_" << postfix)));
-    };
-    auto add_output = [&](const std::string &pin, bool j = true) {
-        graph.add_bel_output(bel, graph.ident(pin), x, y, graph.ident(fmt((j ? "J" : "") << pin << "_" << postfix)));
-    };
-    bel.type = graph.ident(name);
-    bel.loc.x = x;
-    bel.loc.y = y;
-
-    if (name == "CLKDIVF") {
-        postfix = "CLKDIV" + std::to_string(i);
-        bel.name = graph.ident(postfix);
-        bel.z = i;
-        add_input("CLKI", false);
-        add_input("RST");
-        add_input("ALIGNWD");
-        add_output("CDIVX");
-    } else if (name == "ECLKSYNCB") {
-        postfix = "ECLKSYNC" + std::to_string(i);
-        bel.name = graph.ident(postfix + "_BK" + std::to_string(bank));
-        bel.z = 8 + i;
-        add_input("ECLKI", false);
-        add_input("STOP");
-        add_output("ECLKO");
-    } else if (name == "TRELLIS_ECLKBUF") {
-        bel.z = 10 + i;
-        bel.name = graph.ident("ECLKBUF" + std::to_string(i));
-        graph.add_bel_input(bel, graph.ident("ECLKI"), x, y, graph.ident(fmt("JECLK" << i)));
-        graph.add_bel_output(bel, graph.ident("ECLKO"), 0, 0, graph.ident(fmt("G_BANK" << bank << "ECLK" << i)));
-    } else if (name == "ECLKBRIDGECS") {
-        postfix = "ECLKBRIDGECS" + std::to_string(i);
-        bel.name = graph.ident(postfix);
-        bel.z = 14;
-        add_input("CLK0");
-        add_input("CLK1");
-        add_input("SEL");
-        add_output("ECSOUT", false);
-    } else if (name == "BRGECLKSYNC") {
-        postfix = "BRGECLKSYNC" + std::to_string(i);
-        bel.name = graph.ident(postfix);
-        bel.type = graph.ident("ECLKSYNCB");
-        bel.z = 15;
-        add_input("ECLKI", false);
-        add_input("STOP");
-        add_output("ECLKO");
-    } else if (name == "DLLDELD") {
-        postfix = "DLLDEL";
-        bel.name = graph.ident(postfix);
-        bel.z = 12;
-        add_input("A");
-        add_input("DDRDEL", false);
         add_input("LOADN");
         add_input("MOVE");
         add_input("DIRECTION");
-        add_output("Z", false);
-        add_output("CFLAG");
-    } else if (name == "DDRDLL") {
-        postfix = "DDRDLL";
-        bel.name = graph.ident(postfix);
-        bel.z = 0;
-        add_input("CLK");
-        add_input("RST");
-        add_input("UDDCNTLN");
-        add_input("FREEZE");
-        add_output("DDRDEL", false);
-        add_output("LOCK");
-        add_output("DIVOSC");
-        for (int j = 0; j < 8; j++)
-            add_output("DCNTL" + std::to_string(j));
-    } else if (name == "DQSBUFM") {
-        postfix = "DQS";
-        bel.name = graph.ident("DQSBUF");
-        bel.z = 8;
-        add_input("DQSI");
-        add_input("READ1");
-        add_input("READ0");
-        add_input("READCLKSEL2");
-        add_input("READCLKSEL1");
-        add_input("READCLKSEL0");
-        add_input("DDRDEL", false);
-        add_input("ECLK", false);
-        add_input("SCLK");
-        add_input("RST");
-        for (int j = 0; j < 8; j++)
-            add_input("DYNDELAY" + std::to_string(j));
-        add_input("PAUSE");
-        add_input("RDLOADN");
-        add_input("RDMOVE");
-        add_input("RDDIRECTION");
-        add_input("WRLOADN");
-        add_input("WRMOVE");
-        add_input("WRDIRECTION");
-        add_output("DQSR90");
-        add_output("DQSW");
-        add_output("DQSW270");
-        for (int j = 0; j < 3; j++) {
-            add_output("RDPNTR" + std::to_string(j), false);
-            add_output("WRPNTR" + std::to_string(j), false);
-        }
-        add_output("DATAVALID");
-        add_output("BURSTDET");
-        add_output("RDCFLAG");
-        add_output("WRCFLAG");
-    } else {
-        throw runtime_error("unknown Bel " + name);
-    }
-    graph.add_bel(bel);
-}
 
+        add_input("TSDATA0");
+        add_input("TXDATA0");
+        add_input("TXDATA1");
 
-}
+        add_output("RXDATA0");
+        add_output("RXDATA1");
+        add_output("INFF");
+        add_output("CFLAG");
 
-namespace MachXO2Bels {
-    void add_lc(RoutingGraph &graph, int x, int y, int z) {
-        char l = "ABCD"[z];
-        string name = string("SLICE") + l;
-        int lc0 = z * 2;
-        int lc1 = z * 2 + 1;
-        RoutingBel bel;
-        bel.name = graph.ident(name);
-        bel.type = graph.ident("SLICE");
-        bel.loc.x = x;
-        bel.loc.y = y;
-        bel.z = z;
-
-        // Bel in/outs ordered by going from the bottom-up of each SLICE, clockwise.
-        if(z == 0) {
-            graph.add_bel_input(bel, graph.ident("FCI"), x, y, graph.ident(fmt("FCI_SLICE")));
-        } else {
-            graph.add_bel_input(bel, graph.ident("FCI"), x, y, graph.ident(fmt("FCI" << l << "_SLICE")));
+        if (!s) {
+            add_input("ECLK", false);
+
+            add_input("TSDATA1");
+            add_input("TXDATA2");
+            add_input("TXDATA3");
+            add_output("RXDATA2");
+            add_output("RXDATA3");
+            if (z % 2 == 0) {
+                add_input("TXDATA4");
+                add_input("TXDATA5");
+                add_input("TXDATA6");
+                add_input("SLIP");
+                add_output("RXDATA4");
+                add_output("RXDATA5");
+                add_output("RXDATA6");
+            }
+
+            add_input("DQSR90", false);
+            add_input("DQSW270", false);
+            add_input("DQSW", false);
+
+            add_input("RDPNTR0", false);
+            add_input("RDPNTR1", false);
+            add_input("RDPNTR2", false);
+            add_input("WRPNTR0", false);
+            add_input("WRPNTR1", false);
+            add_input("WRPNTR2", false);
         }
+        return b.tmpl;
+    });
+}
 
-        graph.add_bel_input(bel, graph.ident("CLK"), x, y, graph.ident(fmt("CLK" << z << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("LSR"), x, y, graph.ident(fmt("LSR" << z << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("CE"), x, y, graph.ident(fmt("CE" << z << "_SLICE")));
-
-        if(z == 0 || z == 1) {
-            graph.add_bel_input(bel, graph.ident("WCK"), x, y, graph.ident(fmt("WCK" << z << "_SLICE")));
-            graph.add_bel_input(bel, graph.ident("WRE"), x, y, graph.ident(fmt("WRE" << z << "_SLICE")));
-
-            graph.add_bel_input(bel, graph.ident("WD1"), x, y, graph.ident(fmt("WD1" << l << "_SLICE")));
-            graph.add_bel_input(bel, graph.ident("WD0"), x, y, graph.ident(fmt("WD0" << l << "_SLICE")));
-
-            graph.add_bel_input(bel, graph.ident("WAD3"), x, y, graph.ident(fmt("WAD3" << l << "_SLICE")));
-            graph.add_bel_input(bel, graph.ident("WAD2"), x, y, graph.ident(fmt("WAD2" << l << "_SLICE")));
-            graph.add_bel_input(bel, graph.ident("WAD1"), x, y, graph.ident(fmt("WAD1" << l << "_SLICE")));
-            graph.add_bel_input(bel, graph.ident("WAD0"), x, y, graph.ident(fmt("WAD0" << l << "_SLICE")));
+void add_misc(RoutingGraph &graph, const std::string &name, int x, int y) {
+    add_templated_bel(graph, name, x, y, [&]() {
+        std::string postfix;
+        int z;
+        if (name == "GSR" || name == "DTR")
+            z = 0;
+        else if (name == "JTAGG" || name == "USRMCLK")
+            z = 1;
+        else if (name == "OSCG")
+            z = 2;
+        else if (name == "SEDGA")
+            z = 3;
+        else
+            throw runtime_error("unknown Bel " + name);
+        BelTemplateBuilder b(graph, name, name, z);
+
+        auto add_input = [&](const std::string &pin, bool j = true) {
+            b.input(pin, fmt((j ? "J" : "") << pin << "_" << postfix));
+        };
+        auto add_output = [&](const std::string &pin, bool j = true) {
+            b.output(pin, fmt((j ? "J" : "") << pin << "_" << postfix));
+        };
+
+        if (name == "GSR") {
+            postfix = "GSR";
+            add_input("GSR");
+            add_input("CLK");
+        } else if (name == "JTAGG") {
+            postfix = "JTAG";
+            add_input("TCK");
+            add_input("TMS");
+            add_input("TDI");
+            add_input("JTDO2");
+            add_input("JTDO1");
+            add_output("TDO");
+            add_output("JTDI");
+            add_output("JTCK");
+            add_output("JRTI2");
+            add_output("JRTI1");
+            add_output("JSHIFT");
+            add_output("JUPDATE");
+            add_output("JRSTN");
+            add_output("JCE2");
+            add_output("JCE1");
+        } else if (name == "OSCG") {
+            postfix = "OSC";
+            b.global_output("OSC", "G_JOSC_OSC");
+            add_output("SEDSTDBY", false);
+        } else if (name == "SEDGA") {
+            postfix = "SED";
+            add_input("SEDENABLE");
+            add_input("SEDSTART");
+            add_input("SEDFRCERR");
+            add_output("SEDDONE");
+            add_output("SEDINPROG");
+            add_output("SEDERR");
+            add_input("SEDSTDBY", false);
+        } else if (name == "DTR") {
+            postfix = "DTR";
+            add_input("STARTPULSE");
+            for (int i = 0; i < 8; i++)
+                add_output("DTROUT" + std::to_string(i));
+        } else if (name == "USRMCLK") {
+            postfix = "CCLK";
+            add_input("PADDO");
+            add_input("PADDT");
+            add_output("PADDI");
         }
+        return b.tmpl;
+    });
+}
 
-        graph.add_bel_input(bel, graph.ident("FXA"), x, y, graph.ident(fmt("FXA" << l << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("FXB"), x, y, graph.ident(fmt("FXB" << l << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("M0"), x, y, graph.ident(fmt("M" << lc0 << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("M1"), x, y, graph.ident(fmt("M" << lc1 << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("DI0"), x, y, graph.ident(fmt("DI" << lc0 << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("DI1"), x, y, graph.ident(fmt("DI" << lc1 << "_SLICE")));
-
-        graph.add_bel_input(bel, graph.ident("A0"), x, y, graph.ident(fmt("A" << lc0 << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("B0"), x, y, graph.ident(fmt("B" << lc0 << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("C0"), x, y, graph.ident(fmt("C" << lc0 << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("D0"), x, y, graph.ident(fmt("D" << lc0 << "_SLICE")));
-
-        graph.add_bel_input(bel, graph.ident("A1"), x, y, graph.ident(fmt("A" << lc1 << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("B1"), x, y, graph.ident(fmt("B" << lc1 << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("C1"), x, y, graph.ident(fmt("C" << lc1 << "_SLICE")));
-        graph.add_bel_input(bel, graph.ident("D1"), x, y, graph.ident(fmt("D" << lc1 << "_SLICE")));
-
-
-        if(z == 3) {
-            graph.add_bel_output(bel, graph.ident("FCO"), x, y, graph.ident(fmt("FCO_SLICE")));
+void add_ioclk_bel(RoutingGraph &graph, const std::string &name, int x, int y, int i, int bank) {
+    string key = name + "_" + std::to_string(i) + "_" + std::to_string(bank);
+    add_templated_bel(graph, key, x, y, [&]() {
+        std::string postfix, bel_name, type = name;
+        int z;
+        if (name == "CLKDIVF") {
+            postfix = "CLKDIV" + std::to_string(i);
+            bel_name = postfix;
+            z = i;
+        } else if (name == "ECLKSYNCB") {
+            postfix = "ECLKSYNC" + std::to_string(i);
+            bel_name = postfix + "_BK" + std::to_string(bank);
+            z = 8 + i;
+        } else if (name == "TRELLIS_ECLKBUF") {
+            bel_name = "ECLKBUF" + std::to_string(i);
+            z = 10 + i;
+        } else if (name == "ECLKBRIDGECS") {
+            postfix = "ECLKBRIDGECS" + std::to_string(i);
+            bel_name = postfix;
+            z = 14;
+        } else if (name == "BRGECLKSYNC") {
+            postfix = "BRGECLKSYNC" + std::to_string(i);
+            bel_name = postfix;
+            type = "ECLKSYNCB";
+            z = 15;
+        } else if (name == "DLLDELD") {
+            postfix = "DLLDEL";
+            bel_name = postfix;
+            z = 12;
+        } else if (name == "DDRDLL") {
+            postfix = "DDRDLL";
+            bel_name = postfix;
+            z = 0;
+        } else if (name == "DQSBUFM") {
+            postfix = "DQS";
+            bel_name = "DQSBUF";
+            z = 8;
         } else {
-            graph.add_bel_output(bel, graph.ident("FCO"), x, y, graph.ident(fmt("FCO" << l << "_SLICE")));
+            throw runtime_error("unknown Bel " + name);
         }
-
-        if(z == 2) {
-            graph.add_bel_output(bel, graph.ident("WDO3"), x, y, graph.ident(fmt("WDO3" << l << "_SLICE")));
-            graph.add_bel_output(bel, graph.ident("WDO2"), x, y, graph.ident(fmt("WDO2" << l << "_SLICE")));
-            graph.add_bel_output(bel, graph.ident("WDO1"), x, y, graph.ident(fmt("WDO1" << l << "_SLICE")));
-            graph.add_bel_output(bel, graph.ident("WDO0"), x, y, graph.ident(fmt("WDO0" << l << "_SLICE")));
-
-            graph.add_bel_output(bel, graph.ident("WADO3"), x, y, graph.ident(fmt("WADO3" << l << "_SLICE")));
-            graph.add_bel_output(bel, graph.ident("WADO2"), x, y, graph.ident(fmt("WADO2" << l << "_SLICE")));
-            graph.add_bel_output(bel, graph.ident("WADO1"), x, y, graph.ident(fmt("WADO1" << l << "_SLICE")));
-            graph.add_bel_output(bel, graph.ident("WADO0"), x, y, graph.ident(fmt("WADO0" << l << "_SLICE")));
+        BelTemplateBuilder b(graph, bel_name, type, z);
+
+        auto add_input = [&](const std::string &pin, bool j = true) {
+            b.input(pin, fmt((j ? "J" : "") << pin << "_" << postfix));
+        };
+        auto add_output = [&](const std::string &pin, bool j = true) {
+            b.output(pin, fmt((j ? "J" : "") << pin << "_" << postfix));
+        };
+
+        if (name == "CLKDIVF") {
+            add_input("CLKI", false);
+            add_input("RST");
+            add_input("ALIGNWD");
+            add_output("CDIVX");
+        } else if (name == "ECLKSYNCB") {
+            add_input("ECLKI", false);
+            add_input("STOP");
+            add_output("ECLKO");
+        } else if (name == "TRELLIS_ECLKBUF") {
+            b.input("ECLKI", fmt("JECLK" << i));
+            b.global_output("ECLKO", fmt("G_BANK" << bank << "ECLK" << i));
+        } else if (name == "ECLKBRIDGECS") {
+            add_input("CLK0");
+            add_input("CLK1");
+            add_input("SEL");
+            add_output("ECSOUT", false);
+        } else if (name == "BRGECLKSYNC") {
+            add_input("ECLKI", false);
+            add_input("STOP");
+            add_output("ECLKO");
+        } else if (name == "DLLDELD") {
+            add_input("A");
+            add_input("DDRDEL", false);
+            add_input("LOADN");
+            add_input("MOVE");
+            add_input("DIRECTION");
+            add_output("Z", false);
+            add_output("CFLAG");
+        } else if (name == "DDRDLL") {
+            add_input("CLK");
+            add_input("RST");
+            add_input("UDDCNTLN");
+            add_input("FREEZE");
+            add_output("DDRDEL", false);
+            add_output("LOCK");
+            add_output("DIVOSC");
+            for (int j = 0; j < 8; j++)
+                add_output("DCNTL" + std::to_string(j));
+        } else if (name == "DQSBUFM") {
+            add_input("DQSI");
+            add_input("READ1");
+            add_input("READ0");
+            add_input("READCLKSEL2");
+            add_input("READCLKSEL1");
+            add_input("READCLKSEL0");
+            add_input("DDRDEL", false);
+            add_input("ECLK", false);
+            add_input("SCLK");
+            add_input("RST");
+            for (int j = 0; j < 8; j++)
+                add_input("DYNDELAY" + std::to_string(j));
+            add_input("PAUSE");
+            add_input("RDLOADN");
+            add_input("RDMOVE");
+            add_input("RDDIRECTION");
+            add_input("WRLOADN");
+            add_input("WRMOVE");
+            add_input("WRDIRECTION");
+            add_output("DQSR90");
+            add_output("DQSW");
+            add_output("DQSW270");
+            for (int j = 0; j < 3; j++) {
+                add_output("RDPNTR" + std::to_string(j), false);
+                add_output("WRPNTR" + std::to_string(j), false);
+            }
+            add_output("DATAVALID");
+            add_output("BURSTDET");
+            add_output("RDCFLAG");
+            add_output("WRCFLAG");
         }
+        return b.tmpl;
+    });
+}
+
 
-        graph.add_bel_output(bel, graph.ident("OFX1"), x, y, graph.ident(fmt("FX" << l << "_SLICE")));
-        graph.add_bel_output(bel, graph.ident("Q1"), x, y, graph.ident(fmt("Q" << lc1 << "_SLICE")));
-        graph.add_bel_output(bel, graph.ident("F1"), x, y, graph.ident(fmt("F" << lc1 << "_SLICE")));
-        graph.add_bel_output(bel, graph.ident("Q0"), x, y, graph.ident(fmt("Q" << lc0 << "_SLICE")));
-        graph.add_bel_output(bel, graph.ident("F0"), x, y, graph.ident(fmt("F" << lc0 << "_SLICE")));
-        graph.add_bel_output(bel, graph.ident("OFX0"), x, y, graph.ident(fmt("F5" << l << "_SLICE")));
+}
 
-        graph.add_bel(bel);
+namespace MachXO2Bels {
+    void add_lc(RoutingGraph &graph, int x, int y, int z) {
+        add_templated_bel(graph, "SLICE" + std::to_string(z), x, y, [&]() {
+            char l = "ABCD"[z];
+            string name = string("SLICE") + l;
+            int lc0 = z * 2;
+            int lc1 = z * 2 + 1;
+            BelTemplateBuilder b(graph, name, "SLICE", z);
+
+            // Bel in/outs ordered by going from the bottom-up of each SLICE, clockwise.
+            if(z == 0) {
+                b.input("FCI", fmt("FCI_SLICE"));
+            } else {
+                b.input("FCI", fmt("FCI" << l << "_SLICE"));
+            }
+
+            b.input("CLK", fmt("CLK" << z << "_SLICE"));
+            b.input("LSR", fmt("LSR" << z << "_SLICE"));
+            b.input("CE", fmt("CE" << z << "_SLICE"));
+
+            if(z == 0 || z == 1) {
+                b.input("WCK", fmt("WCK" << z << "_SLICE"));
+                b.input("WRE", fmt("WRE" << z << "_SLICE"));
+
+                b.input("WD1", fmt("WD1" << l << "_SLICE"));
+                b.input("WD0", fmt("WD0" << l << "_SLICE"));
+
+                b.input("WAD3", fmt("WAD3" << l << "_SLICE"));
+                b.input("WAD2", fmt("WAD2" << l << "_SLICE"));
+                b.input("WAD1", fmt("WAD1" << l << "_SLICE"));
+                b.input("WAD0", fmt("WAD0" << l << "_SLICE"));
+            }
+
+            b.input("FXA", fmt("FXA" << l << "_SLICE"));
+            b.input("FXB", fmt("FXB" << l << "_SLICE"));
+            b.input("M0", fmt("M" << lc0 << "_SLICE"));
+            b.input("M1", fmt("M" << lc1 << "_SLICE"));
+            b.input("DI0", fmt("DI" << lc0 << "_SLICE"));
+            b.input("DI1", fmt("DI" << lc1 << "_SLICE"));
+
+            b.input("A0", fmt("A" << lc0 << "_SLICE"));
+            b.input("B0", fmt("B" << lc0 << "_SLICE"));
+            b.input("C0", fmt("C" << lc0 << "_SLICE"));
+            b.input("D0", fmt("D" << lc0 << "_SLICE"));
+
+            b.input("A1", fmt("A" << lc1 << "_SLICE"));
+            b.input("B1", fmt("B" << lc1 << "_SLICE"));
+            b.input("C1", fmt("C" << lc1 << "_SLICE"));
+            b.input("D1", fmt("D" << lc1 << "_SLICE"));
+
+
+            if(z == 3) {
+                b.output("FCO", fmt("FCO_SLICE"));
+            } else {
+                b.output("FCO", fmt("FCO" << l << "_SLICE"));
+            }
+
+            if(z == 2) {
+                b.output("WDO3", fmt("WDO3" << l << "_SLICE"));
+                b.output("WDO2", fmt("WDO2" << l << "_SLICE"));
+                b.output("WDO1", fmt("WDO1" << l << "_SLICE"));
+                b.output("WDO0", fmt("WDO0" << l << "_SLICE"));
+
+                b.output("WADO3", fmt("WADO3" << l << "_SLICE"));
+                b.output("WADO2", fmt("WADO2" << l << "_SLICE"));
+                b.output("WADO1", fmt("WADO1" << l << "_SLICE"));
+                b.output("WADO0", fmt("WADO0" << l << "_SLICE"));
+            }
+
+            b.output("OFX1", fmt("FX" << l << "_SLICE"));
+            b.output("Q1", fmt("Q" << lc1 << "_SLICE"));
+            b.output("F1", fmt("F" << lc1 << "_SLICE"));
+            b.output("Q0", fmt("Q" << lc0 << "_SLICE"));
+            b.output("F0", fmt("F" << lc0 << "_SLICE"));
+            b.output("OFX0", fmt("F5" << l << "_SLICE"));
+            return b.tmpl;
+        });
     }
 
     void add_pio(RoutingGraph &graph, int x, int y, int z) {
-        char l = "ABCD"[z];
-        string name = string("PIO") + l;
-        RoutingBel bel;
-        bel.name = graph.ident(name);
-        bel.type = graph.ident("PIO");
-        bel.loc.x = x;
-        bel.loc.y = y;
-        bel.z = z;
-
-        graph.add_bel_input(bel, graph.ident("I"), x, y, graph.ident(fmt("PADDO" << l << "_PIO")));
-        graph.add_bel_input(bel, graph.ident("T"), x, y, graph.ident(fmt("PADDT" << l << "_PIO")));
-        graph.add_bel_output(bel, graph.ident("O"), x, y, graph.ident(fmt("JPADDI" << l << "_PIO")));
-
-        graph.add_bel_input(bel, graph.ident("IOLDO"), x, y, graph.ident(fmt("IOLDO" << l << "_PIO")));
-        graph.add_bel_input(bel, graph.ident("IOLTO"), x, y, graph.ident(fmt("IOLTO" << l << "_PIO")));
-
-        graph.add_bel(bel);
+        add_templated_bel(graph, "PIO" + std::to_string(z), x, y, [&]() {
+            char l = "ABCD"[z];
+            string name = string("PIO") + l;
+            BelTemplateBuilder b(graph, name, "PIO", z);
+
+            b.input("I", fmt("PADDO" << l << "_PIO"));
+            b.input("T", fmt("PADDT" << l << "_PIO"));
+            b.output("O", fmt("JPADDI" << l << "_PIO"));
+
+            b.input("IOLDO", fmt("IOLDO" << l << "_PIO"));
+            b.input("IOLTO", fmt("IOLTO" << l << "_PIO"));
+            return b.tmpl;
+        });
     }
 
     void add_dcc(RoutingGraph &graph, int x, int y, /* const std::string &name, */ int z) {
@@ -763,52 +773,40 @@ namespace MachXO2Bels {
         // commented-out name parameter.
         // Diamond acknowledges these BELs, but attempting to use them crashes.
         // See if they indeed do exist.
-        string name = string("DCC") + std::to_string(z);
-        RoutingBel bel;
-        bel.name = graph.ident(name);
-        bel.type = graph.ident("DCCA");
-        bel.loc.x = x;
-        bel.loc.y = y;
-        bel.z = z;
-
-        graph.add_bel_input(bel, graph.ident("CLKI"), x, y, graph.ident(fmt("G_CLKI" << z << "_DCC")));
-        graph.add_bel_input(bel, graph.ident("CE"), x, y, graph.ident(fmt("G_JCE" << z << "_DCC")));
-        graph.add_bel_output(bel, graph.ident("CLKO"), x, y, graph.ident(fmt("G_CLKO" << z << "_DCC")));
-
-        graph.add_bel(bel);
+        add_templated_bel(graph, "DCC" + std::to_string(z), x, y, [&]() {
+            string name = string("DCC") + std::to_string(z);
+            BelTemplateBuilder b(graph, name, "DCCA", z);
+
+            b.input("CLKI", fmt("G_CLKI" << z << "_DCC"));
+            b.input("CE", fmt("G_JCE" << z << "_DCC"));
+            b.output("CLKO", fmt("G_CLKO" << z << "_DCC"));
+            return b.tmpl;
+        });
     }
 
     void add_dcm(RoutingGraph &graph, int x, int y, int n, int z) {
-        string name = string("DCM") + std::to_string(n);
-        RoutingBel bel;
-        bel.name = graph.ident(name);
-        bel.type = graph.ident("DCMA");
-        bel.loc.x = x;
-        bel.loc.y = y;
-        bel.z = z;
-
-        graph.add_bel_input(bel, graph.ident("CLK0"), x, y, graph.ident(fmt("G_CLK0_" << n << "_DCM")));
-        graph.add_bel_input(bel, graph.ident("CLK1"), x, y, graph.ident(fmt("G_CLK1_" << n << "_DCM")));
-        graph.add_bel_input(bel, graph.ident("SEL"), x, y, graph.ident(fmt("G_JSEL" << n << "_DCM")));
-        graph.add_bel_output(bel, graph.ident("DCMOUT"), x, y, graph.ident(fmt("G_DCMOUT" << n << "_DCM")));
-
-        graph.add_bel(bel);
+        add_templated_bel(graph, "DCM" + std::to_string(n) + "_" + std::to_string(z), x, y, [&]() {
+            string name = string("DCM") + std::to_string(n);
+            BelTemplateBuilder b(graph, name, "DCMA", z);
+
+            b.input("CLK0", fmt("G_CLK0_" << n << "_DCM"));
+            b.input("CLK1", fmt("G_CLK1_" << n << "_DCM"));
+            b.input("SEL", fmt("G_JSEL" << n << "_DCM"));
+            b.output("DCMOUT", fmt("G_DCMOUT" << n << "_DCM"));
+            return b.tmpl;
+        });
     }
 
     void add_osch(RoutingGraph &graph, int x, int y, int z) {
-        string name = string("OSCH");
-        RoutingBel bel;
-        bel.name = graph.ident(name);
-        bel.type = graph.ident("OSCH");
-        bel.loc.x = x;
-        bel.loc.y = y;
-        bel.z = z;
-
-        graph.add_bel_input(bel, graph.ident("STDBY"), x, y, graph.ident(fmt("JSTDBY_OSC")));
-        graph.add_bel_output(bel, graph.ident("OSC"), x, y, graph.ident(fmt("G_JOSC_OSC")));
-        graph.add_bel_output(bel, graph.ident("SEDSTDBY"), x, y, graph.ident(fmt("SEDSTDBY_OSC")));
-
-        graph.add_bel(bel);
+        add_templated_bel(graph, "OSCH" + std::to_string(z), x, y, [&]() {
+            string name = string("OSCH");
+            BelTemplateBuilder b(graph, name, "OSCH", z);
+
+            b.input("STDBY", fmt("JSTDBY_OSC"));
+            b.output("OSC", fmt("G_JOSC_OSC"));
+            b.output("SEDSTDBY", fmt("SEDSTDBY_OSC"));
+            return b.tmpl;
+        });
     }
 }
 }
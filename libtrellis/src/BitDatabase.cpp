@@ -3,13 +3,22 @@
 #include "TileConfig.hpp"
 #include "Tile.hpp"
 #include "RoutingGraph.hpp"
+#include "Profile.hpp"
+#include "Log.hpp"
 
 #include <algorithm>
 #include <fstream>
+#include <unordered_map>
 #ifndef NO_THREADS
 #include <boost/thread/shared_lock_guard.hpp>
 #include <boost/thread/lock_guard.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/interprocess/sync/sharable_lock.hpp>
 #endif
+#include <cstdio>
+#include <iostream>
+#include <boost/filesystem.hpp>
 #include <boost/range/algorithm/copy.hpp>
 #include <boost/range/adaptors.hpp>
 
@@ -274,13 +283,11 @@ void EnumSettingBits::set_value(Trellis::CRAMView &tile, const string &value) co
             grp.set_group(tile);
 	}
 	else {
-	    cerr << "EnumSettingBits::set_value: cannot set " << value  << endl;
-	    cerr << "In Options: " << endl;
-	    for(auto it = options.begin(); it != options.end(); ++it){
-	      cerr << it->first << " -> " << it->second << endl;
-	    }
-
-	    exit(1);
+	    ostringstream err;
+	    err << "cannot set enum " << name << " to " << value << ", options are:";
+	    for (auto it = options.begin(); it != options.end(); ++it)
+	        err << " " << it->first;
+	    throw runtime_error(err.str());
 	}
     }
 }
@@ -337,6 +344,7 @@ TileBitDatabase::TileBitDatabase(const string &filename) : filename(filename)
 
 void TileBitDatabase::config_to_tile_cram(const TileConfig &cfg, CRAMView &tile, bool is_tilegroup, set<string> *tg_matches) const
 {
+    Profile::Timer timer("tile.encode");
 #ifndef NO_THREADS
     boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
@@ -399,100 +407,736 @@ void TileBitDatabase::config_to_tile_cram(const TileConfig &cfg, CRAMView &tile,
 
 }
 
+// Global so that indexes of different databases never share a revision
+#ifdef NO_THREADS
+static uint64_t next_symbolic_revision = 1;
+#else
+static atomic<uint64_t> next_symbolic_revision{1};
+#endif
+
+const int SymbolicEnum::none;
+
+struct TileBitDatabase::SymbolicIndex
+{
+    typedef vector<ConfigBit> Group;
+
+    struct Mux
+    {
+        string sink;
+        vector<string> sources;
+        vector<Group> arcs;
+        unordered_map<string, int> source_ids;
+    };
+
+    struct Word
+    {
+        string name;
+        vector<Group> bits;
+        vector<bool> defval;
+    };
+
+    struct Enum
+    {
+        string name;
+        bool base = false;
+        vector<string> options;
+        vector<Group> groups;
+        unordered_map<string, int> option_ids;
+        // The option named _NONE_, if there is one, is never set and is read back as SymbolicEnum::none
+        int none_option = SymbolicEnum::none;
+        boost::optional<string> defval;
+        int default_option = SymbolicEnum::none;
+        bool default_valid = true;
+        // Whether each option has the same bits as the default, and so is omitted when reading back
+        vector<bool> is_default;
+    };
+
+    uint64_t revision = 0;
+    vector<Mux> muxes;
+    vector<Word> words;
+    vector<Enum> enums;
+    unordered_map<string, int> mux_ids, word_ids, enum_ids;
+
+    SymbolicIndex(const TileBitDatabase &db)
+    {
+        revision = next_symbolic_revision++;
+        for (const auto &mux : db.muxes) {
+            Mux m;
+            m.sink = mux.first;
+            for (const auto &arc : mux.second.arcs) {
+                m.source_ids[arc.first] = int(m.sources.size());
+                m.sources.push_back(arc.first);
+                m.arcs.emplace_back(arc.second.bits.bits.begin(), arc.second.bits.bits.end());
+            }
+            mux_ids[m.sink] = int(muxes.size());
+            muxes.push_back(move(m));
+        }
+        for (const auto &word : db.words) {
+            Word w;
+            w.name = word.first;
+            for (const auto &bg : word.second.bits)
+                w.bits.emplace_back(bg.bits.begin(), bg.bits.end());
+            w.defval = word.second.defval;
+            word_ids[w.name] = int(words.size());
+            words.push_back(move(w));
+        }
+        const string base_prefix = "BASE_";
+        for (const auto &cenum : db.enums) {
+            Enum e;
+            e.name = cenum.first;
+            e.base = e.name.substr(0, base_prefix.length()) == base_prefix;
+            for (const auto &opt : cenum.second.options) {
+                if (opt.first == "_NONE_")
+                    e.none_option = int(e.options.size());
+                e.option_ids[opt.first] = int(e.options.size());
+                e.options.push_back(opt.first);
+                e.groups.emplace_back(opt.second.bits.begin(), opt.second.bits.end());
+            }
+            e.defval = cenum.second.defval;
+            e.is_default.resize(e.options.size(), false);
+            if (e.defval) {
+                auto found = cenum.second.options.find(*e.defval);
+                if (found == cenum.second.options.end()) {
+                    e.default_valid = false;
+                } else {
+                    if (*e.defval != "_NONE_")
+                        e.default_option = e.option_ids.at(*e.defval);
+                    int i = 0;
+                    for (const auto &opt : cenum.second.options)
+                        e.is_default.at(i++) = (opt.second == found->second);
+                }
+            }
+            enum_ids[e.name] = int(enums.size());
+            enums.push_back(move(e));
+        }
+    }
+
+    static void set_group(const Group &group, CRAMView &tile)
+    {
+        for (const auto &b : group)
+            tile.bit(b.frame, b.bit) = !b.inv;
+    }
+
+    static void clear_group(const Group &group, CRAMView &tile)
+    {
+        for (const auto &b : group)
+            tile.bit(b.frame, b.bit) = b.inv;
+    }
+
+    void set_enum(const Enum &e, int option, CRAMView &tile) const
+    {
+        if (option != SymbolicEnum::none && option != e.none_option)
+            set_group(e.groups.at(size_t(option)), tile);
+    }
+
+    void set_word(const Word &w, const vector<bool> &value, CRAMView &tile) const
+    {
+        for (size_t i = 0; i < w.bits.size(); i++) {
+            if (value.at(i))
+                set_group(w.bits.at(i), tile);
+            else
+                clear_group(w.bits.at(i), tile);
+        }
+    }
+
+    SymbolicTileConfig resolve(const TileConfig &cfg) const
+    {
+        SymbolicTileConfig scfg;
+        scfg.revision = revision;
+        for (const auto &arc : cfg.carcs) {
+            auto mux = mux_ids.find(arc.sink);
+            if (mux == mux_ids.end())
+                throw runtime_error("no mux for sink '" + arc.sink + "'");
+            const Mux &m = muxes.at(size_t(mux->second));
+            auto src = m.source_ids.find(arc.source);
+            if (src == m.source_ids.end())
+                throw runtime_error("sink " + arc.sink + " has no driver named " + arc.source);
+            scfg.carcs.push_back(SymbolicArc{mux->second, src->second});
+        }
+        for (const auto &cw : cfg.cwords) {
+            auto word = word_ids.find(cw.name);
+            if (word == word_ids.end())
+                throw runtime_error("no word named '" + cw.name + "'");
+            size_t size = words.at(size_t(word->second)).bits.size();
+            if (cw.value.size() != size)
+                throw runtime_error(fmt("word '" << cw.name << "' has " << size << " bits, but value has "
+                                                 << cw.value.size()));
+            scfg.cwords.push_back(SymbolicWord{word->second, cw.value});
+        }
+        for (const auto &ce : cfg.cenums) {
+            auto cenum = enum_ids.find(ce.name);
+            if (cenum == enum_ids.end())
+                throw runtime_error("no enum named '" + ce.name + "'");
+            int option = SymbolicEnum::none;
+            if (ce.value != "_NONE_") {
+                const Enum &e = enums.at(size_t(cenum->second));
+                auto opt = e.option_ids.find(ce.value);
+                if (opt == e.option_ids.end())
+                    throw runtime_error("enum '" + ce.name + "' has no option named '" + ce.value + "'");
+                option = opt->second;
+            }
+            scfg.cenums.push_back(SymbolicEnum{cenum->second, option});
+        }
+        scfg.cunknowns = cfg.cunknowns;
+        scfg.total_known_bits = cfg.total_known_bits;
+        return scfg;
+    }
+
+    TileConfig to_config(const SymbolicTileConfig &scfg) const
+    {
+        TileConfig cfg;
+        cfg.carcs.reserve(scfg.carcs.size());
+        for (const auto &arc : scfg.carcs) {
+            const Mux &m = muxes.at(size_t(arc.mux));
+            cfg.carcs.push_back(ConfigArc{m.sink, m.sources.at(size_t(arc.source))});
+        }
+        cfg.cwords.reserve(scfg.cwords.size());
+        for (const auto &cw : scfg.cwords)
+            cfg.cwords.push_back(ConfigWord{words.at(size_t(cw.word)).name, cw.value});
+        cfg.cenums.reserve(scfg.cenums.size());
+        for (const auto &ce : scfg.cenums) {
+            const Enum &e = enums.at(size_t(ce.cenum));
+            cfg.cenums.push_back(
+                    ConfigEnum{e.name, ce.option == SymbolicEnum::none ? "_NONE_" : e.options.at(size_t(ce.option))});
+        }
+        cfg.cunknowns = scfg.cunknowns;
+        cfg.total_known_bits = scfg.total_known_bits;
+        return cfg;
+    }
+
+    // Same order and semantics as config_to_tile_cram, for a config that is not a tile group
+    void encode(const SymbolicTileConfig &cfg, CRAMView &tile) const
+    {
+        for (const auto &arc : cfg.carcs)
+            set_group(muxes.at(size_t(arc.mux)).arcs.at(size_t(arc.source)), tile);
+        vector<bool> found_words(words.size(), false), found_enums(enums.size(), false);
+        // Make sure "base" enums like IO type are applied first, other settings may overlay onto them later
+        for (int pass = 0; pass < 2; pass++) {
+            if (pass == 1) {
+                for (const auto &cw : cfg.cwords) {
+                    set_word(words.at(size_t(cw.word)), cw.value, tile);
+                    found_words.at(size_t(cw.word)) = true;
+                }
+            }
+            for (const auto &ce : cfg.cenums) {
+                const Enum &e = enums.at(size_t(ce.cenum));
+                if (e.base == (pass == 0)) {
+                    set_enum(e, ce.option, tile);
+                    found_enums.at(size_t(ce.cenum)) = true;
+                }
+            }
+        }
+        for (const auto &unk : cfg.cunknowns)
+            tile.bit(unk.frame, unk.bit) = 1;
+        for (size_t i = 0; i < words.size(); i++)
+            if (!found_words.at(i))
+                set_word(words.at(i), words.at(i).defval, tile);
+        for (size_t i = 0; i < enums.size(); i++) {
+            const Enum &e = enums.at(i);
+            if (found_enums.at(i) || !e.defval)
+                continue;
+            if (!e.default_valid && *e.defval != "_NONE_")
+                throw runtime_error("default value '" + *e.defval + "' of enum '" + e.name + "' is not an option");
+            set_enum(e, e.default_option, tile);
+        }
+    }
+
+    // Same semantics as tile_cram_to_config. The tile is copied out once, and coverage is kept as a flag per bit
+    SymbolicTileConfig decode(const CRAMView &tile) const
+    {
+        SymbolicTileConfig cfg;
+        cfg.revision = revision;
+        int frames = tile.frames(), bits = tile.bits();
+        vector<uint8_t> data(size_t(frames) * size_t(bits)), coverage(data.size(), 0);
+        tile.get_bits(data.data());
+        auto index = [frames, bits](const ConfigBit &b) {
+            if (b.frame < 0 || b.frame >= frames || b.bit < 0 || b.bit >= bits)
+                throw out_of_range(fmt("config bit " << to_string(b) << " is outside tile"));
+            return size_t(b.frame) * size_t(bits) + size_t(b.bit);
+        };
+        auto match = [&](const Group &group) {
+            for (const auto &b : group)
+                if (bool(data[index(b)]) == b.inv)
+                    return false;
+            return true;
+        };
+        auto add_coverage = [&](const Group &group, bool value) {
+            for (const auto &b : group)
+                if (b.inv != value)
+                    coverage[index(b)] = 1;
+        };
+        // The largest matching group, later groups winning ties; or -1 if none match
+        auto best_match = [&](const vector<Group> &groups) {
+            int best = -1;
+            size_t bestbits = 0;
+            for (size_t i = 0; i < groups.size(); i++) {
+                if (groups[i].size() >= bestbits && match(groups[i])) {
+                    best = int(i);
+                    bestbits = groups[i].size();
+                }
+            }
+            return best;
+        };
+        for (size_t i = 0; i < muxes.size(); i++) {
+            const Mux &m = muxes[i];
+            int best = best_match(m.arcs);
+            if (best == -1)
+                continue;
+            add_coverage(m.arcs[size_t(best)], true);
+            if (!m.arcs[size_t(best)].empty())
+                cfg.carcs.push_back(SymbolicArc{int(i), best});
+        }
+        for (size_t i = 0; i < words.size(); i++) {
+            const Word &w = words[i];
+            vector<bool> value(w.bits.size());
+            for (size_t j = 0; j < w.bits.size(); j++) {
+                bool m = match(w.bits[j]);
+                add_coverage(w.bits[j], m);
+                value[j] = m;
+            }
+            if (value != w.defval)
+                cfg.cwords.push_back(SymbolicWord{int(i), move(value)});
+        }
+        for (size_t i = 0; i < enums.size(); i++) {
+            const Enum &e = enums[i];
+            int best = best_match(e.groups);
+            if (best == -1) {
+                if (e.defval)
+                    cfg.cenums.push_back(SymbolicEnum{int(i), SymbolicEnum::none});
+                continue;
+            }
+            add_coverage(e.groups[size_t(best)], true);
+            if (e.defval) {
+                if (!e.default_valid)
+                    throw out_of_range("default value '" + *e.defval + "' of enum '" + e.name + "' is not an option");
+                if (e.is_default[size_t(best)])
+                    continue;
+            }
+            cfg.cenums.push_back(SymbolicEnum{int(i), best == e.none_option ? SymbolicEnum::none : best});
+        }
+        for (int f = 0; f < frames; f++) {
+            for (int b = 0; b < bits; b++) {
+                size_t idx = size_t(f) * size_t(bits) + size_t(b);
+                if (data[idx]) {
+                    if (coverage[idx])
+                        cfg.total_known_bits++;
+                    else
+                        cfg.cunknowns.push_back(ConfigUnknown{f, b});
+                }
+            }
+        }
+        return cfg;
+    }
+};
+
+shared_ptr<const TileBitDatabase::SymbolicIndex> TileBitDatabase::get_symbolic_index() const
+{
+#ifndef NO_THREADS
+    lock_guard<mutex> guard(symbolic_index_mutex);
+#endif
+    if (!symbolic_index)
+        symbolic_index = make_shared<SymbolicIndex>(*this);
+    return symbolic_index;
+}
+
+shared_ptr<const TileBitDatabase::SymbolicIndex> TileBitDatabase::get_symbolic_index(const SymbolicTileConfig &cfg) const
+{
+    auto index = get_symbolic_index();
+    if (cfg.revision != index->revision)
+        throw runtime_error("symbolic tile config was not resolved against the current contents of " + filename);
+    return index;
+}
+
+uint64_t TileBitDatabase::get_symbolic_revision() const
+{
+    return get_symbolic_index()->revision;
+}
+
+void TileBitDatabase::invalidate_symbolic_index()
+{
+#ifndef NO_THREADS
+    lock_guard<mutex> guard(symbolic_index_mutex);
+#endif
+    symbolic_index.reset();
+}
+
 TileConfig TileBitDatabase::tile_cram_to_config(const CRAMView &tile) const
 {
+    Profile::Timer timer("tile.decode");
 #ifndef NO_THREADS
     boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    TileConfig cfg;
-    BitSet coverage;
-    for (auto mux : muxes) {
-        auto sink = mux.second.get_driver(tile, coverage);
-        if (sink && mux.second.arcs.at(*sink).bits.bits.size() > 0)
-            cfg.carcs.push_back(ConfigArc{mux.first, *sink});
-    }
-    for (auto cw : words) {
-        auto val = cw.second.get_value(tile, coverage);
-        if (val)
-            cfg.cwords.push_back(ConfigWord{cw.first, *val});
-    }
-    for (auto ce : enums) {
-        auto val = ce.second.get_value(tile, coverage);
-        if (val)
-            cfg.cenums.push_back(ConfigEnum{ce.first, *val});
-    }
-    for (int f = 0; f < tile.frames(); f++) {
-        for (int b = 0; b < tile.bits(); b++) {
-            if (tile.bit(f, b)) {
-                if (coverage.find(ConfigBit{f, b, false}) == coverage.end()) {
-                    cfg.cunknowns.push_back(ConfigUnknown{f, b});
-                } else {
-                    cfg.total_known_bits++;
-                }
-            }
+    // Decoding through the symbolic index avoids string handling and hashing of coverage
+    auto index = get_symbolic_index();
+    return index->to_config(index->decode(tile));
+}
+
+SymbolicTileConfig TileBitDatabase::resolve_config(const TileConfig &cfg) const
+{
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    return get_symbolic_index()->resolve(cfg);
+}
+
+TileConfig TileBitDatabase::symbolic_to_config(const SymbolicTileConfig &cfg) const
+{
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    return get_symbolic_index(cfg)->to_config(cfg);
+}
+
+void TileBitDatabase::symbolic_config_to_tile_cram(const SymbolicTileConfig &cfg, CRAMView &tile) const
+{
+    Profile::Timer timer("tile.encode_symbolic");
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    get_symbolic_index(cfg)->encode(cfg, tile);
+}
+
+SymbolicTileConfig TileBitDatabase::tile_cram_to_symbolic_config(const CRAMView &tile) const
+{
+    Profile::Timer timer("tile.decode_symbolic");
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    return get_symbolic_index()->decode(tile);
+}
+
+namespace {
+void hash_bitgroup(ContentHasher &hasher, const BitGroup &bg)
+{
+    hasher.add_int(int64_t(bg.bits.size()));
+    for (const auto &bit : bg.bits) {
+        hasher.add_int(bit.frame);
+        hasher.add_int(bit.bit);
+        hasher.add_int(bit.inv);
+    }
+}
+}
+
+uint64_t TileBitDatabase::get_content_hash() const
+{
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    ContentHasher hasher;
+    hasher.add_int(int64_t(muxes.size()));
+    for (const auto &mux : muxes) {
+        hasher.add(mux.first);
+        hasher.add_int(int64_t(mux.second.arcs.size()));
+        for (const auto &arc : mux.second.arcs) {
+            hasher.add(arc.first);
+            hash_bitgroup(hasher, arc.second.bits);
         }
-    };
-    return cfg;
+    }
+    hasher.add_int(int64_t(words.size()));
+    for (const auto &word : words) {
+        hasher.add(word.first);
+        hasher.add_int(int64_t(word.second.defval.size()));
+        for (bool b : word.second.defval)
+            hasher.add_int(b);
+        hasher.add_int(int64_t(word.second.bits.size()));
+        for (const auto &bg : word.second.bits)
+            hash_bitgroup(hasher, bg);
+    }
+    hasher.add_int(int64_t(enums.size()));
+    for (const auto &cenum : enums) {
+        hasher.add(cenum.first);
+        hasher.add_int(bool(cenum.second.defval));
+        if (cenum.second.defval)
+            hasher.add(*cenum.second.defval);
+        hasher.add_int(int64_t(cenum.second.options.size()));
+        for (const auto &opt : cenum.second.options) {
+            hasher.add(opt.first);
+            hash_bitgroup(hasher, opt.second);
+        }
+    }
+    return hasher.h;
 }
 
-void TileBitDatabase::load()
+namespace {
+// compact_if_large merges the journal into the database file once it reaches this size
+const uintmax_t journal_compact_size = 1 << 20;
+
+// Marks the end of each complete set of changes in the journal
+const string journal_commit = ".commit";
+
+// Length of the complete sets of changes at the start of a journal; anything after them was cut short by a crash
+size_t committed_length(const string &journal)
+{
+    size_t end = 0;
+    for (size_t pos = journal.find(journal_commit + "\n"); pos != string::npos;
+         pos = journal.find(journal_commit + "\n", pos + 1)) {
+        if (pos == 0 || journal.at(pos - 1) == '\n')
+            end = pos + journal_commit.size() + 1;
+    }
+    return end;
+}
+
+string read_file(const string &filename)
+{
+    ifstream in(filename, ios::binary);
+    return string((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+}
+
+// Lock held while reading or writing the files of a database, shared by all processes using them. Only writers create
+// the lock file, and processes that can't create it can't write the database either, so they read it without locking.
+// Readers only need the lock while there is a journal, as bits.db itself is always replaced in one step.
+// This is an fcntl lock, which closing any descriptor of the lock file in this process releases, so the lock file is
+// never opened while it is held and each database takes the lock at most once at a time
+class DatabaseFileLock
 {
+public:
+    DatabaseFileLock(const string &db_filename, bool exclusive)
+    {
 #ifndef NO_THREADS
-    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
+        const string lock_filename = db_filename + ".lock";
+        if (exclusive) {
+            if (!boost::filesystem::exists(lock_filename) && !ofstream(lock_filename, ios::app))
+                return;
+        } else if (!boost::filesystem::exists(db_filename + ".journal") || !boost::filesystem::exists(lock_filename)) {
+            return;
+        }
+        lock = boost::interprocess::file_lock(lock_filename.c_str());
+        if (exclusive)
+            lock.lock();
+        else
+            lock.lock_sharable();
+        exclusive_held = exclusive;
+        locked = true;
+#else
+        UNUSED(db_filename);
+        UNUSED(exclusive);
 #endif
-    ifstream in(filename);
-    if (!in) {
-        throw runtime_error("failed to open tilebit database file " + filename);
     }
-    muxes.clear();
-    words.clear();
-    enums.clear();
+
+    ~DatabaseFileLock()
+    {
+#ifndef NO_THREADS
+        if (!locked)
+            return;
+        if (exclusive_held)
+            lock.unlock();
+        else
+            lock.unlock_sharable();
+#endif
+    }
+
+private:
+#ifndef NO_THREADS
+    boost::interprocess::file_lock lock;
+    bool locked = false, exclusive_held = false;
+#endif
+};
+}
+
+string TileBitDatabase::journal_filename() const
+{
+    return filename + ".journal";
+}
+
+TileBitDatabase::FileState TileBitDatabase::get_file_state() const
+{
+    FileState state;
+    boost::system::error_code ec;
+    state.db_size = boost::filesystem::file_size(filename, ec);
+    state.db_time = boost::filesystem::last_write_time(filename, ec);
+    const uintmax_t journal_size = boost::filesystem::file_size(journal_filename(), ec);
+    if (!ec)
+        state.journal_size = journal_size;
+    return state;
+}
+
+void TileBitDatabase::read_entries(istream &in, const string &source, bool merge)
+{
     while (!skip_check_eof(in)) {
         string token;
         in >> token;
         if (token == ".mux") {
             MuxBits mux;
             in >> mux;
-            muxes[mux.sink] = mux;
+            if (merge) {
+                for (const auto &arc : mux.arcs)
+                    merge_mux_arc(muxes, arc.second);
+            } else {
+                muxes[mux.sink] = mux;
+            }
         } else if (token == ".config") {
             WordSettingBits cw;
             in >> cw;
-            words[cw.name] = cw;
+            if (merge)
+                merge_setting_word(words, cw);
+            else
+                words[cw.name] = cw;
         } else if (token == ".config_enum") {
             EnumSettingBits ce;
             in >> ce;
-            enums[ce.name] = ce;
+            if (merge)
+                merge_setting_enum(enums, ce);
+            else
+                enums[ce.name] = ce;
         } else if (token == ".fixed_conn") {
             FixedConnection c;
             in >> c;
             fixed_conns[c.sink].insert(c);
+        } else if (merge && token == ".remove_fixed_sink") {
+            string sink;
+            in >> sink;
+            fixed_conns.erase(sink);
+        } else if (merge && token == ".remove_config") {
+            string name;
+            in >> name;
+            words.erase(name);
+        } else if (merge && token == ".remove_config_enum") {
+            string name;
+            in >> name;
+            enums.erase(name);
+        } else if (merge && token == journal_commit) {
+            // Only marks the end of a set of changes
         } else {
-            throw runtime_error("unexpected token " + token + " while parsing database file " + filename);
+            throw runtime_error("unexpected token " + token + " while parsing database file " + source);
         }
     }
 }
 
+void TileBitDatabase::read_files()
+{
+    ifstream in(filename);
+    if (!in) {
+        throw runtime_error("failed to open tilebit database file " + filename);
+    }
+    invalidate_symbolic_index();
+    muxes.clear();
+    words.clear();
+    enums.clear();
+    fixed_conns.clear();
+    read_entries(in, filename, false);
+
+    // Replay the complete sets of changes in the journal
+    file_state = get_file_state();
+    const string journal = read_file(journal_filename());
+    istringstream jss(journal.substr(0, committed_length(journal)));
+    read_entries(jss, journal_filename(), true);
+
+    downhill_index.clear();
+    uphill_index.clear();
+    for (const auto &mux : muxes)
+        for (const auto &arc : mux.second.arcs)
+            index_wire_conn(arc.second.source, arc.second.sink, false);
+    for (const auto &csink : fixed_conns)
+        for (const auto &conn : csink.second)
+            index_wire_conn(conn.source, conn.sink, true);
+}
+
+void TileBitDatabase::load()
+{
+    Profile::Timer timer("database.load_bitdb");
+#ifndef NO_THREADS
+    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    DatabaseFileLock lock(filename, false);
+    read_files();
+}
+
+void TileBitDatabase::append_journal(const string &entries)
+{
+    {
+        // Drop any incomplete set of changes left by a crash, so that it isn't committed along with these
+        ifstream in(journal_filename(), ios::binary);
+        char tail[16] = {};
+        const streamoff tail_size = streamoff(journal_commit.size() + 1);
+        if (in && in.seekg(0, ios::end) && in.tellg() > 0 &&
+            !(in.tellg() >= tail_size && in.seekg(-tail_size, ios::end) && in.read(tail, tail_size) &&
+              string(tail, size_t(tail_size)) == journal_commit + "\n")) {
+            in.close();
+            const string journal = read_file(journal_filename());
+            ofstream(journal_filename(), ios::trunc | ios::binary) << journal.substr(0, committed_length(journal));
+        }
+    }
+    {
+        ofstream out(journal_filename(), ios::app | ios::binary);
+        out << entries << journal_commit << endl;
+        if (!out) {
+            throw runtime_error("failed to write tilebit database journal " + journal_filename());
+        }
+    }
+    file_state = get_file_state();
+    dirty = true;
+}
+
+void TileBitDatabase::journal_change(const function<bool()> &apply, const string &entries)
+{
+    if (!apply())
+        return;
+    DatabaseFileLock lock(filename, true);
+    if (!(get_file_state() == file_state)) {
+        read_files();
+        if (!apply())
+            return;
+    }
+    append_journal(entries);
+}
+
 void TileBitDatabase::save()
 {
 #ifndef NO_THREADS
     boost::lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    ofstream out(filename);
-    if (!out) {
-        throw runtime_error("failed to open tilebit database file " + filename + " for writing");
-    }
-    out << "# Routing Mux Bits" << endl;
-    for (auto mux : muxes)
-        out << mux.second << endl;
-    out << endl << "# Non-Routing Configuration" << endl;
-    for (auto word : words)
-        out << word.second << endl;
-    for (auto senum : enums)
-        out << senum.second << endl;
-    out << endl << "# Fixed Connections" << endl;
-    for (auto conns : fixed_conns)
-        for (auto conn2 : conns.second)
-            out << conn2 << endl;
+    write_compacted();
+}
+
+void TileBitDatabase::compact_if_large()
+{
+#ifndef NO_THREADS
+    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    if (file_state.journal_size >= journal_compact_size)
+        write_compacted();
+}
+
+void TileBitDatabase::write_compacted()
+{
+    DatabaseFileLock lock(filename, true);
+    // Other processes may have added to the journal too, so merge everything on disk rather than what is in memory
+    read_files();
+    const string tmp_filename = filename + ".tmp";
+    {
+        ofstream out(tmp_filename);
+        if (!out) {
+            throw runtime_error("failed to open tilebit database file " + tmp_filename + " for writing");
+        }
+        out << "# Routing Mux Bits" << endl;
+        for (auto mux : muxes)
+            out << mux.second << endl;
+        out << endl << "# Non-Routing Configuration" << endl;
+        for (auto word : words)
+            out << word.second << endl;
+        for (auto senum : enums)
+            out << senum.second << endl;
+        out << endl << "# Fixed Connections" << endl;
+        for (auto conns : fixed_conns)
+            for (auto conn2 : conns.second)
+                out << conn2 << endl;
+        if (!out) {
+            throw runtime_error("failed to write tilebit database file " + tmp_filename);
+        }
+    }
+    // Replace the database file in one step, so that it is never seen half written. Unlike rename,
+    // boost::filesystem::rename also replaces an existing file on Windows
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp_filename, filename, ec);
+    if (ec) {
+        throw runtime_error("failed to replace tilebit database file " + filename);
+    }
+    // Without a journal, readers of the database don't need to lock it
+    boost::filesystem::remove(journal_filename(), ec);
+    if (ec) {
+        throw runtime_error("failed to remove tilebit database journal " + journal_filename());
+    }
+    file_state = get_file_state();
     dirty = false;
 }
 
@@ -564,24 +1208,57 @@ vector<FixedConnection> TileBitDatabase::get_fixed_conns() const
     return result;
 }
 
+void TileBitDatabase::index_wire_conn(const string &source, const string &sink, bool fixed)
+{
+    downhill_index[source].emplace(fixed, sink);
+    uphill_index[sink].emplace(fixed, source);
+}
+
+void TileBitDatabase::get_indexed_wires(const unordered_map<string, set<pair<bool, string>>> &index,
+                                        const string &wire, vector<pair<string, bool>> &result) const
+{
+    auto found = index.find(wire);
+    if (found == index.end())
+        return;
+    result.reserve(found->second.size());
+    for (const auto &entry : found->second)
+        result.emplace_back(entry.second, !entry.first);
+}
+
 vector<pair<string, bool>> TileBitDatabase::get_downhill_wires(const string &wire) const
 {
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
     vector<pair<string, bool>> dhwires;
-    for (const auto &mux : muxes) {
-        for (const auto &arc : mux.second.arcs) {
-            if (arc.second.source == wire)
-                dhwires.push_back(make_pair(arc.second.sink, true));
-        }
-    }
-    for (const auto &csink : fixed_conns) {
-        for (const auto &conn : csink.second) {
-            if (conn.source == wire)
-                dhwires.push_back(make_pair(conn.sink, false));
-        }
-    }
+    get_indexed_wires(downhill_index, wire, dhwires);
     return dhwires;
 }
 
+vector<pair<string, bool>> TileBitDatabase::get_uphill_wires(const string &wire) const
+{
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    vector<pair<string, bool>> uhwires;
+    get_indexed_wires(uphill_index, wire, uhwires);
+    return uhwires;
+}
+
+vector<WireConnections> TileBitDatabase::get_wire_connections(const vector<string> &wires) const
+{
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    vector<WireConnections> result(wires.size());
+    for (size_t i = 0; i < wires.size(); i++) {
+        result.at(i).wire = wires.at(i);
+        get_indexed_wires(uphill_index, wires.at(i), result.at(i).uphill);
+        get_indexed_wires(downhill_index, wires.at(i), result.at(i).downhill);
+    }
+    return result;
+}
+
 void TileBitDatabase::add_routing(const TileInfo &tile, RoutingGraph &graph) const
 {
 #ifndef NO_THREADS
@@ -627,12 +1304,8 @@ void TileBitDatabase::add_routing(const TileInfo &tile, RoutingGraph &graph) con
     }
 }
 
-void TileBitDatabase::add_mux_arc(const ArcData &arc)
+bool TileBitDatabase::merge_mux_arc(map<string, MuxBits> &muxes, const ArcData &arc)
 {
-#ifndef NO_THREADS
-    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
-#endif
-    dirty = true;
     if (muxes.find(arc.sink) == muxes.end()) {
         MuxBits mux;
         mux.sink = arc.sink;
@@ -642,6 +1315,7 @@ void TileBitDatabase::add_mux_arc(const ArcData &arc)
     auto found = curr.arcs.find(arc.source);
     if (found == curr.arcs.end()) {
         curr.arcs[arc.source] = arc;
+        return true;
     } else {
         if (found->second.bits == arc.bits) {
             // In DB already, no-op
@@ -652,16 +1326,12 @@ void TileBitDatabase::add_mux_arc(const ArcData &arc)
                                                                       << " don't match existing DB bits " <<
                                                                       found->second.bits));
         }
+        return false;
     }
-
 }
 
-void TileBitDatabase::add_setting_word(const WordSettingBits &wsb)
+bool TileBitDatabase::merge_setting_word(map<string, WordSettingBits> &words, const WordSettingBits &wsb)
 {
-#ifndef NO_THREADS
-    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
-#endif
-    dirty = true;
     if (words.find(wsb.name) != words.end()) {
         WordSettingBits &curr = words.at(wsb.name);
         if (curr.bits.size() != wsb.bits.size()) {
@@ -676,35 +1346,161 @@ void TileBitDatabase::add_setting_word(const WordSettingBits &wsb)
                                                        << curr.bits.at(i)));
             }
         }
+        return false;
     } else {
         words[wsb.name] = wsb;
+        return true;
     }
 }
 
-void TileBitDatabase::add_setting_enum(const EnumSettingBits &esb)
+bool TileBitDatabase::merge_setting_enum(map<string, EnumSettingBits> &enums, const EnumSettingBits &esb)
 {
-#ifndef NO_THREADS
-    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
-#endif
-    dirty = true;
-    if (enums.find(esb.name) != enums.end()) {
-        EnumSettingBits &curr = enums.at(esb.name);
+    auto found = enums.find(esb.name);
+    if (found != enums.end()) {
+        const EnumSettingBits &curr = found->second;
         for (const auto &opt : esb.options) {
-            if (curr.options.find(opt.first) == curr.options.end()) {
-                curr.options[opt.first] = opt.second;
-            } else {
-                if (curr.options.at(opt.first) == opt.second) {
-                    // No-op
-                } else {
-                    throw DatabaseConflictError(
-                            fmt("option " << opt.first << " of " << esb.name << " already in DB, but config bits "
-                                          << opt.second << " don't match existing DB bits "
-                                          << curr.options.at(opt.first)));
-                }
+            auto curr_opt = curr.options.find(opt.first);
+            if (curr_opt != curr.options.end() && !(curr_opt->second == opt.second)) {
+                throw DatabaseConflictError(
+                        fmt("option " << opt.first << " of " << esb.name << " already in DB, but config bits "
+                                      << opt.second << " don't match existing DB bits "
+                                      << curr_opt->second));
             }
         }
+        if (curr == esb)
+            return false;
     }
     enums[esb.name] = esb;
+    return true;
+}
+
+void TileBitDatabase::add_mux_arc(const ArcData &arc)
+{
+#ifndef NO_THREADS
+    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    MuxBits mux;
+    mux.sink = arc.sink;
+    mux.arcs[arc.source] = arc;
+    journal_change([&]() {
+        if (!merge_mux_arc(muxes, arc))
+            return false;
+        invalidate_symbolic_index();
+        index_wire_conn(arc.source, arc.sink, false);
+        return true;
+    }, fmt(mux << endl));
+}
+
+void TileBitDatabase::add_setting_word(const WordSettingBits &wsb)
+{
+#ifndef NO_THREADS
+    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    journal_change([&]() {
+        if (!merge_setting_word(words, wsb))
+            return false;
+        invalidate_symbolic_index();
+        return true;
+    }, fmt(wsb << endl));
+}
+
+void TileBitDatabase::add_setting_enum(const EnumSettingBits &esb)
+{
+#ifndef NO_THREADS
+    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    journal_change([&]() {
+        if (!merge_setting_enum(enums, esb))
+            return false;
+        invalidate_symbolic_index();
+        return true;
+    }, fmt(esb << endl));
+}
+
+bool TileBitDatabase::stage_update(const BitDatabaseUpdate &update, map<string, MuxBits> &new_muxes,
+                                   map<string, WordSettingBits> &new_words, map<string, EnumSettingBits> &new_enums,
+                                   vector<const ArcData *> &new_arcs) const
+{
+    bool changed = false;
+    // Only the parts of the database being added to are copied
+    if (!update.arcs.empty()) {
+        new_muxes = muxes;
+        for (const auto &arc : update.arcs)
+            if (merge_mux_arc(new_muxes, arc))
+                new_arcs.push_back(&arc);
+        changed |= !new_arcs.empty();
+    }
+    if (!update.words.empty()) {
+        new_words = words;
+        for (const auto &wsb : update.words)
+            changed |= merge_setting_word(new_words, wsb);
+    }
+    if (!update.enums.empty()) {
+        new_enums = enums;
+        for (const auto &esb : update.enums)
+            changed |= merge_setting_enum(new_enums, esb);
+    }
+    for (const auto &conn : update.fixed_conns) {
+        auto found = fixed_conns.find(conn.sink);
+        changed |= (found == fixed_conns.end() || !found->second.count(conn));
+    }
+    return changed;
+}
+
+void TileBitDatabase::check_update(const BitDatabaseUpdate &update) const
+{
+#ifndef NO_THREADS
+    boost::shared_lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    map<string, MuxBits> new_muxes;
+    map<string, WordSettingBits> new_words;
+    map<string, EnumSettingBits> new_enums;
+    vector<const ArcData *> new_arcs;
+    stage_update(update, new_muxes, new_words, new_enums, new_arcs);
+}
+
+void TileBitDatabase::add_update(const BitDatabaseUpdate &update)
+{
+#ifndef NO_THREADS
+    boost::lock_guard<boost::shared_mutex> guard(db_mutex);
+#endif
+    // The whole update is journaled as one set of changes
+    ostringstream entries;
+    for (const auto &arc : update.arcs) {
+        MuxBits mux;
+        mux.sink = arc.sink;
+        mux.arcs[arc.source] = arc;
+        entries << mux << endl;
+    }
+    for (const auto &wsb : update.words)
+        entries << wsb << endl;
+    for (const auto &esb : update.enums)
+        entries << esb << endl;
+    for (const auto &conn : update.fixed_conns)
+        entries << conn << endl;
+    journal_change([&]() {
+        map<string, MuxBits> new_muxes;
+        map<string, WordSettingBits> new_words;
+        map<string, EnumSettingBits> new_enums;
+        vector<const ArcData *> new_arcs;
+        // Nothing is changed until the whole update has been checked for conflicts
+        if (!stage_update(update, new_muxes, new_words, new_enums, new_arcs))
+            return false;
+        invalidate_symbolic_index();
+        if (!update.arcs.empty())
+            muxes.swap(new_muxes);
+        if (!update.words.empty())
+            words.swap(new_words);
+        if (!update.enums.empty())
+            enums.swap(new_enums);
+        for (const auto *arc : new_arcs)
+            index_wire_conn(arc->source, arc->sink, false);
+        for (const auto &conn : update.fixed_conns) {
+            fixed_conns[conn.sink].insert(conn);
+            index_wire_conn(conn.source, conn.sink, true);
+        }
+        return true;
+    }, entries.str());
 }
 
 void TileBitDatabase::add_fixed_conn(const Trellis::FixedConnection &conn)
@@ -712,8 +1508,12 @@ void TileBitDatabase::add_fixed_conn(const Trellis::FixedConnection &conn)
 #ifndef NO_THREADS
     boost::lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    fixed_conns[conn.sink].insert(conn);
-    dirty = true;
+    journal_change([&]() {
+        if (!fixed_conns[conn.sink].insert(conn).second)
+            return false;
+        index_wire_conn(conn.source, conn.sink, true);
+        return true;
+    }, fmt(conn << endl));
 }
 
 TileBitDatabase::TileBitDatabase(const TileBitDatabase &other)
@@ -728,7 +1528,17 @@ void TileBitDatabase::remove_fixed_sink(const string &sink)
 #ifndef NO_THREADS
     boost::lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    fixed_conns.erase(sink);
+    journal_change([&]() {
+        auto found = fixed_conns.find(sink);
+        if (found == fixed_conns.end())
+            return false;
+        for (const auto &conn : found->second) {
+            downhill_index.at(conn.source).erase(make_pair(true, conn.sink));
+            uphill_index.at(sink).erase(make_pair(true, conn.source));
+        }
+        fixed_conns.erase(found);
+        return true;
+    }, fmt(".remove_fixed_sink " << sink << endl));
 }
 
 void TileBitDatabase::remove_setting_enum(const string &enum_name)
@@ -736,7 +1546,12 @@ void TileBitDatabase::remove_setting_enum(const string &enum_name)
 #ifndef NO_THREADS
     boost::lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    enums.erase(enum_name);
+    journal_change([&]() {
+        if (!enums.erase(enum_name))
+            return false;
+        invalidate_symbolic_index();
+        return true;
+    }, fmt(".remove_config_enum " << enum_name << endl));
 }
 
 void TileBitDatabase::remove_setting_word(const string &word_name)
@@ -744,7 +1559,12 @@ void TileBitDatabase::remove_setting_word(const string &word_name)
 #ifndef NO_THREADS
     boost::lock_guard<boost::shared_mutex> guard(db_mutex);
 #endif
-    words.erase(word_name);
+    journal_change([&]() {
+        if (!words.erase(word_name))
+            return false;
+        invalidate_symbolic_index();
+        return true;
+    }, fmt(".remove_config " << word_name << endl));
 }
 
 DatabaseConflictError::DatabaseConflictError(const string &desc) : runtime_error(desc)
@@ -752,8 +1572,14 @@ DatabaseConflictError::DatabaseConflictError(const string &desc) : runtime_error
 
 TileBitDatabase::~TileBitDatabase()
 {
-    if (dirty)
+    if (!dirty)
+        return;
+    try {
         save();
+    } catch (const exception &e) {
+        // Nothing is lost, as the changes remain in the journal
+        TRELLIS_LOG(VerbosityLevel::ERROR, "bitdb", "failed to compact tilebit database " << filename << ": " << e.what());
+    }
 }
 
 }
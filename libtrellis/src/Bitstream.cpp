@@ -1,5 +1,9 @@
 #include "Bitstream.hpp"
 #include "Chip.hpp"
+#include "Database.hpp"
+#include "Log.hpp"
+#include "PackCache.hpp"
+#include "Profile.hpp"
 #include "Util.hpp"
 #include <sstream>
 #include <cstring>
@@ -11,6 +15,7 @@
 #include <fstream>
 #include <array>
 #include <queue>
+#include <set>
 namespace Trellis {
 
 static const uint16_t CRC16_POLY = 0x8005;
@@ -36,8 +41,10 @@ static const uint32_t background_flag = 0x2E000000;
 // these options and provides defaults that mimic Diamond-generated output.
 class BitstreamOptions {
 public:
-    BitstreamOptions(const Chip &chip) {
-      if (chip.info.family == "MachXO2") {
+    BitstreamOptions(const Chip &chip) : BitstreamOptions(chip.info) {};
+
+    BitstreamOptions(const ChipInfo &info) {
+      if (info.family == "MachXO2") {
           // Write frames out in order 0 => max or reverse (max => 0).
           reversed_frames = false;
           dummy_bytes_after_preamble = 2;
@@ -49,7 +56,7 @@ public:
           crc_after_each_frame = false;
           dummy_bytes_after_frame = 0;
           security_sed_space = 8;
-      } else if (chip.info.family == "ECP5") {
+      } else if (info.family == "ECP5") {
           reversed_frames = true;
           dummy_bytes_after_preamble = 4;
           crc_meta = 0x91; // CRC check (0x80), per frame (bit 6 cleared),
@@ -58,7 +65,7 @@ public:
           dummy_bytes_after_frame = 1;
           security_sed_space = 12;
       } else
-          throw runtime_error("Unknown chip family: " + chip.info.family);
+          throw runtime_error("Unknown chip family: " + info.family);
     };
 
     bool reversed_frames;
@@ -77,13 +84,21 @@ public:
 
     BitstreamReadWriter(const vector<uint8_t> &data) : data(data), iter(this->data.begin()) {};
 
+    ~BitstreamReadWriter() {
+        // The CRC is updated a byte at a time as data is read or written, which is too fine-grained to time
+        Profile::add_count("bitstream.crc_bytes", crc_bytes);
+        Profile::add_count("bitstream.crc_checks", crc_checks);
+    }
+
     vector<uint8_t> data;
     vector<uint8_t>::iterator iter;
 
     uint16_t crc16 = CRC16_INIT;
+    uint64_t crc_bytes = 0, crc_checks = 0;
 
     // Add a single byte to the running CRC16 accumulator
     void update_crc16(uint8_t val) {
+        crc_bytes++;
         int bit_flag;
         for (int i = 7; i >= 0; i--) {
             bit_flag = crc16 >> 15;
@@ -236,7 +251,71 @@ public:
         }
     }
 
-    void write_compressed_frames(const std::vector<std::vector<uint8_t>> &frames_in, BitstreamOptions &ops) {
+    // Compress one frame, padded with zero bytes to a multiple of 64 bits, into out
+    void compress_frame(const std::vector<uint8_t> &fr, const uint8_t dict_entries[8], std::vector<uint8_t> &out) {
+        out.clear();
+        // For writing a stream of bits
+        uint8_t buffer = 0;
+        int bits_in_buffer = 0;
+        auto flush_bits = [&]() {
+            if (bits_in_buffer != 0) {
+                out.push_back(buffer);
+                buffer = 0;
+                bits_in_buffer = 0;
+            }
+        };
+        auto add_bit = [&](bool bit) {
+            if (bit)
+                buffer |= (1 << (7 - bits_in_buffer));
+            bits_in_buffer++;
+            if (bits_in_buffer == 8)
+                flush_bits();
+        };
+        auto add_bits = [&](uint32_t x, int len) {
+            for (int i = len-1; i >= 0; i--)
+                add_bit((x & (1 << i)) != 0);
+        };
+        // Add zero bytes (represented by zero bits in the bitstream)
+        // to pad frame to 64 bits
+        int frame_bytes = int(fr.size());
+        if ((frame_bytes % 8) != 0)
+            for (int i = 0; i < (8 - (frame_bytes % 8)); i++)
+                add_bit(0);
+        // Process bytes of frames
+        for (auto b : fr) {
+            if (b == 0) {
+                add_bit(0); // 0 bit -> 0 byte
+                continue;
+            }
+            int oh = decode_onehot(b);
+            if (oh != -1) {
+                add_bits(0b100, 3); // 0b100xxx -> only bit xxx set in byte
+                add_bits(oh, 3);
+                continue;
+            }
+            // Search dictionary
+            for (int j = 0; j < 8; j++)
+                if (dict_entries[j] == b) {
+                    add_bits(0b101, 3); // 0b101xxx -> dictionary entry xxx
+                    add_bits(j, 3);
+                    goto dict_found;
+                }
+            if (false) {
+            dict_found:
+                continue;
+            }
+            // Uncompressable byte; use literal
+            add_bits(0b11, 2); // 0b11xxxxxxxx -> literal byte
+            add_bits(b, 8);
+        }
+        // This ensures compressed frame is 8-bit aligned
+        flush_bits();
+    }
+
+    void write_compressed_frames(const std::vector<std::vector<uint8_t>> &frames_in, BitstreamOptions &ops,
+                                 PackCache *cache) {
+        Profile::Timer timer("bitstream.compress_frames");
+        Profile::add_count("bitstream.compressed_frames", frames_in.size());
         // Build a histogram of bytes to aid creating the dictionary
         int histogram[256];
         for (int i = 0; i < 256; i++)
@@ -265,63 +344,19 @@ public:
         write_byte(uint8_t((frames >> 8) & 0xFF));
         write_byte(uint8_t(frames & 0xFF));
 
-        // For writing a stream of bits
-        uint8_t buffer = 0;
-        int bits_in_buffer = 0;
-        auto flush_bits = [&]() {
-            if (bits_in_buffer != 0) {
-                write_byte(buffer);
-                buffer = 0;
-                bits_in_buffer = 0;
-            }
-        };
-        auto add_bit = [&](bool bit) {
-            if (bit)
-                buffer |= (1 << (7 - bits_in_buffer));
-            bits_in_buffer++;
-            if (bits_in_buffer == 8)
-                flush_bits();
-        };
-        auto add_bits = [&](uint32_t x, int len) {
-            for (int i = len-1; i >= 0; i--)
-                add_bit((x & (1 << i)) != 0);
-        };
-        // Add zero bytes (represented by zero bits in the bitstream)
-        // to pad frame to 64 bits
+        std::array<uint8_t, 8> dict;
+        std::copy(dict_entries, dict_entries + 8, dict.begin());
+        std::vector<uint8_t> compressed;
         for (auto &fr : frames_in) {
-            int frame_bytes = int(fr.size());
-            if ((frame_bytes % 8) != 0)
-                for (int i = 0; i < (8 - (frame_bytes % 8)); i++)
-                    add_bit(0);
-            // Process bytes of frames
-            for (auto b : fr) {
-                if (b == 0) {
-                    add_bit(0); // 0 bit -> 0 byte
-                    continue;
-                }
-                int oh = decode_onehot(b);
-                if (oh != -1) {
-                    add_bits(0b100, 3); // 0b100xxx -> only bit xxx set in byte
-                    add_bits(oh, 3);
-                    continue;
-                }
-                // Search dictionary
-                for (int j = 0; j < 8; j++)
-                    if (dict_entries[j] == b) {
-                        add_bits(0b101, 3); // 0b101xxx -> dictionary entry xxx
-                        add_bits(j, 3);
-                        goto dict_found;
-                    }
-                if (false) {
-                dict_found:
-                    continue;
-                }
-                // Uncompressable byte; use literal
-                add_bits(0b11, 2); // 0b11xxxxxxxx -> literal byte
-                add_bits(b, 8);
+            // Every compressed frame starts and ends byte aligned, so frames compress independently of each other
+            const std::vector<uint8_t> *cached = cache ? cache->find_compressed_frame(dict, fr) : nullptr;
+            if (cached == nullptr) {
+                compress_frame(fr, dict_entries, compressed);
+                if (cache)
+                    cache->add_compressed_frame(dict, fr, compressed);
+                cached = &compressed;
             }
-            // This ensures compressed frame is 8-bit aligned
-            flush_bits();
+            write_bytes(cached->begin(), cached->size());
             // Post-frame CRC and 0xFF byte
             if(ops.crc_after_each_frame) {
                 insert_crc16();
@@ -382,6 +417,7 @@ public:
     }
 
     uint16_t finalise_crc16() {
+        crc_checks++;
         // item b) "push out" the last 16 bits
         int i;
         bool bit_flag;
@@ -439,6 +475,7 @@ public:
 Bitstream::Bitstream(const vector<uint8_t> &data, const vector<string> &metadata) : data(data), metadata(metadata) {}
 
 Bitstream Bitstream::read_bit(istream &in) {
+    Profile::Timer timer("bitstream.read_bit");
     vector<uint8_t> bytes;
     vector<string> meta;
     auto hdr1 = uint8_t(in.get());
@@ -466,9 +503,8 @@ Bitstream Bitstream::read_bit(istream &in) {
     return Bitstream(bytes, meta);
 }
 
-// TODO: replace these macros with something more flexible
-#define BITSTREAM_DEBUG(x) if (verbosity >= VerbosityLevel::DEBUG) cerr << "bitstream: " << x << endl
-#define BITSTREAM_NOTE(x) if (verbosity >= VerbosityLevel::NOTE) cerr << "bitstream: " << x << endl
+#define BITSTREAM_DEBUG(x) TRELLIS_LOG(VerbosityLevel::DEBUG, "bitstream", x)
+#define BITSTREAM_NOTE(x) TRELLIS_LOG(VerbosityLevel::NOTE, "bitstream", x)
 #define BITSTREAM_FATAL(x, pos) { ostringstream ss; ss << x; throw BitstreamParseError(ss.str(), pos); }
 
 static const vector<uint8_t> preamble = {0xFF, 0xFF, 0xBD, 0xB3};
@@ -477,11 +513,51 @@ Chip Bitstream::deserialise_chip() {
     return deserialise_chip(boost::none);
 }
 
-Chip Bitstream::deserialise_chip(boost::optional<uint32_t> idcode) {
-    cerr << "bitstream size: " << data.size() * 8 << " bits" << endl;
+// An LSC_EBR_WRITE command found in a bitstream
+struct EbrWriteBlock {
+    size_t data_offset; // offset of the first 72-bit frame
+    int frame_count;
+    uint16_t first_ebr;
+    int first_addr;
+    uint16_t crc_before_data; // CRC16 accumulator before the frame data, for recalculating the CRC after patching
+};
+
+// Receives the commands of a bitstream from walk_bitstream, which deals with opcodes, parameters and CRCs. Each
+// visitor only overrides the commands it needs
+class BitstreamVisitor {
+public:
+    virtual ~BitstreamVisitor() = default;
+
+    // The device ID from VERIFY_ID. Returns the device, whose frame geometry is needed to read configuration frames
+    virtual const ChipInfo &verify_id(uint32_t id) = 0;
+
+    virtual void control_reg0(uint32_t cfg) { UNUSED(cfg); };
+
+    virtual void usercode(uint32_t uc) { UNUSED(uc); };
+
+    virtual void program_done() {};
+
+    virtual void program_security() {};
+
+    virtual void spi_mode(const string &mode) { UNUSED(mode); };
+
+    // Start of frame_count configuration frames, each followed by dummy_bytes dummy bytes
+    virtual void config_frames(size_t frame_count, size_t dummy_bytes) { UNUSED(frame_count); UNUSED(dummy_bytes); };
+
+    // A configuration frame, with its index in the CRAM and its bytes as stored (after decompression)
+    virtual void config_frame(size_t idx, const uint8_t *bytes, size_t size) { UNUSED(idx); UNUSED(bytes); UNUSED(size); };
+
+    virtual void ebr_address(uint16_t ebr, int addr) { UNUSED(ebr); UNUSED(addr); };
+
+    // An EBR write, whose frames are at block.data_offset in the bitstream
+    virtual void ebr_write(const EbrWriteBlock &block) { UNUSED(block); };
+};
+
+// Walk the commands of a bitstream, checking CRCs, and pass them to a visitor
+static void walk_bitstream(const vector<uint8_t> &data, BitstreamVisitor &visitor) {
     BitstreamReadWriter rd(data);
-    boost::optional<Chip> chip;
     bool found_preamble = rd.find_preamble(preamble);
+    const ChipInfo *info = nullptr;
     boost::optional<array<uint8_t, 8>> compression_dict;
 
     if (!found_preamble)
@@ -501,37 +577,29 @@ Chip Bitstream::deserialise_chip(boost::optional<uint32_t> idcode) {
             case BitstreamCommand::VERIFY_ID: {
                 rd.skip_bytes(3);
                 uint32_t id = rd.get_uint32();
-                if (idcode) {
-                    BITSTREAM_NOTE("Overriding device ID from 0x" << hex << setw(8) << setfill('0') << id << " to 0x" << *idcode);
-                    id = *idcode;
-                }
-
-                BITSTREAM_NOTE("device ID: 0x" << hex << setw(8) << setfill('0') << id);
-                chip = boost::make_optional(Chip(id));
-                chip->metadata = metadata;
+                info = &visitor.verify_id(id);
             }
                 break;
             case BitstreamCommand::LSC_PROG_CNTRL0: {
                 rd.skip_bytes(3);
                 uint32_t cfg = rd.get_uint32();
-                chip->ctrl0 = cfg;
                 BITSTREAM_DEBUG("set control reg 0 to 0x" << hex << setw(8) << setfill('0') << cfg);
+                visitor.control_reg0(cfg);
             }
                 break;
             case BitstreamCommand::ISC_PROGRAM_DONE:
                 rd.skip_bytes(3);
-                BITSTREAM_NOTE("program DONE");
+                visitor.program_done();
                 break;
             case BitstreamCommand::ISC_PROGRAM_SECURITY:
                 rd.skip_bytes(3);
-                BITSTREAM_NOTE("program SECURITY");
+                visitor.program_security();
                 break;
             case BitstreamCommand::ISC_PROGRAM_USERCODE: {
                 bool check_crc = (rd.get_byte() & 0x80) != 0;
                 rd.skip_bytes(2);
                 uint32_t uc = rd.get_uint32();
-                BITSTREAM_NOTE("set USERCODE to 0x" << hex << setw(8) << setfill('0') << uc);
-                chip->usercode = uc;
+                visitor.usercode(uc);
                 if (check_crc)
                     rd.check_crc16();
             }
@@ -570,10 +638,10 @@ Chip Bitstream::deserialise_chip(boost::optional<uint32_t> idcode) {
                 // fall through
             case BitstreamCommand::LSC_PROG_INCR_RTI: {
                 // This is the main bitstream payload
-                if (!chip)
+                if (info == nullptr)
                     throw BitstreamParseError("start of bitstream data before chip was identified", rd.get_offset());
 
-                BitstreamOptions ops(chip.get()); // Only reversed_frames is meaningful here.
+                BitstreamOptions ops(*info); // Only reversed_frames is meaningful here.
 
                 uint8_t params[3];
                 rd.get_bytes(params, 3);
@@ -589,26 +657,24 @@ Chip Bitstream::deserialise_chip(boost::optional<uint32_t> idcode) {
                 // bool include_dummy_bytes = params[0] & 0x10U;
                 size_t dummy_bytes = params[0] & 0x0FU;
                 size_t frame_count = (params[1] << 8U) | params[2];
-                BITSTREAM_NOTE("reading " << std::dec << frame_count << " config frames (with " << std::dec << dummy_bytes << " dummy bytes)");
-                size_t bytes_per_frame = (chip->info.bits_per_frame + chip->info.pad_bits_after_frame +
-                                          chip->info.pad_bits_before_frame) / 8U;
+                visitor.config_frames(frame_count, dummy_bytes);
+                size_t bytes_per_frame = (info->bits_per_frame + info->pad_bits_after_frame +
+                                          info->pad_bits_before_frame) / 8U;
                 // If compressed 0 bits are added to the stream before compression to make it 64 bit bounded, so
                 // we should consider that space here but they shouldn't be copied to the output
                 if (cmd == BitstreamCommand::LSC_PROG_INCR_CMP)
                     bytes_per_frame += (7 - ((bytes_per_frame - 1) % 8));
                 unique_ptr<uint8_t[]> frame_bytes = make_unique<uint8_t[]>(bytes_per_frame);
+                Profile::Timer frames_timer(cmd == BitstreamCommand::LSC_PROG_INCR_CMP ?
+                                            "bitstream.decompress_frames" : "bitstream.read_frames");
+                Profile::add_count("bitstream.frames_read", frame_count);
                 for (size_t i = 0; i < frame_count; i++) {
-                    size_t idx = ops.reversed_frames ? (chip->info.num_frames - 1) - i : i;
+                    size_t idx = ops.reversed_frames ? (info->num_frames - 1) - i : i;
                     if (cmd == BitstreamCommand::LSC_PROG_INCR_CMP)
                         rd.get_compressed_bytes(frame_bytes.get(), bytes_per_frame, compression_dict.get());
                     else
                         rd.get_bytes(frame_bytes.get(), bytes_per_frame);
-
-                    for (int j = 0; j < chip->info.bits_per_frame; j++) {
-                        size_t ofs = j + chip->info.pad_bits_after_frame;
-                        chip->cram.bit(idx, j) = (char)
-                            ((frame_bytes[(bytes_per_frame - 1) - (ofs / 8)] >> (ofs % 8)) & 0x01);
-                    }
+                    visitor.config_frame(idx, frame_bytes.get(), bytes_per_frame);
                     if (crc_after_each_frame || (check_crc && (i == frame_count-1)))
                       rd.check_crc16();
                     rd.skip_bytes(dummy_bytes);
@@ -617,42 +683,36 @@ Chip Bitstream::deserialise_chip(boost::optional<uint32_t> idcode) {
                 break;
             case BitstreamCommand::LSC_EBR_ADDRESS: {
                 rd.skip_bytes(3);
-                uint32_t data = rd.get_uint32();
-                current_ebr = (data >> 11) & 0x3FF;
-                addr_in_ebr = data & 0x7FF;
-                chip->bram_data[current_ebr].resize(2048);
+                uint32_t addr = rd.get_uint32();
+                current_ebr = (addr >> 11) & 0x3FF;
+                addr_in_ebr = addr & 0x7FF;
+                visitor.ebr_address(current_ebr, addr_in_ebr);
             }
                 break;
             case BitstreamCommand::LSC_EBR_WRITE: {
                 uint8_t params[3];
                 rd.get_bytes(params, 3);
-                int frame_count = (params[1] << 8U) | params[2];
-                int frames_read = 0;
-
-                while (frames_read < frame_count) {
-
-                    if (addr_in_ebr >= 2048) {
-                        addr_in_ebr = 0;
-                        current_ebr++;
-                        chip->bram_data[current_ebr].resize(2048);
-                    }
-
-                    auto &ebr = chip->bram_data[current_ebr];
-                    frames_read++;
-                    uint8_t frame[9];
-                    rd.get_bytes(frame, 9);
-                    ebr.at(addr_in_ebr+0) = (frame[0] << 1)        | (frame[1] >> 7);
-                    ebr.at(addr_in_ebr+1) = (frame[1] & 0x7F) << 2 | (frame[2] >> 6);
-                    ebr.at(addr_in_ebr+2) = (frame[2] & 0x3F) << 3 | (frame[3] >> 5);
-                    ebr.at(addr_in_ebr+3) = (frame[3] & 0x1F) << 4 | (frame[4] >> 4);
-                    ebr.at(addr_in_ebr+4) = (frame[4] & 0x0F) << 5 | (frame[5] >> 3);
-                    ebr.at(addr_in_ebr+5) = (frame[5] & 0x07) << 6 | (frame[6] >> 2);
-                    ebr.at(addr_in_ebr+6) = (frame[6] & 0x03) << 7 | (frame[7] >> 1);
-                    ebr.at(addr_in_ebr+7) = (frame[7] & 0x01) << 8 | frame[8];
-                    addr_in_ebr += 8;
-
+                EbrWriteBlock block;
+                block.frame_count = (params[1] << 8U) | params[2];
+                block.data_offset = rd.get_offset();
+                block.crc_before_data = rd.crc16;
+                // Writes carry on into the next EBR past the end of the current one
+                if (block.frame_count > 0 && addr_in_ebr >= 2048) {
+                    addr_in_ebr = 0;
+                    current_ebr++;
                 }
+                block.first_ebr = current_ebr;
+                block.first_addr = addr_in_ebr;
+                if (size_t(block.frame_count) * 9 + 2 > data.size() - block.data_offset)
+                    throw BitstreamParseError("EBR data runs past end of bitstream", block.data_offset);
+                rd.skip_bytes(size_t(block.frame_count) * 9);
                 rd.check_crc16();
+                if (block.frame_count > 0) {
+                    int end = addr_in_ebr + 8 * block.frame_count;
+                    current_ebr += uint16_t((end - 1) / 2048);
+                    addr_in_ebr = end - 2048 * ((end - 1) / 2048);
+                }
+                visitor.ebr_write(block);
             }
                 break;
             case BitstreamCommand::SPI_MODE: {
@@ -666,7 +726,7 @@ Chip Bitstream::deserialise_chip(boost::optional<uint32_t> idcode) {
                 if (spimode == spi_modes.end())
                     throw runtime_error("bad SPI mode" + std::to_string(spi_mode));
 
-                BITSTREAM_NOTE("SPI Mode " <<  spimode->first);
+                visitor.spi_mode(spimode->first);
             }
                 break;
             case BitstreamCommand::JUMP:
@@ -681,13 +741,211 @@ Chip Bitstream::deserialise_chip(boost::optional<uint32_t> idcode) {
                                      rd.get_offset());
         }
     }
-    if (chip) {
-        return *chip;
+}
+
+// Call func(ebr, addr, frame) for each 72-bit frame of an EBR write, where frame points at its 9 bytes in data
+template <typename T, typename F>
+static void for_each_ebr_frame(const EbrWriteBlock &block, T *data, F func) {
+    uint16_t ebr = block.first_ebr;
+    int addr = block.first_addr;
+    for (int i = 0; i < block.frame_count; i++) {
+        if (addr >= 2048) {
+            addr = 0;
+            ebr++;
+        }
+        func(ebr, addr, data + block.data_offset + 9 * size_t(i));
+        addr += 8;
+    }
+}
+
+// Unpack the eight 9-bit values of a 72-bit EBR frame into values, starting at addr
+static void unpack_ebr_frame(const uint8_t *frame, vector<uint16_t> &values, int addr) {
+    values.at(addr+0) = (frame[0] << 1)        | (frame[1] >> 7);
+    values.at(addr+1) = (frame[1] & 0x7F) << 2 | (frame[2] >> 6);
+    values.at(addr+2) = (frame[2] & 0x3F) << 3 | (frame[3] >> 5);
+    values.at(addr+3) = (frame[3] & 0x1F) << 4 | (frame[4] >> 4);
+    values.at(addr+4) = (frame[4] & 0x0F) << 5 | (frame[5] >> 3);
+    values.at(addr+5) = (frame[5] & 0x07) << 6 | (frame[6] >> 2);
+    values.at(addr+6) = (frame[6] & 0x03) << 7 | (frame[7] >> 1);
+    values.at(addr+7) = (frame[7] & 0x01) << 8 | frame[8];
+}
+
+// Builds a Chip from the whole of a bitstream
+class ChipReader : public BitstreamVisitor {
+public:
+    ChipReader(const vector<uint8_t> &data, const vector<string> &metadata, boost::optional<uint32_t> idcode)
+            : data(data), metadata(metadata), idcode(idcode) {};
+
+    const ChipInfo &verify_id(uint32_t id) override {
+        if (idcode) {
+            BITSTREAM_NOTE("Overriding device ID from 0x" << hex << setw(8) << setfill('0') << id << " to 0x" << *idcode);
+            id = *idcode;
+        }
+
+        BITSTREAM_NOTE("device ID: 0x" << hex << setw(8) << setfill('0') << id);
+        chip = boost::make_optional(Chip(id));
+        chip->metadata = metadata;
+        return chip->info;
+    }
+
+    void control_reg0(uint32_t cfg) override {
+        chip->ctrl0 = cfg;
+    }
+
+    void usercode(uint32_t uc) override {
+        BITSTREAM_NOTE("set USERCODE to 0x" << hex << setw(8) << setfill('0') << uc);
+        chip->usercode = uc;
+    }
+
+    void program_done() override {
+        BITSTREAM_NOTE("program DONE");
+    }
+
+    void program_security() override {
+        BITSTREAM_NOTE("program SECURITY");
+    }
+
+    void spi_mode(const string &mode) override {
+        BITSTREAM_NOTE("SPI Mode " <<  mode);
+    }
+
+    void config_frames(size_t frame_count, size_t dummy_bytes) override {
+        BITSTREAM_NOTE("reading " << std::dec << frame_count << " config frames (with " << std::dec << dummy_bytes << " dummy bytes)");
+    }
+
+    void config_frame(size_t idx, const uint8_t *bytes, size_t size) override {
+        for (int j = 0; j < chip->info.bits_per_frame; j++) {
+            size_t ofs = j + chip->info.pad_bits_after_frame;
+            chip->cram.bit(idx, j) = (char) ((bytes[(size - 1) - (ofs / 8)] >> (ofs % 8)) & 0x01);
+        }
+    }
+
+    void ebr_address(uint16_t ebr, int) override {
+        chip->bram_data[ebr].resize(2048);
+    }
+
+    void ebr_write(const EbrWriteBlock &block) override {
+        for_each_ebr_frame(block, data.data(), [&](uint16_t ebr, int addr, const uint8_t *frame) {
+            auto &values = chip->bram_data[ebr];
+            values.resize(2048);
+            unpack_ebr_frame(frame, values, addr);
+        });
+    }
+
+    boost::optional<Chip> chip;
+
+private:
+    const vector<uint8_t> &data;
+    const vector<string> &metadata;
+    boost::optional<uint32_t> idcode;
+};
+
+Chip Bitstream::deserialise_chip(boost::optional<uint32_t> idcode) {
+    Profile::Timer timer("bitstream.deserialise_chip");
+    BITSTREAM_DEBUG("size: " << data.size() * 8 << " bits");
+    ChipReader reader(data, metadata, idcode);
+    walk_bitstream(data, reader);
+    if (reader.chip) {
+        return *reader.chip;
     } else {
         throw BitstreamParseError("failed to parse bitstream, no valid payload found");
     }
 }
 
+// Finds the EBR writes of a bitstream. This only needs the frame geometry from the device database; configuration
+// frames are read to check CRCs, then discarded
+class EbrWriteFinder : public BitstreamVisitor {
+public:
+    explicit EbrWriteFinder(boost::optional<uint32_t> idcode) : idcode(idcode) {};
+
+    const ChipInfo &verify_id(uint32_t id) override {
+        info = get_chip_info(find_device_by_idcode(idcode ? *idcode : id));
+        return *info;
+    }
+
+    void ebr_write(const EbrWriteBlock &block) override {
+        blocks.push_back(block);
+    }
+
+    vector<EbrWriteBlock> blocks;
+
+private:
+    boost::optional<uint32_t> idcode;
+    boost::optional<ChipInfo> info;
+};
+
+static vector<EbrWriteBlock> find_ebr_writes(const vector<uint8_t> &data, boost::optional<uint32_t> idcode) {
+    EbrWriteFinder finder(idcode);
+    walk_bitstream(data, finder);
+    return finder.blocks;
+}
+
+map<uint16_t, vector<uint16_t>> Bitstream::get_bram_data(boost::optional<uint32_t> idcode) const {
+    map<uint16_t, vector<uint16_t>> bram_data;
+    for (const auto &block : find_ebr_writes(data, idcode)) {
+        for_each_ebr_frame(block, data.data(), [&](uint16_t ebr, int addr, const uint8_t *frame) {
+            auto &values = bram_data[ebr];
+            values.resize(2048);
+            unpack_ebr_frame(frame, values, addr);
+        });
+    }
+    return bram_data;
+}
+
+int Bitstream::patch_bram_data(const map<uint16_t, vector<uint16_t>> &bram_data, boost::optional<uint32_t> idcode) {
+    vector<EbrWriteBlock> blocks = find_ebr_writes(data, idcode);
+    set<uint16_t> found;
+    for (const auto &block : blocks)
+        for_each_ebr_frame(block, data.data(), [&](uint16_t ebr, int, const uint8_t *) { found.insert(ebr); });
+    // Check everything before changing any frames, so that a bad argument can't leave the bitstream half patched
+    for (const auto &ebr : bram_data) {
+        if (!found.count(ebr.first))
+            throw runtime_error(fmt("BRAM " << ebr.first << " is not initialised by the bitstream, so cannot be patched"));
+        if (ebr.second.size() != 2048)
+            throw runtime_error(fmt("BRAM " << ebr.first << " data has " << ebr.second.size()
+                                            << " entries, expected 2048"));
+    }
+
+    int changed_blocks = 0;
+    for (const auto &block : blocks) {
+        bool changed = false;
+        for_each_ebr_frame(block, data.data(), [&](uint16_t ebr, int addr, uint8_t *frame) {
+            auto found_ebr = bram_data.find(ebr);
+            if (found_ebr == bram_data.end())
+                return;
+            const auto &values = found_ebr->second;
+            uint8_t new_frame[9];
+            new_frame[0] = values.at(addr+0) >> 1;
+            new_frame[1] = (values.at(addr+0) & 0x01) << 7 | (values.at(addr+1) >> 2);
+            new_frame[2] = (values.at(addr+1) & 0x03) << 6 | (values.at(addr+2) >> 3);
+            new_frame[3] = (values.at(addr+2) & 0x07) << 5 | (values.at(addr+3) >> 4);
+            new_frame[4] = (values.at(addr+3) & 0x0F) << 4 | (values.at(addr+4) >> 5);
+            new_frame[5] = (values.at(addr+4) & 0x1F) << 3 | (values.at(addr+5) >> 6);
+            new_frame[6] = (values.at(addr+5) & 0x3F) << 2 | (values.at(addr+6) >> 7);
+            new_frame[7] = (values.at(addr+6) & 0x7F) << 1 | (values.at(addr+7) >> 8);
+            new_frame[8] = values.at(addr+7);
+            if (memcmp(frame, new_frame, 9) != 0) {
+                memcpy(frame, new_frame, 9);
+                changed = true;
+            }
+        });
+        if (!changed)
+            continue;
+        // The CRC following the EBR data covers everything since the previous CRC, so carry on from the
+        // accumulator as it was before the data
+        BitstreamReadWriter crc;
+        crc.crc16 = block.crc_before_data;
+        size_t crc_offset = block.data_offset + 9 * size_t(block.frame_count);
+        for (size_t i = block.data_offset; i < crc_offset; i++)
+            crc.update_crc16(data.at(i));
+        uint16_t new_crc = crc.finalise_crc16();
+        data.at(crc_offset) = uint8_t((new_crc >> 8) & 0xFF);
+        data.at(crc_offset + 1) = uint8_t(new_crc & 0xFF);
+        changed_blocks++;
+    }
+    return changed_blocks;
+}
+
 Bitstream Bitstream::generate_jump(uint32_t address) {
     BitstreamReadWriter wr;
 
@@ -722,7 +980,8 @@ Bitstream Bitstream::serialise_chip_py(const Chip &chip) {
     return serialise_chip(chip, map<string, string>());
 }
 
-Bitstream Bitstream::serialise_chip(const Chip &chip, const map<string, string> options) {
+Bitstream Bitstream::serialise_chip(const Chip &chip, const map<string, string> options, PackCache *cache) {
+    Profile::Timer timer("bitstream.serialise_chip");
     BitstreamReadWriter wr;
 
     BitstreamOptions ops(chip);
@@ -806,7 +1065,7 @@ Bitstream Bitstream::serialise_chip(const Chip &chip, const map<string, string>
             }
         }
         // Then compress and write
-        wr.write_compressed_frames(frames_data, ops);
+        wr.write_compressed_frames(frames_data, ops, cache);
     } else {
         // Bitstream data
         wr.write_byte(uint8_t(BitstreamCommand::LSC_PROG_INCR_RTI));
@@ -910,6 +1169,7 @@ Bitstream Bitstream::serialise_chip_delta_py(const Chip &chip1, const Chip &chip
 
 Bitstream Bitstream::serialise_chip_partial(const Chip &chip, const vector<uint32_t> &frames, const map<string, string> options)
 {
+    Profile::Timer timer("bitstream.serialise_chip_partial");
     BitstreamReadWriter wr;
 
     // Address encoding for partial frame writes
@@ -1001,6 +1261,7 @@ Bitstream Bitstream::serialise_chip_partial(const Chip &chip, const vector<uint3
 }
 
 void Bitstream::write_bit(ostream &out) {
+    Profile::Timer timer("bitstream.write_bit");
     // Write metadata header
     out.put(char(0xFF));
     out.put(0x00);
@@ -1,5 +1,7 @@
 #include "CRAM.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <stdexcept>
 
 namespace Trellis {
@@ -34,11 +36,49 @@ void CRAMView::clear() {
     }
 }
 
+void CRAMView::get_bits(uint8_t *dest) const {
+    for (int i = 0; i < frame_count; i++) {
+        const auto &frame = cram_data->at(frame_offset + i);
+        if (bit_offset + bit_count > int(frame.size()))
+            throw out_of_range("CRAMView extends past end of frame");
+        memcpy(dest + size_t(i) * bit_count, frame.data() + bit_offset, bit_count);
+    }
+}
+
+void CRAMView::set_bits(const uint8_t *src) {
+    for (int i = 0; i < frame_count; i++) {
+        auto &frame = cram_data->at(frame_offset + i);
+        if (bit_offset + bit_count > int(frame.size()))
+            throw out_of_range("CRAMView extends past end of frame");
+        memcpy(frame.data() + bit_offset, src + size_t(i) * bit_count, bit_count);
+    }
+}
+
+// Compare one frame of two equally sized views
+static bool frames_equal(const CRAMView &a, const CRAMView &b, int frame) {
+    if (a.bits() == 0)
+        return true;
+    const char *pa = &a.bit(frame, 0), *pb = &b.bit(frame, 0);
+    return pa == pb || equal(pa, pa + a.bits(), pb);
+}
+
+bool operator==(const CRAMView &a, const CRAMView &b) {
+    if ((a.bits() != b.bits()) || (a.frames() != b.frames()))
+        return false;
+    for (int i = 0; i < a.frames(); i++)
+        if (!frames_equal(a, b, i))
+            return false;
+    return true;
+}
+
 CRAMDelta operator-(const CRAMView &a, const CRAMView &b) {
     if ((a.bits() != b.bits()) || (a.frames() != b.frames()))
         throw runtime_error("cannot compare CRAMViews of different sizes");
     CRAMDelta delta;
     for (int i = 0; i < a.frames(); i++) {
+        // Most frames of a tile are unchanged, so skip those with a single comparison
+        if (frames_equal(a, b, i))
+            continue;
         for (int j = 0; j < b.bits(); j++) {
             if (a.bit(i, j) != b.bit(i, j)) {
                 delta.push_back(ChangedBit{i, j, int(a.bit(i, j)) - int(b.bit(i, j))});
@@ -48,6 +88,14 @@ CRAMDelta operator-(const CRAMView &a, const CRAMView &b) {
     return delta;
 }
 
+CRAMDelta CRAMDiff::to_delta() const {
+    CRAMDelta delta;
+    delta.reserve(size());
+    for (size_t i = 0; i < size(); i++)
+        delta.push_back(ChangedBit{frames.at(i), bits.at(i), deltas.at(i)});
+    return delta;
+}
+
 CRAM::CRAM(int frames, int bits) {
     data = make_shared<vector<vector<char>>>();
     data->resize(frames, vector<char>(bits));
@@ -69,8 +117,52 @@ int CRAM::frames() const { return int(data->size()); }
 
 int CRAM::bits() const { return int(data->at(0).size()); }
 
+void CRAM::get_bits(uint8_t *dest) const {
+    const size_t stride = bits();
+    for (size_t i = 0; i < data->size(); i++)
+        memcpy(dest + i * stride, data->at(i).data(), stride);
+}
+
+void CRAM::set_bits(const uint8_t *src) {
+    const size_t stride = bits();
+    for (size_t i = 0; i < data->size(); i++)
+        memcpy(data->at(i).data(), src + i * stride, stride);
+}
+
 CRAMView CRAM::make_view(int frame_offset, int bit_offset, int frame_count, int bit_count) {
     return CRAMView(data, frame_offset, bit_offset, frame_count, bit_count);
 }
 
+CRAMDiff diff_cram(const CRAM &a, const CRAM &b) {
+    if ((a.bits() != b.bits()) || (a.frames() != b.frames()))
+        throw runtime_error("cannot compare CRAMs of different sizes");
+    CRAMDiff diff;
+    const size_t bits = size_t(a.bits());
+    auto add_changes = [&](int frame, const char *pa, const char *pb, size_t start, size_t end) {
+        for (size_t j = start; j < end; j++) {
+            if (pa[j] != pb[j]) {
+                diff.frames.push_back(frame);
+                diff.bits.push_back(int(j));
+                diff.deltas.push_back(int8_t(int(pa[j]) - int(pb[j])));
+            }
+        }
+    };
+    for (int i = 0; i < a.frames(); i++) {
+        const char *pa = a.data->at(i).data(), *pb = b.data->at(i).data();
+        if (pa == pb || memcmp(pa, pb, bits) == 0)
+            continue;
+        // Bits are stored one per byte, so compare eight at a time and only look at single bits in words that differ
+        size_t j = 0;
+        for (; j + sizeof(uint64_t) <= bits; j += sizeof(uint64_t)) {
+            uint64_t wa, wb;
+            memcpy(&wa, pa + j, sizeof(uint64_t));
+            memcpy(&wb, pb + j, sizeof(uint64_t));
+            if (wa != wb)
+                add_changes(i, pa, pb, j, j + sizeof(uint64_t));
+        }
+        add_changes(i, pa, pb, j, bits);
+    }
+    return diff;
+}
+
 }
@@ -5,6 +5,7 @@
 #include "RoutingGraph.hpp"
 #include "BitDatabase.hpp"
 #include "Bels.hpp"
+#include "Profile.hpp"
 #include <algorithm>
 #include <iostream>
 using namespace std;
@@ -32,6 +33,8 @@ Chip::Chip(const Trellis::ChipInfo &info) : info(info), cram(info.num_frames, in
         }
         tiles_at_location.at(row).at(col).push_back(make_pair(tile.name, tile.type));
     }
+    for (const auto &tile : tiles)
+        tiles_by_type[tile.second->info.type].push_back(tile.first);
 
     if(info.family == "ECP5")
         global_data_ecp5 = get_global_info_ecp5(DeviceLocator{info.family, info.name});
@@ -49,10 +52,15 @@ shared_ptr<Tile> Chip::get_tile_by_name(string name)
 vector<shared_ptr<Tile>> Chip::get_tiles_by_position(int row, int col)
 {
     vector<shared_ptr<Tile>> result;
-    for (const auto &tile : tiles) {
-        if (tile.second->info.get_row_col() == make_pair(row, col))
-            result.push_back(tile.second);
-    }
+    if (row < 0 || row >= int(tiles_at_location.size()) || col < 0 || col >= int(tiles_at_location.at(row).size()))
+        return result;
+    // Return tiles in name order, like get_tiles_by_type
+    vector<string> names;
+    for (const auto &tile : tiles_at_location.at(row).at(col))
+        names.push_back(tile.first);
+    sort(names.begin(), names.end());
+    for (const auto &name : names)
+        result.push_back(tiles.at(name));
     return result;
 }
 
@@ -76,10 +84,11 @@ string Chip::get_tile_by_position_and_type(int row, int col, set<string> type) {
 vector<shared_ptr<Tile>> Chip::get_tiles_by_type(string type)
 {
     vector<shared_ptr<Tile>> result;
-    for (const auto &tile : tiles) {
-        if (tile.second->info.type == type)
-            result.push_back(tile.second);
-    }
+    auto found = tiles_by_type.find(type);
+    if (found == tiles_by_type.end())
+        return result;
+    for (const auto &name : found->second)
+        result.push_back(tiles.at(name));
     return result;
 }
 
@@ -105,16 +114,41 @@ int Chip::get_max_col() const
 ChipDelta operator-(const Chip &a, const Chip &b)
 {
     ChipDelta delta;
+    for (const auto &tile : diff_chips(a, b))
+        delta[tile.first] = tile.second.to_delta();
+    return delta;
+}
+
+CompactChipDelta diff_chips(const Chip &a, const Chip &b)
+{
+    CompactChipDelta delta;
+    const CRAMDiff diff = diff_cram(a.cram, b.cram);
+    if (diff.size() == 0)
+        return delta;
     for (const auto &tile : a.tiles) {
-        CRAMDelta cd = tile.second->cram - b.tiles.at(tile.first)->cram;
-        if (!cd.empty())
-            delta[tile.first] = cd;
+        const TileInfo &ti = tile.second->info;
+        const int frame_start = int(ti.frame_offset), frame_end = int(ti.frame_offset + ti.num_frames);
+        const int bit_start = int(ti.bit_offset), bit_end = int(ti.bit_offset + ti.bits_per_frame);
+        // The diff is sorted by frame, so only the changes in the tile's frames need to be checked
+        size_t i = size_t(lower_bound(diff.frames.begin(), diff.frames.end(), frame_start) - diff.frames.begin());
+        CRAMDiff *td = nullptr;
+        for (; i < diff.size() && diff.frames.at(i) < frame_end; i++) {
+            int bit = diff.bits.at(i);
+            if (bit < bit_start || bit >= bit_end)
+                continue;
+            if (td == nullptr)
+                td = &delta[tile.first];
+            td->frames.push_back(diff.frames.at(i) - frame_start);
+            td->bits.push_back(bit - bit_start);
+            td->deltas.push_back(diff.deltas.at(i));
+        }
     }
     return delta;
 }
 
 shared_ptr<RoutingGraph> Chip::get_routing_graph(bool include_lutperm_pips)
 {
+    Profile::Timer timer("chip.routing_graph");
     if(info.family == "ECP5") {
         return get_routing_graph_ecp5(include_lutperm_pips);
     } else if(info.family == "MachXO2") {
@@ -130,7 +164,7 @@ shared_ptr<RoutingGraph> Chip::get_routing_graph_ecp5(bool include_lutperm_pips)
     for (auto tile_entry : tiles) {
         shared_ptr<Tile> tile = tile_entry.second;
         //cout << "    Tile " << tile->info.name << endl;
-        shared_ptr<TileBitDatabase> bitdb = get_tile_bitdata(TileLocator{info.family, info.name, tile->info.type});
+        const shared_ptr<TileBitDatabase> &bitdb = get_tile_bitdata(tile->info);
         bitdb->add_routing(tile->info, *rg);
         int x, y;
         tie(y, x) = tile->info.get_row_col();
@@ -308,7 +342,7 @@ shared_ptr<RoutingGraph> Chip::get_routing_graph_machxo2()
     for (auto tile_entry : tiles) {
         shared_ptr<Tile> tile = tile_entry.second;
         //cout << "    Tile " << tile->info.name << endl;
-        shared_ptr<TileBitDatabase> bitdb = get_tile_bitdata(TileLocator{info.family, info.name, tile->info.type});
+        const shared_ptr<TileBitDatabase> &bitdb = get_tile_bitdata(tile->info);
         bitdb->add_routing(tile->info, *rg);
         int x, y;
         tie(y, x) = tile->info.get_row_col();
@@ -349,6 +383,48 @@ shared_ptr<RoutingGraph> Chip::get_routing_graph_machxo2()
     return rg;
 }
 
+void Chip::update_routing_graph(RoutingGraph &graph, const string &tiletype)
+{
+    // Other tiles sharing a location may contribute arcs with the same identifier, so every tile at an affected
+    // location is re-added, in the same order as get_routing_graph, so that the same arc wins
+    map<Location, set<ident_t>> affected;
+    for (const auto &tile_entry : tiles) {
+        if (tile_entry.second->info.type != tiletype)
+            continue;
+        int row, col;
+        tie(row, col) = tile_entry.second->info.get_row_col();
+        affected[Location(col, row)];
+    }
+    for (const auto &tile_entry : tiles) {
+        int row, col;
+        tie(row, col) = tile_entry.second->info.get_row_col();
+        auto found = affected.find(Location(col, row));
+        if (found != affected.end())
+            found->second.insert(graph.ident(tile_entry.second->info.type));
+    }
+
+    for (const auto &loc : affected) {
+        auto rt = graph.tiles.find(loc.first);
+        if (rt == graph.tiles.end())
+            continue;
+        vector<ident_t> stale;
+        for (const auto &arc : rt->second.arcs)
+            if (arc.second.lutperm_flags == 0 && loc.second.count(arc.second.tiletype))
+                stale.push_back(arc.first);
+        for (ident_t arc : stale)
+            graph.remove_arc(loc.first, arc);
+    }
+
+    for (const auto &tile_entry : tiles) {
+        const TileInfo &tinf = tile_entry.second->info;
+        int row, col;
+        tie(row, col) = tinf.get_row_col();
+        if (!affected.count(Location(col, row)))
+            continue;
+        get_tile_bitdata(tinf)->add_routing(tinf, graph);
+    }
+}
+
 // Global network funcs
 
 bool GlobalRegion::matches(int row, int col) const {
@@ -3,120 +3,152 @@
 #include "BitDatabase.hpp"
 #include "Database.hpp"
 #include "Tile.hpp"
+#include "ConfigParser.hpp"
+#include "PackCache.hpp"
+#include "Profile.hpp"
 #include <sstream>
+#include <fstream>
 #include <iostream>
+#ifndef __wasi__
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#endif
 
 namespace Trellis {
 
-string ChipConfig::to_string() const
+// Output is collected in a string; when writing to a file it is flushed whenever it grows past this size
+static const size_t write_chunk_size = 1 << 20;
+
+static void write_config(const ChipConfig &cc, string &out, ostream *file)
 {
-    stringstream ss;
-    ss << ".device " << chip_name << endl << endl;
-    for (const auto &meta : metadata)
-        ss << ".comment " << meta << endl;
-    for (const auto &sc : sysconfig)
-        ss << ".sysconfig " << sc.first << " " << sc.second << endl;
-    ss << endl;
-    for (const auto &tile : tiles) {
+    auto maybe_flush = [&]() {
+        if (file != nullptr && out.size() >= write_chunk_size) {
+            file->write(out.data(), streamsize(out.size()));
+            out.clear();
+        }
+    };
+    out += ".device ";
+    out += cc.chip_name;
+    out += "\n\n";
+    for (const auto &meta : cc.metadata) {
+        out += ".comment ";
+        out += meta;
+        out += '\n';
+    }
+    for (const auto &sc : cc.sysconfig) {
+        out += ".sysconfig ";
+        out += sc.first;
+        out += ' ';
+        out += sc.second;
+        out += '\n';
+    }
+    out += '\n';
+    for (const auto &tile : cc.tiles) {
         if (!tile.second.empty()) {
-            ss << ".tile " << tile.first << endl;
-            ss << tile.second;
-            ss << endl;
+            out += ".tile ";
+            out += tile.first;
+            out += '\n';
+            tile.second.write(out);
+            out += '\n';
+            maybe_flush();
         }
     }
-    for (const auto &bram : bram_data) {
-        ss << ".bram_init " << bram.first << endl;
-        ios_base::fmtflags f( ss.flags() );
+    static const char hex_digits[] = "0123456789abcdef";
+    for (const auto &bram : cc.bram_data) {
+        out += ".bram_init ";
+        out += std::to_string(bram.first);
+        out += '\n';
         for (size_t i = 0; i < bram.second.size(); i++) {
-            ss << setw(3) << setfill('0') << hex << bram.second.at(i);
-            if (i % 8 == 7)
-                ss << endl;
-            else
-                ss << " ";
+            // At least three hex digits, as setw(3) << setfill('0') << hex
+            uint16_t value = bram.second.at(i);
+            if (value > 0xFFF)
+                out += hex_digits[(value >> 12) & 0xF];
+            out += hex_digits[(value >> 8) & 0xF];
+            out += hex_digits[(value >> 4) & 0xF];
+            out += hex_digits[value & 0xF];
+            out += (i % 8 == 7) ? '\n' : ' ';
         }
-        ss.flags(f);
-        ss << endl;
+        out += '\n';
+        maybe_flush();
     }
-    for (const auto &tg : tilegroups) {
-        ss << ".tile_group";
+    for (const auto &tg : cc.tilegroups) {
+        out += ".tile_group";
         for (const auto &tile : tg.tiles) {
-            ss << " " << tile;
+            out += ' ';
+            out += tile;
         }
-        ss << endl;
-        ss << tg.config;
-        ss << endl;
+        out += '\n';
+        tg.config.write(out);
+        out += '\n';
+        maybe_flush();
     }
-    return ss.str();
+}
+
+string ChipConfig::to_string() const
+{
+    Profile::Timer timer("chipconfig.write_text");
+    string out;
+    write_config(*this, out, nullptr);
+    return out;
+}
+
+void ChipConfig::to_file(const string &filename) const
+{
+    Profile::Timer timer("chipconfig.write_text");
+    ofstream file(filename);
+    if (!file)
+        throw runtime_error("failed to open config file " + filename + " for writing");
+    string out;
+    out.reserve(write_chunk_size + write_chunk_size / 4);
+    write_config(*this, out, &file);
+    file.write(out.data(), streamsize(out.size()));
+    if (!file)
+        throw runtime_error("failed to write config file " + filename);
 }
 
 ChipConfig ChipConfig::from_string(const string &config)
 {
-    stringstream ss(config);
-    ChipConfig cc;
-    while (!skip_check_eof(ss)) {
-        std::string verb;
-        ss >> verb;
-        if (verb == ".device") {
-            ss >> cc.chip_name;
-        } else if (verb == ".comment") {
-            std::string line;
-            ss.get(); //skip space
-            getline(ss, line);
-            cc.metadata.push_back(line);
-        } else if (verb == ".tile") {
-            std::string tilename;
-            ss >> tilename;
-            TileConfig tc;
-            ss >> tc;
-            cc.tiles[tilename] = tc;
-        } else if (verb == ".sysconfig") {
-            std::string key, value;
-            ss >> key >> value;
-            cc.sysconfig[key] = value;
-        } else if (verb == ".bram_init") {
-            uint16_t bram;
-            ss >> bram;
-            ios_base::fmtflags f(ss.flags());
-            while (!skip_check_eor(ss)) {
-                uint16_t value;
-                ss >> hex >> value;
-                cc.bram_data[bram].push_back(value);
-            }
-            ss.flags(f);
-        } else if (verb == ".tile_group") {
-            TileGroup tg;
-            std::string line;
-            getline(ss, line);
-            std::stringstream ss2(line);
+    Profile::Timer timer("chipconfig.parse_text");
+    return ConfigParser(config.data(), config.size()).parse_chip_config();
+}
 
-            std::string tile;
-            while (ss2) {
-                ss2 >> tile;
-                tg.tiles.push_back(tile);
-            }
-            ss >> tg.config;
-            cc.tilegroups.push_back(tg);
-        } else {
-            throw runtime_error("unrecognised config entry " + verb);
-        }
+ChipConfig ChipConfig::from_file(const string &filename)
+{
+    Profile::Timer timer("chipconfig.parse_text");
+#ifndef __wasi__
+    try {
+        using namespace boost::interprocess;
+        file_mapping file(filename.c_str(), read_only);
+        mapped_region region(file, read_only);
+        return ConfigParser(static_cast<const char *>(region.get_address()), region.get_size()).parse_chip_config();
+    } catch (const boost::interprocess::interprocess_exception &) {
+        // Fall back to reading the file normally, e.g. for empty files which cannot be mapped
     }
-    return cc;
+#endif
+    ifstream in(filename, ios::binary);
+    if (!in)
+        throw runtime_error("failed to open config file " + filename);
+    string config((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    return ConfigParser(config.data(), config.size()).parse_chip_config();
 }
 
-Chip ChipConfig::to_chip() const
+Chip ChipConfig::to_chip(PackCache *cache) const
 {
+    Profile::Timer timer("chipconfig.to_chip");
     Chip c(chip_name);
     c.metadata = metadata;
     c.bram_data = bram_data;
     set<string> processed_tiles;
-    for (auto tile_entry : c.tiles) {
-        auto tile_db = get_tile_bitdata(TileLocator{c.info.family, c.info.name, tile_entry.second->info.type});
-        if (tiles.find(tile_entry.first) != tiles.end()) {
-            tile_db->config_to_tile_cram(tiles.at(tile_entry.first), tile_entry.second->cram);
-        } else {
-            // Empty config sets default values (not always zero, e.g. in IO tiles)
-            tile_db->config_to_tile_cram(TileConfig(), tile_entry.second->cram);
-        }
+    const TileConfig empty_config;
+    for (const auto &tile_entry : c.tiles) {
+        const auto &tile_db = get_tile_bitdata(tile_entry.second->info);
+        auto found = tiles.find(tile_entry.first);
+        // Empty config sets default values (not always zero, e.g. in IO tiles)
+        const TileConfig &tile_cfg = (found != tiles.end()) ? found->second : empty_config;
+        if (cache)
+            cache->config_to_tile_cram(tile_entry.second->info.type, *tile_db, tile_cfg, tile_entry.second->cram);
+        else
+            tile_db->config_to_tile_cram(tile_cfg, tile_entry.second->cram);
         processed_tiles.insert(tile_entry.first);
     }
 
@@ -124,7 +156,7 @@ Chip ChipConfig::to_chip() const
         set<string> matched;
         for (const auto &tilename : tilegroup.tiles) {
             auto tile = c.tiles.at(tilename);
-            auto tile_db = get_tile_bitdata(TileLocator{c.info.family, c.info.name, tile->info.type});
+            const auto &tile_db = get_tile_bitdata(tile->info);
             tile_db->config_to_tile_cram(tilegroup.config, tile->cram, true, &matched);
         }
         for (const auto &word : tilegroup.config.cwords)
@@ -145,12 +177,13 @@ Chip ChipConfig::to_chip() const
 
 ChipConfig ChipConfig::from_chip(const Chip &chip)
 {
+    Profile::Timer timer("chipconfig.from_chip");
     ChipConfig cc;
     cc.chip_name = chip.info.name;
     cc.metadata = chip.metadata;
     cc.bram_data = chip.bram_data;
-    for (auto tile : chip.tiles) {
-        auto tile_db = get_tile_bitdata(TileLocator{chip.info.family, chip.info.name, tile.second->info.type});
+    for (const auto &tile : chip.tiles) {
+        const auto &tile_db = get_tile_bitdata(tile.second->info);
         cc.tiles[tile.first] = tile_db->tile_cram_to_config(tile.second->cram);
     }
     return cc;
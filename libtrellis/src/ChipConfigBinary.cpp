@@ -0,0 +1,341 @@
+#include "ChipConfig.hpp"
+#include "Util.hpp"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#ifndef __wasi__
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#endif
+
+namespace Trellis {
+
+static const char config_binary_magic[8] = {'T', 'R', 'C', 'O', 'N', 'F', 'I', 'G'};
+static const uint32_t config_binary_version = 1;
+
+namespace {
+void append_uint(vector<uint8_t> &out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+class BinaryConfigWriter
+{
+public:
+    void write_uint(uint64_t value)
+    {
+        append_uint(body, value);
+    }
+
+    void write_string(const string &str)
+    {
+        auto found = string_ids.find(str);
+        if (found == string_ids.end()) {
+            found = string_ids.emplace(str, uint32_t(strings.size())).first;
+            strings.push_back(&found->first);
+        }
+        write_uint(found->second);
+    }
+
+    void write_tile_config(const TileConfig &tc)
+    {
+        write_uint(tc.carcs.size());
+        for (const auto &arc : tc.carcs) {
+            write_string(arc.sink);
+            write_string(arc.source);
+        }
+        write_uint(tc.cwords.size());
+        for (const auto &word : tc.cwords) {
+            write_string(word.name);
+            write_uint(word.value.size());
+            for (size_t i = 0; i < word.value.size(); i += 8) {
+                uint8_t packed = 0;
+                for (size_t j = i; j < min(i + 8, word.value.size()); j++)
+                    if (word.value.at(j))
+                        packed |= uint8_t(1 << (j - i));
+                body.push_back(packed);
+            }
+        }
+        write_uint(tc.cenums.size());
+        for (const auto &cenum : tc.cenums) {
+            write_string(cenum.name);
+            write_string(cenum.value);
+        }
+        write_uint(tc.cunknowns.size());
+        for (const auto &unk : tc.cunknowns) {
+            write_uint(uint32_t(unk.frame));
+            write_uint(uint32_t(unk.bit));
+        }
+    }
+
+    void write_uint16_le(uint16_t value)
+    {
+        body.push_back(uint8_t(value & 0xFF));
+        body.push_back(uint8_t(value >> 8));
+    }
+
+    // Assemble the header, string table and body
+    vector<uint8_t> finish()
+    {
+        size_t string_size = 0;
+        for (const string *str : strings)
+            string_size += str->size() + 2;
+        vector<uint8_t> out(sizeof(config_binary_magic));
+        out.reserve(out.size() + 16 + string_size + body.size());
+        memcpy(out.data(), config_binary_magic, sizeof(config_binary_magic));
+        append_uint(out, config_binary_version);
+        append_uint(out, strings.size());
+        for (const string *str : strings) {
+            append_uint(out, str->size());
+            out.insert(out.end(), str->begin(), str->end());
+        }
+        out.insert(out.end(), body.begin(), body.end());
+        return out;
+    }
+
+private:
+    vector<uint8_t> body;
+    unordered_map<string, uint32_t> string_ids;
+    vector<const string *> strings;
+};
+
+class BinaryConfigReader
+{
+public:
+    BinaryConfigReader(const uint8_t *data, size_t size) : begin(data), pos(data), end(data + size)
+    {}
+
+    void read_header()
+    {
+        if (size_t(end - pos) < sizeof(config_binary_magic) ||
+            memcmp(pos, config_binary_magic, sizeof(config_binary_magic)) != 0)
+            throw runtime_error("not a binary Trellis config");
+        pos += sizeof(config_binary_magic);
+        uint64_t version = read_uint();
+        if (version != config_binary_version)
+            throw runtime_error(fmt("unsupported binary config version " << version));
+        size_t count = read_count();
+        strings.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            size_t len = read_count();
+            const uint8_t *str = take(len);
+            strings.emplace_back(reinterpret_cast<const char *>(str), len);
+        }
+    }
+
+    uint64_t read_uint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = *take(1);
+            value |= uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        fail("invalid integer");
+    }
+
+    // A count of items still to be read, each of which takes at least one byte
+    size_t read_count()
+    {
+        uint64_t count = read_uint();
+        if (count > uint64_t(end - pos))
+            fail("count exceeds size of data");
+        return size_t(count);
+    }
+
+    int read_int()
+    {
+        uint64_t value = read_uint();
+        if (value > uint64_t(INT32_MAX))
+            fail("integer out of range");
+        return int(value);
+    }
+
+    const string &read_string()
+    {
+        uint64_t id = read_uint();
+        if (id >= strings.size())
+            fail("invalid string index");
+        return strings.at(size_t(id));
+    }
+
+    uint16_t read_uint16_le()
+    {
+        const uint8_t *p = take(2);
+        return uint16_t(p[0] | (p[1] << 8));
+    }
+
+    TileConfig read_tile_config()
+    {
+        TileConfig tc;
+        tc.carcs.resize(read_count());
+        for (auto &arc : tc.carcs) {
+            arc.sink = read_string();
+            arc.source = read_string();
+        }
+        tc.cwords.resize(read_count());
+        for (auto &word : tc.cwords) {
+            word.name = read_string();
+            uint64_t bits = read_uint();
+            if (bits > 8 * uint64_t(end - pos))
+                fail("word size exceeds size of data");
+            const uint8_t *packed = take(size_t((bits + 7) / 8));
+            word.value.resize(size_t(bits));
+            for (size_t i = 0; i < word.value.size(); i++)
+                word.value[i] = (packed[i / 8] >> (i % 8)) & 1;
+        }
+        tc.cenums.resize(read_count());
+        for (auto &cenum : tc.cenums) {
+            cenum.name = read_string();
+            cenum.value = read_string();
+        }
+        tc.cunknowns.resize(read_count());
+        for (auto &unk : tc.cunknowns) {
+            unk.frame = read_int();
+            unk.bit = read_int();
+        }
+        return tc;
+    }
+
+    bool at_end() const
+    {
+        return pos == end;
+    }
+
+    [[noreturn]] void fail(const string &msg) const
+    {
+        throw runtime_error(fmt("invalid binary config at offset " << (pos - begin) << ": " << msg));
+    }
+
+private:
+    const uint8_t *take(size_t len)
+    {
+        if (len > size_t(end - pos))
+            fail("unexpected end of data");
+        const uint8_t *p = pos;
+        pos += len;
+        return p;
+    }
+
+    const uint8_t *begin, *pos, *end;
+    vector<string> strings;
+};
+}
+
+vector<uint8_t> ChipConfig::to_binary() const
+{
+    BinaryConfigWriter wr;
+    wr.write_string(chip_name);
+    wr.write_uint(metadata.size());
+    for (const auto &meta : metadata)
+        wr.write_string(meta);
+    wr.write_uint(sysconfig.size());
+    for (const auto &sc : sysconfig) {
+        wr.write_string(sc.first);
+        wr.write_string(sc.second);
+    }
+    wr.write_uint(tiles.size());
+    for (const auto &tile : tiles) {
+        wr.write_string(tile.first);
+        wr.write_tile_config(tile.second);
+    }
+    wr.write_uint(bram_data.size());
+    for (const auto &bram : bram_data) {
+        wr.write_uint(bram.first);
+        wr.write_uint(bram.second.size());
+        for (uint16_t value : bram.second)
+            wr.write_uint16_le(value);
+    }
+    wr.write_uint(tilegroups.size());
+    for (const auto &tg : tilegroups) {
+        wr.write_uint(tg.tiles.size());
+        for (const auto &tile : tg.tiles)
+            wr.write_string(tile);
+        wr.write_tile_config(tg.config);
+    }
+    return wr.finish();
+}
+
+ChipConfig ChipConfig::from_binary(const uint8_t *data, size_t size)
+{
+    BinaryConfigReader rd(data, size);
+    rd.read_header();
+    ChipConfig cc;
+    cc.chip_name = rd.read_string();
+    cc.metadata.resize(rd.read_count());
+    for (auto &meta : cc.metadata)
+        meta = rd.read_string();
+    size_t count = rd.read_count();
+    for (size_t i = 0; i < count; i++) {
+        const string &key = rd.read_string();
+        cc.sysconfig[key] = rd.read_string();
+    }
+    count = rd.read_count();
+    for (size_t i = 0; i < count; i++) {
+        const string &name = rd.read_string();
+        cc.tiles[name] = rd.read_tile_config();
+    }
+    count = rd.read_count();
+    for (size_t i = 0; i < count; i++) {
+        uint64_t index = rd.read_uint();
+        if (index > 0xFFFF)
+            rd.fail("BRAM index out of range");
+        auto &values = cc.bram_data[uint16_t(index)];
+        values.resize(rd.read_count());
+        for (auto &value : values)
+            value = rd.read_uint16_le();
+    }
+    cc.tilegroups.resize(rd.read_count());
+    for (auto &tg : cc.tilegroups) {
+        tg.tiles.resize(rd.read_count());
+        for (auto &tile : tg.tiles)
+            tile = rd.read_string();
+        tg.config = rd.read_tile_config();
+    }
+    if (!rd.at_end())
+        rd.fail("unexpected data after end of config");
+    return cc;
+}
+
+ChipConfig ChipConfig::from_binary(const vector<uint8_t> &data)
+{
+    return from_binary(data.data(), data.size());
+}
+
+void ChipConfig::to_binary_file(const string &filename) const
+{
+    vector<uint8_t> data = to_binary();
+    ofstream file(filename, ios::binary);
+    if (!file)
+        throw runtime_error("failed to open config file " + filename + " for writing");
+    file.write(reinterpret_cast<const char *>(data.data()), streamsize(data.size()));
+    if (!file)
+        throw runtime_error("failed to write config file " + filename);
+}
+
+ChipConfig ChipConfig::from_binary_file(const string &filename)
+{
+#ifndef __wasi__
+    try {
+        using namespace boost::interprocess;
+        file_mapping file(filename.c_str(), read_only);
+        mapped_region region(file, read_only);
+        return from_binary(static_cast<const uint8_t *>(region.get_address()), region.get_size());
+    } catch (const boost::interprocess::interprocess_exception &) {
+        // Fall back to reading the file normally, e.g. for empty files which cannot be mapped
+    }
+#endif
+    ifstream in(filename, ios::binary);
+    if (!in)
+        throw runtime_error("failed to open config file " + filename);
+    vector<uint8_t> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    return from_binary(data);
+}
+
+}
@@ -0,0 +1,487 @@
+#include "ChipdbBinary.hpp"
+#include "Util.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#ifndef __wasi__
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#endif
+
+namespace Trellis {
+namespace DDChipDb {
+
+static_assert(sizeof(BinRelId) == 8, "unexpected BinRelId layout");
+static_assert(sizeof(BinBelPort) == 12, "unexpected BinBelPort layout");
+static_assert(sizeof(BinBelWire) == 16, "unexpected BinBelWire layout");
+static_assert(sizeof(BinArcData) == 28, "unexpected BinArcData layout");
+static_assert(sizeof(BinWireData) == 28, "unexpected BinWireData layout");
+static_assert(sizeof(BinBelData) == 20, "unexpected BinBelData layout");
+static_assert(sizeof(BinLocationType) == 40, "unexpected BinLocationType layout");
+static_assert(sizeof(BinExtraLocation) == 8, "unexpected BinExtraLocation layout");
+static_assert(sizeof(BinHeader) == 64, "unexpected BinHeader layout");
+
+namespace {
+// Records are zero-filled before use so padding never carries stale memory into the blob
+template <typename T>
+T zeroed()
+{
+    T value;
+    memset(&value, 0, sizeof(T));
+    return value;
+}
+
+class BlobWriter
+{
+public:
+    BlobWriter() : buf(sizeof(BinHeader), 0)
+    {}
+
+    template <typename T>
+    BinArray<T> alloc(size_t count)
+    {
+        size_t offset = (buf.size() + 7) & ~size_t(7);
+        size_t end = offset + count * sizeof(T);
+        if (end > numeric_limits<uint32_t>::max())
+            throw runtime_error("chip database too large for binary format");
+        buf.resize(end, 0);
+        BinArray<T> arr;
+        arr.count = uint32_t(count);
+        arr.offset = uint32_t(offset);
+        return arr;
+    }
+
+    template <typename T>
+    void set(const BinArray<T> &arr, size_t index, const T &value)
+    {
+        memcpy(buf.data() + arr.offset + index * sizeof(T), &value, sizeof(T));
+    }
+
+    vector<uint8_t> buf;
+};
+
+BinRelId to_bin(const RelId &id)
+{
+    BinRelId bin = zeroed<BinRelId>();
+    bin.x = id.rel.x;
+    bin.y = id.rel.y;
+    bin.id = id.id;
+    return bin;
+}
+
+RelId from_bin(const BinRelId &bin)
+{
+    RelId id;
+    id.rel = Location(bin.x, bin.y);
+    id.id = bin.id;
+    return id;
+}
+
+template <typename Container>
+BinArray<BinRelId> write_relids(BlobWriter &wr, const Container &ids)
+{
+    auto arr = wr.alloc<BinRelId>(ids.size());
+    size_t i = 0;
+    for (const auto &id : ids)
+        wr.set(arr, i++, to_bin(id));
+    return arr;
+}
+
+BinLocationType write_location(BlobWriter &wr, const LocationData &ld, checksum_t checksum)
+{
+    BinLocationType lt = zeroed<BinLocationType>();
+    lt.checksum[0] = checksum.first;
+    lt.checksum[1] = checksum.second;
+
+    lt.wires = wr.alloc<BinWireData>(ld.wires.size());
+    for (size_t i = 0; i < ld.wires.size(); i++) {
+        const WireData &wd = ld.wires.at(i);
+        BinWireData bw = zeroed<BinWireData>();
+        bw.name = wd.name;
+        bw.arcsDownhill = write_relids(wr, wd.arcsDownhill);
+        bw.arcsUphill = write_relids(wr, wd.arcsUphill);
+        bw.belPins = wr.alloc<BinBelPort>(wd.belPins.size());
+        for (size_t j = 0; j < wd.belPins.size(); j++) {
+            BinBelPort bp = zeroed<BinBelPort>();
+            bp.bel = to_bin(wd.belPins.at(j).bel);
+            bp.pin = wd.belPins.at(j).pin;
+            wr.set(bw.belPins, j, bp);
+        }
+        wr.set(lt.wires, i, bw);
+    }
+
+    lt.arcs = wr.alloc<BinArcData>(ld.arcs.size());
+    for (size_t i = 0; i < ld.arcs.size(); i++) {
+        const DdArcData &ad = ld.arcs.at(i);
+        BinArcData ba = zeroed<BinArcData>();
+        ba.srcWire = to_bin(ad.srcWire);
+        ba.sinkWire = to_bin(ad.sinkWire);
+        ba.delay = ad.delay;
+        ba.tiletype = ad.tiletype;
+        ba.lutperm_flags = ad.lutperm_flags;
+        ba.cls = ad.cls;
+        wr.set(lt.arcs, i, ba);
+    }
+
+    lt.bels = wr.alloc<BinBelData>(ld.bels.size());
+    for (size_t i = 0; i < ld.bels.size(); i++) {
+        const BelData &bd = ld.bels.at(i);
+        BinBelData bb = zeroed<BinBelData>();
+        bb.name = bd.name;
+        bb.type = bd.type;
+        bb.z = bd.z;
+        bb.wires = wr.alloc<BinBelWire>(bd.wires.size());
+        for (size_t j = 0; j < bd.wires.size(); j++) {
+            BinBelWire bbw = zeroed<BinBelWire>();
+            bbw.wire = to_bin(bd.wires.at(j).wire);
+            bbw.pin = bd.wires.at(j).pin;
+            bbw.dir = bd.wires.at(j).dir;
+            wr.set(bb.wires, j, bbw);
+        }
+        wr.set(lt.bels, i, bb);
+    }
+    return lt;
+}
+
+struct TypeRef
+{
+    checksum_t checksum;
+    const LocationData *data;
+};
+
+vector<uint8_t> build_blob(const IdStore &ids, ChipdbBinaryKind kind, const vector<TypeRef> &types,
+                           const vector<pair<Location, int32_t>> &locs)
+{
+    BlobWriter wr;
+    BinHeader hdr = zeroed<BinHeader>();
+    memcpy(hdr.magic, chipdb_binary_magic, sizeof(hdr.magic));
+    hdr.version = chipdb_binary_version;
+    hdr.byte_order = chipdb_binary_byte_order;
+    hdr.kind = kind;
+
+    hdr.idents = wr.alloc<uint32_t>(ids.num_idents());
+    for (size_t i = 0; i < ids.num_idents(); i++) {
+        string str = ids.to_str(ident_t(i));
+        auto chars = wr.alloc<char>(str.size() + 1);
+        memcpy(wr.buf.data() + chars.offset, str.c_str(), str.size() + 1);
+        wr.set(hdr.idents, i, chars.offset);
+    }
+
+    hdr.types = wr.alloc<BinLocationType>(types.size());
+    for (size_t i = 0; i < types.size(); i++)
+        wr.set(hdr.types, i, write_location(wr, *(types.at(i).data), types.at(i).checksum));
+
+    int max_x = -1, max_y = -1;
+    size_t extra_count = 0;
+    for (const auto &loc : locs) {
+        if (loc.first.x >= 0 && loc.first.y >= 0) {
+            max_x = max<int>(max_x, loc.first.x);
+            max_y = max<int>(max_y, loc.first.y);
+        } else {
+            extra_count++;
+        }
+    }
+    hdr.grid_width = max_x + 1;
+    hdr.grid_height = max_y + 1;
+    hdr.grid = wr.alloc<int32_t>(size_t(hdr.grid_width) * size_t(hdr.grid_height));
+    for (size_t i = 0; i < hdr.grid.count; i++)
+        wr.set(hdr.grid, i, int32_t(-1));
+    hdr.extra_locations = wr.alloc<BinExtraLocation>(extra_count);
+    size_t extra_idx = 0;
+    // locs comes from a map, so is already sorted by (y, x)
+    for (const auto &loc : locs) {
+        if (loc.first.x >= 0 && loc.first.y >= 0) {
+            wr.set(hdr.grid, size_t(loc.first.y) * hdr.grid_width + loc.first.x, loc.second);
+        } else {
+            BinExtraLocation el = zeroed<BinExtraLocation>();
+            el.x = loc.first.x;
+            el.y = loc.first.y;
+            el.type = loc.second;
+            wr.set(hdr.extra_locations, extra_idx++, el);
+        }
+    }
+
+    hdr.total_size = uint32_t(wr.buf.size());
+    memcpy(wr.buf.data(), &hdr, sizeof(hdr));
+    return wr.buf;
+}
+
+void write_blob(const vector<uint8_t> &blob, const string &filename)
+{
+    ofstream out(filename, ios::binary);
+    if (!out)
+        throw runtime_error("failed to open " + filename + " for writing");
+    out.write(reinterpret_cast<const char *>(blob.data()), blob.size());
+    if (!out)
+        throw runtime_error("failed to write chip database to " + filename);
+}
+}
+
+vector<uint8_t> chipdb_to_binary(const DedupChipdb &db)
+{
+    vector<TypeRef> types;
+    map<checksum_t, int32_t> type_index;
+    for (const auto &lt : db.locationTypes) {
+        type_index[lt.first] = int32_t(types.size());
+        types.push_back(TypeRef{lt.first, &lt.second});
+    }
+    vector<pair<Location, int32_t>> locs;
+    for (const auto &loc : db.typeAtLocation)
+        locs.emplace_back(loc.first, type_index.at(loc.second));
+    return build_blob(db, CHIPDB_DEDUP, types, locs);
+}
+
+vector<uint8_t> chipdb_to_binary(const OptimizedChipdb &db)
+{
+    vector<TypeRef> types;
+    vector<pair<Location, int32_t>> locs;
+    for (const auto &tile : db.tiles) {
+        locs.emplace_back(tile.first, int32_t(types.size()));
+        types.push_back(TypeRef{checksum_t(0, 0), &tile.second});
+    }
+    return build_blob(db, CHIPDB_OPTIMIZED, types, locs);
+}
+
+void write_chipdb_binary(const DedupChipdb &db, const string &filename)
+{
+    write_blob(chipdb_to_binary(db), filename);
+}
+
+void write_chipdb_binary(const OptimizedChipdb &db, const string &filename)
+{
+    write_blob(chipdb_to_binary(db), filename);
+}
+
+struct ChipdbBinary::Mapping
+{
+#ifndef __wasi__
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+#endif
+};
+
+ChipdbBinary::~ChipdbBinary() = default;
+
+shared_ptr<ChipdbBinary> ChipdbBinary::open(const string &filename)
+{
+#ifdef __wasi__
+    ifstream in(filename, ios::binary);
+    if (!in)
+        throw runtime_error("failed to open chip database " + filename);
+    vector<uint8_t> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    return from_bytes(std::move(data));
+#else
+    shared_ptr<ChipdbBinary> cdb(new ChipdbBinary());
+    cdb->mapping.reset(new Mapping());
+    try {
+        using namespace boost::interprocess;
+        cdb->mapping->file = file_mapping(filename.c_str(), read_only);
+        cdb->mapping->region = mapped_region(cdb->mapping->file, read_only);
+    } catch (const boost::interprocess::interprocess_exception &e) {
+        throw runtime_error("failed to map chip database " + filename + ": " + e.what());
+    }
+    cdb->attach(static_cast<const uint8_t *>(cdb->mapping->region.get_address()), cdb->mapping->region.get_size());
+    return cdb;
+#endif
+}
+
+shared_ptr<ChipdbBinary> ChipdbBinary::from_bytes(vector<uint8_t> data)
+{
+    shared_ptr<ChipdbBinary> cdb(new ChipdbBinary());
+    cdb->owned = std::move(data);
+    cdb->attach(cdb->owned.data(), cdb->owned.size());
+    return cdb;
+}
+
+shared_ptr<ChipdbBinary> ChipdbBinary::from_memory(const void *data, size_t size)
+{
+    shared_ptr<ChipdbBinary> cdb(new ChipdbBinary());
+    cdb->attach(static_cast<const uint8_t *>(data), size);
+    return cdb;
+}
+
+void ChipdbBinary::attach(const uint8_t *data, size_t data_size)
+{
+    base = data;
+    size = data_size;
+    if (size < sizeof(BinHeader))
+        throw runtime_error("chip database blob too small");
+    if (reinterpret_cast<uintptr_t>(base) % 8 != 0)
+        throw runtime_error("chip database blob must be 8-byte aligned");
+    hdr = reinterpret_cast<const BinHeader *>(base);
+    if (memcmp(hdr->magic, chipdb_binary_magic, sizeof(hdr->magic)) != 0)
+        throw runtime_error("not a binary chip database");
+    if (hdr->byte_order != chipdb_binary_byte_order)
+        throw runtime_error("binary chip database was written with a different byte order");
+    if (hdr->version != chipdb_binary_version)
+        throw runtime_error(fmt("unsupported binary chip database version " << hdr->version));
+    if (hdr->kind != CHIPDB_DEDUP && hdr->kind != CHIPDB_OPTIMIZED)
+        throw runtime_error(fmt("unknown binary chip database kind " << hdr->kind));
+    if (hdr->total_size > size)
+        throw runtime_error("binary chip database is truncated");
+    if (hdr->grid_width < 0 || hdr->grid_height < 0 ||
+        size_t(hdr->grid.count) != size_t(hdr->grid_width) * size_t(hdr->grid_height))
+        throw runtime_error("binary chip database has an invalid location grid");
+    get(hdr->idents);
+    get(hdr->types);
+    get(hdr->grid);
+    get(hdr->extra_locations);
+}
+
+void ChipdbBinary::check_range(size_t offset, size_t length) const
+{
+    if (offset > size || length > size - offset)
+        throw runtime_error(fmt("binary chip database reference out of range (offset " << offset << ", length "
+                                                                                        << length << ")"));
+}
+
+const char *ChipdbBinary::ident_str(ident_t id) const
+{
+    if (id < 0 || uint32_t(id) >= hdr->idents.count)
+        throw out_of_range(fmt("identifier " << id << " not in binary chip database"));
+    uint32_t offset = get(hdr->idents)[id];
+    check_range(offset, 1);
+    if (memchr(base + offset, 0, size - offset) == nullptr)
+        throw runtime_error("unterminated identifier in binary chip database");
+    return reinterpret_cast<const char *>(base + offset);
+}
+
+const BinLocationType &ChipdbBinary::location_type(int32_t index) const
+{
+    if (index < 0 || uint32_t(index) >= hdr->types.count)
+        throw out_of_range(fmt("location type " << index << " not in binary chip database"));
+    return get(hdr->types)[index];
+}
+
+int32_t ChipdbBinary::type_at(Location loc) const
+{
+    if (loc.x >= 0 && loc.y >= 0) {
+        if (loc.x >= hdr->grid_width || loc.y >= hdr->grid_height)
+            return -1;
+        return get(hdr->grid)[size_t(loc.y) * hdr->grid_width + loc.x];
+    }
+    const BinExtraLocation *begin = get(hdr->extra_locations);
+    const BinExtraLocation *end = begin + hdr->extra_locations.count;
+    auto found = lower_bound(begin, end, loc, [](const BinExtraLocation &el, Location l) {
+        return Location(el.x, el.y) < l;
+    });
+    if (found != end && found->x == loc.x && found->y == loc.y)
+        return found->type;
+    return -1;
+}
+
+vector<Location> ChipdbBinary::locations() const
+{
+    vector<Location> locs;
+    const BinExtraLocation *extra = get(hdr->extra_locations);
+    for (uint32_t i = 0; i < hdr->extra_locations.count; i++)
+        locs.emplace_back(extra[i].x, extra[i].y);
+    const int32_t *grid = get(hdr->grid);
+    for (int y = 0; y < hdr->grid_height; y++)
+        for (int x = 0; x < hdr->grid_width; x++)
+            if (grid[size_t(y) * hdr->grid_width + x] >= 0)
+                locs.emplace_back(int16_t(x), int16_t(y));
+    sort(locs.begin(), locs.end());
+    return locs;
+}
+
+LocationData ChipdbBinary::get_location_data(int32_t type_index) const
+{
+    const BinLocationType &lt = location_type(type_index);
+    LocationData ld;
+
+    const BinWireData *wires = get(lt.wires);
+    ld.wires.reserve(lt.wires.count);
+    for (uint32_t i = 0; i < lt.wires.count; i++) {
+        WireData wd;
+        wd.name = wires[i].name;
+        const BinRelId *downhill = get(wires[i].arcsDownhill);
+        for (uint32_t j = 0; j < wires[i].arcsDownhill.count; j++)
+            wd.arcsDownhill.insert(from_bin(downhill[j]));
+        const BinRelId *uphill = get(wires[i].arcsUphill);
+        for (uint32_t j = 0; j < wires[i].arcsUphill.count; j++)
+            wd.arcsUphill.insert(from_bin(uphill[j]));
+        const BinBelPort *pins = get(wires[i].belPins);
+        for (uint32_t j = 0; j < wires[i].belPins.count; j++) {
+            BelPort bp;
+            bp.bel = from_bin(pins[j].bel);
+            bp.pin = pins[j].pin;
+            wd.belPins.push_back(bp);
+        }
+        ld.wires.push_back(std::move(wd));
+    }
+
+    const BinArcData *arcs = get(lt.arcs);
+    ld.arcs.reserve(lt.arcs.count);
+    for (uint32_t i = 0; i < lt.arcs.count; i++) {
+        DdArcData ad;
+        ad.srcWire = from_bin(arcs[i].srcWire);
+        ad.sinkWire = from_bin(arcs[i].sinkWire);
+        ad.cls = ArcClass(arcs[i].cls);
+        ad.delay = arcs[i].delay;
+        ad.tiletype = arcs[i].tiletype;
+        ad.lutperm_flags = arcs[i].lutperm_flags;
+        ld.arcs.push_back(ad);
+    }
+
+    const BinBelData *bels = get(lt.bels);
+    ld.bels.reserve(lt.bels.count);
+    for (uint32_t i = 0; i < lt.bels.count; i++) {
+        BelData bd;
+        bd.name = bels[i].name;
+        bd.type = bels[i].type;
+        bd.z = bels[i].z;
+        const BinBelWire *bws = get(bels[i].wires);
+        for (uint32_t j = 0; j < bels[i].wires.count; j++) {
+            BelWire bw;
+            bw.wire = from_bin(bws[j].wire);
+            bw.pin = bws[j].pin;
+            bw.dir = PortDirection(bws[j].dir);
+            bd.wires.push_back(bw);
+        }
+        ld.bels.push_back(std::move(bd));
+    }
+    return ld;
+}
+
+void ChipdbBinary::load_idents(IdStore &store) const
+{
+    for (uint32_t i = 0; i < hdr->idents.count; i++) {
+        if (store.ident(ident_str(ident_t(i))) != ident_t(i))
+            throw runtime_error("duplicate identifier in binary chip database");
+    }
+}
+
+shared_ptr<DedupChipdb> ChipdbBinary::to_dedup_chipdb() const
+{
+    if (kind() != CHIPDB_DEDUP)
+        throw runtime_error("binary chip database is not a deduplicated database");
+    auto db = make_shared<DedupChipdb>();
+    load_idents(*db);
+    vector<checksum_t> checksums;
+    for (uint32_t i = 0; i < hdr->types.count; i++) {
+        const BinLocationType &lt = location_type(int32_t(i));
+        checksum_t cs(lt.checksum[0], lt.checksum[1]);
+        checksums.push_back(cs);
+        db->locationTypes[cs] = get_location_data(int32_t(i));
+    }
+    for (const auto &loc : locations())
+        db->typeAtLocation[loc] = checksums.at(type_at(loc));
+    return db;
+}
+
+shared_ptr<OptimizedChipdb> ChipdbBinary::to_optimized_chipdb() const
+{
+    if (kind() != CHIPDB_OPTIMIZED)
+        throw runtime_error("binary chip database is not an optimized database");
+    auto db = make_shared<OptimizedChipdb>();
+    load_idents(*db);
+    for (const auto &loc : locations())
+        db->tiles.emplace_hint(db->tiles.end(), loc, get_location_data(type_at(loc)));
+    return db;
+}
+
+}
+}
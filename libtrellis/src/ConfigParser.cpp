@@ -0,0 +1,211 @@
+#include "ConfigParser.hpp"
+#include "Util.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace Trellis {
+
+static inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+ConfigParser::ConfigParser(const char *data, size_t size) : begin(data), pos(data), end(data + size)
+{}
+
+void ConfigParser::error(const char *at, const string &msg) const
+{
+    int line = 1 + int(count(begin, at, '\n'));
+    const char *line_start = at;
+    while (line_start > begin && line_start[-1] != '\n')
+        --line_start;
+    throw runtime_error(fmt("line " << line << ", column " << (at - line_start + 1) << ": " << msg));
+}
+
+void ConfigParser::skip_blank(bool nl)
+{
+    while (pos != end && (*pos == ' ' || *pos == '\t' || (nl && (*pos == '\n' || *pos == '\r'))))
+        ++pos;
+}
+
+void ConfigParser::skip()
+{
+    skip_blank(true);
+    while (pos != end && *pos == '#') {
+        while (pos != end && *pos != '\n')
+            ++pos;
+        skip_blank(true);
+    }
+}
+
+bool ConfigParser::check_eor()
+{
+    skip();
+    return pos == end || *pos == '.';
+}
+
+bool ConfigParser::check_eol()
+{
+    while (pos != end && *pos != '\n' && is_space(*pos))
+        ++pos;
+    if (pos != end && *pos == '#')
+        while (pos != end && *pos != '\n')
+            ++pos;
+    return pos == end || *pos == '\n';
+}
+
+string ConfigParser::next_token(const char *what)
+{
+    while (pos != end && is_space(*pos))
+        ++pos;
+    const char *start = pos;
+    while (pos != end && !is_space(*pos))
+        ++pos;
+    if (pos == start)
+        error(pos, fmt("expected " << what));
+    return string(start, pos);
+}
+
+void ConfigParser::read_word(vector<bool> &value)
+{
+    while (pos != end && is_space(*pos))
+        ++pos;
+    const char *start = pos;
+    while (pos != end && !is_space(*pos))
+        ++pos;
+    if (pos == start)
+        error(pos, "expected word value");
+    // Words are written MSB first
+    value.resize(size_t(pos - start));
+    for (const char *p = start; p != pos; ++p) {
+        if (*p != '0' && *p != '1')
+            error(p, fmt("invalid character '" << *p << "' in word value"));
+        value[size_t(pos - p - 1)] = (*p == '1');
+    }
+}
+
+void ConfigParser::read_unknown(ConfigUnknown &cu)
+{
+    while (pos != end && is_space(*pos))
+        ++pos;
+    const char *start = pos;
+    auto read_number = [&](char prefix, int &value) {
+        if (pos == end || *pos != prefix)
+            error(pos, fmt("expected '" << prefix << "' in unknown bit"));
+        ++pos;
+        const char *digits = pos;
+        value = 0;
+        while (pos != end && *pos >= '0' && *pos <= '9')
+            value = value * 10 + (*pos++ - '0');
+        if (pos == digits)
+            error(pos, "expected number in unknown bit");
+    };
+    read_number('F', cu.frame);
+    read_number('B', cu.bit);
+    if (pos != end && !is_space(*pos))
+        error(start, "invalid unknown bit");
+}
+
+uint16_t ConfigParser::read_uint16(int base, const char *what)
+{
+    while (pos != end && is_space(*pos))
+        ++pos;
+    const char *start = pos;
+    uint32_t value = 0;
+    while (pos != end && !is_space(*pos)) {
+        char c = *pos;
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (base == 16 && c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (base == 16 && c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            error(pos, fmt("invalid character '" << c << "' in " << what));
+        value = value * uint32_t(base) + uint32_t(digit);
+        if (value > 0xFFFF)
+            error(start, fmt(what << " out of range"));
+        ++pos;
+    }
+    if (pos == start)
+        error(pos, fmt("expected " << what));
+    return uint16_t(value);
+}
+
+TileConfig ConfigParser::parse_tile_config()
+{
+    TileConfig tc;
+    while (!check_eor()) {
+        const char *type_start = pos;
+        string type = next_token("config entry");
+        if (type == "arc:") {
+            ConfigArc a;
+            a.sink = next_token("arc sink");
+            a.source = next_token("arc source");
+            tc.carcs.push_back(std::move(a));
+        } else if (type == "word:") {
+            ConfigWord w;
+            w.name = next_token("word name");
+            read_word(w.value);
+            tc.cwords.push_back(std::move(w));
+        } else if (type == "enum:") {
+            ConfigEnum e;
+            e.name = next_token("enum name");
+            e.value = next_token("enum value");
+            tc.cenums.push_back(std::move(e));
+        } else if (type == "unknown:") {
+            ConfigUnknown u;
+            read_unknown(u);
+            tc.cunknowns.push_back(u);
+        } else {
+            error(type_start, "unexpected token " + type + " while reading config text");
+        }
+    }
+    return tc;
+}
+
+ChipConfig ConfigParser::parse_chip_config()
+{
+    ChipConfig cc;
+    for (skip(); pos != end; skip()) {
+        const char *verb_start = pos;
+        string verb = next_token("config entry");
+        if (verb == ".device") {
+            cc.chip_name = next_token("device name");
+        } else if (verb == ".comment") {
+            if (pos != end && *pos != '\n')
+                ++pos; // skip space
+            const char *start = pos;
+            while (pos != end && *pos != '\n')
+                ++pos;
+            cc.metadata.emplace_back(start, pos);
+        } else if (verb == ".tile") {
+            string tilename = next_token("tile name");
+            cc.tiles[tilename] = parse_tile_config();
+        } else if (verb == ".sysconfig") {
+            string key = next_token("sysconfig key");
+            cc.sysconfig[key] = next_token("sysconfig value");
+        } else if (verb == ".bram_init") {
+            uint16_t bram = read_uint16(10, "BRAM index");
+            vector<uint16_t> *data = nullptr;
+            while (!check_eor()) {
+                uint16_t value = read_uint16(16, "BRAM data");
+                if (data == nullptr)
+                    data = &cc.bram_data[bram];
+                data->push_back(value);
+            }
+        } else if (verb == ".tile_group") {
+            TileGroup tg;
+            while (!check_eol())
+                tg.tiles.push_back(next_token("tile name"));
+            tg.config = parse_tile_config();
+            cc.tilegroups.push_back(std::move(tg));
+        } else {
+            error(verb_start, "unrecognised config entry " + verb);
+        }
+    }
+    return cc;
+}
+
+}
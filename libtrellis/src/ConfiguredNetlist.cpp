@@ -0,0 +1,274 @@
+#include "ConfiguredNetlist.hpp"
+#include "BitDatabase.hpp"
+#include "Chip.hpp"
+#include "Database.hpp"
+#include "Parallel.hpp"
+#include "Tile.hpp"
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Trellis {
+
+namespace {
+class NetlistBuilder
+{
+public:
+    NetlistBuilder(const Chip &chip, RoutingGraph &graph, ConfiguredNetlist &nl)
+            : chip(chip), graph(graph), nl(nl), globals(chip.global_data_ecp5)
+    {}
+
+    void build(unsigned threads)
+    {
+        decode_tiles(threads);
+        // Visit the wires of the configured arcs first, recording the Bels they reach, then visit every pin of those
+        // Bels
+        for (size_t i = 0; i < nl.arcs.size(); i++) {
+            push(nl.wires.at(nl.arc_sources.at(i)));
+            push(nl.wires.at(nl.arc_sinks.at(i)));
+        }
+        visit_all(true);
+        for (const auto &bel_id : bels_used) {
+            const RoutingBel &bel = graph.tiles.at(bel_id.loc).bels.at(bel_id.id);
+            for (const auto &pin : bel.pins) {
+                add_bel_pin(bel_id, pin.first, pin.second.first, pin.second.second == PORT_OUT);
+                push(pin.second.first);
+            }
+        }
+        visit_all(false);
+        find_nets();
+    }
+
+private:
+    const Chip &chip;
+    RoutingGraph &graph;
+    ConfiguredNetlist &nl;
+    // get_spine_driver is not const
+    Ecp5GlobalsInfo globals;
+
+    unordered_map<RoutingId, int> wire_index;
+    unordered_set<RoutingId> arcs_added;
+    set<pair<int, int>> global_arcs_added;
+    set<pair<RoutingId, ident_t>> bel_pins_added;
+    // Zero-bit arcs by tile type
+    unordered_map<ident_t, unordered_set<ident_t>> zero_bit_arcs;
+    unordered_set<RoutingId> configured_sinks;
+
+    vector<RoutingId> worklist;
+    unordered_set<RoutingId> visited;
+    vector<RoutingId> bels_used;
+    unordered_set<RoutingId> bels_used_set;
+
+    void decode_tiles(unsigned threads)
+    {
+        vector<shared_ptr<Tile>> tiles;
+        vector<shared_ptr<TileBitDatabase>> dbs;
+        for (const auto &tile : chip.tiles) {
+            tiles.push_back(tile.second);
+            dbs.push_back(get_tile_bitdata(tile.second->info));
+        }
+        vector<TileConfig> configs(tiles.size());
+        // Decoding is most of the work; everything that touches the routing graph's identifiers stays single threaded
+        parallel_for(tiles.size(), [&](size_t i) {
+            configs.at(i) = dbs.at(i)->tile_cram_to_config(tiles.at(i)->cram);
+        }, threads);
+
+        for (size_t i = 0; i < tiles.size(); i++) {
+            const string &type = tiles.at(i)->info.type;
+            ident_t type_id = graph.ident(type);
+            if (!zero_bit_arcs.count(type_id)) {
+                auto &arcs = zero_bit_arcs[type_id];
+                for (const auto &sink : dbs.at(i)->get_sinks())
+                    for (const auto &arc : dbs.at(i)->get_mux_data_for_sink(sink).arcs)
+                        if (arc.second.bits.bits.empty())
+                            arcs.insert(graph.ident(arc.second.source + "->" + arc.second.sink));
+            }
+
+            int row, col;
+            tie(row, col) = tiles.at(i)->info.get_row_col();
+            auto rtile = graph.tiles.find(Location(int16_t(col), int16_t(row)));
+            if (rtile != graph.tiles.end()) {
+                for (const auto &carc : configs.at(i).carcs) {
+                    auto rarc = rtile->second.arcs.find(graph.ident(carc.source + "->" + carc.sink));
+                    // Arcs between wires that the routing graph ignores are not in it
+                    if (rarc == rtile->second.arcs.end())
+                        continue;
+                    add_arc(RoutingId{rtile->first, rarc->first}, rarc->second.source, rarc->second.sink, true);
+                    configured_sinks.insert(rarc->second.sink);
+                }
+            }
+            nl.tile_configs[tiles.at(i)->info.name] = std::move(configs.at(i));
+        }
+    }
+
+    int get_wire_index(const RoutingId &wire)
+    {
+        auto found = wire_index.find(wire);
+        if (found != wire_index.end())
+            return found->second;
+        int index = int(nl.wires.size());
+        wire_index.emplace(wire, index);
+        nl.wires.push_back(wire);
+        return index;
+    }
+
+    void add_arc(const RoutingId &arc, const RoutingId &source, const RoutingId &sink, bool configurable)
+    {
+        if (arc.id != -1 && !arcs_added.insert(arc).second)
+            return;
+        int src_index = get_wire_index(source), sink_index = get_wire_index(sink);
+        if (arc.id == -1 && !global_arcs_added.insert(make_pair(src_index, sink_index)).second)
+            return;
+        nl.arcs.push_back(arc);
+        nl.arc_sources.push_back(src_index);
+        nl.arc_sinks.push_back(sink_index);
+        nl.arc_configurable.push_back(configurable);
+    }
+
+    void add_global_arc(const RoutingId &source, const RoutingId &sink)
+    {
+        add_arc(RoutingId{GlobalLoc, -1}, source, sink, false);
+        push(source);
+    }
+
+    void add_bel_pin(const RoutingId &bel, ident_t pin, const RoutingId &wire, bool output)
+    {
+        if (!bel_pins_added.insert(make_pair(bel, pin)).second)
+            return;
+        nl.bel_pin_bels.push_back(bel);
+        nl.bel_pin_names.push_back(pin);
+        nl.bel_pin_wires.push_back(get_wire_index(wire));
+        nl.bel_pin_outputs.push_back(output);
+    }
+
+    void push(const RoutingId &wire)
+    {
+        if (visited.insert(wire).second)
+            worklist.push_back(wire);
+    }
+
+    void visit_all(bool record_bels)
+    {
+        while (!worklist.empty()) {
+            RoutingId wire = worklist.back();
+            worklist.pop_back();
+            visit(wire, record_bels);
+        }
+    }
+
+    void visit(const RoutingId &wire, bool record_bels)
+    {
+        get_wire_index(wire);
+        auto rtile = graph.tiles.find(wire.loc);
+        if (rtile == graph.tiles.end())
+            return;
+        auto found = rtile->second.wires.find(wire.id);
+        if (found == rtile->second.wires.end())
+            return;
+        const RoutingWire &rwire = found->second;
+
+        if (!configured_sinks.count(wire)) {
+            for (const auto &arc_id : rwire.uphill) {
+                const RoutingArc &arc = graph.tiles.at(arc_id.loc).arcs.at(arc_id.id);
+                auto zba = zero_bit_arcs.find(arc.tiletype);
+                if (arc.configurable && zba != zero_bit_arcs.end() && zba->second.count(arc.id)) {
+                    add_arc(arc_id, arc.source, arc.sink, true);
+                    push(arc.source);
+                }
+            }
+        }
+
+        for (const auto &bel : rwire.belsUphill) {
+            add_bel_pin(bel.first, bel.second, wire, true);
+            record_bel(bel.first, record_bels);
+        }
+        for (const auto &bel : rwire.belsDownhill) {
+            add_bel_pin(bel.first, bel.second, wire, false);
+            record_bel(bel.first, record_bels);
+        }
+
+        for (const auto *arcs : {&rwire.uphill, &rwire.downhill}) {
+            for (const auto &arc_id : *arcs) {
+                const RoutingArc &arc = graph.tiles.at(arc_id.loc).arcs.at(arc_id.id);
+                // Skip configurable arcs, and the LUT permutation pseudo-arcs
+                if (arc.configurable || arc.lutperm_flags != 0)
+                    continue;
+                add_arc(arc_id, arc.source, arc.sink, false);
+                push(arc.source);
+                push(arc.sink);
+            }
+        }
+
+        if (chip.info.family == "ECP5")
+            visit_globals(wire);
+    }
+
+    void record_bel(const RoutingId &bel, bool record_bels)
+    {
+        if (record_bels && bels_used_set.insert(bel).second)
+            bels_used.push_back(bel);
+    }
+
+    // The routing graph leaves out most of the global clock network, so add the connections needed to follow clocks
+    void visit_globals(const RoutingId &wire)
+    {
+        const string name = graph.to_str(wire.id);
+        int x = wire.loc.x, y = wire.loc.y;
+        if (name.compare(0, 6, "G_HPBX") == 0) {
+            // TAP_DRIVE to PLB tile
+            TapDriver tap = globals.get_tap_driver(y, x);
+            string tap_name = (tap.dir == TapDriver::LEFT ? "L_HPBX" : "R_HPBX") + name.substr(6);
+            add_global_arc(RoutingId{Location(int16_t(tap.col), int16_t(y)), graph.ident(tap_name)}, wire);
+        } else if (name.compare(0, 6, "G_VPTX") == 0) {
+            // Spine tile to TAP_DRIVE
+            TapDriver tap = globals.get_tap_driver(y, x);
+            if (tap.col == x) {
+                pair<int, int> spine = globals.get_spine_driver(globals.get_quadrant(y, x), x);
+                add_global_arc(RoutingId{Location(int16_t(spine.second), int16_t(spine.first)), wire.id}, wire);
+            }
+        } else if (name.compare(0, 6, "G_HPRX") == 0 && name.size() > 8 && name.compare(name.size() - 2, 2, "00") == 0) {
+            // Centre mux to spine tile (qqPCLKn to G_HPRXnn00)
+            int clk = stoi(name.substr(6, name.size() - 8));
+            string global_name = "G_" + globals.get_quadrant(y, x) + "PCLK" + std::to_string(clk);
+            add_global_arc(RoutingId{Location(0, 0), graph.ident(global_name)}, wire);
+        }
+    }
+
+    void find_nets()
+    {
+        vector<int> parent(nl.wires.size());
+        for (size_t i = 0; i < parent.size(); i++)
+            parent.at(i) = int(i);
+        auto find = [&](int w) {
+            while (parent.at(w) != w) {
+                parent.at(w) = parent.at(parent.at(w));
+                w = parent.at(w);
+            }
+            return w;
+        };
+        for (size_t i = 0; i < nl.arcs.size(); i++) {
+            int a = find(nl.arc_sources.at(i)), b = find(nl.arc_sinks.at(i));
+            if (a != b)
+                parent.at(max(a, b)) = min(a, b);
+        }
+        // Number nets in order of their first wire
+        nl.wire_nets.assign(nl.wires.size(), -1);
+        nl.num_nets = 0;
+        for (size_t i = 0; i < nl.wires.size(); i++) {
+            int root = find(int(i));
+            if (nl.wire_nets.at(root) == -1)
+                nl.wire_nets.at(root) = nl.num_nets++;
+            nl.wire_nets.at(i) = nl.wire_nets.at(root);
+        }
+    }
+};
+}
+
+ConfiguredNetlist extract_configured_netlist(const Chip &chip, RoutingGraph &graph, unsigned threads)
+{
+    ConfiguredNetlist nl;
+    NetlistBuilder(chip, graph, nl).build(threads);
+    return nl;
+}
+
+}
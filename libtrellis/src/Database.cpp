@@ -3,12 +3,16 @@
 #include "Tile.hpp"
 #include "Util.hpp"
 #include "BitDatabase.hpp"
+#include "Parallel.hpp"
+#include "Profile.hpp"
+#include <algorithm>
 #include <iostream>
 #include <boost/optional.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <stdexcept>
 #include <mutex>
+#include <set>
 
 
 namespace pt = boost::property_tree;
@@ -24,6 +28,7 @@ static mutex tilegrid_cache_mutex;
 #endif
 
 void load_database(string root) {
+    Profile::Timer timer("database.load_devices");
     db_root = root;
     pt::read_json(root + "/" + "devices.json", devices_info);
 }
@@ -197,21 +202,107 @@ MachXO2GlobalsInfo get_global_info_machxo2(const DeviceLocator &part) {
     return glbs;
 }
 
-vector<TileInfo> get_device_tilegrid(const DeviceLocator &part) {
-    vector <TileInfo> tilesInfo;
+/*
+The BitDatabases of the tile types used by one device, indexed by TileInfo::type_id. Each slot is written once, under
+slot_mutex, before its ready flag is set, so once a slot is ready it can be read without locking. Tables are created
+when a device's tilegrid is first loaded, and are never destroyed before exit, so TileInfo can point to them.
+ */
+class DeviceBitDatabases
+{
+public:
+    DeviceBitDatabases(string family, string device, vector<string> types)
+            : family(move(family)), device(move(device)), types(move(types)), slots(this->types.size()),
+              ready(new flag[this->types.size()])
+    {
+        for (size_t i = 0; i < this->types.size(); i++)
+            ready[i] = false;
+    }
+
+    size_t size() const
+    {
+        return types.size();
+    }
+
+    // -1 if the device doesn't use the tile type
+    int type_id(const string &type) const
+    {
+        auto found = lower_bound(types.begin(), types.end(), type);
+        return (found != types.end() && *found == type) ? int(found - types.begin()) : -1;
+    }
+
+    const shared_ptr<TileBitDatabase> &get(int type_id)
+    {
+        size_t i = size_t(type_id);
+#ifdef NO_THREADS
+        if (!ready[i]) {
+            slots.at(i) = get_tile_bitdata(TileLocator{family, device, types.at(i)});
+            ready[i] = true;
+        }
+#else
+        if (!ready[i].load(memory_order_acquire)) {
+            // Loaded outside the lock, so that different tile types can be loaded at once
+            shared_ptr<TileBitDatabase> bitdb = get_tile_bitdata(TileLocator{family, device, types.at(i)});
+            lock_guard<mutex> lock(slot_mutex);
+            if (!ready[i].load(memory_order_relaxed)) {
+                slots.at(i) = move(bitdb);
+                ready[i].store(true, memory_order_release);
+            }
+        }
+#endif
+        return slots[i];
+    }
+
+private:
+    string family, device;
+    // Sorted, so type ids are the same for every process
+    vector<string> types;
+    vector<shared_ptr<TileBitDatabase>> slots;
+#ifdef NO_THREADS
+    typedef bool flag;
+#else
+    typedef atomic<bool> flag;
+    mutex slot_mutex;
+#endif
+    unique_ptr<flag[]> ready;
+};
+
+static map<string, unique_ptr<DeviceBitDatabases>> device_bitdbs;
+
+// Must be called with tilegrid_cache_mutex held
+static const pt::ptree &load_tilegrid(const DeviceLocator &part) {
     assert(db_root != "");
+    auto found = tilegrid_cache.find(part.device);
+    if (found != tilegrid_cache.end())
+        return found->second;
+    Profile::Timer timer("database.load_tilegrid");
     string tilegrid_path = db_root + "/" + part.family + "/" + part.device + "/tilegrid.json";
+    pt::ptree tg_parsed;
+    pt::read_json(tilegrid_path, tg_parsed);
+    return tilegrid_cache[part.device] = tg_parsed;
+}
+
+// Must be called with tilegrid_cache_mutex held
+static DeviceBitDatabases &device_bit_databases(const DeviceLocator &part) {
+    auto found = device_bitdbs.find(part.device);
+    if (found != device_bitdbs.end())
+        return *found->second;
+    set<string> types;
+    for (const pt::ptree::value_type &tile : load_tilegrid(part))
+        types.insert(tile.second.get<string>("type"));
+    auto &bitdbs = device_bitdbs[part.device];
+    bitdbs.reset(new DeviceBitDatabases(part.family, part.device, vector<string>(types.begin(), types.end())));
+    return *bitdbs;
+}
+
+vector<TileInfo> get_device_tilegrid(const DeviceLocator &part) {
+    vector <TileInfo> tilesInfo;
     {
         ChipInfo info = get_chip_info(part);
 #ifndef NO_THREADS
         lock_guard <mutex> lock(tilegrid_cache_mutex);
 #endif
-        if (tilegrid_cache.find(part.device) == tilegrid_cache.end()) {
-            pt::ptree tg_parsed;
-            pt::read_json(tilegrid_path, tg_parsed);
-            tilegrid_cache[part.device] = tg_parsed;
-        }
-        const pt::ptree &tg = tilegrid_cache[part.device];
+        const pt::ptree &tg = load_tilegrid(part);
+        DeviceBitDatabases &bitdbs = device_bit_databases(part);
 
         for (const pt::ptree::value_type &tile : tg) {
             TileInfo ti;
@@ -234,30 +325,82 @@ vector<TileInfo> get_device_tilegrid(const DeviceLocator &part) {
                 si.row = site.second.get<int>("pos_row");
                 ti.sites.push_back(si);
             }
+            tie(ti.row, ti.col) = ti.get_row_col();
+            ti.bitdbs = &bitdbs;
+            ti.type_id = bitdbs.type_id(ti.type);
             tilesInfo.push_back(ti);
         }
     }
     return tilesInfo;
 }
 
-static unordered_map<TileLocator, shared_ptr<TileBitDatabase>> bitdb_store;
+// Each entry is loaded under its own mutex, so that loading one BitDatabase doesn't hold up others
+struct BitDatabaseEntry {
+#ifndef NO_THREADS
+    mutex load_mutex;
+#endif
+    shared_ptr<TileBitDatabase> bitdb;
+};
+
+static unordered_map<TileLocator, shared_ptr<BitDatabaseEntry>> bitdb_store;
 #ifndef NO_THREADS
 static mutex bitdb_store_mutex;
 #endif
 
-shared_ptr<TileBitDatabase> get_tile_bitdata(const TileLocator &tile) {
+// Entries are never removed, so they remain valid until exit
+static shared_ptr<BitDatabaseEntry> get_bitdb_entry(const TileLocator &tile) {
 #ifndef NO_THREADS
     lock_guard <mutex> bitdb_store_lg(bitdb_store_mutex);
 #endif
-    if (bitdb_store.find(tile) == bitdb_store.end()) {
+    auto &found = bitdb_store[tile];
+    if (!found)
+        found = make_shared<BitDatabaseEntry>();
+    return found;
+}
+
+shared_ptr<TileBitDatabase> get_tile_bitdata(const TileLocator &tile) {
+    shared_ptr<BitDatabaseEntry> entry = get_bitdb_entry(tile);
+#ifndef NO_THREADS
+    lock_guard <mutex> entry_lg(entry->load_mutex);
+#endif
+    if (!entry->bitdb) {
         assert(!db_root.empty());
         string bitdb_path = db_root + "/" + tile.family + "/tiledata/" + tile.tiletype + "/bits.db";
-        shared_ptr <TileBitDatabase> bitdb{new TileBitDatabase(bitdb_path)};
-        bitdb_store[tile] = bitdb;
-        return bitdb;
-    } else {
-        return bitdb_store.at(tile);
+        entry->bitdb.reset(new TileBitDatabase(bitdb_path));
+    }
+    return entry->bitdb;
+}
+
+const shared_ptr<TileBitDatabase> &get_tile_bitdata(const TileInfo &tile) {
+    if (tile.bitdbs != nullptr && tile.type_id >= 0)
+        return tile.bitdbs->get(tile.type_id);
+    DeviceBitDatabases *bitdbs;
+    {
+#ifndef NO_THREADS
+        lock_guard <mutex> lock(tilegrid_cache_mutex);
+#endif
+        bitdbs = &device_bit_databases(DeviceLocator{tile.family, tile.device});
+    }
+    int type_id = bitdbs->type_id(tile.type);
+    if (type_id < 0) {
+        // Not in the tilegrid, as for a TileInfo made by hand, so load it by type alone
+        TileLocator loc{tile.family, tile.device, tile.type};
+        get_tile_bitdata(loc);
+        return get_bitdb_entry(loc)->bitdb;
+    }
+    return bitdbs->get(type_id);
+}
+
+void preload_device(const string &family, const string &device, unsigned threads) {
+    Profile::Timer timer("database.preload_device");
+    DeviceBitDatabases *bitdbs;
+    {
+#ifndef NO_THREADS
+        lock_guard <mutex> lock(tilegrid_cache_mutex);
+#endif
+        bitdbs = &device_bit_databases(DeviceLocator{family, device});
     }
+    parallel_for(bitdbs->size(), [&](size_t i) { bitdbs->get(int(i)); }, threads);
 }
 
 }
@@ -1,5 +1,12 @@
 #include "DedupChipdb.hpp"
 #include "Chip.hpp"
+#include "Parallel.hpp"
+#include "Profile.hpp"
+#include "Util.hpp"
+#include <algorithm>
+#ifndef NO_THREADS
+#include <mutex>
+#endif
 
 namespace Trellis {
 namespace DDChipDb {
@@ -32,37 +39,93 @@ DedupChipdb::DedupChipdb()
 DedupChipdb::DedupChipdb(const IdStore &base) : IdStore(base)
 {}
 
-shared_ptr<DedupChipdb> make_dedup_chipdb(Chip &chip, bool include_lutperm_pips)
+RoutingGraphIndex::RoutingGraphIndex(const RoutingGraph &graph)
+        : grid_width(graph.max_col + 1), grid_height(graph.max_row + 1)
 {
-    shared_ptr<RoutingGraph> graph = chip.get_routing_graph(include_lutperm_pips);
-    for (auto &loc : graph->tiles) {
+    grid_slot.resize(size_t(grid_width) * size_t(grid_height), -1);
+    for (const auto &loc : graph.tiles) {
+        int idx = int(slots.size());
+        locs.push_back(loc.first);
+        slots.emplace_back();
+        Slot &slot = slots.back();
         const auto &td = loc.second;
-        // Index bels, wires and arcs
-        int bel_id = 0, wire_id = 0, arc_id = 0;
-        for (auto &bel : td.bels) {
-            RoutingId rid;
-            rid.loc = loc.first;
-            rid.id = bel.first;
-            bel.second.cdb_id = bel_id++;
-        }
-        for (auto &wire : td.wires) {
-            RoutingId rid;
-            rid.loc = loc.first;
-            rid.id = wire.first;
-            wire.second.cdb_id  = wire_id++;
-        }
-        for (auto &arc : td.arcs) {
-            RoutingId rid;
-            rid.loc = loc.first;
-            rid.id = arc.first;
-            arc.second.cdb_id = arc_id++;
-        }
+        slot.wires.reserve(td.wires.size());
+        for (const auto &wire : td.wires)
+            slot.wires.push_back(wire.first);
+        slot.arcs.reserve(td.arcs.size());
+        for (const auto &arc : td.arcs)
+            slot.arcs.push_back(arc.first);
+        slot.bels.reserve(td.bels.size());
+        for (const auto &bel : td.bels)
+            slot.bels.push_back(bel.first);
+        const Location &l = loc.first;
+        if (l.x >= 0 && l.x < grid_width && l.y >= 0 && l.y < grid_height)
+            grid_slot.at(size_t(l.y) * size_t(grid_width) + size_t(l.x)) = idx;
+        else
+            other_slot[l] = idx;
+    }
+}
+
+const RoutingGraphIndex::Slot &RoutingGraphIndex::slot_at(Location loc) const
+{
+    if (loc.x >= 0 && loc.x < grid_width && loc.y >= 0 && loc.y < grid_height) {
+        int idx = grid_slot.at(size_t(loc.y) * size_t(grid_width) + size_t(loc.x));
+        if (idx != -1)
+            return slots.at(idx);
+    } else {
+        auto found = other_slot.find(loc);
+        if (found != other_slot.end())
+            return slots.at(found->second);
     }
+    throw out_of_range(fmt("no location X" << loc.x << "Y" << loc.y << " in routing graph"));
+}
+
+// Position of an identifier in one of the sorted per-location vectors
+static int sequential_id(const vector<ident_t> &ids, ident_t id)
+{
+    auto found = lower_bound(ids.begin(), ids.end(), id);
+    if (found == ids.end() || *found != id)
+        throw out_of_range(fmt("identifier " << id << " not found in routing graph location"));
+    return int(distance(ids.begin(), found));
+}
+
+int RoutingGraphIndex::wire_id(const RoutingId &wire) const
+{
+    return sequential_id(slot_at(wire.loc).wires, wire.id);
+}
+
+int RoutingGraphIndex::arc_id(const RoutingId &arc) const
+{
+    return sequential_id(slot_at(arc.loc).arcs, arc.id);
+}
+
+int RoutingGraphIndex::bel_id(const RoutingId &bel) const
+{
+    return sequential_id(slot_at(bel.loc).bels, bel.id);
+}
+
+shared_ptr<DedupChipdb> make_dedup_chipdb(Chip &chip, bool include_lutperm_pips)
+{
+    Profile::Timer timer("dedup.make_chipdb");
+    shared_ptr<RoutingGraph> graph = chip.get_routing_graph(include_lutperm_pips);
+    const RoutingGraphIndex index(*graph);
+    const vector<Location> &locs = index.locations();
     shared_ptr<DedupChipdb> cdb = make_shared<DedupChipdb>(IdStore(*graph));
-    for (const auto &loc : graph->tiles) {
-        int x = loc.first.x, y = loc.first.y;
+
+    // Each location only reads the graph and index, so they can be converted independently. Only the first
+    // location of each type is kept, later ones are checked against it outside of the lock.
+    vector<checksum_t> loc_types(locs.size());
+#ifndef NO_THREADS
+    mutex types_mutex;
+#endif
+    parallel_for(locs.size(), [&](size_t i) {
+        int x = locs.at(i).x, y = locs.at(i).y;
+        auto rel = [x, y](const Location &l) {
+            return Location(l.x - x, l.y - y);
+        };
         LocationData ld;
-        const auto &td = loc.second;
+        const auto &td = graph->tiles.at(locs.at(i));
+        ld.bels.reserve(td.bels.size());
         for (const auto &bel : td.bels) {
             const RoutingBel &rb = bel.second;
             BelData bd;
@@ -72,59 +135,73 @@ shared_ptr<DedupChipdb> make_dedup_chipdb(Chip &chip, bool include_lutperm_pips)
             for (const auto &wire : rb.pins) {
                 BelWire bw;
                 bw.pin = wire.first;
-                bw.wire = RelId{Location(wire.second.first.loc.x - x, wire.second.first.loc.y - y), graph->tiles.at(wire.second.first.loc).wires.at(wire.second.first.id).cdb_id};
+                bw.wire = RelId{rel(wire.second.first.loc), index.wire_id(wire.second.first)};
                 bw.dir = wire.second.second;
                 bd.wires.push_back(bw);
             }
-            ld.bels.push_back(bd);
+            ld.bels.push_back(std::move(bd));
         }
 
+        ld.arcs.reserve(td.arcs.size());
         for (const auto &arc : td.arcs) {
             const RoutingArc &ra = arc.second;
             DdArcData ad;
             ad.tiletype = ra.tiletype;
             ad.cls = ra.configurable ? ARC_STANDARD : ARC_FIXED;
             ad.delay = 1;
-            ad.sinkWire = RelId{Location(ra.sink.loc.x - x, ra.sink.loc.y - y), graph->tiles.at(ra.sink.loc).wires.at(ra.sink.id).cdb_id};
-            ad.srcWire = RelId{Location(ra.source.loc.x - x, ra.source.loc.y - y), graph->tiles.at(ra.source.loc).wires.at(ra.source.id).cdb_id};
+            ad.sinkWire = RelId{rel(ra.sink.loc), index.wire_id(ra.sink)};
+            ad.srcWire = RelId{rel(ra.source.loc), index.wire_id(ra.source)};
             ad.lutperm_flags = ra.lutperm_flags;
             ld.arcs.push_back(ad);
         }
 
+        ld.wires.reserve(td.wires.size());
         for (const auto &wire : td.wires) {
             const RoutingWire &rw = wire.second;
             WireData wd;
             wd.name = rw.id;
             for (const auto &dh : rw.downhill)
-                wd.arcsDownhill.insert(RelId{Location(dh.loc.x - x, dh.loc.y - y), graph->tiles.at(dh.loc).arcs.at(dh.id).cdb_id});
+                wd.arcsDownhill.insert(RelId{rel(dh.loc), index.arc_id(dh)});
             for (const auto &uh : rw.uphill)
-                wd.arcsUphill.insert(RelId{Location(uh.loc.x - x, uh.loc.y - y), graph->tiles.at(uh.loc).arcs.at(uh.id).cdb_id});
+                wd.arcsUphill.insert(RelId{rel(uh.loc), index.arc_id(uh)});
             for (const auto &bdh : rw.belsDownhill) {
                 BelPort bp;
                 bp.pin = bdh.second;
-                bp.bel = RelId{Location(bdh.first.loc.x - x, bdh.first.loc.y - y), graph->tiles.at(bdh.first.loc).bels.at(bdh.first.id).cdb_id};
+                bp.bel = RelId{rel(bdh.first.loc), index.bel_id(bdh.first)};
                 wd.belPins.push_back(bp);
             }
             assert(rw.belsUphill.size() <= 1);
             if (rw.belsUphill.size() == 1) {
                 const auto &buh = rw.belsUphill[0];
                 BelPort uh;
-                uh.bel = RelId{Location(buh.first.loc.x - x, buh.first.loc.y - y), graph->tiles.at(buh.first.loc).bels.at(buh.first.id).cdb_id};
+                uh.bel = RelId{rel(buh.first.loc), index.bel_id(buh.first)};
                 uh.pin = buh.second;
                 wd.belPins.push_back(uh);
             }
-            ld.wires.push_back(wd);
+            ld.wires.push_back(std::move(wd));
         }
 
         checksum_t cs = ld.checksum();
-        if (cdb->locationTypes.find(cs) == cdb->locationTypes.end()) {
-            cdb->locationTypes[cs] = ld;
-        } else {
-            if (!(ld == cdb->locationTypes[cs]))
-                terminate();
+        loc_types.at(i) = cs;
+        const LocationData *existing;
+        {
+#ifndef NO_THREADS
+            lock_guard<mutex> lock(types_mutex);
+#endif
+            auto found = cdb->locationTypes.find(cs);
+            if (found == cdb->locationTypes.end()) {
+                cdb->locationTypes.emplace(cs, std::move(ld));
+                return;
+            }
+            // std::map never moves its elements, so this stays valid after the lock is released
+            existing = &(found->second);
         }
-        cdb->typeAtLocation[loc.first] = cs;
-    }
+        if (!(ld == *existing))
+            terminate();
+    });
+
+    for (size_t i = 0; i < locs.size(); i++)
+        cdb->typeAtLocation[locs.at(i)] = loc_types.at(i);
 
     return cdb;
 }
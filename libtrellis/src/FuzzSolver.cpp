@@ -0,0 +1,225 @@
+#include "FuzzSolver.hpp"
+#include "Chip.hpp"
+#include "Parallel.hpp"
+#include "Tile.hpp"
+#include "Util.hpp"
+#include <set>
+#include <unordered_map>
+
+namespace Trellis {
+
+namespace {
+// Bits as (frame, bit), by tile name
+typedef map<string, set<pair<int, int>>> TileBits;
+
+// Compare each chip against ref, or against chips[0] if ref is null
+vector<CompactChipDelta> diff_all(const vector<Chip> &chips, const Chip *ref, unsigned threads)
+{
+    vector<CompactChipDelta> diffs(chips.size());
+    parallel_for(chips.size(), [&](size_t i) {
+        diffs.at(i) = diff_chips(chips.at(i), ref ? *ref : chips.at(0));
+    }, threads);
+    return diffs;
+}
+
+// The bits changed in the tiles of interest by any of the diffs
+TileBits changed_bits(const vector<CompactChipDelta> &diffs, const vector<string> &tiles)
+{
+    TileBits changed;
+    for (const auto &diff : diffs) {
+        for (const auto &tile : tiles) {
+            auto found = diff.find(tile);
+            if (found == diff.end())
+                continue;
+            auto &bits = changed[tile];
+            for (size_t i = 0; i < found->second.size(); i++)
+                bits.emplace(found->second.frames.at(i), found->second.bits.at(i));
+        }
+    }
+    return changed;
+}
+
+const CRAMView &tile_cram(const Chip &chip, const string &tile)
+{
+    auto found = chip.tiles.find(tile);
+    if (found == chip.tiles.end())
+        throw runtime_error(fmt("tile " << tile << " not found in chip " << chip.info.name));
+    return found->second->cram;
+}
+
+BitDatabaseUpdate &tile_update(FuzzResult &result, const Chip &chip, const string &tile)
+{
+    if (!result.tile_dbs.count(tile)) {
+        tile_cram(chip, tile);
+        result.tile_dbs[tile] = TileLocator{chip.info.family, chip.info.name, chip.tiles.at(tile)->info.type};
+    }
+    return result.tile_updates[tile];
+}
+
+// The state of every bit in bits, as a BitGroup matched by the tile
+BitGroup bit_states(const CRAMView &tile, const set<pair<int, int>> &bits)
+{
+    BitGroup bg;
+    for (const auto &bit : bits)
+        bg.bits.insert(ConfigBit{bit.first, bit.second, !tile.bit(bit.first, bit.second)});
+    return bg;
+}
+}
+
+void FuzzResult::commit() const
+{
+    // Tiles of the same type share a database, so merge their entries so that they are checked against each other
+    unordered_map<TileLocator, BitDatabaseUpdate> db_updates;
+    vector<TileLocator> order;
+    for (const auto &tile : tile_updates) {
+        const TileLocator &loc = tile_dbs.at(tile.first);
+        if (!db_updates.count(loc))
+            order.push_back(loc);
+        BitDatabaseUpdate &update = db_updates[loc];
+        const BitDatabaseUpdate &tu = tile.second;
+        update.arcs.insert(update.arcs.end(), tu.arcs.begin(), tu.arcs.end());
+        update.words.insert(update.words.end(), tu.words.begin(), tu.words.end());
+        update.enums.insert(update.enums.end(), tu.enums.begin(), tu.enums.end());
+        update.fixed_conns.insert(update.fixed_conns.end(), tu.fixed_conns.begin(), tu.fixed_conns.end());
+    }
+    vector<shared_ptr<TileBitDatabase>> dbs;
+    for (const auto &loc : order) {
+        dbs.push_back(get_tile_bitdata(loc));
+        dbs.back()->check_update(db_updates.at(loc));
+    }
+    for (size_t i = 0; i < order.size(); i++) {
+        dbs.at(i)->add_update(db_updates.at(order.at(i)));
+        dbs.at(i)->compact_if_large();
+    }
+}
+
+FuzzResult solve_word_setting(const string &name, const Chip &baseline, const vector<Chip> &bit_chips,
+                              const vector<string> &tiles, const Chip *empty, unsigned threads)
+{
+    const vector<CompactChipDelta> diffs = diff_all(bit_chips, &baseline, threads);
+    FuzzResult result;
+    for (const auto &tile : tiles) {
+        WordSettingBits wsb;
+        wsb.name = name;
+        bool is_empty = true;
+        for (const auto &diff : diffs) {
+            auto found = diff.find(tile);
+            if (found != diff.end()) {
+                wsb.bits.emplace_back(found->second.to_delta());
+                is_empty = false;
+            } else {
+                wsb.bits.emplace_back();
+            }
+            if (empty != nullptr)
+                wsb.defval.push_back(wsb.bits.back().match(tile_cram(*empty, tile)));
+        }
+        if (!is_empty)
+            tile_update(result, baseline, tile).words.push_back(wsb);
+    }
+    return result;
+}
+
+FuzzResult solve_enum_setting(const string &name, const vector<string> &values, const vector<Chip> &chips,
+                              const vector<string> &tiles, const Chip *empty, bool include_zeros,
+                              const vector<Chip> &ignore, const vector<string> &pref_options, unsigned threads)
+{
+    if (values.size() != chips.size())
+        throw runtime_error(fmt("enum " << name << " has " << values.size() << " values but " << chips.size()
+                                        << " chips"));
+    if (chips.empty())
+        return FuzzResult();
+    // A bit differs between some pair of chips if and only if it differs between the first chip and another one
+    TileBits changed = changed_bits(diff_all(chips, nullptr, threads), tiles);
+    if (!ignore.empty()) {
+        TileBits ignored = changed_bits(diff_all(ignore, nullptr, threads), tiles);
+        for (auto &tile : changed)
+            for (const auto &bit : ignored[tile.first])
+                tile.second.erase(bit);
+    }
+    const set<string> pref(pref_options.begin(), pref_options.end());
+
+    FuzzResult result;
+    for (const auto &tile : changed) {
+        // Bits set by at least one preferred option and no other option
+        set<pair<int, int>> pref_only, set_by_other;
+        for (size_t i = 0; i < values.size(); i++) {
+            const CRAMView &cram = tile_cram(chips.at(i), tile.first);
+            for (const auto &bit : tile.second) {
+                if (!cram.bit(bit.first, bit.second))
+                    continue;
+                if (pref.count(values.at(i)))
+                    pref_only.insert(bit);
+                else
+                    set_by_other.insert(bit);
+            }
+        }
+        for (const auto &bit : set_by_other)
+            pref_only.erase(bit);
+
+        EnumSettingBits esb;
+        esb.name = name;
+        for (size_t i = 0; i < values.size(); i++) {
+            const CRAMView &cram = tile_cram(chips.at(i), tile.first);
+            BitGroup bg;
+            for (const auto &bit : tile.second) {
+                bool state = cram.bit(bit.first, bit.second);
+                if (!state && !include_zeros && empty != nullptr &&
+                    !tile_cram(*empty, tile.first).bit(bit.first, bit.second) && !pref_only.count(bit))
+                    continue;
+                bg.bits.insert(ConfigBit{bit.first, bit.second, !state});
+            }
+            esb.options[values.at(i)] = bg;
+            if (empty != nullptr && bg.match(tile_cram(*empty, tile.first)))
+                esb.defval = values.at(i);
+        }
+        tile_update(result, chips.at(0), tile.first).enums.push_back(esb);
+    }
+    return result;
+}
+
+FuzzResult solve_arcs(const Chip &baseline, const vector<FuzzArc> &arcs, const vector<Chip> &arc_chips,
+                      const vector<string> &tiles, bool full_mux, unsigned threads)
+{
+    if (arcs.size() != arc_chips.size())
+        throw runtime_error(fmt(arcs.size() << " arcs given but " << arc_chips.size() << " chips"));
+    const vector<CompactChipDelta> diffs = diff_all(arc_chips, &baseline, threads);
+    auto arc_data = [&](const FuzzArc &arc, const string &tile, const BitGroup &bits) {
+        auto found = arc.tile_names.find(tile);
+        if (found == arc.tile_names.end())
+            throw runtime_error(fmt("arc has no name in tile " << tile));
+        ArcData ad;
+        ad.source = found->second.first;
+        ad.sink = found->second.second;
+        ad.bits = bits;
+        return ad;
+    };
+
+    FuzzResult result;
+    if (full_mux && arcs.size() > 1) {
+        for (const auto &tile : changed_bits(diffs, tiles))
+            for (size_t i = 0; i < arcs.size(); i++)
+                tile_update(result, baseline, tile.first).arcs.push_back(
+                        arc_data(arcs.at(i), tile.first, bit_states(tile_cram(arc_chips.at(i), tile.first),
+                                                                    tile.second)));
+        return result;
+    }
+
+    for (size_t i = 0; i < arcs.size(); i++) {
+        const FuzzArc &arc = arcs.at(i);
+        if (diffs.at(i).empty()) {
+            // No difference means fixed interconnect, which is considered to be in the first tile
+            if (!tiles.empty() && !(arc.fixed_conn.source.empty() && arc.fixed_conn.sink.empty()))
+                tile_update(result, baseline, tiles.at(0)).fixed_conns.push_back(arc.fixed_conn);
+            continue;
+        }
+        for (const auto &tile : tiles) {
+            auto found = diffs.at(i).find(tile);
+            if (found != diffs.at(i).end())
+                tile_update(result, baseline, tile).arcs.push_back(
+                        arc_data(arc, tile, BitGroup(found->second.to_delta())));
+        }
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,519 @@
+#include "JobServer.hpp"
+#include "Database.hpp"
+#include "Log.hpp"
+#include "Parallel.hpp"
+#include "Util.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+
+#if defined(_WIN32) || defined(__wasm) || defined(NO_THREADS)
+#define TRELLIS_NO_SOCKETS
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace Trellis {
+
+namespace {
+const char *job_magic = "trellis-job-1";
+const uint32_t max_frame_strings = 1u << 20;
+// Request strings are paths and arguments, so a much smaller limit applies to them than to the output of a job
+const uint32_t max_request_string_size = 1u << 20;
+const uint32_t max_response_string_size = 1u << 30;
+// A client connected to the server must send its request, and read the response, within this time
+const int socket_timeout_seconds = 30;
+
+void put_u32(string &data, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        data.push_back(char((value >> (8 * i)) & 0xFF));
+}
+
+string encode_frame(const vector<string> &fields)
+{
+    string data;
+    put_u32(data, uint32_t(fields.size()));
+    for (const auto &field : fields) {
+        put_u32(data, uint32_t(field.size()));
+        data += field;
+    }
+    return data;
+}
+
+// Fills as much of a buffer as it can, returning the number of bytes read, which is less than asked for only at the
+// end of the input
+typedef function<size_t(char *, size_t)> FrameReader;
+
+uint32_t get_u32(const uint8_t *bytes)
+{
+    return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+}
+
+// Returns false if the input ends before the frame starts
+bool read_frame(const FrameReader &read, uint32_t max_string_size, vector<string> &fields)
+{
+    uint8_t bytes[4];
+    size_t got = read(reinterpret_cast<char *>(bytes), 4);
+    if (got == 0)
+        return false;
+    if (got != 4)
+        throw runtime_error("job frame is truncated");
+    uint32_t count = get_u32(bytes);
+    if (count > max_frame_strings)
+        throw runtime_error("job frame has too many strings");
+    fields.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        if (read(reinterpret_cast<char *>(bytes), 4) != 4)
+            throw runtime_error("job frame is truncated");
+        uint32_t size = get_u32(bytes);
+        if (size > max_string_size)
+            throw runtime_error("job frame string is too long");
+        string field(size, '\0');
+        if (size > 0 && read(&field[0], size) != size)
+            throw runtime_error("job frame is truncated");
+        fields.push_back(move(field));
+    }
+    return true;
+}
+
+vector<string> request_fields(const string &id, const JobRequest &request)
+{
+    vector<string> fields{job_magic, id, request.tool, request.cwd, request.default_database};
+    fields.insert(fields.end(), request.args.begin(), request.args.end());
+    return fields;
+}
+
+JobRequest parse_request(const vector<string> &fields, string &id)
+{
+    if (fields.size() < 6 || fields.at(0) != job_magic)
+        throw runtime_error("invalid job request");
+    JobRequest request;
+    id = fields.at(1);
+    request.tool = fields.at(2);
+    request.cwd = fields.at(3);
+    request.default_database = fields.at(4);
+    request.args.assign(fields.begin() + 5, fields.end());
+    return request;
+}
+
+vector<string> response_fields(const string &id, const JobResult &result)
+{
+    return vector<string>{job_magic, id, result.served ? "1" : "0", std::to_string(result.exit_code), result.out,
+                          result.err};
+}
+
+JobResult parse_response(const vector<string> &fields)
+{
+    if (fields.size() != 6 || fields.at(0) != job_magic)
+        throw runtime_error("invalid job response");
+    JobResult result;
+    result.served = fields.at(2) == "1";
+    result.exit_code = atoi(fields.at(3).c_str());
+    result.out = fields.at(4);
+    result.err = fields.at(5);
+    return result;
+}
+
+#ifndef TRELLIS_NO_SOCKETS
+#ifdef MSG_NOSIGNAL
+const int send_flags = MSG_NOSIGNAL;
+#else
+const int send_flags = 0;
+#endif
+
+// Returns false if the path doesn't fit in a socket address
+bool socket_address(const string &socket_path, sockaddr_un &addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path))
+        return false;
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return true;
+}
+
+int new_socket()
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+#ifdef SO_NOSIGPIPE
+    if (fd >= 0) {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+#endif
+    return fd;
+}
+
+// Returns -1 if nothing is listening on the socket
+int connect_socket(const string &socket_path)
+{
+    sockaddr_un addr;
+    if (!socket_address(socket_path, addr))
+        return -1;
+    int fd = new_socket();
+    if (fd < 0)
+        return -1;
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+size_t read_fd(int fd, char *buf, size_t size)
+{
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, buf + done, size - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            throw runtime_error("timed out reading from socket");
+        if (n < 0)
+            throw runtime_error(string("failed to read from socket: ") + strerror(errno));
+        if (n == 0)
+            break;
+        done += size_t(n);
+    }
+    return done;
+}
+
+void write_fd(int fd, const string &data)
+{
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = send(fd, data.data() + done, data.size() - done, send_flags);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            throw runtime_error("timed out writing to socket");
+        if (n < 0)
+            throw runtime_error(string("failed to write to socket: ") + strerror(errno));
+        done += size_t(n);
+    }
+}
+
+class SocketCloser
+{
+public:
+    explicit SocketCloser(int fd) : fd(fd)
+    {}
+
+    ~SocketCloser()
+    {
+        close(fd);
+    }
+
+    SocketCloser(const SocketCloser &) = delete;
+    SocketCloser &operator=(const SocketCloser &) = delete;
+
+private:
+    int fd;
+};
+#endif
+}
+
+JobContext::JobContext(ostream &out, ostream &err, string default_database)
+        : out(out), err(err), default_database(move(default_database))
+{}
+
+JobContext::JobContext(ostream &out, ostream &err, string default_database, string cwd, string server_database)
+        : out(out), err(err), default_database(move(default_database)), cwd(move(cwd)),
+          server_database(move(server_database))
+{}
+
+string JobContext::path(const string &name) const
+{
+    if (cwd.empty() || name.empty() || boost::filesystem::path(name).is_absolute())
+        return name;
+    return (boost::filesystem::path(cwd) / name).string();
+}
+
+void JobContext::load_database(const string &root) const
+{
+    if (!in_server()) {
+        Trellis::load_database(root);
+        return;
+    }
+    boost::system::error_code ec;
+    if (!boost::filesystem::equivalent(path(root), server_database, ec) || ec)
+        throw JobNotServed("the server has a different database loaded");
+}
+
+bool JobContext::in_server() const
+{
+    return !server_database.empty();
+}
+
+JobServer::JobServer(string database, map<string, JobFunction> tools, unsigned threads)
+        : database(move(database)), tools(move(tools))
+{
+#ifdef NO_THREADS
+    UNUSED(threads);
+#else
+    if (threads == 0)
+        threads = default_thread_count();
+    for (unsigned i = 0; i < threads; i++)
+        workers.emplace_back(&JobServer::worker, this);
+#endif
+}
+
+JobServer::~JobServer()
+{
+#ifndef NO_THREADS
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_ready.notify_all();
+    for (auto &w : workers)
+        w.join();
+#endif
+}
+
+JobResult JobServer::run(const JobRequest &request) const
+{
+    JobResult result;
+    auto tool = tools.find(request.tool);
+    if (tool == tools.end() || request.args.empty())
+        return result;
+
+    ostringstream out, err;
+    JobContext ctx(out, err, request.default_database, request.cwd, database);
+    vector<string> args = request.args;
+    vector<char *> argv;
+    for (auto &arg : args)
+        argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+
+    // Messages logged by the job are part of its stderr. parallel_for may log from several threads at once
+#ifndef NO_THREADS
+    mutex err_mutex;
+#endif
+    ScopedLogSink sink([&](const LogMessage &msg) {
+#ifndef NO_THREADS
+        lock_guard<mutex> lock(err_mutex);
+#endif
+        if (!msg.component.empty())
+            err << msg.component << ": ";
+        err << msg.text << endl;
+    });
+    try {
+        result.exit_code = tool->second(int(args.size()), argv.data(), ctx);
+    } catch (JobNotServed &) {
+        return JobResult();
+    } catch (exception &e) {
+        err << "Error: " << e.what() << endl;
+        result.exit_code = 1;
+    }
+    result.served = true;
+    result.out = out.str();
+    result.err = err.str();
+    return result;
+}
+
+void JobServer::submit(function<void()> task)
+{
+#ifdef NO_THREADS
+    task();
+#else
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        tasks.push(move(task));
+    }
+    queue_ready.notify_one();
+#endif
+}
+
+void JobServer::wait_idle()
+{
+#ifndef NO_THREADS
+    unique_lock<mutex> lock(queue_mutex);
+    queue_idle.wait(lock, [&]() { return tasks.empty() && active == 0; });
+#endif
+}
+
+#ifndef NO_THREADS
+void JobServer::worker()
+{
+    unique_lock<mutex> lock(queue_mutex);
+    while (true) {
+        queue_ready.wait(lock, [&]() { return stopping || !tasks.empty(); });
+        if (tasks.empty())
+            return;
+        function<void()> task = move(tasks.front());
+        tasks.pop();
+        active++;
+        lock.unlock();
+        try {
+            task();
+        } catch (exception &e) {
+            TRELLIS_LOG(VerbosityLevel::ERROR, "jobserver", e.what());
+        }
+        lock.lock();
+        active--;
+        if (tasks.empty() && active == 0)
+            queue_idle.notify_all();
+    }
+}
+#endif
+
+void JobServer::serve_stream(istream &in, ostream &out)
+{
+#ifndef NO_THREADS
+    mutex out_mutex;
+#endif
+    auto respond = [&](const string &id, const JobResult &result) {
+        string response = encode_frame(response_fields(id, result));
+#ifndef NO_THREADS
+        lock_guard<mutex> lock(out_mutex);
+#endif
+        out.write(response.data(), streamsize(response.size()));
+        out.flush();
+    };
+    FrameReader read = [&](char *buf, size_t size) {
+        in.read(buf, streamsize(size));
+        return size_t(in.gcount());
+    };
+    try {
+        vector<string> fields;
+        while (read_frame(read, max_request_string_size, fields)) {
+            string id;
+            JobRequest request = parse_request(fields, id);
+            submit([this, &respond, id, request]() { respond(id, run(request)); });
+        }
+    } catch (...) {
+        // Jobs still running refer to the output stream
+        wait_idle();
+        throw;
+    }
+    wait_idle();
+}
+
+#ifdef TRELLIS_NO_SOCKETS
+void JobServer::serve_socket(const string &socket_path)
+{
+    UNUSED(socket_path);
+    throw runtime_error("job server sockets are not supported on this platform");
+}
+
+bool send_job(const string &socket_path, const JobRequest &request, JobResult &result)
+{
+    UNUSED(socket_path);
+    UNUSED(request);
+    UNUSED(result);
+    return false;
+}
+#else
+void JobServer::serve_socket(const string &socket_path)
+{
+    sockaddr_un addr;
+    if (!socket_address(socket_path, addr))
+        throw runtime_error("invalid socket path " + socket_path);
+    int fd = new_socket();
+    if (fd < 0)
+        throw runtime_error(string("failed to create socket: ") + strerror(errno));
+    SocketCloser closer(fd);
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        if (errno != EADDRINUSE)
+            throw runtime_error("failed to bind socket " + socket_path + ": " + strerror(errno));
+        // Only replace the socket file if nothing is listening on it any more
+        int probe = connect_socket(socket_path);
+        if (probe >= 0) {
+            close(probe);
+            throw runtime_error("a server is already listening on " + socket_path);
+        }
+        unlink(socket_path.c_str());
+        if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+            throw runtime_error("failed to bind socket " + socket_path + ": " + strerror(errno));
+    }
+    if (listen(fd, SOMAXCONN) != 0)
+        throw runtime_error("failed to listen on socket " + socket_path + ": " + strerror(errno));
+
+    while (true) {
+        int conn = accept(fd, nullptr, nullptr);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            throw runtime_error(string("failed to accept connection: ") + strerror(errno));
+        }
+        // A client that stops sending or reading must not hold up a worker for ever
+        timeval timeout{socket_timeout_seconds, 0};
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        submit([this, conn]() {
+            SocketCloser conn_closer(conn);
+            vector<string> fields;
+            if (!read_frame([conn](char *buf, size_t size) { return read_fd(conn, buf, size); },
+                            max_request_string_size, fields))
+                return;
+            string id;
+            JobRequest request = parse_request(fields, id);
+            write_fd(conn, encode_frame(response_fields(id, run(request))));
+        });
+    }
+}
+
+bool send_job(const string &socket_path, const JobRequest &request, JobResult &result)
+{
+    int fd = connect_socket(socket_path);
+    if (fd < 0)
+        return false;
+    SocketCloser closer(fd);
+    try {
+        write_fd(fd, encode_frame(request_fields("0", request)));
+        vector<string> fields;
+        if (!read_frame([fd](char *buf, size_t size) { return read_fd(fd, buf, size); }, max_response_string_size,
+                        fields))
+            return false;
+        result = parse_response(fields);
+    } catch (runtime_error &) {
+        return false;
+    }
+    return true;
+}
+#endif
+
+int run_tool(const string &tool, const JobFunction &func, int argc, char *argv[], const string &default_database)
+{
+    string server;
+    const char *env_server = getenv("TRELLIS_SERVER");
+    if (env_server != nullptr)
+        server = env_server;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--server" && i + 1 < argc)
+            server = argv[i + 1];
+        else if (arg.compare(0, 9, "--server=") == 0)
+            server = arg.substr(9);
+    }
+
+    if (!server.empty()) {
+        JobRequest request;
+        request.tool = tool;
+        request.default_database = default_database;
+        boost::system::error_code ec;
+        request.cwd = boost::filesystem::current_path(ec).string();
+        request.args.assign(argv, argv + argc);
+        JobResult result;
+        if (!ec && send_job(server, request, result) && result.served) {
+            cout << result.out << flush;
+            cerr << result.err << flush;
+            return result.exit_code;
+        }
+    }
+
+    JobContext ctx(cout, cerr, default_database);
+    return func(argc, argv, ctx);
+}
+
+}
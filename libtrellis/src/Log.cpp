@@ -0,0 +1,195 @@
+#include "Log.hpp"
+#include <iostream>
+
+namespace Trellis {
+
+namespace {
+#ifndef NO_THREADS
+mutex sink_mutex, stderr_mutex;
+thread_local shared_ptr<const LogSink> current_thread_sink;
+#else
+shared_ptr<const LogSink> current_thread_sink;
+#endif
+
+// Never destroyed, as messages may still be logged while static objects are being destroyed
+shared_ptr<const LogSink> &global_sink()
+{
+    static shared_ptr<const LogSink> *sink = new shared_ptr<const LogSink>();
+    return *sink;
+}
+
+void write_stderr(const LogMessage &msg)
+{
+    // Written in one go so that lines from different threads are not mixed up
+    string line = msg.component.empty() ? msg.text : msg.component + ": " + msg.text;
+    line += '\n';
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(stderr_mutex);
+#endif
+    cerr << line;
+}
+}
+
+void log_message(VerbosityLevel level, const string &component, const string &text)
+{
+    if (!log_enabled(level))
+        return;
+    shared_ptr<const LogSink> sink = current_thread_sink;
+    if (!sink) {
+#ifndef NO_THREADS
+        lock_guard<mutex> lock(sink_mutex);
+#endif
+        sink = global_sink();
+    }
+    LogMessage msg{level, component, text};
+    if (sink)
+        (*sink)(msg);
+    else
+        write_stderr(msg);
+}
+
+void set_log_sink(LogSink sink)
+{
+    shared_ptr<const LogSink> new_sink;
+    if (sink)
+        new_sink = make_shared<const LogSink>(move(sink));
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(sink_mutex);
+#endif
+    // The old sink is destroyed here unless a thread is still using it, in which case that thread destroys it
+    global_sink().swap(new_sink);
+}
+
+shared_ptr<const LogSink> thread_log_sink()
+{
+    return current_thread_sink;
+}
+
+ScopedLogSink::ScopedLogSink(LogSink sink)
+        : ScopedLogSink(sink ? make_shared<const LogSink>(move(sink)) : shared_ptr<const LogSink>())
+{}
+
+ScopedLogSink::ScopedLogSink(shared_ptr<const LogSink> sink) : previous(current_thread_sink)
+{
+    current_thread_sink = move(sink);
+}
+
+ScopedLogSink::~ScopedLogSink()
+{
+    current_thread_sink = move(previous);
+}
+
+LogBuffer::LogBuffer(size_t capacity) : capacity(capacity > 0 ? capacity : 1)
+{}
+
+void LogBuffer::push(const LogMessage &msg)
+{
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(buffer_mutex);
+#endif
+    if (messages.size() >= capacity) {
+        messages.pop_front();
+        dropped_count++;
+    }
+    messages.push_back(msg);
+}
+
+vector<LogMessage> LogBuffer::drain()
+{
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(buffer_mutex);
+#endif
+    vector<LogMessage> result(make_move_iterator(messages.begin()), make_move_iterator(messages.end()));
+    messages.clear();
+    return result;
+}
+
+uint64_t LogBuffer::dropped() const
+{
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(buffer_mutex);
+#endif
+    return dropped_count;
+}
+
+LogSink LogBuffer::sink(shared_ptr<LogBuffer> buffer)
+{
+    return [buffer](const LogMessage &msg) { buffer->push(msg); };
+}
+
+#ifdef NO_THREADS
+AsyncLogSink::AsyncLogSink(LogSink downstream, size_t) : downstream(move(downstream))
+{}
+
+AsyncLogSink::~AsyncLogSink()
+{}
+
+void AsyncLogSink::push(const LogMessage &msg)
+{
+    downstream(msg);
+}
+
+void AsyncLogSink::flush()
+{}
+#else
+AsyncLogSink::AsyncLogSink(LogSink downstream, size_t capacity)
+        : downstream(move(downstream)), buffer(capacity), worker(&AsyncLogSink::run, this)
+{}
+
+AsyncLogSink::~AsyncLogSink()
+{
+    {
+        lock_guard<mutex> lock(state_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+void AsyncLogSink::push(const LogMessage &msg)
+{
+    buffer.push(msg);
+    {
+        lock_guard<mutex> lock(state_mutex);
+        pushed++;
+    }
+    wake.notify_one();
+}
+
+void AsyncLogSink::flush()
+{
+    unique_lock<mutex> lock(state_mutex);
+    const uint64_t target = pushed;
+    drained.wait(lock, [&]() { return passed + buffer.dropped() >= target; });
+}
+
+void AsyncLogSink::run()
+{
+    unique_lock<mutex> lock(state_mutex);
+    while (true) {
+        wake.wait(lock, [&]() { return stopping || pushed > passed + buffer.dropped(); });
+        const bool stop = stopping;
+        lock.unlock();
+        vector<LogMessage> messages = buffer.drain();
+        for (const auto &msg : messages) {
+            try {
+                downstream(msg);
+            } catch (...) {
+                // A failing sink loses the message, but must not stop the messages after it
+            }
+        }
+        lock.lock();
+        passed += messages.size();
+        drained.notify_all();
+        if (stop && messages.empty())
+            return;
+    }
+}
+#endif
+
+LogSink AsyncLogSink::sink(shared_ptr<AsyncLogSink> async)
+{
+    return [async](const LogMessage &msg) { async->push(msg); };
+}
+
+}
@@ -1,5 +1,6 @@
 #include "DedupChipdb.hpp"
 #include "Chip.hpp"
+#include "Parallel.hpp"
 
 namespace Trellis {
 namespace DDChipDb {
@@ -15,33 +16,15 @@ OptimizedChipdb::OptimizedChipdb(const IdStore &base) : IdStore(base)
 shared_ptr<OptimizedChipdb> make_optimized_chipdb(Chip &chip)
 {
     shared_ptr<RoutingGraph> graph = chip.get_routing_graph();
-    for (auto &loc : graph->tiles) {
-        const auto &td = loc.second;
-        // Index bels, wires and arcs
-        int bel_id = 0, wire_id = 0, arc_id = 0;
-        for (auto &bel : td.bels) {
-            RoutingId rid;
-            rid.loc = loc.first;
-            rid.id = bel.first;
-            bel.second.cdb_id = bel_id++;
-        }
-        for (auto &wire : td.wires) {
-            RoutingId rid;
-            rid.loc = loc.first;
-            rid.id = wire.first;
-            wire.second.cdb_id  = wire_id++;
-        }
-        for (auto &arc : td.arcs) {
-            RoutingId rid;
-            rid.loc = loc.first;
-            rid.id = arc.first;
-            arc.second.cdb_id = arc_id++;
-        }
-    }
+    const RoutingGraphIndex index(*graph);
+    const vector<Location> &locs = index.locations();
     shared_ptr<OptimizedChipdb> cdb = make_shared<OptimizedChipdb>(IdStore(*graph));
-    for (const auto &loc : graph->tiles) {
-        LocationData ld;
-        const auto &td = loc.second;
+
+    vector<LocationData> lds(locs.size());
+    parallel_for(locs.size(), [&](size_t i) {
+        LocationData &ld = lds.at(i);
+        const auto &td = graph->tiles.at(locs.at(i));
+        ld.bels.reserve(td.bels.size());
         for (const auto &bel : td.bels) {
             const RoutingBel &rb = bel.second;
             BelData bd;
@@ -51,51 +34,55 @@ shared_ptr<OptimizedChipdb> make_optimized_chipdb(Chip &chip)
             for (const auto &wire : rb.pins) {
                 BelWire bw;
                 bw.pin = wire.first;
-                bw.wire = OptId{wire.second.first.loc, graph->tiles.at(wire.second.first.loc).wires.at(wire.second.first.id).cdb_id};
+                bw.wire = OptId{wire.second.first.loc, index.wire_id(wire.second.first)};
                 bw.dir = wire.second.second;
                 bd.wires.push_back(bw);
             }
-            ld.bels.push_back(bd);
+            ld.bels.push_back(std::move(bd));
         }
 
+        ld.arcs.reserve(td.arcs.size());
         for (const auto &arc : td.arcs) {
             const RoutingArc &ra = arc.second;
             OptArcData ad;
             ad.tiletype = ra.tiletype;
             ad.cls = ra.configurable ? ARC_STANDARD : ARC_FIXED;
             ad.delay = 1;
-            ad.sinkWire = OptId{ra.sink.loc, graph->tiles.at(ra.sink.loc).wires.at(ra.sink.id).cdb_id};
-            ad.srcWire = OptId{ra.source.loc, graph->tiles.at(ra.source.loc).wires.at(ra.source.id).cdb_id};
+            ad.sinkWire = OptId{ra.sink.loc, index.wire_id(ra.sink)};
+            ad.srcWire = OptId{ra.source.loc, index.wire_id(ra.source)};
+            ad.lutperm_flags = ra.lutperm_flags;
             ld.arcs.push_back(ad);
         }
 
+        ld.wires.reserve(td.wires.size());
         for (const auto &wire : td.wires) {
             const RoutingWire &rw = wire.second;
             WireData wd;
             wd.name = rw.id;
             for (const auto &dh : rw.downhill)
-                wd.arcsDownhill.insert(OptId{dh.loc, graph->tiles.at(dh.loc).arcs.at(dh.id).cdb_id});
+                wd.arcsDownhill.insert(OptId{dh.loc, index.arc_id(dh)});
             for (const auto &uh : rw.uphill)
-                wd.arcsUphill.insert(OptId{uh.loc, graph->tiles.at(uh.loc).arcs.at(uh.id).cdb_id});
+                wd.arcsUphill.insert(OptId{uh.loc, index.arc_id(uh)});
             for (const auto &bdh : rw.belsDownhill) {
                 BelPort bp;
                 bp.pin = bdh.second;
-                bp.bel = OptId{bdh.first.loc, graph->tiles.at(bdh.first.loc).bels.at(bdh.first.id).cdb_id};
+                bp.bel = OptId{bdh.first.loc, index.bel_id(bdh.first)};
                 wd.belPins.push_back(bp);
             }
             assert(rw.belsUphill.size() <= 1);
             if (rw.belsUphill.size() == 1) {
                 const auto &buh = rw.belsUphill[0];
                 BelPort uh;
-                uh.bel = OptId{buh.first.loc, graph->tiles.at(buh.first.loc).bels.at(buh.first.id).cdb_id};
+                uh.bel = OptId{buh.first.loc, index.bel_id(buh.first)};
                 uh.pin = buh.second;
                 wd.belPins.push_back(uh);
             }
-            ld.wires.push_back(wd);
+            ld.wires.push_back(std::move(wd));
         }
+    });
 
-        cdb->tiles[loc.first] = ld;
-    }
+    for (size_t i = 0; i < locs.size(); i++)
+        cdb->tiles.emplace_hint(cdb->tiles.end(), locs.at(i), std::move(lds.at(i)));
 
     return cdb;
 }
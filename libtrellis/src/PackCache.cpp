@@ -0,0 +1,230 @@
+#include "PackCache.hpp"
+#include "BitDatabase.hpp"
+#include "CRAM.hpp"
+#include "Profile.hpp"
+#include "TileConfig.hpp"
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace Trellis {
+
+static const char pack_cache_magic[8] = {'T', 'R', 'P', 'C', 'A', 'C', 'H', 'E'};
+static const uint32_t pack_cache_version = 1;
+
+/*
+Cache file format, all integers little endian:
+    magic "TRPCACHE", uint32 version
+    uint32 tile entry count, then for each: uint32 key length, key, uint32 write count, uint32 writes
+    uint32 frame entry count, then for each: uint32 key length, key, uint32 data length, data
+ */
+
+namespace {
+void write_u32(ostream &out, uint32_t value)
+{
+    char buf[4] = {char(value & 0xFF), char((value >> 8) & 0xFF), char((value >> 16) & 0xFF), char(value >> 24)};
+    out.write(buf, 4);
+}
+
+class CacheReader
+{
+public:
+    CacheReader(const vector<char> &data) : pos(data.data()), end(data.data() + data.size())
+    {}
+
+    const char *take(size_t len)
+    {
+        if (len > size_t(end - pos))
+            throw runtime_error("truncated cache file");
+        const char *p = pos;
+        pos += len;
+        return p;
+    }
+
+    uint32_t read_u32()
+    {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(take(4));
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    string read_string()
+    {
+        uint32_t len = read_u32();
+        return string(take(len), len);
+    }
+
+    bool at_end() const
+    {
+        return pos == end;
+    }
+
+private:
+    const char *pos, *end;
+};
+}
+
+PackCache::PackCache(const string &filename) : filename(filename)
+{
+    try {
+        load();
+    } catch (runtime_error &) {
+        // An unreadable cache is the same as no cache
+        tiles.clear();
+        frames.clear();
+    }
+}
+
+void PackCache::load()
+{
+    ifstream in(filename, ios::binary);
+    if (!in)
+        return;
+    vector<char> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    CacheReader rd(data);
+    if (memcmp(rd.take(sizeof(pack_cache_magic)), pack_cache_magic, sizeof(pack_cache_magic)) != 0)
+        throw runtime_error("not a pack cache file");
+    if (rd.read_u32() != pack_cache_version)
+        throw runtime_error("unsupported pack cache version");
+    uint32_t count = rd.read_u32();
+    for (uint32_t i = 0; i < count; i++) {
+        string key = rd.read_string();
+        Entry &entry = tiles[key];
+        entry.writes.resize(rd.read_u32());
+        for (auto &w : entry.writes)
+            w = rd.read_u32();
+    }
+    count = rd.read_u32();
+    for (uint32_t i = 0; i < count; i++) {
+        string key = rd.read_string();
+        Entry &entry = frames[key];
+        uint32_t len = rd.read_u32();
+        const char *bytes = rd.take(len);
+        entry.data.assign(bytes, bytes + len);
+    }
+    if (!rd.at_end())
+        throw runtime_error("unexpected data at end of cache file");
+}
+
+void PackCache::save() const
+{
+    // Write to a temporary file first, so an interrupted save never leaves a damaged cache behind
+    string tmp_filename = filename + ".tmp";
+    {
+        ofstream out(tmp_filename, ios::binary);
+        if (!out)
+            throw runtime_error("failed to open cache file " + tmp_filename + " for writing");
+        out.write(pack_cache_magic, sizeof(pack_cache_magic));
+        write_u32(out, pack_cache_version);
+        auto write_entries = [&](const unordered_map<string, Entry> &entries, bool is_tile) {
+            uint32_t count = 0;
+            for (const auto &entry : entries)
+                if (entry.second.used)
+                    count++;
+            write_u32(out, count);
+            for (const auto &entry : entries) {
+                if (!entry.second.used)
+                    continue;
+                write_u32(out, uint32_t(entry.first.size()));
+                out.write(entry.first.data(), streamsize(entry.first.size()));
+                if (is_tile) {
+                    write_u32(out, uint32_t(entry.second.writes.size()));
+                    for (uint32_t w : entry.second.writes)
+                        write_u32(out, w);
+                } else {
+                    write_u32(out, uint32_t(entry.second.data.size()));
+                    out.write(reinterpret_cast<const char *>(entry.second.data.data()),
+                              streamsize(entry.second.data.size()));
+                }
+            }
+        };
+        write_entries(tiles, true);
+        write_entries(frames, false);
+        if (!out)
+            throw runtime_error("failed to write cache file " + tmp_filename);
+    }
+    // boost::filesystem::rename replaces an existing file on Windows too, unlike rename
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp_filename, filename, ec);
+    if (ec)
+        throw runtime_error("failed to replace cache file " + filename);
+}
+
+uint64_t PackCache::get_db_hash(const TileBitDatabase &db)
+{
+    auto found = db_hashes.find(&db);
+    if (found == db_hashes.end())
+        found = db_hashes.emplace(&db, db.get_content_hash()).first;
+    return found->second;
+}
+
+void PackCache::config_to_tile_cram(const string &tiletype, const TileBitDatabase &db, const TileConfig &cfg,
+                                    CRAMView &tile)
+{
+    int tile_frames = tile.frames(), tile_bits = tile.bits();
+    string key = tiletype;
+    key.push_back('\0');
+    uint64_t header[3] = {uint64_t(tile_frames), uint64_t(tile_bits), get_db_hash(db)};
+    key.append(reinterpret_cast<const char *>(header), sizeof(header));
+    cfg.write(key);
+
+    auto found = tiles.find(key);
+    if (found == tiles.end()) {
+        tile_misses++;
+        Profile::add_count("packcache.tile_misses");
+        // Encode onto all-zero and all-one tiles: the bits that come out the same in both are those written
+        CRAM zeros(tile_frames, tile_bits), ones(tile_frames, tile_bits);
+        for (auto &frame : *ones.data)
+            fill(frame.begin(), frame.end(), 1);
+        CRAMView zeros_view = zeros.make_view(0, 0, tile_frames, tile_bits);
+        CRAMView ones_view = ones.make_view(0, 0, tile_frames, tile_bits);
+        db.config_to_tile_cram(cfg, zeros_view);
+        db.config_to_tile_cram(cfg, ones_view);
+        Entry entry;
+        for (int f = 0; f < tile_frames; f++)
+            for (int b = 0; b < tile_bits; b++)
+                if (zeros.bit(f, b) == ones.bit(f, b))
+                    entry.writes.push_back((uint32_t(f * tile_bits + b) << 1) | uint32_t(zeros.bit(f, b) & 1));
+        found = tiles.emplace(std::move(key), std::move(entry)).first;
+    } else {
+        tile_hits++;
+        Profile::add_count("packcache.tile_hits");
+    }
+    found->second.used = true;
+    for (uint32_t w : found->second.writes) {
+        int idx = int(w >> 1);
+        tile.bit(idx / tile_bits, idx % tile_bits) = char(w & 1);
+    }
+}
+
+static string frame_key(const array<uint8_t, 8> &dict, const vector<uint8_t> &frame)
+{
+    string key(dict.begin(), dict.end());
+    key.append(frame.begin(), frame.end());
+    return key;
+}
+
+const vector<uint8_t> *PackCache::find_compressed_frame(const array<uint8_t, 8> &dict, const vector<uint8_t> &frame)
+{
+    auto found = frames.find(frame_key(dict, frame));
+    if (found == frames.end()) {
+        frame_misses++;
+        Profile::add_count("packcache.frame_misses");
+        return nullptr;
+    }
+    frame_hits++;
+    Profile::add_count("packcache.frame_hits");
+    found->second.used = true;
+    return &found->second.data;
+}
+
+void PackCache::add_compressed_frame(const array<uint8_t, 8> &dict, const vector<uint8_t> &frame,
+                                     const vector<uint8_t> &compressed)
+{
+    Entry &entry = frames[frame_key(dict, frame)];
+    entry.data = compressed;
+    entry.used = true;
+}
+
+}
@@ -0,0 +1,327 @@
+#include "Profile.hpp"
+#include "Util.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifndef NO_THREADS
+#include <mutex>
+#endif
+
+namespace Trellis {
+namespace Profile {
+#ifdef NO_THREADS
+bool enabled_flag = false;
+#else
+atomic<bool> enabled_flag{false};
+#endif
+
+namespace {
+const size_t max_trace_events = 1000000;
+
+struct Event
+{
+    const char *name;
+    int64_t start, end;
+};
+
+struct TimerTotals
+{
+    uint64_t calls = 0;
+    int64_t total = 0, min = numeric_limits<int64_t>::max(), max = 0;
+
+    void add(int64_t time)
+    {
+        calls++;
+        total += time;
+        min = std::min(min, time);
+        max = std::max(max, time);
+    }
+
+    void add(const TimerTotals &other)
+    {
+        calls += other.calls;
+        total += other.total;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+    }
+};
+
+// Everything recorded by one thread
+struct ThreadRecord
+{
+#ifndef NO_THREADS
+    mutex record_mutex;
+#endif
+    int tid = 0;
+    vector<Event> events;
+    uint64_t dropped_events = 0;
+    unordered_map<const char *, TimerTotals> timers;
+    unordered_map<const char *, uint64_t> counters;
+};
+
+struct Registry
+{
+#ifndef NO_THREADS
+    mutex registry_mutex;
+#endif
+    vector<unique_ptr<ThreadRecord>> threads;
+    // What threads that have exited recorded, merged together so that their records can be freed. Only the first
+    // million of their events are kept for the trace
+    unordered_map<const char *, TimerTotals> retired_timers;
+    unordered_map<const char *, uint64_t> retired_counters;
+    vector<pair<int, Event>> retired_events;
+    uint64_t retired_dropped_events = 0;
+    int next_tid = 0;
+    // Time that trace timestamps are relative to
+    int64_t epoch = 0;
+};
+
+// Never destroyed, as threads may still record while static objects are being destroyed
+Registry &registry()
+{
+    static Registry *r = new Registry();
+    return *r;
+}
+
+struct ThreadHandle
+{
+    ThreadRecord *record = nullptr;
+
+    ~ThreadHandle()
+    {
+        if (record == nullptr)
+            return;
+        Registry &r = registry();
+#ifndef NO_THREADS
+        lock_guard<mutex> lock(r.registry_mutex);
+#endif
+        for (const auto &timer : record->timers)
+            r.retired_timers[timer.first].add(timer.second);
+        for (const auto &counter : record->counters)
+            r.retired_counters[counter.first] += counter.second;
+        r.retired_dropped_events += record->dropped_events;
+        for (const auto &event : record->events) {
+            if (r.retired_events.size() < max_trace_events)
+                r.retired_events.emplace_back(record->tid, event);
+            else
+                r.retired_dropped_events++;
+        }
+        r.threads.erase(find_if(r.threads.begin(), r.threads.end(),
+                                [&](const unique_ptr<ThreadRecord> &t) { return t.get() == record; }));
+    }
+};
+
+ThreadRecord &this_thread_record()
+{
+#ifdef NO_THREADS
+    static ThreadHandle handle;
+#else
+    thread_local ThreadHandle handle;
+#endif
+    if (handle.record == nullptr) {
+        Registry &r = registry();
+#ifndef NO_THREADS
+        lock_guard<mutex> lock(r.registry_mutex);
+#endif
+        r.threads.emplace_back(new ThreadRecord());
+        handle.record = r.threads.back().get();
+        handle.record->tid = r.next_tid++;
+    }
+    return *handle.record;
+}
+
+// Totals of every thread, by name
+void merge_totals(Registry &r, map<string, TimerTotals> &timers, map<string, uint64_t> &counters)
+{
+    for (const auto &timer : r.retired_timers)
+        timers[timer.first].add(timer.second);
+    for (const auto &counter : r.retired_counters)
+        counters[counter.first] += counter.second;
+    uint64_t dropped_events = r.retired_dropped_events;
+    for (const auto &thread : r.threads) {
+#ifndef NO_THREADS
+        lock_guard<mutex> lock(thread->record_mutex);
+#endif
+        for (const auto &timer : thread->timers)
+            timers[timer.first].add(timer.second);
+        for (const auto &counter : thread->counters)
+            counters[counter.first] += counter.second;
+        dropped_events += thread->dropped_events;
+    }
+    if (dropped_events > 0)
+        counters["profile.dropped_trace_events"] += dropped_events;
+}
+}
+
+void set_enabled(bool enabled)
+{
+    Registry &r = registry();
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(r.registry_mutex);
+#endif
+    if (enabled && r.epoch == 0)
+        r.epoch = Timer::now();
+    enabled_flag = enabled;
+}
+
+void reset()
+{
+    Registry &r = registry();
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(r.registry_mutex);
+#endif
+    for (auto &thread : r.threads) {
+#ifndef NO_THREADS
+        lock_guard<mutex> thread_lock(thread->record_mutex);
+#endif
+        thread->events.clear();
+        thread->events.shrink_to_fit();
+        thread->dropped_events = 0;
+        thread->timers.clear();
+        thread->counters.clear();
+    }
+    r.retired_timers.clear();
+    r.retired_counters.clear();
+    r.retired_events.clear();
+    r.retired_events.shrink_to_fit();
+    r.retired_dropped_events = 0;
+    r.epoch = Timer::now();
+}
+
+int64_t Timer::now()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Timer::record(const char *name, int64_t start, int64_t end)
+{
+    ThreadRecord &thread = this_thread_record();
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(thread.record_mutex);
+#endif
+    thread.timers[name].add(end - start);
+    if (thread.events.size() < max_trace_events)
+        thread.events.push_back(Event{name, start, end});
+    else
+        thread.dropped_events++;
+}
+
+void add_count_enabled(const char *name, uint64_t count)
+{
+    ThreadRecord &thread = this_thread_record();
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(thread.record_mutex);
+#endif
+    thread.counters[name] += count;
+}
+
+void write_summary(ostream &out)
+{
+    map<string, TimerTotals> timers;
+    map<string, uint64_t> counters;
+    {
+        Registry &r = registry();
+#ifndef NO_THREADS
+        lock_guard<mutex> lock(r.registry_mutex);
+#endif
+        merge_totals(r, timers, counters);
+    }
+    const ios::fmtflags flags = out.flags();
+    const streamsize precision = out.precision();
+    out << fixed << setprecision(3);
+    out << "{" << endl << "  \"timers\": {";
+    bool first = true;
+    for (const auto &timer : timers) {
+        const TimerTotals &t = timer.second;
+        out << (first ? "" : ",") << endl << "    ";
+        write_json_string(out, timer.first);
+        out << ": {\"calls\": " << t.calls << ", \"total_ms\": " << t.total / 1e6
+            << ", \"mean_ms\": " << t.total / 1e6 / t.calls << ", \"min_ms\": " << t.min / 1e6
+            << ", \"max_ms\": " << t.max / 1e6 << "}";
+        first = false;
+    }
+    out << endl << "  }," << endl << "  \"counters\": {";
+    first = true;
+    for (const auto &counter : counters) {
+        out << (first ? "" : ",") << endl << "    ";
+        write_json_string(out, counter.first);
+        out << ": " << counter.second;
+        first = false;
+    }
+    out << endl << "  }" << endl << "}" << endl;
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void write_trace(ostream &out)
+{
+    Registry &r = registry();
+#ifndef NO_THREADS
+    lock_guard<mutex> lock(r.registry_mutex);
+#endif
+    map<string, TimerTotals> timers;
+    map<string, uint64_t> counters;
+    merge_totals(r, timers, counters);
+
+    const ios::fmtflags flags = out.flags();
+    const streamsize precision = out.precision();
+    out << fixed << setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << endl;
+    int64_t last = 0;
+    bool first = true;
+    auto write_event = [&](int tid, const Event &event) {
+        out << (first ? "" : ",\n") << "{\"name\": ";
+        write_json_string(out, event.name);
+        out << ", \"cat\": \"trellis\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+            << ", \"ts\": " << (event.start - r.epoch) / 1e3 << ", \"dur\": " << (event.end - event.start) / 1e3
+            << "}";
+        last = max(last, event.end - r.epoch);
+        first = false;
+    };
+    for (const auto &event : r.retired_events)
+        write_event(event.first, event.second);
+    for (const auto &thread : r.threads) {
+#ifndef NO_THREADS
+        lock_guard<mutex> thread_lock(thread->record_mutex);
+#endif
+        for (const auto &event : thread->events)
+            write_event(thread->tid, event);
+    }
+    // Counters are only kept as totals, so are shown at the end of the trace
+    for (const auto &counter : counters) {
+        out << (first ? "" : ",\n") << "{\"name\": ";
+        write_json_string(out, counter.first);
+        out << ", \"ph\": \"C\", \"pid\": 1, \"ts\": " << last / 1e3 << ", \"args\": {\"total\": " << counter.second
+            << "}}";
+        first = false;
+    }
+    out << endl << "]}" << endl;
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void write_files(const string &summary_filename, const string &trace_filename)
+{
+    if (!summary_filename.empty()) {
+        ofstream out(summary_filename);
+        if (!out)
+            throw runtime_error("failed to open profile file " + summary_filename + " for writing");
+        write_summary(out);
+    }
+    if (!trace_filename.empty()) {
+        ofstream out(trace_filename);
+        if (!out)
+            throw runtime_error("failed to open profile trace file " + trace_filename + " for writing");
+        write_trace(out);
+    }
+}
+}
+}
@@ -6,7 +6,14 @@
 #include "BitDatabase.hpp"
 #include "TileConfig.hpp"
 #include "RoutingGraph.hpp"
+#include "ConfiguredNetlist.hpp"
+#include "RoutingQuery.hpp"
+#include "FuzzSolver.hpp"
 #include "DedupChipdb.hpp"
+#include "ChipdbBinary.hpp"
+#include "Profile.hpp"
+#include "Log.hpp"
+#include "Util.hpp"
 
 #include <vector>
 #include <string>
@@ -17,6 +24,7 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/operators.h>
 #include <pybind11/stl_bind.h>
+#include <pybind11/numpy.h>
 
 using namespace pybind11;
 using namespace Trellis;
@@ -29,6 +37,11 @@ typedef pair<string, bool> StringBoolPair;
 typedef pair<RoutingId, ident_t> BelPin;
 typedef pair<RoutingId, PortDirection> BelWireDir;
 
+// Long-running calls drop the GIL so Python worker threads (e.g. fuzzloops.parallel_foreach) can run them
+// concurrently. The global caches they use (tilegrid, bit databases) are protected by their own locks, and each
+// routing graph has its own IdStore; as usual, objects passed in must not be modified by another thread meanwhile.
+typedef py::call_guard<py::gil_scoped_release> release_gil;
+
 // Common Types
 PYBIND11_MAKE_OPAQUE(IntPair)
 PYBIND11_MAKE_OPAQUE(LocationData)
@@ -36,6 +49,189 @@ PYBIND11_MAKE_OPAQUE(checksum_t)
 PYBIND11_MAKE_OPAQUE(map<checksum_t, LocationData>)
 PYBIND11_MAKE_OPAQUE(Location)
 
+// NumPy access to CRAM and CRAMView, shared by both classes. Each frame is stored separately, so a single frame can
+// be exposed without copying but whole arrays are copies.
+typedef py::array_t<uint8_t, py::array::c_style | py::array::forcecast> ByteArray;
+typedef py::array_t<int, py::array::c_style | py::array::forcecast> IntArray;
+
+template <typename T>
+py::array_t<uint8_t> cram_to_array(const T &c)
+{
+    py::array_t<uint8_t> arr({size_t(c.frames()), size_t(c.bits())});
+    c.get_bits(arr.mutable_data());
+    return arr;
+}
+
+template <typename T>
+void cram_from_array(T &c, ByteArray arr)
+{
+    if (arr.ndim() != 2 || arr.shape(0) != c.frames() || arr.shape(1) != c.bits())
+        throw py::value_error(fmt("expected an array of shape (" << c.frames() << ", " << c.bits() << ")"));
+    const uint8_t *src = arr.data();
+    for (py::ssize_t i = 0; i < arr.size(); i++)
+        if (src[i] > 1)
+            throw py::value_error("CRAM bits must be 0 or 1");
+    c.set_bits(src);
+}
+
+// A writable array aliasing one frame, which keeps `owner` (and so the CRAM storage) alive
+template <typename T>
+py::array_t<uint8_t> cram_frame(py::object owner, int frame)
+{
+    const T &c = owner.cast<const T &>();
+    if (frame < 0 || frame >= c.frames())
+        throw py::index_error(fmt("frame " << frame << " out of range"));
+    if (c.bits() == 0)
+        return py::array_t<uint8_t>(vector<py::ssize_t>{0});
+    auto ptr = reinterpret_cast<uint8_t *>(&c.bit(frame, 0));
+    return py::array_t<uint8_t>({py::ssize_t(c.bits())}, {py::ssize_t(1)}, ptr, owner);
+}
+
+template <typename T>
+void cram_check_bit(const T &c, int frame, int bit)
+{
+    if (frame < 0 || frame >= c.frames() || bit < 0 || bit >= c.bits())
+        throw py::index_error(fmt("bit (" << frame << ", " << bit << ") out of range"));
+}
+
+// Read the bits at (frames[i], bits[i])
+template <typename T>
+py::array_t<uint8_t> cram_get_bits(const T &c, IntArray frames, IntArray bits)
+{
+    if (frames.ndim() != 1 || bits.ndim() != 1 || frames.size() != bits.size())
+        throw py::value_error("frames and bits must be 1-D arrays of the same length");
+    py::array_t<uint8_t> result(vector<py::ssize_t>{frames.size()});
+    auto f = frames.unchecked<1>(), b = bits.unchecked<1>();
+    auto r = result.mutable_unchecked<1>();
+    for (py::ssize_t i = 0; i < f.shape(0); i++) {
+        cram_check_bit(c, f(i), b(i));
+        r(i) = uint8_t(c.bit(f(i), b(i)));
+    }
+    return result;
+}
+
+// Set the bits at (frames[i], bits[i]) to values[i], or to values[0] if only one value is given
+template <typename T>
+void cram_set_bits(T &c, IntArray frames, IntArray bits, ByteArray values)
+{
+    if (frames.ndim() != 1 || bits.ndim() != 1 || frames.size() != bits.size())
+        throw py::value_error("frames and bits must be 1-D arrays of the same length");
+    if (values.size() != 1 && values.size() != frames.size())
+        throw py::value_error("values must have one entry, or one per bit");
+    auto f = frames.unchecked<1>(), b = bits.unchecked<1>();
+    const uint8_t *v = values.data();
+    for (py::ssize_t i = 0; i < f.shape(0); i++)
+        cram_check_bit(c, f(i), b(i));
+    for (py::ssize_t i = 0; i < f.shape(0); i++)
+        c.bit(f(i), b(i)) = char(v[values.size() == 1 ? 0 : i] != 0);
+}
+
+// RoutingIds as an (n, 3) array of x, y and id
+static py::array_t<int> routing_ids_to_array(const vector<RoutingId> &ids)
+{
+    py::array_t<int> result({ids.size(), size_t(3)});
+    auto r = result.mutable_unchecked<2>();
+    for (size_t i = 0; i < ids.size(); i++) {
+        r(i, 0) = ids.at(i).loc.x;
+        r(i, 1) = ids.at(i).loc.y;
+        r(i, 2) = ids.at(i).id;
+    }
+    return result;
+}
+
+template <typename T, typename V>
+py::array_t<T> vector_to_array(const vector<V> &values)
+{
+    py::array_t<T> result(vector<py::ssize_t>{py::ssize_t(values.size())});
+    T *r = result.mutable_data();
+    for (size_t i = 0; i < values.size(); i++)
+        r[i] = T(values.at(i));
+    return result;
+}
+
+// a ^ b as a (frames, bits) array
+static py::array_t<uint8_t> cram_xor(const CRAMView &a, const CRAMView &b)
+{
+    if (a.frames() != b.frames() || a.bits() != b.bits())
+        throw py::value_error("cannot compare CRAMViews of different sizes");
+    py::array_t<uint8_t> result = cram_to_array(a);
+    uint8_t *r = result.mutable_data();
+    for (int i = 0; i < b.frames(); i++)
+        for (int j = 0; j < b.bits(); j++)
+            *(r++) ^= uint8_t(b.bit(i, j));
+    return result;
+}
+
+// An (N, 3) array of (frame, bit, delta) rows, in the same order as CRAMDelta
+static py::array_t<int> cram_diff_array(const CRAMDiff &diff)
+{
+    py::array_t<int> result({diff.size(), size_t(3)});
+    auto r = result.mutable_unchecked<2>();
+    for (size_t i = 0; i < diff.size(); i++) {
+        r(i, 0) = diff.frames.at(i);
+        r(i, 1) = diff.bits.at(i);
+        r(i, 2) = diff.deltas.at(i);
+    }
+    return result;
+}
+
+// a - b in the form returned by cram_diff_array
+static py::array_t<int> cram_changed_bits(const CRAMView &a, const CRAMView &b)
+{
+    CRAMDelta delta = a - b;
+    CRAMDiff diff;
+    for (const auto &cb : delta) {
+        diff.frames.push_back(cb.frame);
+        diff.bits.push_back(cb.bit);
+        diff.deltas.push_back(int8_t(cb.delta));
+    }
+    return cram_diff_array(diff);
+}
+
+static CRAMView whole_cram(CRAM &c)
+{
+    return c.make_view(0, 0, c.frames(), c.bits());
+}
+
+namespace {
+// A Python log callback, which may be called and destroyed from any thread
+struct PyLogCallback
+{
+    py::object func;
+
+    void operator()(const LogMessage &msg) const
+    {
+        py::gil_scoped_acquire gil;
+        try {
+            func(msg);
+        } catch (py::error_already_set &e) {
+            e.discard_as_unraisable(func);
+        }
+    }
+
+    ~PyLogCallback()
+    {
+        py::gil_scoped_acquire gil;
+        func = py::object();
+    }
+};
+
+// Sends messages logged on the current thread to a LogBuffer within a with block
+struct PyLogCapture
+{
+    shared_ptr<LogBuffer> buffer;
+    unique_ptr<ScopedLogSink> scope;
+};
+}
+
+static py::list log_messages_to_list(const vector<LogMessage> &messages)
+{
+    py::list result;
+    for (const auto &msg : messages)
+        result.append(py::cast(msg));
+    return result;
+}
+
 PYBIND11_MODULE (pytrellis, m)
 {
     // Common Types
@@ -66,13 +262,17 @@ PYBIND11_MODULE (pytrellis, m)
     });
 
     class_<Bitstream>(m, "Bitstream")
-            .def_static("read_bit", &Bitstream::read_bit_py)
-            .def_static("serialise_chip", &Bitstream::serialise_chip_py)
-            .def_static("serialise_chip_delta", &Bitstream::serialise_chip_delta_py)
-            .def("write_bit", &Bitstream::write_bit_py)
+            .def_static("read_bit", &Bitstream::read_bit_py, release_gil())
+            .def_static("serialise_chip", &Bitstream::serialise_chip_py, release_gil())
+            .def_static("serialise_chip_delta", &Bitstream::serialise_chip_delta_py, release_gil())
+            .def("write_bit", &Bitstream::write_bit_py, release_gil())
             .def_readwrite("metadata", &Bitstream::metadata)
             .def_readwrite("data", &Bitstream::data)
-            .def("deserialise_chip", static_cast<Chip (Bitstream::*)()>(&Bitstream::deserialise_chip));
+            .def("deserialise_chip", static_cast<Chip (Bitstream::*)()>(&Bitstream::deserialise_chip), release_gil())
+            .def("get_bram_data", [](const Bitstream &b) { return b.get_bram_data(); }, release_gil())
+            .def("patch_bram_data", [](Bitstream &b, const map<uint16_t, vector<uint16_t>> &bram_data) {
+                return b.patch_bram_data(bram_data);
+            }, release_gil());
 
     class_<DeviceLocator>(m, "DeviceLocator")
             .def_readwrite("family", &DeviceLocator::family)
@@ -165,16 +365,17 @@ PYBIND11_MODULE (pytrellis, m)
             .def_readwrite("missing_dccs", &MachXO2GlobalsInfo::missing_dccs);
 
     class_<Chip>(m, "Chip")
-            .def(init<string>())
-            .def(init<uint32_t>())
-            .def(init<const ChipInfo &>())
+            .def(init<string>(), release_gil())
+            .def(init<uint32_t>(), release_gil())
+            .def(init<const ChipInfo &>(), release_gil())
             .def("get_tile_by_name", &Chip::get_tile_by_name)
             .def("get_tiles_by_position", &Chip::get_tiles_by_position)
             .def("get_tiles_by_type", &Chip::get_tiles_by_type)
             .def("get_all_tiles", &Chip::get_all_tiles)
             .def("get_max_row", &Chip::get_max_row)
             .def("get_max_col", &Chip::get_max_col)
-            .def("get_routing_graph", &Chip::get_routing_graph)
+            .def("get_routing_graph", &Chip::get_routing_graph, release_gil())
+            .def("update_routing_graph", &Chip::update_routing_graph, release_gil())
             .def_readonly("info", &Chip::info)
             .def_readwrite("cram", &Chip::cram)
             .def_readwrite("tiles", &Chip::tiles)
@@ -188,6 +389,19 @@ PYBIND11_MODULE (pytrellis, m)
 
     py::bind_map<ChipDelta>(m, "ChipDelta");
 
+    // Returns a dict mapping tile name to an array of (frame, bit, delta) rows
+    m.def("diff_chips", [](const Chip &a, const Chip &b) {
+        CompactChipDelta delta;
+        {
+            py::gil_scoped_release release;
+            delta = diff_chips(a, b);
+        }
+        py::dict result;
+        for (const auto &tile : delta)
+            result[py::str(tile.first)] = cram_diff_array(tile.second);
+        return result;
+    });
+
     // From CRAM.cpp
     class_<ChangedBit>(m, "ChangedBit")
             .def_readonly("frame", &ChangedBit::frame)
@@ -200,7 +414,15 @@ PYBIND11_MODULE (pytrellis, m)
             .def("bits", &CRAMView::bits)
             .def("frames", &CRAMView::frames)
             .def("clear", &CRAMView::clear)
-            .def(self - self);
+            .def("to_array", &cram_to_array<CRAMView>)
+            .def("from_array", &cram_from_array<CRAMView>)
+            .def("frame", &cram_frame<CRAMView>)
+            .def("get_bits", &cram_get_bits<CRAMView>)
+            .def("set_bits", &cram_set_bits<CRAMView>, py::arg("frames"), py::arg("bits"), py::arg("values"))
+            .def("xor", &cram_xor)
+            .def("changed_bits", &cram_changed_bits)
+            .def(self - self)
+            .def(self == self);
 
     class_<CRAM>(m, "CRAM")
             .def(init<int, int>())
@@ -208,10 +430,20 @@ PYBIND11_MODULE (pytrellis, m)
             .def("set_bit", &CRAM::set_bit)
             .def("bits", &CRAM::bits)
             .def("frames", &CRAM::frames)
-            .def("make_view", &CRAM::make_view);
+            .def("make_view", &CRAM::make_view)
+            .def("to_array", &cram_to_array<CRAM>)
+            .def("from_array", &cram_from_array<CRAM>)
+            .def("frame", &cram_frame<CRAM>)
+            .def("get_bits", &cram_get_bits<CRAM>)
+            .def("set_bits", &cram_set_bits<CRAM>, py::arg("frames"), py::arg("bits"), py::arg("values"))
+            .def("xor", [](CRAM &a, CRAM &b) { return cram_xor(whole_cram(a), whole_cram(b)); })
+            .def("changed_bits", [](const CRAM &a, const CRAM &b) { return cram_diff_array(diff_cram(a, b)); })
+            .def("__eq__", [](CRAM &a, CRAM &b) { return whole_cram(a) == whole_cram(b); });
 
     py::bind_vector<CRAMDelta>(m, "CRAMDelta");
 
+    m.def("diff_cram", [](const CRAM &a, const CRAM &b) { return cram_diff_array(diff_cram(a, b)); });
+
     // From Tile.cpp
     m.def("get_row_col_pair_from_chipsize", get_row_col_pair_from_chipsize);
 
@@ -230,6 +462,8 @@ PYBIND11_MODULE (pytrellis, m)
             .def_readonly("frame_offset", &TileInfo::frame_offset)
             .def_readonly("bit_offset", &TileInfo::bit_offset)
             .def_readonly("sites", &TileInfo::sites)
+            .def_readonly("row", &TileInfo::row)
+            .def_readonly("col", &TileInfo::col)
             .def("get_row_col", &TileInfo::get_row_col);
 
     class_<Tile, shared_ptr<Tile>>(m, "Tile")
@@ -245,8 +479,11 @@ PYBIND11_MODULE (pytrellis, m)
     m.def("find_device_by_name", find_device_by_name);
     m.def("find_device_by_idcode", find_device_by_idcode);
     m.def("get_chip_info", get_chip_info);
-    m.def("get_device_tilegrid", get_device_tilegrid);
-    m.def("get_tile_bitdata", get_tile_bitdata);
+    m.def("get_device_tilegrid", get_device_tilegrid, release_gil());
+    m.def("get_tile_bitdata", static_cast<shared_ptr<TileBitDatabase> (*)(const TileLocator &)>(get_tile_bitdata),
+          release_gil());
+    m.def("preload_device", preload_device, py::arg("family"), py::arg("device"), py::arg("threads") = 0,
+          release_gil());
 
     // From BitDatabase.cpp
     class_<ConfigBit>(m, "ConfigBit")
@@ -316,9 +553,32 @@ PYBIND11_MODULE (pytrellis, m)
 
     py::bind_vector<vector<FixedConnection>>(m, "FixedConnectionVector");
 
+    class_<WireConnections>(m, "WireConnections")
+            .def_readonly("wire", &WireConnections::wire)
+            .def_readonly("uphill", &WireConnections::uphill)
+            .def_readonly("downhill", &WireConnections::downhill);
+
+    py::bind_vector<vector<WireConnections>>(m, "WireConnectionsVector");
+
+    py::bind_vector<vector<ArcData>>(m, "ArcDataVector");
+    py::bind_vector<vector<WordSettingBits>>(m, "WordSettingBitsVector");
+    py::bind_vector<vector<EnumSettingBits>>(m, "EnumSettingBitsVector");
+
+    class_<BitDatabaseUpdate>(m, "BitDatabaseUpdate")
+            .def(init<>())
+            .def_readwrite("arcs", &BitDatabaseUpdate::arcs)
+            .def_readwrite("words", &BitDatabaseUpdate::words)
+            .def_readwrite("enums", &BitDatabaseUpdate::enums)
+            .def_readwrite("fixed_conns", &BitDatabaseUpdate::fixed_conns);
+
     class_<TileBitDatabase, shared_ptr<TileBitDatabase>>(m, "TileBitDatabase")
-            .def("config_to_tile_cram", &TileBitDatabase::config_to_tile_cram)
-            .def("tile_cram_to_config", &TileBitDatabase::tile_cram_to_config)
+            .def("config_to_tile_cram", &TileBitDatabase::config_to_tile_cram, release_gil())
+            .def("tile_cram_to_config", &TileBitDatabase::tile_cram_to_config, release_gil())
+            .def("resolve_config", &TileBitDatabase::resolve_config, release_gil())
+            .def("symbolic_to_config", &TileBitDatabase::symbolic_to_config, release_gil())
+            .def("symbolic_config_to_tile_cram", &TileBitDatabase::symbolic_config_to_tile_cram, release_gil())
+            .def("tile_cram_to_symbolic_config", &TileBitDatabase::tile_cram_to_symbolic_config, release_gil())
+            .def_property_readonly("revision", &TileBitDatabase::get_symbolic_revision)
             .def("get_sinks", &TileBitDatabase::get_sinks)
             .def("get_mux_data_for_sink", &TileBitDatabase::get_mux_data_for_sink)
             .def("get_settings_words", &TileBitDatabase::get_settings_words)
@@ -327,14 +587,19 @@ PYBIND11_MODULE (pytrellis, m)
             .def("get_data_for_enum", &TileBitDatabase::get_data_for_enum)
             .def("get_fixed_conns", &TileBitDatabase::get_fixed_conns)
             .def("get_downhill_wires", &TileBitDatabase::get_downhill_wires)
+            .def("get_uphill_wires", &TileBitDatabase::get_uphill_wires)
+            .def("get_wire_connections", &TileBitDatabase::get_wire_connections, release_gil())
             .def("add_mux_arc", &TileBitDatabase::add_mux_arc)
             .def("add_setting_word", &TileBitDatabase::add_setting_word)
             .def("add_setting_enum", &TileBitDatabase::add_setting_enum)
             .def("add_fixed_conn", &TileBitDatabase::add_fixed_conn)
+            .def("add_update", &TileBitDatabase::add_update, release_gil())
+            .def("check_update", &TileBitDatabase::check_update, release_gil())
             .def("remove_fixed_sink", &TileBitDatabase::remove_fixed_sink)
             .def("remove_setting_word", &TileBitDatabase::remove_setting_word)
             .def("remove_setting_enum", &TileBitDatabase::remove_setting_enum)
-            .def("save", &TileBitDatabase::save);
+            .def("save", &TileBitDatabase::save)
+            .def("compact_if_large", &TileBitDatabase::compact_if_large);
 
     class_<StringBoolPair>(m, "StringBoolPair")
             .def_readonly("first", &StringBoolPair::first)
@@ -374,6 +639,34 @@ PYBIND11_MODULE (pytrellis, m)
             .def("to_string", &TileConfig::to_string)
             .def_static("from_string", &TileConfig::from_string);
 
+    // From BitDatabase.hpp, symbolic configs
+    class_<SymbolicArc>(m, "SymbolicArc")
+            .def(init<>())
+            .def_readwrite("mux", &SymbolicArc::mux)
+            .def_readwrite("source", &SymbolicArc::source);
+    class_<SymbolicWord>(m, "SymbolicWord")
+            .def(init<>())
+            .def_readwrite("word", &SymbolicWord::word)
+            .def_readwrite("value", &SymbolicWord::value);
+    class_<SymbolicEnum>(m, "SymbolicEnum")
+            .def(init<>())
+            .def_readwrite("cenum", &SymbolicEnum::cenum)
+            .def_readwrite("option", &SymbolicEnum::option)
+            .def_readonly_static("none", &SymbolicEnum::none);
+
+    py::bind_vector<vector<SymbolicArc>>(m, "SymbolicArcVector");
+    py::bind_vector<vector<SymbolicWord>>(m, "SymbolicWordVector");
+    py::bind_vector<vector<SymbolicEnum>>(m, "SymbolicEnumVector");
+
+    class_<SymbolicTileConfig>(m, "SymbolicTileConfig")
+            .def(init<>())
+            .def_readwrite("carcs", &SymbolicTileConfig::carcs)
+            .def_readwrite("cwords", &SymbolicTileConfig::cwords)
+            .def_readwrite("cenums", &SymbolicTileConfig::cenums)
+            .def_readwrite("cunknowns", &SymbolicTileConfig::cunknowns)
+            .def_readonly("total_known_bits", &SymbolicTileConfig::total_known_bits)
+            .def_readwrite("revision", &SymbolicTileConfig::revision);
+
     // From ChipConfig.hpp
     py::bind_map<map<string, TileConfig>>(m, "TileConfigMap");
     py::bind_vector<vector<uint16_t>>(m, "Uint16Vector");
@@ -385,10 +678,27 @@ PYBIND11_MODULE (pytrellis, m)
             .def_readwrite("tiles", &ChipConfig::tiles)
             .def_readwrite("tilegroups", &ChipConfig::tilegroups)
             .def_readwrite("bram_data", &ChipConfig::bram_data)
-            .def("to_string", &ChipConfig::to_string)
-            .def_static("from_string", &ChipConfig::from_string)
-            .def("to_chip", &ChipConfig::to_chip)
-            .def_static("from_chip", &ChipConfig::from_chip);
+            .def("to_string", &ChipConfig::to_string, release_gil())
+            .def("to_file", &ChipConfig::to_file, release_gil())
+            .def_static("from_string", &ChipConfig::from_string, release_gil())
+            .def_static("from_file", &ChipConfig::from_file, release_gil())
+            .def("to_chip", [](const ChipConfig &cc) { return cc.to_chip(); }, release_gil())
+            .def_static("from_chip", &ChipConfig::from_chip, release_gil())
+            .def("to_binary", [](const ChipConfig &cc) {
+                vector<uint8_t> data;
+                {
+                    py::gil_scoped_release release;
+                    data = cc.to_binary();
+                }
+                return py::bytes(reinterpret_cast<const char *>(data.data()), data.size());
+            })
+            .def_static("from_binary", [](py::bytes data) {
+                string str = data;
+                py::gil_scoped_release release;
+                return ChipConfig::from_binary(reinterpret_cast<const uint8_t *>(str.data()), str.size());
+            })
+            .def("to_binary_file", &ChipConfig::to_binary_file, release_gil())
+            .def_static("from_binary_file", &ChipConfig::from_binary_file, release_gil());
 
     // From RoutingGraph.hpp
     class_<Location>(m, "Location")
@@ -469,7 +779,163 @@ PYBIND11_MODULE (pytrellis, m)
             .def_readwrite("tiles", &RoutingGraph::tiles)
             .def("globalise_net", &RoutingGraph::globalise_net)
             .def("add_arc", &RoutingGraph::add_arc)
-            .def("add_wire", &RoutingGraph::add_wire);
+            .def("add_wire", &RoutingGraph::add_wire)
+            .def("remove_arc", &RoutingGraph::remove_arc);
+
+    // From ConfiguredNetlist.hpp
+    class_<ConfiguredNetlist>(m, "ConfiguredNetlist")
+            .def_readonly("tile_configs", &ConfiguredNetlist::tile_configs)
+            .def_readonly("num_nets", &ConfiguredNetlist::num_nets)
+            .def_property_readonly("wires", [](const ConfiguredNetlist &nl) { return routing_ids_to_array(nl.wires); })
+            .def_property_readonly("wire_nets", [](const ConfiguredNetlist &nl) {
+                return vector_to_array<int>(nl.wire_nets);
+            })
+            .def_property_readonly("arcs", [](const ConfiguredNetlist &nl) { return routing_ids_to_array(nl.arcs); })
+            .def_property_readonly("arc_sources", [](const ConfiguredNetlist &nl) {
+                return vector_to_array<int>(nl.arc_sources);
+            })
+            .def_property_readonly("arc_sinks", [](const ConfiguredNetlist &nl) {
+                return vector_to_array<int>(nl.arc_sinks);
+            })
+            .def_property_readonly("arc_configurable", [](const ConfiguredNetlist &nl) {
+                return vector_to_array<uint8_t>(nl.arc_configurable);
+            })
+            .def_property_readonly("bel_pin_bels", [](const ConfiguredNetlist &nl) {
+                return routing_ids_to_array(nl.bel_pin_bels);
+            })
+            .def_property_readonly("bel_pin_names", [](const ConfiguredNetlist &nl) {
+                return vector_to_array<int>(nl.bel_pin_names);
+            })
+            .def_property_readonly("bel_pin_wires", [](const ConfiguredNetlist &nl) {
+                return vector_to_array<int>(nl.bel_pin_wires);
+            })
+            .def_property_readonly("bel_pin_outputs", [](const ConfiguredNetlist &nl) {
+                return vector_to_array<uint8_t>(nl.bel_pin_outputs);
+            });
+
+    m.def("extract_configured_netlist", &extract_configured_netlist, py::arg("chip"), py::arg("graph"),
+          py::arg("threads") = 0, release_gil());
+
+    // From FuzzSolver.hpp
+    py::bind_map<map<string, BitDatabaseUpdate>>(m, "BitDatabaseUpdateMap");
+    py::bind_map<map<string, TileLocator>>(m, "TileLocatorMap");
+    py::bind_map<map<string, pair<string, string>>>(m, "StringPairMap");
+
+    class_<FuzzResult>(m, "FuzzResult")
+            .def(init<>())
+            .def_readwrite("tile_updates", &FuzzResult::tile_updates)
+            .def_readwrite("tile_dbs", &FuzzResult::tile_dbs)
+            .def("commit", &FuzzResult::commit, release_gil());
+
+    class_<FuzzArc>(m, "FuzzArc")
+            .def(init<>())
+            .def_readwrite("tile_names", &FuzzArc::tile_names)
+            .def_readwrite("fixed_conn", &FuzzArc::fixed_conn);
+
+    // Chips are passed as Python lists
+    auto chip_list = [](const py::list &chips) {
+        vector<Chip> result;
+        for (const auto &chip : chips)
+            result.push_back(chip.cast<Chip>());
+        return result;
+    };
+    m.def("solve_word_setting", [chip_list](const string &name, const Chip &baseline, const py::list &bit_chips,
+                                            const vector<string> &tiles, const Chip *empty, unsigned threads) {
+        vector<Chip> chips = chip_list(bit_chips);
+        py::gil_scoped_release release;
+        return solve_word_setting(name, baseline, chips, tiles, empty, threads);
+    }, py::arg("name"), py::arg("baseline"), py::arg("bit_chips"), py::arg("tiles"), py::arg("empty") = py::none(),
+          py::arg("threads") = 0);
+    m.def("solve_enum_setting", [chip_list](const string &name, const vector<string> &values, const py::list &chips,
+                                            const vector<string> &tiles, const Chip *empty, bool include_zeros,
+                                            const py::list &ignore, const vector<string> &pref_options,
+                                            unsigned threads) {
+        vector<Chip> value_chips = chip_list(chips), ignore_chips = chip_list(ignore);
+        py::gil_scoped_release release;
+        return solve_enum_setting(name, values, value_chips, tiles, empty, include_zeros, ignore_chips, pref_options,
+                                  threads);
+    }, py::arg("name"), py::arg("values"), py::arg("chips"), py::arg("tiles"), py::arg("empty") = py::none(),
+          py::arg("include_zeros") = true, py::arg("ignore") = py::list(), py::arg("pref_options") = vector<string>(),
+          py::arg("threads") = 0);
+    m.def("solve_arcs", [chip_list](const Chip &baseline, const py::list &arcs, const py::list &arc_chips,
+                                    const vector<string> &tiles, bool full_mux, unsigned threads) {
+        vector<FuzzArc> arc_list;
+        for (const auto &arc : arcs)
+            arc_list.push_back(arc.cast<FuzzArc>());
+        vector<Chip> chips = chip_list(arc_chips);
+        py::gil_scoped_release release;
+        return solve_arcs(baseline, arc_list, chips, tiles, full_mux, threads);
+    }, py::arg("baseline"), py::arg("arcs"), py::arg("arc_chips"), py::arg("tiles"), py::arg("full_mux") = false,
+          py::arg("threads") = 0);
+
+    // From RoutingQuery.hpp
+    class_<RoutingQuery>(m, "RoutingQuery")
+            .def(init<const RoutingGraph &>(), release_gil())
+            .def_property_readonly("num_wires", &RoutingQuery::num_wires)
+            .def_property_readonly("num_arcs", &RoutingQuery::num_arcs)
+            .def("wire_index", &RoutingQuery::wire_index)
+            .def("wire_indices", [](const RoutingQuery &q, IntArray wires) {
+                if (wires.ndim() != 2 || wires.shape(1) != 3)
+                    throw runtime_error("wires must be an (n, 3) array of x, y and id");
+                auto w = wires.unchecked<2>();
+                py::array_t<int> result(vector<py::ssize_t>{w.shape(0)});
+                int *r = result.mutable_data();
+                for (py::ssize_t i = 0; i < w.shape(0); i++)
+                    r[i] = q.wire_index(RoutingId{Location(int16_t(w(i, 0)), int16_t(w(i, 1))), w(i, 2)});
+                return result;
+            })
+            .def("wire_id", &RoutingQuery::wire_id)
+            .def("arc_id", &RoutingQuery::arc_id)
+            .def("arc_source", &RoutingQuery::arc_source)
+            .def("arc_sink", &RoutingQuery::arc_sink)
+            .def("arc_configurable", &RoutingQuery::arc_configurable)
+            .def("uphill_arcs", [](const RoutingQuery &q, int wire) {
+                return vector_to_array<int>(q.uphill_arcs(wire));
+            })
+            .def("downhill_arcs", [](const RoutingQuery &q, int wire) {
+                return vector_to_array<int>(q.downhill_arcs(wire));
+            })
+            .def("reachable", [](const RoutingQuery &q, int wire, int max_hops, bool uphill) {
+                vector<int> hops;
+                vector<int> wires = q.reachable(wire, max_hops, uphill, &hops);
+                return make_pair(vector_to_array<int>(wires), vector_to_array<int>(hops));
+            }, py::arg("wire"), py::arg("max_hops") = -1, py::arg("uphill") = false)
+            .def("shortest_path", [](const RoutingQuery &q, int source, int sink, int max_hops) {
+                return vector_to_array<int>(q.shortest_path(source, sink, max_hops));
+            }, py::arg("source"), py::arg("sink"), py::arg("max_hops") = -1)
+            .def("arcs_within", [](const RoutingQuery &q, Location loc, int distance, bool configurable_only) {
+                return vector_to_array<int>(q.arcs_within(loc, distance, configurable_only));
+            }, py::arg("loc"), py::arg("distance"), py::arg("configurable_only") = false)
+            .def("reachable_batch", [](const RoutingQuery &q, IntArray wires, int max_hops, bool uphill,
+                                       unsigned threads) {
+                vector<int> sources(wires.data(), wires.data() + wires.size());
+                vector<vector<int>> results;
+                {
+                    py::gil_scoped_release release;
+                    results = q.reachable_batch(sources, max_hops, uphill, threads);
+                }
+                py::list result;
+                for (const auto &r : results)
+                    result.append(vector_to_array<int>(r));
+                return result;
+            }, py::arg("wires"), py::arg("max_hops") = -1, py::arg("uphill") = false, py::arg("threads") = 0)
+            .def("shortest_path_batch", [](const RoutingQuery &q, IntArray endpoints, int max_hops, unsigned threads) {
+                if (endpoints.ndim() != 2 || endpoints.shape(1) != 2)
+                    throw runtime_error("endpoints must be an (n, 2) array of source and sink");
+                auto e = endpoints.unchecked<2>();
+                vector<pair<int, int>> pairs;
+                for (py::ssize_t i = 0; i < e.shape(0); i++)
+                    pairs.emplace_back(e(i, 0), e(i, 1));
+                vector<vector<int>> results;
+                {
+                    py::gil_scoped_release release;
+                    results = q.shortest_path_batch(pairs, max_hops, threads);
+                }
+                py::list result;
+                for (const auto &r : results)
+                    result.append(vector_to_array<int>(r));
+                return result;
+            }, py::arg("endpoints"), py::arg("max_hops") = -1, py::arg("threads") = 0);
 
     // DedupChipdb
     class_<RelId>(m, "RelId")
@@ -548,15 +1014,107 @@ PYBIND11_MODULE (pytrellis, m)
             .def("to_str", &DedupChipdb::to_str);
 
     m.def("make_dedup_chipdb", make_dedup_chipdb,
-        py::arg("chip"), py::arg("include_lutperm_pips")=false);
+        py::arg("chip"), py::arg("include_lutperm_pips")=false, release_gil());
 
     class_<OptimizedChipdb, shared_ptr<OptimizedChipdb>>(m, "OptimizedChipdb")
             .def_readwrite("tiles", &OptimizedChipdb::tiles)
             .def("ident", &OptimizedChipdb::ident)
             .def("to_str", &OptimizedChipdb::to_str);
 
-    m.def("make_optimized_chipdb", make_optimized_chipdb);
-
+    m.def("make_optimized_chipdb", make_optimized_chipdb, release_gil());
+
+    // ChipdbBinary
+    enum_<ChipdbBinaryKind>(m, "ChipdbBinaryKind")
+            .value("CHIPDB_DEDUP", CHIPDB_DEDUP)
+            .value("CHIPDB_OPTIMIZED", CHIPDB_OPTIMIZED);
+
+    py::bind_vector<vector<Location>>(m, "LocationVector");
+
+    m.def("chipdb_to_binary", (vector<uint8_t>(*)(const DedupChipdb &)) &chipdb_to_binary);
+    m.def("chipdb_to_binary", (vector<uint8_t>(*)(const OptimizedChipdb &)) &chipdb_to_binary);
+    m.def("write_chipdb_binary", (void (*)(const DedupChipdb &, const string &)) &write_chipdb_binary, release_gil());
+    m.def("write_chipdb_binary", (void (*)(const OptimizedChipdb &, const string &)) &write_chipdb_binary,
+          release_gil());
+
+    class_<ChipdbBinary, shared_ptr<ChipdbBinary>>(m, "ChipdbBinary")
+            .def_static("open", &ChipdbBinary::open)
+            .def_static("from_bytes", &ChipdbBinary::from_bytes)
+            .def("kind", &ChipdbBinary::kind)
+            .def("num_idents", &ChipdbBinary::num_idents)
+            .def("ident_str", &ChipdbBinary::ident_str)
+            .def("num_location_types", &ChipdbBinary::num_location_types)
+            .def("type_at", &ChipdbBinary::type_at)
+            .def("locations", &ChipdbBinary::locations)
+            .def("get_location_data", &ChipdbBinary::get_location_data)
+            .def("to_dedup_chipdb", &ChipdbBinary::to_dedup_chipdb, release_gil())
+            .def("to_optimized_chipdb", &ChipdbBinary::to_optimized_chipdb, release_gil());
+
+    // From Profile.cpp
+    m.def("set_profiling", &Profile::set_enabled);
+    m.def("reset_profile", &Profile::reset);
+    m.def("profile_summary", []() {
+        ostringstream out;
+        Profile::write_summary(out);
+        return out.str();
+    });
+    m.def("profile_trace", []() {
+        ostringstream out;
+        Profile::write_trace(out);
+        return out.str();
+    });
+    m.def("write_profile", &Profile::write_files, py::arg("summary_filename") = "", py::arg("trace_filename") = "");
+
+    // From Log.cpp
+    enum_<VerbosityLevel>(m, "VerbosityLevel")
+            .value("ERROR", VerbosityLevel::ERROR)
+            .value("NOTE", VerbosityLevel::NOTE)
+            .value("DEBUG", VerbosityLevel::DEBUG);
+    m.def("get_verbosity", []() { return verbosity; });
+    m.def("set_verbosity", [](VerbosityLevel level) { verbosity = level; });
+
+    class_<LogMessage>(m, "LogMessage")
+            .def_readonly("level", &LogMessage::level)
+            .def_readonly("component", &LogMessage::component)
+            .def_readonly("text", &LogMessage::text);
+
+    class_<LogBuffer, shared_ptr<LogBuffer>>(m, "LogBuffer")
+            .def(init<size_t>(), py::arg("capacity") = 4096)
+            .def("drain", [](LogBuffer &buffer) { return log_messages_to_list(buffer.drain()); })
+            .def_property_readonly("dropped", &LogBuffer::dropped);
+
+    // Replacing the sink may wait for an asynchronous Python sink to finish, which needs the GIL
+    m.def("set_log_sink", [](shared_ptr<LogBuffer> buffer) {
+        py::gil_scoped_release release;
+        set_log_sink(LogBuffer::sink(buffer));
+    });
+    m.def("set_log_sink", [](py::object callback) {
+        LogSink sink;
+        if (!callback.is_none()) {
+            // Messages are passed to Python on a background thread, so logging never waits for the GIL
+            auto func = make_shared<PyLogCallback>();
+            func->func = callback;
+            sink = AsyncLogSink::sink(make_shared<AsyncLogSink>([func](const LogMessage &msg) { (*func)(msg); }));
+        }
+        py::gil_scoped_release release;
+        set_log_sink(sink);
+    });
+    // The background thread of a Python sink must be stopped while the interpreter can still run it
+    py::module::import("atexit").attr("register")(py::cpp_function([]() {
+        py::gil_scoped_release release;
+        set_log_sink(LogSink());
+    }));
+
+    class_<PyLogCapture>(m, "LogCapture")
+            .def(py::init([](shared_ptr<LogBuffer> buffer) {
+                PyLogCapture capture;
+                capture.buffer = buffer;
+                return capture;
+            }), py::arg("buffer"))
+            .def("__enter__", [](PyLogCapture &capture) {
+                capture.scope.reset(new ScopedLogSink(LogBuffer::sink(capture.buffer)));
+                return capture.buffer;
+            })
+            .def("__exit__", [](PyLogCapture &capture, py::args) { capture.scope.reset(); });
 }
 
 #endif
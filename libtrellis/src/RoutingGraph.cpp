@@ -52,6 +52,11 @@ std::string IdStore::to_str(ident_t id) const
     return identifiers.at(id);
 }
 
+size_t IdStore::num_idents() const
+{
+    return identifiers.size();
+}
+
 RoutingId IdStore::id_at_loc(int16_t x, int16_t y, const std::string &str) const
 {
     RoutingId rid;
@@ -260,6 +265,37 @@ void RoutingGraph::add_arc(Location loc, const RoutingArc &arc)
     tiles[arc.source.loc].wires.at(arc.source.id).downhill.push_back(arcId);
 }
 
+void RoutingGraph::remove_arc(Location loc, ident_t arc_id)
+{
+    auto tile = tiles.find(loc);
+    if (tile == tiles.end())
+        return;
+    auto found = tile->second.arcs.find(arc_id);
+    if (found == tile->second.arcs.end())
+        return;
+    RoutingArc arc = found->second;
+    tile->second.arcs.erase(found);
+
+    RoutingId arcId;
+    arcId.loc = loc;
+    arcId.id = arc_id;
+    auto unlink = [&](RoutingId wire, vector<RoutingId> RoutingWire::*refs) {
+        auto wire_tile = tiles.find(wire.loc);
+        if (wire_tile == tiles.end())
+            return;
+        auto rw = wire_tile->second.wires.find(wire.id);
+        if (rw == wire_tile->second.wires.end())
+            return;
+        vector<RoutingId> &arcs = rw->second.*refs;
+        arcs.erase(remove(arcs.begin(), arcs.end(), arcId), arcs.end());
+        if (rw->second.uphill.empty() && rw->second.downhill.empty() && rw->second.belsUphill.empty() &&
+            rw->second.belsDownhill.empty())
+            wire_tile->second.wires.erase(rw);
+    };
+    unlink(arc.sink, &RoutingWire::uphill);
+    unlink(arc.source, &RoutingWire::downhill);
+}
+
 void RoutingGraph::add_wire(RoutingId wire)
 {
     RoutingTileLoc &tile = tiles[wire.loc];
@@ -275,6 +311,25 @@ void RoutingGraph::add_bel(RoutingBel &bel)
     tiles[bel.loc].bels[bel.name] = bel;
 }
 
+void RoutingGraph::add_bel(const BelTemplate &tmpl, int x, int y)
+{
+    RoutingBel bel;
+    bel.name = tmpl.name;
+    bel.type = tmpl.type;
+    bel.loc.x = x;
+    bel.loc.y = y;
+    bel.z = tmpl.z;
+    for (const auto &pin : tmpl.pins) {
+        int wire_x = pin.relative ? x : 0;
+        int wire_y = pin.relative ? y : 0;
+        if (pin.dir == PORT_IN)
+            add_bel_input(bel, pin.pin, wire_x, wire_y, pin.wire);
+        else
+            add_bel_output(bel, pin.pin, wire_x, wire_y, pin.wire);
+    }
+    add_bel(bel);
+}
+
 void RoutingGraph::add_bel_input(RoutingBel &bel, ident_t pin, int wire_x, int wire_y, ident_t wire_name) {
     RoutingId wireId, belId;
     wireId.id = wire_name;
@@ -0,0 +1,262 @@
+#include "RoutingQuery.hpp"
+#include "Parallel.hpp"
+#include "Util.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace Trellis {
+
+namespace {
+// The wires visited by a query
+class WireBitmap
+{
+public:
+    explicit WireBitmap(size_t wires) : bits((wires + 63) / 64, 0)
+    {}
+
+    // Set a bit, returning false if it was already set
+    bool insert(int wire)
+    {
+        uint64_t &word = bits[size_t(wire) >> 6];
+        uint64_t mask = uint64_t(1) << (wire & 63);
+        if (word & mask)
+            return false;
+        word |= mask;
+        return true;
+    }
+
+private:
+    vector<uint64_t> bits;
+};
+}
+
+RoutingQuery::RoutingQuery(const RoutingGraph &graph)
+{
+    auto add_wire = [&](const RoutingId &wire) {
+        auto found = wire_indices.find(wire);
+        if (found != wire_indices.end())
+            return found->second;
+        int index = int(wires.size());
+        wire_indices.emplace(wire, index);
+        wires.push_back(wire);
+        return index;
+    };
+    for (const auto &tile : graph.tiles)
+        for (const auto &wire : tile.second.wires)
+            add_wire(RoutingId{tile.first, wire.first});
+    for (const auto &tile : graph.tiles) {
+        int begin = int(arcs.size());
+        for (const auto &arc : tile.second.arcs) {
+            arcs.push_back(RoutingId{tile.first, arc.first});
+            arc_sources.push_back(add_wire(arc.second.source));
+            arc_sinks.push_back(add_wire(arc.second.sink));
+            arc_configurable_flags.push_back(arc.second.configurable);
+        }
+        if (int(arcs.size()) > begin) {
+            if (loc_arcs.empty()) {
+                arcs_min = arcs_max = tile.first;
+            } else {
+                arcs_min = Location(min(arcs_min.x, tile.first.x), min(arcs_min.y, tile.first.y));
+                arcs_max = Location(max(arcs_max.x, tile.first.x), max(arcs_max.y, tile.first.y));
+            }
+            loc_arcs[tile.first] = make_pair(begin, int(arcs.size()));
+        }
+    }
+
+    auto build_csr = [&](const vector<int> &arc_wires, vector<int> &start, vector<int> &wire_arcs) {
+        start.assign(wires.size() + 1, 0);
+        for (int w : arc_wires)
+            start[w + 1]++;
+        for (size_t i = 0; i < wires.size(); i++)
+            start[i + 1] += start[i];
+        wire_arcs.resize(arc_wires.size());
+        vector<int> next(start.begin(), start.end() - 1);
+        for (size_t a = 0; a < arc_wires.size(); a++)
+            wire_arcs[next[arc_wires[a]]++] = int(a);
+    };
+    build_csr(arc_sinks, up_start, up_arcs);
+    build_csr(arc_sources, down_start, down_arcs);
+}
+
+size_t RoutingQuery::num_wires() const
+{
+    return wires.size();
+}
+
+size_t RoutingQuery::num_arcs() const
+{
+    return arcs.size();
+}
+
+void RoutingQuery::check_wire(int wire) const
+{
+    if (wire < 0 || wire >= int(wires.size()))
+        throw out_of_range(fmt("wire index " << wire << " out of range"));
+}
+
+void RoutingQuery::check_arc(int arc) const
+{
+    if (arc < 0 || arc >= int(arcs.size()))
+        throw out_of_range(fmt("arc index " << arc << " out of range"));
+}
+
+int RoutingQuery::wire_index(const RoutingId &wire) const
+{
+    auto found = wire_indices.find(wire);
+    return found == wire_indices.end() ? -1 : found->second;
+}
+
+RoutingId RoutingQuery::wire_id(int wire) const
+{
+    check_wire(wire);
+    return wires[wire];
+}
+
+RoutingId RoutingQuery::arc_id(int arc) const
+{
+    check_arc(arc);
+    return arcs[arc];
+}
+
+int RoutingQuery::arc_source(int arc) const
+{
+    check_arc(arc);
+    return arc_sources[arc];
+}
+
+int RoutingQuery::arc_sink(int arc) const
+{
+    check_arc(arc);
+    return arc_sinks[arc];
+}
+
+bool RoutingQuery::arc_configurable(int arc) const
+{
+    check_arc(arc);
+    return arc_configurable_flags[arc];
+}
+
+vector<int> RoutingQuery::uphill_arcs(int wire) const
+{
+    check_wire(wire);
+    return vector<int>(up_arcs.begin() + up_start[wire], up_arcs.begin() + up_start[wire + 1]);
+}
+
+vector<int> RoutingQuery::downhill_arcs(int wire) const
+{
+    check_wire(wire);
+    return vector<int>(down_arcs.begin() + down_start[wire], down_arcs.begin() + down_start[wire + 1]);
+}
+
+vector<int> RoutingQuery::reachable(int wire, int max_hops, bool uphill, vector<int> *hops) const
+{
+    check_wire(wire);
+    const vector<int> &start = uphill ? up_start : down_start;
+    const vector<int> &wire_arcs = uphill ? up_arcs : down_arcs;
+    const vector<int> &next_wire = uphill ? arc_sources : arc_sinks;
+
+    WireBitmap visited(wires.size());
+    vector<int> result{wire};
+    if (hops)
+        hops->assign(1, 0);
+    visited.insert(wire);
+    // result doubles as the BFS queue; each pass of the outer loop expands one more hop
+    size_t level_begin = 0;
+    for (int hop = 1; level_begin < result.size() && (max_hops < 0 || hop <= max_hops); hop++) {
+        size_t level_end = result.size();
+        for (size_t i = level_begin; i < level_end; i++) {
+            int w = result[i];
+            for (int j = start[w]; j < start[w + 1]; j++) {
+                int n = next_wire[wire_arcs[j]];
+                if (visited.insert(n)) {
+                    result.push_back(n);
+                    if (hops)
+                        hops->push_back(hop);
+                }
+            }
+        }
+        level_begin = level_end;
+    }
+    return result;
+}
+
+vector<int> RoutingQuery::shortest_path(int source, int sink, int max_hops) const
+{
+    check_wire(source);
+    check_wire(sink);
+    if (source == sink)
+        return vector<int>{source};
+    WireBitmap visited(wires.size());
+    // Wires in BFS order, with the index in queue of the wire each was reached from
+    vector<int> queue{source}, parent{-1};
+    visited.insert(source);
+    size_t level_begin = 0;
+    for (int hop = 1; level_begin < queue.size() && (max_hops < 0 || hop <= max_hops); hop++) {
+        size_t level_end = queue.size();
+        for (size_t i = level_begin; i < level_end; i++) {
+            int w = queue[i];
+            for (int j = down_start[w]; j < down_start[w + 1]; j++) {
+                int n = arc_sinks[down_arcs[j]];
+                if (!visited.insert(n))
+                    continue;
+                queue.push_back(n);
+                parent.push_back(int(i));
+                if (n == sink) {
+                    vector<int> path;
+                    for (int k = int(queue.size()) - 1; k != -1; k = parent[k])
+                        path.push_back(queue[k]);
+                    return vector<int>(path.rbegin(), path.rend());
+                }
+            }
+        }
+        level_begin = level_end;
+    }
+    return vector<int>();
+}
+
+vector<int> RoutingQuery::arcs_within(Location loc, int distance, bool configurable_only) const
+{
+    if (distance < 0)
+        throw out_of_range(fmt("distance " << distance << " is negative"));
+    vector<int> result;
+    if (loc_arcs.empty())
+        return result;
+    // Only visit locations that can have arcs, so that a large distance costs no more than the whole graph.
+    // Coordinates are 16 bit, so any larger distance covers everything and would only overflow the sums below
+    distance = min(distance, 0xFFFF);
+    const int min_y = max(loc.y - distance, int(arcs_min.y)), max_y = min(loc.y + distance, int(arcs_max.y));
+    const int min_x = max(loc.x - distance, int(arcs_min.x)), max_x = min(loc.x + distance, int(arcs_max.x));
+    for (int y = min_y; y <= max_y; y++) {
+        for (int x = min_x; x <= max_x; x++) {
+            auto found = loc_arcs.find(Location(int16_t(x), int16_t(y)));
+            if (found == loc_arcs.end())
+                continue;
+            for (int a = found->second.first; a < found->second.second; a++)
+                if (!configurable_only || arc_configurable_flags[a])
+                    result.push_back(a);
+        }
+    }
+    return result;
+}
+
+vector<vector<int>> RoutingQuery::reachable_batch(const vector<int> &sources, int max_hops, bool uphill,
+                                                  unsigned threads) const
+{
+    vector<vector<int>> result(sources.size());
+    parallel_for(sources.size(), [&](size_t i) {
+        result[i] = reachable(sources[i], max_hops, uphill);
+    }, threads);
+    return result;
+}
+
+vector<vector<int>> RoutingQuery::shortest_path_batch(const vector<pair<int, int>> &endpoints, int max_hops,
+                                                      unsigned threads) const
+{
+    vector<vector<int>> result(endpoints.size());
+    parallel_for(endpoints.size(), [&](size_t i) {
+        result[i] = shortest_path(endpoints[i].first, endpoints[i].second, max_hops);
+    }, threads);
+    return result;
+}
+
+}
@@ -6,19 +6,81 @@
 #include "Util.hpp"
 
 namespace Trellis {
-// Regexes to extract row/column from a tile name.
-static const regex tile_rxcx_re(R"(R(\d+)C(\d+))");
+// Matchers to extract row/column from a tile name. These run for every tile when a tilegrid is loaded, so are
+// hand-written equivalents of the regexes given in each comment rather than std::regex.
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static bool is_word(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || is_digit(c) || c == '_';
+}
+
+// End of the run of digits starting at pos
+static size_t digits_end(const string &name, size_t pos)
+{
+    while (pos < name.size() && is_digit(name[pos]))
+        pos++;
+    return pos;
+}
 
-// MachXO2-specific, in order of precedence (otherwise, e.g.
-// CENTER_EBR matches r_regex)
-static const regex tile_center_re(R"(CENTER(\d+))");
-static const regex tile_centerb_re(R"(CENTER_B)");
-static const regex tile_centert_re(R"(CENTER_T)");
-static const regex tile_centerebr_re(R"(CENTER_EBR(\d+))");
-static const regex tile_t_re(R"([A-Za-z0-9_]*T(\d+))");
-static const regex tile_b_re(R"([A-Za-z0-9_]*B(\d+))");
-static const regex tile_l_re(R"([A-Za-z0-9_]*L(\d+))");
-static const regex tile_r_re(R"([A-Za-z0-9_]*R(\d+))");
+// R(\d+)C(\d+)
+static bool match_rxcx(const string &name, int &row, int &col)
+{
+    for (size_t pos = name.find('R'); pos != string::npos; pos = name.find('R', pos + 1)) {
+        size_t row_end = digits_end(name, pos + 1);
+        if (row_end == pos + 1 || row_end >= name.size() || name[row_end] != 'C')
+            continue;
+        size_t col_end = digits_end(name, row_end + 1);
+        if (col_end == row_end + 1)
+            continue;
+        row = stoi(name.substr(pos + 1, row_end - pos - 1));
+        col = stoi(name.substr(row_end + 1, col_end - row_end - 1));
+        return true;
+    }
+    return false;
+}
+
+// <prefix>(\d+)
+static bool match_prefix_number(const string &name, const string &prefix, int &num)
+{
+    for (size_t pos = name.find(prefix); pos != string::npos; pos = name.find(prefix, pos + 1)) {
+        size_t start = pos + prefix.size();
+        size_t end = digits_end(name, start);
+        if (end == start)
+            continue;
+        num = stoi(name.substr(start, end - start));
+        return true;
+    }
+    return false;
+}
+
+// [A-Za-z0-9_]*<letter>(\d+)
+// The greedy prefix means the match is the last <letter> followed by a digit in the first run of word characters
+// that contains one.
+static bool match_word_letter_number(const string &name, char letter, int &num)
+{
+    size_t pos = 0;
+    while (pos < name.size()) {
+        if (!is_word(name[pos])) {
+            pos++;
+            continue;
+        }
+        size_t run_end = pos;
+        while (run_end < name.size() && is_word(name[run_end]))
+            run_end++;
+        for (size_t i = run_end; i-- > pos;) {
+            if (name[i] == letter && i + 1 < run_end && is_digit(name[i + 1])) {
+                num = stoi(name.substr(i + 1, digits_end(name, i + 1) - i - 1));
+                return true;
+            }
+        }
+        pos = run_end;
+    }
+    return false;
+}
 
 // Given the zero-indexed max chip_size, return the zero-indexed
 // center. Mainly for MachXO2, it is based on the location of the entry
@@ -39,33 +101,41 @@ map<pair<int, int>, pair<int, int>> center_map = {
     {make_pair(26, 40), make_pair(13, 18)},
 };
 
+static pair<int, int> get_center(pair<int, int> chip_size)
+{
+    auto found = center_map.find(chip_size);
+    return found != center_map.end() ? found->second : make_pair(0, 0);
+}
+
 // Universal function to get a zero-indexed row/column pair.
 pair<int, int> get_row_col_pair_from_chipsize(string name, pair<int, int> chip_size, int bias) {
-    smatch m;
+    int a, b;
 
     // Special-cases... CENTER30 will match wrong regex. Only on 7000HC,
     // this position is a best-guess.
+    // MachXO2-specific patterns are checked in order of precedence
+    // (otherwise, e.g. CENTER_EBR matches the R pattern)
     if(name.find("CENTER30") != std::string::npos) {
         return make_pair(20, 29);
-    } else if(regex_search(name, m, tile_rxcx_re)) {
-        return make_pair(stoi(m.str(1)), stoi(m.str(2)) - bias);
-    } else if(regex_search(name, m, tile_centert_re)) {
-        return make_pair(0, center_map[chip_size].second);
-    } else if(regex_search(name, m, tile_centerb_re)) {
-        return make_pair(chip_size.first, center_map[chip_size].second);
-    } else if(regex_search(name, m, tile_centerebr_re)) {
+    } else if(match_rxcx(name, a, b)) {
+        return make_pair(a, b - bias);
+    } else if(name.find("CENTER_T") != std::string::npos) {
+        return make_pair(0, get_center(chip_size).second);
+    } else if(name.find("CENTER_B") != std::string::npos) {
+        return make_pair(chip_size.first, get_center(chip_size).second);
+    } else if(match_prefix_number(name, "CENTER_EBR", a)) {
         // TODO: This may not apply to devices larger than 1200.
-        return make_pair(center_map[chip_size].first, stoi(m.str(1)) - bias);
-    } else if(regex_search(name, m, tile_center_re)) {
-        return make_pair(stoi(m.str(1)), center_map[chip_size].second);
-    } else if(regex_search(name, m, tile_t_re)) {
-        return make_pair(0, stoi(m.str(1)) - bias);
-    } else if(regex_search(name, m, tile_b_re)) {
-        return make_pair(chip_size.first, stoi(m.str(1)) - bias);
-    } else if(regex_search(name, m, tile_l_re)) {
-        return make_pair(stoi(m.str(1)), 0);
-    } else if(regex_search(name, m, tile_r_re)) {
-        return make_pair(stoi(m.str(1)), chip_size.second);
+        return make_pair(get_center(chip_size).first, a - bias);
+    } else if(match_prefix_number(name, "CENTER", a)) {
+        return make_pair(a, get_center(chip_size).second);
+    } else if(match_word_letter_number(name, 'T', a)) {
+        return make_pair(0, a - bias);
+    } else if(match_word_letter_number(name, 'B', a)) {
+        return make_pair(chip_size.first, a - bias);
+    } else if(match_word_letter_number(name, 'L', a)) {
+        return make_pair(a, 0);
+    } else if(match_word_letter_number(name, 'R', a)) {
+        return make_pair(a, chip_size.second);
     } else {
         throw runtime_error(fmt("Could not extract position from " << name));
     }
@@ -77,20 +147,15 @@ Tile::Tile(Trellis::TileInfo info, Trellis::Chip &parent) : info(info), cram(par
                                                                                                    info.bits_per_frame)) {}
 
 string Tile::dump_config() const {
-    shared_ptr<TileBitDatabase> bitdb = get_tile_bitdata(TileLocator(info.family, info.device, info.type));
+    const shared_ptr<TileBitDatabase> &bitdb = get_tile_bitdata(info);
     TileConfig cfg = bitdb->tile_cram_to_config(cram);
     known_bits = cfg.total_known_bits;
     unknown_bits = int(cfg.cunknowns.size());
-    stringstream ss;
-    ss << cfg;
-    return ss.str();
+    return cfg.to_string();
 }
 
 void Tile::read_config(string config) {
-    shared_ptr<TileBitDatabase> bitdb = get_tile_bitdata(TileLocator(info.family, info.device, info.type));
-    stringstream ss(config);
-    TileConfig tcfg;
-    ss >> tcfg;
-    bitdb->config_to_tile_cram(tcfg, cram);
+    const shared_ptr<TileBitDatabase> &bitdb = get_tile_bitdata(info);
+    bitdb->config_to_tile_cram(TileConfig::from_string(config), cram);
 }
 }
@@ -1,13 +1,14 @@
 #include "TileConfig.hpp"
 #include "Util.hpp"
 #include "BitDatabase.hpp"
+#include "ConfigParser.hpp"
 #include <algorithm>
 #include <sstream>
 using namespace std;
 
 namespace Trellis {
 ostream &operator<<(ostream &out, const ConfigArc &arc) {
-    out << "arc: " << arc.sink << " " << arc.source << endl;
+    out << "arc: " << arc.sink << " " << arc.source << '\n';
     return out;
 }
 
@@ -18,7 +19,7 @@ istream &operator>>(istream &in, ConfigArc &arc) {
 }
 
 ostream &operator<<(ostream &out, const ConfigWord &cw) {
-    out << "word: " << cw.name << " " << to_string(cw.value) << endl;
+    out << "word: " << cw.name << " " << to_string(cw.value) << '\n';
     return out;
 }
 
@@ -29,7 +30,7 @@ istream &operator>>(istream &in, ConfigWord &cw) {
 }
 
 ostream &operator<<(ostream &out, const ConfigEnum &cw) {
-    out << "enum: " << cw.name << " " << cw.value << endl;
+    out << "enum: " << cw.name << " " << cw.value << '\n';
     return out;
 }
 
@@ -40,7 +41,7 @@ istream &operator>>(istream &in, ConfigEnum &ce) {
 }
 
 ostream &operator<<(ostream &out, const ConfigUnknown &cu) {
-    out << "unknown: " << to_string(ConfigBit{cu.frame, cu.bit, false}) << endl;
+    out << "unknown: " << to_string(ConfigBit{cu.frame, cu.bit, false}) << '\n';
     return out;
 }
 
@@ -55,14 +56,9 @@ istream &operator>>(istream &in, ConfigUnknown &cu) {
 }
 
 ostream &operator<<(ostream &out, const TileConfig &tc) {
-    for (const auto &arc : tc.carcs)
-        out << arc;
-    for (const auto &cword : tc.cwords)
-        out << cword;
-    for (const auto &cenum : tc.cenums)
-        out << cenum;
-    for (const auto &cunk : tc.cunknowns)
-        out << cunk;
+    string text;
+    tc.write(text);
+    out << text;
     return out;
 }
 
@@ -114,16 +110,60 @@ void TileConfig::add_unknown(int frame, int bit) {
 
 
 string TileConfig::to_string() const {
-    stringstream ss;
-    ss << *this;
-    return ss.str();
+    string text;
+    write(text);
+    return text;
+}
+
+static void append_int(string &out, int value) {
+    char buf[16];
+    char *p = buf + sizeof(buf);
+    bool neg = value < 0;
+    unsigned u = neg ? 0U - unsigned(value) : unsigned(value);
+    do {
+        *--p = char('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (neg)
+        *--p = '-';
+    out.append(p, buf + sizeof(buf));
+}
+
+void TileConfig::write(string &out) const {
+    for (const auto &arc : carcs) {
+        out += "arc: ";
+        out += arc.sink;
+        out += ' ';
+        out += arc.source;
+        out += '\n';
+    }
+    for (const auto &cword : cwords) {
+        out += "word: ";
+        out += cword.name;
+        out += ' ';
+        // MSB first, as to_string(vector<bool>)
+        for (auto it = cword.value.rbegin(); it != cword.value.rend(); ++it)
+            out += (*it ? '1' : '0');
+        out += '\n';
+    }
+    for (const auto &cenum : cenums) {
+        out += "enum: ";
+        out += cenum.name;
+        out += ' ';
+        out += cenum.value;
+        out += '\n';
+    }
+    for (const auto &cunk : cunknowns) {
+        out += "unknown: F";
+        append_int(out, cunk.frame);
+        out += 'B';
+        append_int(out, cunk.bit);
+        out += '\n';
+    }
 }
 
 TileConfig TileConfig::from_string(const string &str) {
-    stringstream ss(str);
-    TileConfig tc;
-    ss >> tc;
-    return tc;
+    return ConfigParser(str.data(), str.size()).parse_tile_config();
 }
 
 bool TileConfig::empty() const {
@@ -2,4 +2,18 @@
 
 namespace Trellis {
 VerbosityLevel verbosity = VerbosityLevel::DEBUG;
+
+void write_json_string(ostream &out, const string &str)
+{
+    out << '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (uint8_t(c) < 0x20)
+            out << "\\u" << hex << setw(4) << setfill('0') << int(c) << dec << setfill(' ');
+        else
+            out << c;
+    }
+    out << '"';
+}
 }
@@ -15,6 +15,7 @@
 //  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 //
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,7 +30,9 @@
 #include <sys/time.h>
 #endif
 
+#include <array>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include <fstream>
@@ -37,28 +40,99 @@
 
 #include <boost/program_options.hpp>
 
+#include "Bitstream.hpp"
 #include "ChipConfig.hpp"
 #include "Chip.hpp"
 #include "Database.hpp"
+#include "Parallel.hpp"
+#include "jobs.hpp"
+
+#ifndef TRELLIS_NO_TOOL_MAIN
 #include "DatabasePath.hpp"
 #include "wasmexcept.hpp"
+#endif
 
 using std::map;
+using std::unordered_map;
 using std::pair;
 using std::vector;
 using std::string;
 using std::ifstream;
 using std::getline;
 
-uint64_t x;
-uint64_t xorshift64star(void) {
+static uint64_t xorshift64star(uint64_t &x) {
     x ^= x >> 12; // a
     x ^= x << 25; // b
     x ^= x >> 27; // c
     return x * UINT64_C(2685821657736338717);
 }
 
-void push_back_bitvector(vector<vector<bool>> &hexfile, const vector<int> &digits)
+static string stringf(const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    int size = vsnprintf(nullptr, 0, format, ap);
+    va_end(ap);
+    vector<char> buf(size_t(size > 0 ? size : 0) + 1);
+    va_start(ap, format);
+    vsnprintf(buf.data(), buf.size(), format, ap);
+    va_end(ap);
+    return string(buf.data());
+}
+
+// A 512-bit slice of memory content, one bit of each of 512 consecutive words, packed LSB first
+typedef std::array<uint64_t, 8> BitSlice;
+
+struct BitSliceHash
+{
+    size_t operator()(const BitSlice &slice) const
+    {
+        uint64_t h = 0;
+        for (uint64_t w : slice)
+            h = (h ^ w) * UINT64_C(0x9E3779B97F4A7C15);
+        return size_t(h ^ (h >> 32));
+    }
+};
+
+// Number of 16-bit words of initialisation data for one BRAM
+const size_t bram_words = 2048;
+
+// Where each bit of each bit slice lives in the BRAM initialisation data, for one of the BRAM data widths. Positions are
+// (word << 4) | bit, 512 per slice
+struct SliceLayout
+{
+    int slices;
+    vector<uint32_t> positions;
+};
+
+static vector<SliceLayout> make_slice_layouts()
+{
+    const int W[] =  {  1,  2,  4,  9, 18, 36 };
+    const int NW[] = {  8,  8,  8,  9,  9,  9 };
+    const int B[]  = { 32, 32, 32, 36, 36, 36 };
+
+    vector<SliceLayout> layouts;
+    for (int i = 0; i < 6; i++)
+    {
+        SliceLayout layout;
+        layout.slices = B[i];
+        for (int j = 0; j < B[i]; j++)
+        {
+            for (int k = 0; k < 512; k++)
+            {
+                int bn = (k * W[i]) + (j % W[i]) + ((j/W[i]) * 512 * W[i]);
+                int word  = bn / NW[i];
+                int bit   = bn % NW[i];
+                assert(word < int(bram_words));
+                layout.positions.push_back(uint32_t((word << 4) | bit));
+            }
+        }
+        layouts.push_back(std::move(layout));
+    }
+    return layouts;
+}
+
+static void push_back_bitvector(vector<vector<bool>> &hexfile, const vector<int> &digits)
 {
     if (digits.empty())
         return;
@@ -70,7 +144,7 @@ void push_back_bitvector(vector<vector<bool>> &hexfile, const vector<int> &digit
             hexfile.back().at(i) = true;
 }
 
-void parse_hexfile_line(const char *filename, int linenr, vector<vector<bool>> &hexfile, string &line, int &address)
+static void parse_hexfile_line(const char *filename, int linenr, vector<vector<bool>> &hexfile, string &line, int &address)
 {
     vector<int> digits;
     bool reading_address = false;
@@ -100,8 +174,7 @@ void parse_hexfile_line(const char *filename, int linenr, vector<vector<bool>> &
 		    file_address |= digits.at(i);
 		}
 		if (file_address != address) {
-		    fprintf(stderr, "Non-contiguous address (expected @%X) at line %d of %s: %s\n", address, linenr, filename, line.c_str());
-		    exit(1);
+		    throw runtime_error(stringf("Non-contiguous address (expected @%X) at line %d of %s: %s", address, linenr, filename, line.c_str()));
 		}
 	    } else {
 		push_back_bitvector(hexfile, digits);
@@ -118,28 +191,30 @@ void parse_hexfile_line(const char *filename, int linenr, vector<vector<bool>> &
     return;
 
 error:
-    fprintf(stderr, "Can't parse line %d of %s: %s\n", linenr, filename, line.c_str());
-    exit(1);
+    throw runtime_error(stringf("Can't parse line %d of %s: %s", linenr, filename, line.c_str()));
 }
 
-int main(int argc, char **argv)
+int ecpbram_job(int argc, char *argv[], Trellis::JobContext &ctx)
 {
     bool verbose = false;
     namespace po = boost::program_options;
 
-    std::string database_folder = get_database_path();;
+    std::string database_folder = ctx.default_database;
 
     po::options_description options("Allowed options");
 
     po::options_description options_any("Generic options");
     options_any.add_options()("help,h", "show help");
     options_any.add_options()("verbose,v", "verbose output");
+    options_any.add_options()("server", po::value<std::string>(), "run in the ecpserver listening on this socket, if there is one");
 
     po::options_description options_init("Initialize options");
     options_init.add_options()("input,i", po::value<std::string>(), "input configuration file");
     options_init.add_options()("output,o", po::value<std::string>(), "output configuration file");
     options_init.add_options()("from,f", po::value<std::string>(), "original content hex file");
     options_init.add_options()("to,t", po::value<std::string>(), "new content hex file");
+    options_init.add_options()("binary", "input and output configurations are in binary format");
+    options_init.add_options()("bitstream", "input and output are .bit files, patched in place without repacking");
 
     po::options_description options_gen("Generate options");
     options_gen.add_options()("generate,g", po::value<std::string>(), "Generate random hex of given geometry into given file");
@@ -156,19 +231,19 @@ int main(int argc, char **argv)
         po::notify(vm);
     }
     catch (std::exception &e) {
-        cerr << e.what() << endl << endl;
+        ctx.err << e.what() << endl << endl;
         goto help;
     }
 
     if (vm.count("help")) {
     help:
-        cerr << "Project Trellis - Open Source Tools for ECP5 FPGAs" << endl;
-        cerr << argv[0] << ": ECP5 BRAM content initialization tool" << endl;
-        cerr << endl;
-        cerr << "Copyright (C) 2019  Sylvain Munaut <tnt@246tNt.com>" << endl;
-        cerr << "Copyright (C) 2016  Claire Xenia Wolf <claire@yosyshq.com>" << endl;
-        cerr << endl;
-        cerr << options << endl;
+        ctx.err << "Project Trellis - Open Source Tools for ECP5 FPGAs" << endl;
+        ctx.err << argv[0] << ": ECP5 BRAM content initialization tool" << endl;
+        ctx.err << endl;
+        ctx.err << "Copyright (C) 2019  Sylvain Munaut <tnt@246tNt.com>" << endl;
+        ctx.err << "Copyright (C) 2016  Claire Xenia Wolf <claire@yosyshq.com>" << endl;
+        ctx.err << endl;
+        ctx.err << options << endl;
         return vm.count("help") ? 0 : 1;
     }
 
@@ -184,12 +259,12 @@ int main(int argc, char **argv)
         int depth = vm.at("depth").as<int>();
 
         if (width <= 0 || width % 4 != 0) {
-            fprintf(stderr, "Hexfile width (%d bits) is not divisible by 4 or nonpositive!\n", width);
+            ctx.err << stringf("Hexfile width (%d bits) is not divisible by 4 or nonpositive!\n", width);
             return 1;
         }
 
         if (depth <= 0 || depth % 512 != 0) {
-            fprintf(stderr, "Hexfile number of words (%d) is not divisible by 512 or nonpositive!\n", depth);
+            ctx.err << stringf("Hexfile number of words (%d) is not divisible by 512 or nonpositive!\n", depth);
             return 1;
         }
 
@@ -201,7 +276,7 @@ int main(int argc, char **argv)
             seed_nr = vm.at("seed").as<int>();
 
             if (verbose)
-                fprintf(stderr, "Seed: %d\n", seed_nr);
+                ctx.err << stringf("Seed: %d\n", seed_nr);
         } else {
 #if defined(__wasm)
             seed_nr = 0;
@@ -212,6 +287,7 @@ int main(int argc, char **argv)
 #endif
         }
 
+        uint64_t x;
         x  = uint64_t(seed_nr) << 32;
         x ^= uint64_t(seed_nr) << 20;
         x ^= uint64_t(seed_nr);
@@ -219,9 +295,9 @@ int main(int argc, char **argv)
         x ^= uint64_t(depth) << 16;
         x ^= uint64_t(width) << 10;
 
-        xorshift64star();
-        xorshift64star();
-        xorshift64star();
+        xorshift64star(x);
+        xorshift64star(x);
+        xorshift64star(x);
 
         if (!vm.count("seed")) {
 #ifdef _WIN32
@@ -240,15 +316,15 @@ int main(int argc, char **argv)
 #endif
         }
 
-        xorshift64star();
-        xorshift64star();
-        xorshift64star();
+        xorshift64star(x);
+        xorshift64star(x);
+        xorshift64star(x);
 
-        ofstream romfile(vm.at("generate").as<std::string>());
+        ofstream romfile(ctx.path(vm.at("generate").as<std::string>()));
 
         for (int i = 0; i < depth; i++) {
             for (int j = 0; j < width / 4; j++) {
-                int digit = xorshift64star() & 15;
+                int digit = xorshift64star(x) & 15;
                 romfile << "0123456789abcdef"[digit];
             }
             romfile << std::endl;
@@ -260,28 +336,38 @@ int main(int argc, char **argv)
     if (!vm.count("input") || !vm.count("output") || !vm.count("from") || !vm.count("to"))
         goto help;
 
+    if (vm.count("binary") && vm.count("bitstream")) {
+        ctx.err << "--binary and --bitstream cannot be used together!" << endl;
+        return 1;
+    }
+
     // -------------------------------------------------------
     // Load from_hexfile and to_hexfile
 
     const char *from_hexfile_n = vm.at("from").as<std::string>().c_str();
-    ifstream from_hexfile_f(from_hexfile_n);
+    ifstream from_hexfile_f(ctx.path(from_hexfile_n));
     vector<vector<bool>> from_hexfile;
 
     const char *to_hexfile_n = vm.at("to").as<std::string>().c_str();
-    ifstream to_hexfile_f(to_hexfile_n);
+    ifstream to_hexfile_f(ctx.path(to_hexfile_n));
     vector<vector<bool>> to_hexfile;
 
     string line;
     
-    for (int i = 1, address = 0; getline(from_hexfile_f, line); i++)
-        parse_hexfile_line(from_hexfile_n, i, from_hexfile, line, address);
+    try {
+        for (int i = 1, address = 0; getline(from_hexfile_f, line); i++)
+            parse_hexfile_line(from_hexfile_n, i, from_hexfile, line, address);
 
-    for (int i = 1, address = 0; getline(to_hexfile_f, line); i++)
-        parse_hexfile_line(to_hexfile_n, i, to_hexfile, line, address);
+        for (int i = 1, address = 0; getline(to_hexfile_f, line); i++)
+            parse_hexfile_line(to_hexfile_n, i, to_hexfile, line, address);
+    } catch (runtime_error &e) {
+        ctx.err << e.what() << endl;
+        return 1;
+    }
 
     if (to_hexfile.size() > 0 && from_hexfile.size() > to_hexfile.size()) {
         if (verbose)
-            fprintf(stderr, "Padding to_hexfile from %d words to %d\n",
+            ctx.err << stringf("Padding to_hexfile from %d words to %d\n",
                 int(to_hexfile.size()), int(from_hexfile.size()));
         do
             to_hexfile.push_back(vector<bool>(to_hexfile.at(0).size()));
@@ -289,18 +375,18 @@ int main(int argc, char **argv)
     }
 
     if (from_hexfile.size() != to_hexfile.size()) {
-        fprintf(stderr, "Hexfiles have different number of words! (%d vs. %d)\n", int(from_hexfile.size()), int(to_hexfile.size()));
+        ctx.err << stringf("Hexfiles have different number of words! (%d vs. %d)\n", int(from_hexfile.size()), int(to_hexfile.size()));
         return 1;
     }
 
     if (from_hexfile.size() % 512 != 0) {
-        fprintf(stderr, "Hexfile number of words (%d) is not divisible by 512!\n", int(from_hexfile.size()));
+        ctx.err << stringf("Hexfile number of words (%d) is not divisible by 512!\n", int(from_hexfile.size()));
         return 1;
     }
 
     for (size_t i = 1; i < from_hexfile.size(); i++)
         if (from_hexfile.at(i-1).size() != from_hexfile.at(i).size()) {
-            fprintf(stderr, "Inconsistent word width at line %d of %s!\n", int(i), from_hexfile_n);
+            ctx.err << stringf("Inconsistent word width at line %d of %s!\n", int(i), from_hexfile_n);
             return 1;
         }
 
@@ -308,130 +394,183 @@ int main(int argc, char **argv)
         while (to_hexfile.at(i-1).size() > to_hexfile.at(i).size())
             to_hexfile.at(i).push_back(false);
         if (to_hexfile.at(i-1).size() != to_hexfile.at(i).size()) {
-            fprintf(stderr, "Inconsistent word width at line %d of %s!\n", int(i+1), to_hexfile_n);
+            ctx.err << stringf("Inconsistent word width at line %d of %s!\n", int(i+1), to_hexfile_n);
             return 1;
         }
     }
 
     if (from_hexfile.size() == 0 || from_hexfile.at(0).size() == 0) {
-        fprintf(stderr, "Empty from/to hexfiles!\n");
+        ctx.err << "Empty from/to hexfiles!" << endl;
         return 1;
     }
 
     if (verbose)
-        fprintf(stderr, "Loaded pattern for %d bits wide and %d words deep memory.\n", int(from_hexfile.at(0).size()), int(from_hexfile.size()));
+        ctx.err << stringf("Loaded pattern for %d bits wide and %d words deep memory.\n", int(from_hexfile.at(0).size()), int(from_hexfile.size()));
 
 
     // -------------------------------------------------------
     // Create bitslices from pattern data
 
-    map<vector<bool>, pair<vector<bool>, int>> pattern;
+    unordered_map<BitSlice, BitSlice, BitSliceHash> pattern;
 
     for (int i = 0; i < int(from_hexfile.at(0).size()); i++)
     {
-        vector<bool> pattern_from, pattern_to;
-
-        for (int j = 0; j < int(from_hexfile.size()); j++)
+        for (int j0 = 0; j0 < int(from_hexfile.size()); j0 += 512)
         {
-            pattern_from.push_back(from_hexfile.at(j).at(i));
-            pattern_to.push_back(to_hexfile.at(j).at(i));
+            BitSlice pattern_from{}, pattern_to{};
 
-            if (pattern_from.size() == 512) {
-                if (pattern.count(pattern_from)) {
-                    fprintf(stderr, "Conflicting from pattern for bit slice from_hexfile[%d:%d][%d]!\n", j, j-255, i);
-                    return 1;
-                }
-                pattern[pattern_from] = std::make_pair(pattern_to, 0);
-                pattern_from.clear(), pattern_to.clear();
+            for (int k = 0; k < 512; k++)
+            {
+                if (from_hexfile.at(j0 + k).at(i))
+                    pattern_from[k / 64] |= UINT64_C(1) << (k % 64);
+                if (to_hexfile.at(j0 + k).at(i))
+                    pattern_to[k / 64] |= UINT64_C(1) << (k % 64);
             }
-        }
 
-        assert(pattern_from.empty());
-        assert(pattern_to.empty());
+            if (!pattern.emplace(pattern_from, pattern_to).second) {
+                int j = j0 + 511;
+                ctx.err << stringf("Conflicting from pattern for bit slice from_hexfile[%d:%d][%d]!\n", j, j-255, i);
+                return 1;
+            }
+        }
     }
 
     if (verbose)
-        fprintf(stderr, "Extracted %d bit slices from from/to hexfile data.\n", int(pattern.size()));
+        ctx.err << stringf("Extracted %d bit slices from from/to hexfile data.\n", int(pattern.size()));
 
 
     // -------------------------------------------------------
     // Load database and config
 
-    ifstream config_file(vm.at("input").as<string>());
-
     try {
-        Trellis::load_database(database_folder);
+        ctx.load_database(database_folder);
     } catch (runtime_error &e) {
-        cerr << "Failed to load Trellis database: " << e.what() << endl;
+        ctx.err << "Failed to load Trellis database: " << e.what() << endl;
         return 1;
     }
 
-    string textcfg((std::istreambuf_iterator<char>(config_file)), std::istreambuf_iterator<char>());
-
     Trellis::ChipConfig cc;
+    boost::optional<Trellis::Bitstream> bitstream;
     try {
-        cc = Trellis::ChipConfig::from_string(textcfg);
+        if (vm.count("bitstream")) {
+            ifstream bit_file(ctx.path(vm.at("input").as<string>()), std::ios::binary);
+            if (!bit_file) {
+                ctx.err << "Failed to open input file " << vm.at("input").as<string>() << endl;
+                return 1;
+            }
+            bitstream = Trellis::Bitstream::read_bit(bit_file);
+            cc.bram_data = bitstream->get_bram_data();
+        } else if (vm.count("binary")) {
+            cc = Trellis::ChipConfig::from_binary_file(ctx.path(vm.at("input").as<string>()));
+        } else {
+            cc = Trellis::ChipConfig::from_file(ctx.path(vm.at("input").as<string>()));
+        }
+    } catch (Trellis::BitstreamParseError &e) {
+        ctx.err << "Failed to process input bitstream: " << e.what() << endl;
+        return 1;
     } catch (runtime_error &e) {
-        cerr << "Failed to process input config: " << e.what() << endl;
+        ctx.err << "Failed to process input " << (vm.count("bitstream") ? "bitstream" : "config") << ": " << e.what() << endl;
         return 1;
     }
 
     // -------------------------------------------------------
     // Replace bram data
 
-    int max_replace_cnt = 0;
+    vector<vector<uint16_t> *> brams;
 
     for (auto &bram_it : cc.bram_data)
     {
-        auto &bram_data = bram_it.second;
+        if (bram_it.second.size() < bram_words) {
+            ctx.err << stringf("BRAM %d has only %d words of initialisation data!\n", int(bram_it.first), int(bram_it.second.size()));
+            return 1;
+        }
+        brams.push_back(&bram_it.second);
+    }
+
+    const vector<SliceLayout> layouts = make_slice_layouts();
+    vector<int> replace_cnt(brams.size());
 
-        const int W[] =  {  1,  2,  4,  9, 18, 36 };
-        const int NW[] = {  8,  8,  8,  9,  9,  9 };
-        const int B[]  = { 32, 32, 32, 36, 36, 36 };
+    // Each BRAM is independent, but within a BRAM the widths are tried in turn, each seeing any earlier replacements
+    Trellis::parallel_for(brams.size(), [&](size_t n) {
+        auto &bram_data = *brams.at(n);
 
-        for (int i = 0; i < 6; i++)
+        for (const auto &layout : layouts)
         {
-            for (int j = 0; j < B[i]; j++)
+            for (int j = 0; j < layout.slices; j++)
             {
-                vector<bool> from_bitslice;
+                const uint32_t *positions = layout.positions.data() + j * 512;
+                BitSlice from_bitslice{};
 
                 for (int k = 0; k < 512; k++)
                 {
-                    int bn = (k * W[i]) + (j % W[i]) + ((j/W[i]) * 512 * W[i]);
-                    int word  = bn / NW[i];
-                    int bit   = bn % NW[i];
-
-                    from_bitslice.push_back((bram_data.at(word) & (1 << bit)) != 0);
+                    uint32_t pos = positions[k];
+                    if ((bram_data[pos >> 4] >> (pos & 15)) & 1)
+                        from_bitslice[k / 64] |= UINT64_C(1) << (k % 64);
                 }
 
                 auto p = pattern.find(from_bitslice);
                 if (p != pattern.end())
                 {
-                    auto &to_bitslice = p->second.first;
+                    const auto &to_bitslice = p->second;
 
                     for (int k = 0; k < 512; k++)
                     {
-                        int bn = (k * W[i]) + (j % W[i]) + ((j/W[i]) * 512 * W[i]);
-                        int word  = bn / NW[i];
-                        int bit   = bn % NW[i];
+                        uint32_t pos = positions[k];
+                        uint16_t mask = uint16_t(1 << (pos & 15));
 
-                        if (to_bitslice.at(k))
-                            bram_data.at(word) |=  (1 << bit);
+                        if ((to_bitslice[k / 64] >> (k % 64)) & 1)
+                            bram_data[pos >> 4] |= mask;
                         else
-                            bram_data.at(word) &= ~(1 << bit);
+                            bram_data[pos >> 4] &= uint16_t(~mask);
                     }
 
-                    max_replace_cnt = std::max(++p->second.second, max_replace_cnt);
+                    replace_cnt.at(n)++;
                 }
             }
         }
+    });
+
+    if (verbose) {
+        int total = 0;
+        for (int cnt : replace_cnt)
+            total += cnt;
+        ctx.err << stringf("Replaced %d bit slices in %d BRAMs.\n", total, int(brams.size()));
     }
 
     // -------------------------------------------------------
     // Save the new config
 
-    ofstream new_config_file(vm.at("output").as<std::string>());
-    new_config_file << cc.to_string();
+    try {
+        if (bitstream) {
+            int changed = bitstream->patch_bram_data(cc.bram_data);
+            if (verbose)
+                ctx.err << stringf("Patched %d EBR writes in bitstream.\n", changed);
+            // read_bit keeps the whole file, header included, so write it back out unchanged apart from the patches
+            ofstream bit_file(ctx.path(vm.at("output").as<std::string>()), std::ios::binary);
+            if (!bit_file) {
+                ctx.err << "Failed to open output file " << vm.at("output").as<std::string>() << endl;
+                return 1;
+            }
+            bitstream->write_bin(bit_file);
+        } else if (vm.count("binary")) {
+            cc.to_binary_file(ctx.path(vm.at("output").as<std::string>()));
+        } else {
+            cc.to_file(ctx.path(vm.at("output").as<std::string>()));
+        }
+    } catch (Trellis::BitstreamParseError &e) {
+        ctx.err << "Failed to patch bitstream: " << e.what() << endl;
+        return 1;
+    } catch (runtime_error &e) {
+        ctx.err << "Failed to write output " << (bitstream ? "bitstream" : "config") << ": " << e.what() << endl;
+        return 1;
+    }
 
     return 0;
 }
+
+#ifndef TRELLIS_NO_TOOL_MAIN
+int main(int argc, char *argv[])
+{
+    return Trellis::run_tool("ecpbram", ecpbram_job, argc, argv, get_database_path());
+}
+#endif
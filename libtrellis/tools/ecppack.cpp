@@ -2,21 +2,28 @@
 #include "Bitstream.hpp"
 #include "Chip.hpp"
 #include "Database.hpp"
-#include "DatabasePath.hpp"
 #include "Tile.hpp"
 #include "BitDatabase.hpp"
+#include "PackCache.hpp"
+#include "Profile.hpp"
+#include "jobs.hpp"
 #include "version.hpp"
-#include "wasmexcept.hpp"
 #include <iostream>
+#include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include <stdexcept>
 #include <streambuf>
 #include <fstream>
 #include <iomanip>
 
+#ifndef TRELLIS_NO_TOOL_MAIN
+#include "DatabasePath.hpp"
+#include "wasmexcept.hpp"
+#endif
+
 using namespace std;
 
-uint8_t reverse_byte(uint8_t byte) {
+static uint8_t reverse_byte(uint8_t byte) {
     uint8_t rev = 0;
     for (int i = 0; i < 8; i++)
         if (byte & (1 << i))
@@ -24,17 +31,17 @@ uint8_t reverse_byte(uint8_t byte) {
     return rev;
 }
 
-uint32_t convert_hexstring(std::string value_str)
+static uint32_t convert_hexstring(std::string value_str)
 {
     return uint32_t(strtoul(value_str.c_str(), nullptr, 0));
 }
 
-int main(int argc, char *argv[])
+int ecppack_job(int argc, char *argv[], Trellis::JobContext &ctx)
 {
     using namespace Trellis;
     namespace po = boost::program_options;
 
-    std::string database_folder = get_database_path();
+    std::string database_folder = ctx.default_database;
 
     po::options_description options("Allowed options");
     options.add_options()("help,h", "show help");
@@ -50,6 +57,11 @@ int main(int argc, char *argv[])
     options.add_options()("background", "enable background reconfiguration in bitstream");
     options.add_options()("delta", po::value<std::string>(), "create a delta partial bitstream given a reference config");
     options.add_options()("bootaddr", po::value<std::string>(), "set next BOOTADDR in bitstream and enable multi-boot");
+    options.add_options()("binary", "input (and delta reference) configuration is in binary format");
+    options.add_options()("cache", po::value<std::string>(), "cache file of encoded tiles and frames, reused between runs");
+    options.add_options()("profile", po::value<std::string>(), "write a JSON summary of time spent in each stage to a file");
+    options.add_options()("profile-trace", po::value<std::string>(), "write a Chrome trace of time spent in each stage to a file");
+    options.add_options()("server", po::value<std::string>(), "run in the ecpserver listening on this socket, if there is one");
     po::positional_options_description pos;
     options.add_options()("input", po::value<std::string>()->required(), "input textual configuration");
     pos.add("input", 1);
@@ -64,37 +76,37 @@ int main(int argc, char *argv[])
         po::store(parsed, vm);
 
         if (vm.count("version")) {
-            cerr << "Project Trellis ecppack Version " << git_describe_str << endl;
+            ctx.err << "Project Trellis ecppack Version " << git_describe_str << endl;
             return 0;
         }
 
         po::notify(vm);
     }
     catch (po::required_option& e) {
-        cerr << "Error: input file is mandatory." << endl << endl;
+        ctx.err << "Error: input file is mandatory." << endl << endl;
         goto help;
     }
     catch (std::exception& e) {
-        cerr << "Error: " << e.what() << endl << endl;
+        ctx.err << "Error: " << e.what() << endl << endl;
         goto help;
     }
 
     if (vm.count("help")) {
 help:
-        cerr << "Project Trellis - Open Source Tools for ECP5 FPGAs" << endl;
-        cerr << "Version " << git_describe_str << endl;
-        cerr << argv[0] << ": ECP5 bitstream packer" << endl;
-        cerr << endl;
-        cerr << "Copyright (C) 2018 gatecat <gatecat@ds0.me>" << endl;
-        cerr << endl;
-        cerr << "Usage: " << argv[0] << " input.config [output.bit] [options]" << endl;
-        cerr << options << endl;
+        ctx.err << "Project Trellis - Open Source Tools for ECP5 FPGAs" << endl;
+        ctx.err << "Version " << git_describe_str << endl;
+        ctx.err << argv[0] << ": ECP5 bitstream packer" << endl;
+        ctx.err << endl;
+        ctx.err << "Copyright (C) 2018 gatecat <gatecat@ds0.me>" << endl;
+        ctx.err << endl;
+        ctx.err << "Usage: " << argv[0] << " input.config [output.bit] [options]" << endl;
+        ctx.err << options << endl;
         return vm.count("help") ? 0 : 1;
     }
 
-    ifstream config_file(vm["input"].as<string>());
-    if (!config_file) {
-        cerr << "Failed to open input file" << endl;
+    // Checked before the database is loaded; the file itself is only opened once, by the parser
+    if (!boost::filesystem::exists(ctx.path(vm["input"].as<string>()))) {
+        ctx.err << "Failed to open input file" << endl;
         return 1;
     }
 
@@ -102,24 +114,36 @@ help:
         database_folder = vm["db"].as<string>();
     }
 
+    if (vm.count("profile") || vm.count("profile-trace")) {
+        // Profiling is process-wide, so would include other jobs
+        if (ctx.in_server())
+            throw JobNotServed("profiling is not supported in a server");
+        Profile::set_enabled(true);
+    }
+
     try {
-        load_database(database_folder);
+        ctx.load_database(database_folder);
     } catch (runtime_error &e) {
-        cerr << "Failed to load Trellis database: " << e.what() << endl;
+        ctx.err << "Failed to load Trellis database: " << e.what() << endl;
         return 1;
     }
 
-    string textcfg((std::istreambuf_iterator<char>(config_file)), std::istreambuf_iterator<char>());
-
     ChipConfig cc;
     try {
-        cc = ChipConfig::from_string(textcfg);
+        if (vm.count("binary"))
+            cc = ChipConfig::from_binary_file(ctx.path(vm["input"].as<string>()));
+        else
+            cc = ChipConfig::from_file(ctx.path(vm["input"].as<string>()));
     } catch (runtime_error &e) {
-        cerr << "Failed to process input config: " << e.what() << endl;
+        ctx.err << "Failed to process input config: " << e.what() << endl;
         return 1;
     }
 
-    Chip c = cc.to_chip();
+    unique_ptr<PackCache> cache;
+    if (vm.count("cache"))
+        cache.reset(new PackCache(ctx.path(vm["cache"].as<string>())));
+
+    Chip c = cc.to_chip(cache.get());
     if (vm.count("usercode"))
         c.usercode = vm["usercode"].as<uint32_t>();
 
@@ -127,7 +151,7 @@ help:
         string idcode_str = vm["idcode"].as<string>();
         uint32_t idcode = uint32_t(strtoul(idcode_str.c_str(), nullptr, 0));
         if (idcode == 0) {
-            cerr << "Invalid idcode: " << idcode_str << endl;
+            ctx.err << "Invalid idcode: " << idcode_str << endl;
             return 1;
         }
         c.info.idcode = idcode;
@@ -169,7 +193,7 @@ help:
         uint32_t bootaddr = convert_hexstring(vm["bootaddr"].as<string>());
 
         if (bootaddr & 0xffff) {
-            cerr << "Error: Boot Address must be 64k aligned !" << endl;
+            ctx.err << "Error: Boot Address must be 64k aligned !" << endl;
             return 1;
         }
 
@@ -180,7 +204,7 @@ help:
         auto tile = c.get_tiles_by_type("EFB1_PICB1");
 
         if (tile.size() != 1) {
-            cerr << "EFB1_PICB1 Frame is wrong size. Can't proceed" << endl;
+            ctx.err << "EFB1_PICB1 Frame is wrong size. Can't proceed" << endl;
             return 1;
         }
 
@@ -198,21 +222,17 @@ help:
     bool partial_mode = false;
     vector<uint32_t> partial_frames;
     if (vm.count("delta")) {
-        ifstream delta_file(vm["delta"].as<string>());
-        if (!delta_file) {
-            cerr << "Failed to open reference config file" << endl;
-            return 1;
-        }
-        string refcfg((std::istreambuf_iterator<char>(delta_file)), std::istreambuf_iterator<char>());
-
         ChipConfig ref_cc;
         try {
-            ref_cc = ChipConfig::from_string(refcfg);
+            if (vm.count("binary"))
+                ref_cc = ChipConfig::from_binary_file(ctx.path(vm["delta"].as<string>()));
+            else
+                ref_cc = ChipConfig::from_file(ctx.path(vm["delta"].as<string>()));
         } catch (runtime_error &e) {
-            cerr << "Failed to process reference config: " << e.what() << endl;
+            ctx.err << "Failed to process reference config: " << e.what() << endl;
             return 1;
         }
-        Chip ref_c = ref_cc.to_chip();
+        Chip ref_c = ref_cc.to_chip(cache.get());
         for (int frame = 0; frame < c.cram.frames(); frame++) {
             if (ref_c.cram.data->at(frame) != c.cram.data->at(frame)) {
                 partial_frames.push_back(frame);
@@ -222,11 +242,11 @@ help:
         partial_mode = true;
     }
 
-    Bitstream b = partial_mode ? Bitstream::serialise_chip_partial(c, partial_frames, bitopts) : Bitstream::serialise_chip(c, bitopts);
+    Bitstream b = partial_mode ? Bitstream::serialise_chip_partial(c, partial_frames, bitopts) : Bitstream::serialise_chip(c, bitopts, cache.get());
     if (vm.count("bit")) {
-        ofstream bit_file(vm["bit"].as<string>(), ios::binary);
+        ofstream bit_file(ctx.path(vm["bit"].as<string>()), ios::binary);
         if (!bit_file) {
-            cerr << "Failed to open output file" << endl;
+            ctx.err << "Failed to open output file" << endl;
             return 1;
         }
         b.write_bit(bit_file);
@@ -238,7 +258,7 @@ help:
         if (!bitopts.empty() && !(bitopts.size() == 1 && bitopts.count("compress"))) {
             bitopts.erase("spimode");
             bitopts.erase("freq");
-            b = Bitstream::serialise_chip(c, bitopts);
+            b = Bitstream::serialise_chip(c, bitopts, cache.get());
         }
 
         vector<uint8_t> bitstream = b.get_bytes();
@@ -246,12 +266,12 @@ help:
         if (vm.count("svf-rowsize"))
             max_row_size = vm["svf-rowsize"].as<int>();
         if ((max_row_size % 8) != 0 || max_row_size <= 0) {
-            cerr << "SVF row size must be an exact positive number of bytes" << endl;
+            ctx.err << "SVF row size must be an exact positive number of bytes" << endl;
             return 1;
         }
-        ofstream svf_file(vm["svf"].as<string>());
+        ofstream svf_file(ctx.path(vm["svf"].as<string>()));
         if (!svf_file) {
-            cerr << "Failed to open output SVF file" << endl;
+            ctx.err << "Failed to open output SVF file" << endl;
             return 1;
         }
         svf_file << "HDR\t0;" << endl;
@@ -338,5 +358,32 @@ help:
         }
     }
 
+    if (cache) {
+        if (vm.count("verbose"))
+            ctx.err << "Pack cache: " << cache->tile_hits << " tile hits, " << cache->tile_misses << " tile misses, "
+                 << cache->frame_hits << " frame hits, " << cache->frame_misses << " frame misses" << endl;
+        try {
+            cache->save();
+        } catch (runtime_error &e) {
+            // The cache only saves time, so failing to update it is not fatal
+            ctx.err << "Warning: failed to save pack cache: " << e.what() << endl;
+        }
+    }
+
+    try {
+        Profile::write_files(vm.count("profile") ? ctx.path(vm["profile"].as<string>()) : "",
+                             vm.count("profile-trace") ? ctx.path(vm["profile-trace"].as<string>()) : "");
+    } catch (runtime_error &e) {
+        ctx.err << "Failed to write profile: " << e.what() << endl;
+        return 1;
+    }
+
     return 0;
 }
+
+#ifndef TRELLIS_NO_TOOL_MAIN
+int main(int argc, char *argv[])
+{
+    return Trellis::run_tool("ecppack", ecppack_job, argc, argv, get_database_path());
+}
+#endif
@@ -0,0 +1,130 @@
+#include "Database.hpp"
+#include "DatabasePath.hpp"
+#include "JobServer.hpp"
+#include "jobs.hpp"
+#include "version.hpp"
+#include <iostream>
+#include <boost/program_options.hpp>
+#include <stdexcept>
+#include <csignal>
+#include <cstring>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/*
+Runs ecppack, ecpunpack and ecpbram jobs for clients started with --server (or TRELLIS_SERVER set) to the same socket,
+keeping the database loaded between jobs. Clients fall back to running jobs themselves if no server is listening,
+or if they ask for a database other than the one the server has loaded.
+ */
+
+#ifndef _WIN32
+// Socket to remove when stopped by a signal
+static char socket_to_remove[256];
+
+static void remove_socket_and_exit(int sig)
+{
+    if (socket_to_remove[0] != '\0')
+        unlink(socket_to_remove);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    using namespace Trellis;
+    namespace po = boost::program_options;
+
+    std::string database_folder = get_database_path();
+
+    po::options_description options("Allowed options");
+    options.add_options()("help,h", "show help");
+    options.add_options()("db", po::value<std::string>(), "Trellis database folder location");
+    options.add_options()("socket", po::value<std::string>(), "listen for jobs on this Unix socket");
+    options.add_options()("stdio", "read jobs from stdin and write results to stdout, until stdin is closed");
+    options.add_options()("threads", po::value<unsigned>(), "number of jobs to run at once (default one per hardware thread)");
+    options.add_options()("preload", po::value<vector<string>>(), "load the tilegrid and bit databases of a device before accepting jobs; may be given more than once");
+    options.add_options()("version", "show current version and exit");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, options), vm);
+
+        if (vm.count("version")) {
+            cerr << "Project Trellis ecpserver Version " << git_describe_str << endl;
+            return 0;
+        }
+
+        po::notify(vm);
+    }
+    catch (std::exception &e) {
+        cerr << "Error: " << e.what() << endl << endl;
+        goto help;
+    }
+
+    if (vm.count("help") || (vm.count("socket") == 0) == (vm.count("stdio") == 0)) {
+help:
+        cerr << "Project Trellis - Open Source Tools for ECP5 FPGAs" << endl;
+        cerr << "Version " << git_describe_str << endl;
+        cerr << argv[0] << ": job server for ecppack, ecpunpack and ecpbram" << endl;
+        cerr << endl;
+        cerr << "Usage: " << argv[0] << " --socket PATH [options]" << endl;
+        cerr << "       " << argv[0] << " --stdio [options]" << endl;
+        cerr << options << endl;
+        return vm.count("help") ? 0 : 1;
+    }
+
+    if (vm.count("db")) {
+        database_folder = vm["db"].as<string>();
+    }
+
+    try {
+        load_database(database_folder);
+    } catch (runtime_error &e) {
+        cerr << "Failed to load Trellis database: " << e.what() << endl;
+        return 1;
+    }
+
+    const unsigned threads = vm.count("threads") ? vm["threads"].as<unsigned>() : 0;
+    if (vm.count("preload")) {
+        for (const auto &device : vm["preload"].as<vector<string>>()) {
+            try {
+                DeviceLocator part = find_device_by_name(device);
+                preload_device(part.family, part.device, threads);
+            } catch (runtime_error &e) {
+                cerr << "Failed to preload " << device << ": " << e.what() << endl;
+                return 1;
+            }
+        }
+    }
+
+    map<string, JobFunction> tools{
+            {"ecppack",   ecppack_job},
+            {"ecpunpack", ecpunpack_job},
+            {"ecpbram",   ecpbram_job},
+    };
+
+    try {
+        JobServer server(database_folder, tools, threads);
+        if (vm.count("stdio")) {
+            server.serve_stream(cin, cout);
+        } else {
+            string socket_path = vm["socket"].as<string>();
+#ifndef _WIN32
+            if (socket_path.size() < sizeof(socket_to_remove)) {
+                strcpy(socket_to_remove, socket_path.c_str());
+                signal(SIGINT, remove_socket_and_exit);
+                signal(SIGTERM, remove_socket_and_exit);
+            }
+#endif
+            server.serve_socket(socket_path);
+        }
+    } catch (runtime_error &e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
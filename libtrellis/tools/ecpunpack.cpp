@@ -2,9 +2,9 @@
 #include "Bitstream.hpp"
 #include "Chip.hpp"
 #include "Database.hpp"
-#include "DatabasePath.hpp"
+#include "Profile.hpp"
+#include "jobs.hpp"
 #include "version.hpp"
-#include "wasmexcept.hpp"
 #include <iostream>
 #include <boost/optional.hpp>
 #include <boost/program_options.hpp>
@@ -12,21 +12,30 @@
 #include <streambuf>
 #include <fstream>
 
+#ifndef TRELLIS_NO_TOOL_MAIN
+#include "DatabasePath.hpp"
+#include "wasmexcept.hpp"
+#endif
+
 using namespace std;
 
-int main(int argc, char *argv[])
+int ecpunpack_job(int argc, char *argv[], Trellis::JobContext &ctx)
 {
     using namespace Trellis;
     namespace po = boost::program_options;
     boost::optional<uint32_t> idcode;
 
-    std::string database_folder = get_database_path();
+    std::string database_folder = ctx.default_database;
 
     po::options_description options("Allowed options");
     options.add_options()("help,h", "show help");
     options.add_options()("verbose,v", "verbose output");
     options.add_options()("db", po::value<std::string>(), "Trellis database folder location");
     options.add_options()("idcode", po::value<std::string>(), "IDCODE to override in bitstream");
+    options.add_options()("binary", "write the configuration in binary format");
+    options.add_options()("profile", po::value<std::string>(), "write a JSON summary of time spent in each stage to a file");
+    options.add_options()("profile-trace", po::value<std::string>(), "write a Chrome trace of time spent in each stage to a file");
+    options.add_options()("server", po::value<std::string>(), "run in the ecpserver listening on this socket, if there is one");
     po::positional_options_description pos;
     options.add_options()("input", po::value<std::string>()->required(), "input bitstream file");
     pos.add("input", 1);
@@ -40,30 +49,30 @@ int main(int argc, char *argv[])
         po::notify(vm);
     }
     catch (po::required_option &e) {
-        cerr << "Error: input file is mandatory." << endl << endl;
+        ctx.err << "Error: input file is mandatory." << endl << endl;
         goto help;
     }
     catch (std::exception &e) {
-        cerr << "Error: " << e.what() << endl << endl;
+        ctx.err << "Error: " << e.what() << endl << endl;
         goto help;
     }
 
     if (vm.count("help")) {
 help:
-        cerr << "Project Trellis - Open Source Tools for ECP5 FPGAs" << endl;
-        cerr << "Version " << git_describe_str << endl;
-        cerr << argv[0] << ": ECP5 bitstream to text config converter" << endl;
-        cerr << endl;
-        cerr << "Copyright (C) 2018 gatecat <gatecat@ds0.me>" << endl;
-        cerr << endl;
-        cerr << "Usage: " << argv[0] << " input.bit [output.config] [options]" << endl;
-        cerr << options << endl;
+        ctx.err << "Project Trellis - Open Source Tools for ECP5 FPGAs" << endl;
+        ctx.err << "Version " << git_describe_str << endl;
+        ctx.err << argv[0] << ": ECP5 bitstream to text config converter" << endl;
+        ctx.err << endl;
+        ctx.err << "Copyright (C) 2018 gatecat <gatecat@ds0.me>" << endl;
+        ctx.err << endl;
+        ctx.err << "Usage: " << argv[0] << " input.bit [output.config] [options]" << endl;
+        ctx.err << options << endl;
         return vm.count("help") ? 0 : 1;
     }
 
-    ifstream bit_file(vm["input"].as<string>(), ios::binary);
+    ifstream bit_file(ctx.path(vm["input"].as<string>()), ios::binary);
     if (!bit_file) {
-        cerr << "Failed to open input file" << endl;
+        ctx.err << "Failed to open input file" << endl;
         return 1;
     }
 
@@ -71,40 +80,64 @@ help:
         database_folder = vm["db"].as<string>();
     }
 
+    if (vm.count("profile") || vm.count("profile-trace")) {
+        // Profiling is process-wide, so would include other jobs
+        if (ctx.in_server())
+            throw JobNotServed("profiling is not supported in a server");
+        Profile::set_enabled(true);
+    }
+
     if (vm.count("idcode")) {
         string idcode_str = vm["idcode"].as<string>();
         uint32_t idcode_val;
         idcode_val = uint32_t(strtoul(idcode_str.c_str(), nullptr, 0));
         if (idcode_val == 0) {
-            cerr << "Invalid idcode: " << idcode_str << endl;
+            ctx.err << "Invalid idcode: " << idcode_str << endl;
             return 1;
         }
         idcode = idcode_val;
     }
 
     try {
-        load_database(database_folder);
+        ctx.load_database(database_folder);
     } catch (runtime_error &e) {
-        cerr << "Failed to load Trellis database: " << e.what() << endl;
+        ctx.err << "Failed to load Trellis database: " << e.what() << endl;
         return 1;
     }
 
     try {
         Chip c = Bitstream::read_bit(bit_file).deserialise_chip(idcode);
         ChipConfig cc = ChipConfig::from_chip(c);
-        ofstream out_file(vm["textcfg"].as<string>());
-        if (!out_file) {
-            cerr << "Failed to open output file" << endl;
+        try {
+            if (vm.count("binary"))
+                cc.to_binary_file(ctx.path(vm["textcfg"].as<string>()));
+            else
+                cc.to_file(ctx.path(vm["textcfg"].as<string>()));
+        } catch (runtime_error &e) {
+            ctx.err << "Failed to write output file: " << e.what() << endl;
+            return 1;
+        }
+        try {
+            Profile::write_files(vm.count("profile") ? ctx.path(vm["profile"].as<string>()) : "",
+                                 vm.count("profile-trace") ? ctx.path(vm["profile-trace"].as<string>()) : "");
+        } catch (runtime_error &e) {
+            ctx.err << "Failed to write profile: " << e.what() << endl;
             return 1;
         }
-        out_file << cc.to_string();
         return 0;
     } catch (BitstreamParseError &e) {
-        cerr << "Failed to process input bitstream: " << e.what() << endl;
+        ctx.err << "Failed to process input bitstream: " << e.what() << endl;
         return 1;
     } catch (runtime_error &e) {
-        cerr << "Failed to process input bitstream: " << e.what() << endl;
+        ctx.err << "Failed to process input bitstream: " << e.what() << endl;
         return 1;
     }
 
 }
+
+#ifndef TRELLIS_NO_TOOL_MAIN
+int main(int argc, char *argv[])
+{
+    return Trellis::run_tool("ecpunpack", ecpunpack_job, argc, argv, get_database_path());
+}
+#endif
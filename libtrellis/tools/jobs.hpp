@@ -0,0 +1,12 @@
+#ifndef TRELLIS_TOOLS_JOBS_HPP
+#define TRELLIS_TOOLS_JOBS_HPP
+
+#include "JobServer.hpp"
+
+// Tools that can be run by ecpserver. Each tool's source file also has a main function, unless built with
+// TRELLIS_NO_TOOL_MAIN for linking into the server
+int ecppack_job(int argc, char *argv[], Trellis::JobContext &ctx);
+int ecpunpack_job(int argc, char *argv[], Trellis::JobContext &ctx);
+int ecpbram_job(int argc, char *argv[], Trellis::JobContext &ctx);
+
+#endif //TRELLIS_TOOLS_JOBS_HPP
@@ -0,0 +1,352 @@
+#include "ChipConfig.hpp"
+#include "Bitstream.hpp"
+#include "Chip.hpp"
+#include "Database.hpp"
+#include "DatabasePath.hpp"
+#include "Tile.hpp"
+#include "BitDatabase.hpp"
+#include "DedupChipdb.hpp"
+#include "Parallel.hpp"
+#include "Util.hpp"
+#include "version.hpp"
+#include "wasmexcept.hpp"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <boost/optional.hpp>
+#include <boost/program_options.hpp>
+#include <stdexcept>
+
+using namespace std;
+using namespace Trellis;
+
+/*
+Benchmarks of the main libtrellis operations, on synthetic designs that are the same on every run given the same
+database, device, density and seed. Each design starts from the empty configuration of a device, then sets `density` of
+the muxes in each tile to a random source and `density` of the words (such as LUT initialisation) to random values.
+
+Results are written as JSON, with the time of every iteration and a hash of each design's bitstream, so runs can be
+compared to check for regressions.
+ */
+
+namespace {
+
+struct BenchResult
+{
+    string device;
+    boost::optional<double> density;
+    string name;
+    vector<double> times_ms;
+    string error;
+    boost::optional<uint64_t> input_hash;
+};
+
+void write_json(ostream &out, const vector<BenchResult> &results, unsigned seed, int iterations)
+{
+    out << "{" << endl;
+    out << "  \"version\": ";
+    write_json_string(out, git_describe_str);
+    out << "," << endl;
+    out << "  \"seed\": " << seed << "," << endl;
+    out << "  \"iterations\": " << iterations << "," << endl;
+    out << "  \"threads\": " << default_thread_count() << "," << endl;
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results.at(i);
+        out << (i > 0 ? "," : "") << endl << "    {";
+        out << "\"device\": ";
+        write_json_string(out, r.device);
+        out << ", \"density\": ";
+        if (r.density)
+            out << *r.density;
+        else
+            out << "null";
+        out << ", \"benchmark\": ";
+        write_json_string(out, r.name);
+        if (!r.error.empty()) {
+            out << ", \"error\": ";
+            write_json_string(out, r.error);
+            out << "}";
+            continue;
+        }
+        if (r.input_hash)
+            out << ", \"input_hash\": \"" << hex << setw(16) << setfill('0') << *r.input_hash << dec << setfill(' ')
+                << "\"";
+        vector<double> sorted = r.times_ms;
+        sort(sorted.begin(), sorted.end());
+        double total = 0;
+        for (double t : sorted)
+            total += t;
+        out << fixed << setprecision(3);
+        out << ", \"min_ms\": " << sorted.front();
+        out << ", \"median_ms\": " << sorted.at(sorted.size() / 2);
+        out << ", \"mean_ms\": " << total / sorted.size();
+        out << ", \"max_ms\": " << sorted.back();
+        out << ", \"times_ms\": [";
+        for (size_t j = 0; j < r.times_ms.size(); j++)
+            out << (j > 0 ? ", " : "") << r.times_ms.at(j);
+        out << "]}";
+        out.unsetf(ios::floatfield);
+        out << setprecision(6);
+    }
+    out << endl << "  ]" << endl << "}" << endl;
+}
+
+uint64_t hash_bytes(const string &data)
+{
+    ContentHasher hasher;
+    hasher.add(data.data(), data.size());
+    return hasher.h;
+}
+
+// Random numbers that don't depend on the standard library's distributions, which differ between implementations
+class BenchRandom
+{
+public:
+    explicit BenchRandom(uint64_t seed) : rng(seed)
+    {}
+
+    double uniform()
+    {
+        return rng() / 4294967296.0;
+    }
+
+    size_t below(size_t n)
+    {
+        return size_t(rng() % n);
+    }
+
+private:
+    mt19937 rng;
+};
+
+ChipConfig make_design(const string &device, double density, unsigned seed)
+{
+    Chip empty(device);
+    ChipConfig cc = ChipConfig::from_chip(empty);
+    BenchRandom rand(seed ^ hash_bytes(device) ^ uint64_t(density * 1000000));
+    // Muxes and words of each tile type, in name order
+    map<string, pair<vector<MuxBits>, vector<WordSettingBits>>> tile_types;
+    for (const auto &tile : empty.tiles) {
+        const string &type = tile.second->info.type;
+        if (!tile_types.count(type)) {
+            auto db = get_tile_bitdata(TileLocator{empty.info.family, empty.info.name, type});
+            auto &tt = tile_types[type];
+            for (const auto &sink : db->get_sinks())
+                tt.first.push_back(db->get_mux_data_for_sink(sink));
+            for (const auto &word : db->get_settings_words())
+                tt.second.push_back(db->get_data_for_setword(word));
+        }
+        const auto &tt = tile_types.at(type);
+        TileConfig &tc = cc.tiles[tile.first];
+        for (const auto &mux : tt.first) {
+            if (mux.arcs.empty() || rand.uniform() >= density)
+                continue;
+            auto arc = mux.arcs.begin();
+            advance(arc, rand.below(mux.arcs.size()));
+            tc.carcs.push_back(ConfigArc{mux.sink, arc->first});
+        }
+        for (const auto &word : tt.second) {
+            if (rand.uniform() >= density)
+                continue;
+            ConfigWord cw;
+            cw.name = word.name;
+            for (size_t i = 0; i < word.bits.size(); i++)
+                cw.value.push_back(rand.below(2) != 0);
+            tc.cwords.push_back(cw);
+        }
+        if (tc.carcs.empty() && tc.cwords.empty() && tc.cenums.empty() && tc.cunknowns.empty())
+            cc.tiles.erase(tile.first);
+    }
+    return cc;
+}
+
+BenchResult run_bench(const string &device, boost::optional<double> density, const string &name, int iterations,
+                      const function<void()> &func)
+{
+    BenchResult r;
+    r.device = device;
+    r.density = density;
+    r.name = name;
+    cerr << "  " << name << "..." << flush;
+    try {
+        for (int i = 0; i < iterations; i++) {
+            auto start = chrono::steady_clock::now();
+            func();
+            auto end = chrono::steady_clock::now();
+            r.times_ms.push_back(chrono::duration<double, milli>(end - start).count());
+        }
+        cerr << " " << fixed << setprecision(1) << *min_element(r.times_ms.begin(), r.times_ms.end()) << "ms"
+             << endl;
+        cerr.unsetf(ios::floatfield);
+    } catch (exception &e) {
+        r.error = e.what();
+        cerr << " failed: " << r.error << endl;
+    }
+    return r;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    namespace po = boost::program_options;
+
+    std::string database_folder = get_database_path();
+
+    po::options_description options("Allowed options");
+    options.add_options()("help,h", "show help");
+    options.add_options()("db", po::value<std::string>(), "Trellis database folder location");
+    options.add_options()("device", po::value<vector<string>>(),
+                          "device to benchmark; may be given more than once (default LFE5U-45F and LCMXO2-7000HC)");
+    options.add_options()("density", po::value<vector<double>>(),
+                          "fraction of muxes and words set in the synthetic designs; may be given more than once "
+                          "(default 0.1 and 0.5)");
+    options.add_options()("iterations", po::value<int>()->default_value(3), "number of times to run each benchmark");
+    options.add_options()("seed", po::value<unsigned>()->default_value(1), "seed for the synthetic designs");
+    options.add_options()("output,o", po::value<std::string>(), "write JSON results to a file rather than stdout");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        po::notify(vm);
+    }
+    catch (std::exception &e) {
+        cerr << "Error: " << e.what() << endl << endl;
+        goto help;
+    }
+
+    if (vm.count("help")) {
+help:
+        cerr << "Project Trellis - Open Source Tools for ECP5 FPGAs" << endl;
+        cerr << "Version " << git_describe_str << endl;
+        cerr << argv[0] << ": libtrellis benchmarks" << endl;
+        cerr << endl;
+        cerr << "Usage: " << argv[0] << " [options]" << endl;
+        cerr << options << endl;
+        return vm.count("help") ? 0 : 1;
+    }
+
+    if (vm.count("db")) {
+        database_folder = vm["db"].as<string>();
+    }
+    vector<string> devices{"LFE5U-45F", "LCMXO2-7000HC"};
+    if (vm.count("device"))
+        devices = vm["device"].as<vector<string>>();
+    vector<double> densities{0.1, 0.5};
+    if (vm.count("density"))
+        densities = vm["density"].as<vector<double>>();
+    const int iterations = vm["iterations"].as<int>();
+    const unsigned seed = vm["seed"].as<unsigned>();
+    if (iterations < 1) {
+        cerr << "Error: at least one iteration is needed" << endl;
+        return 1;
+    }
+
+    // Keep the progress output readable; bitstream notes would be printed on every iteration
+    verbosity = VerbosityLevel::ERROR;
+
+    try {
+        load_database(database_folder);
+    } catch (runtime_error &e) {
+        cerr << "Failed to load Trellis database: " << e.what() << endl;
+        return 1;
+    }
+
+    vector<BenchResult> results;
+    for (const auto &device : devices) {
+        cerr << device << endl;
+        boost::optional<Chip> chip;
+        results.push_back(run_bench(device, boost::none, "chip_create", 1, [&]() {
+            chip = Chip(device);
+        }));
+        if (!chip)
+            continue;
+        // Bit databases are only loaded once per process, so this has a single iteration
+        results.push_back(run_bench(device, boost::none, "bitdb_load", 1, [&]() {
+            set<string> types;
+            for (const auto &tile : chip->tiles)
+                if (types.insert(tile.second->info.type).second)
+                    get_tile_bitdata(TileLocator{chip->info.family, chip->info.name, tile.second->info.type});
+        }));
+        results.push_back(run_bench(device, boost::none, "get_routing_graph", iterations, [&]() {
+            chip->get_routing_graph();
+        }));
+        results.push_back(run_bench(device, boost::none, "make_dedup_chipdb", iterations, [&]() {
+            DDChipDb::make_dedup_chipdb(*chip);
+        }));
+
+        for (double density : densities) {
+            cerr << device << " at density " << density << endl;
+            ChipConfig cc;
+            string text, bit;
+            boost::optional<Chip> design_chip;
+            boost::optional<Bitstream> bitstream;
+            try {
+                cc = make_design(device, density, seed);
+                text = cc.to_string();
+                design_chip = cc.to_chip();
+                ostringstream bit_out;
+                Bitstream::serialise_chip(*design_chip, map<string, string>()).write_bit(bit_out);
+                bit = bit_out.str();
+            } catch (exception &e) {
+                BenchResult r;
+                r.device = device;
+                r.density = density;
+                r.name = "make_design";
+                r.error = e.what();
+                cerr << "  failed to make design: " << r.error << endl;
+                results.push_back(r);
+                continue;
+            }
+            const uint64_t input_hash = hash_bytes(bit);
+            auto bench = [&](const string &name, const function<void()> &func) {
+                results.push_back(run_bench(device, density, name, iterations, func));
+                results.back().input_hash = input_hash;
+            };
+            bench("config_from_text", [&]() { ChipConfig::from_string(text); });
+            bench("config_to_text", [&]() { cc.to_string(); });
+            bench("config_to_chip", [&]() { cc.to_chip(); });
+            bench("chip_to_config", [&]() { ChipConfig::from_chip(*design_chip); });
+            bench("serialise_chip", [&]() {
+                ostringstream out;
+                Bitstream::serialise_chip(*design_chip, map<string, string>()).write_bit(out);
+            });
+            if (design_chip->info.family == "ECP5") {
+                bench("serialise_chip_compressed", [&]() {
+                    ostringstream out;
+                    Bitstream::serialise_chip(*design_chip, map<string, string>{{"compress", "yes"}}).write_bit(out);
+                });
+            }
+            bench("read_bit", [&]() {
+                istringstream in(bit);
+                bitstream = Bitstream::read_bit(in);
+            });
+            bench("deserialise_chip", [&]() {
+                if (!bitstream)
+                    throw runtime_error("no bitstream, as read_bit failed");
+                bitstream->deserialise_chip(boost::none);
+            });
+        }
+    }
+
+    if (vm.count("output")) {
+        ofstream out(vm["output"].as<string>());
+        if (!out) {
+            cerr << "Failed to open output file" << endl;
+            return 1;
+        }
+        write_json(out, results, seed, iterations);
+    } else {
+        write_json(cout, results, seed, iterations);
+    }
+    for (const auto &r : results)
+        if (!r.error.empty())
+            return 1;
+    return 0;
+}
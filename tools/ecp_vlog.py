@@ -3,8 +3,7 @@ import re
 import sys
 from collections import defaultdict
 from dataclasses import dataclass, field
-from functools import lru_cache
-from typing import Callable, ClassVar, Dict, List, Optional, Set, Tuple, Type
+from typing import ClassVar, Dict, List, Optional, Set, Tuple, Type
 
 try:
     # optional import to get natural sorting of integers (i.e. 1, 5, 9, 10 instead of 1, 10, 5, 9)
@@ -27,13 +26,11 @@ Location = Tuple[int, int]  # pytrellis.Location cannot be used as a dictionary
 TilesByLoc = Dict[Location, List[TileData]]
 
 
-def make_tiles_by_loc(chip: pytrellis.Chip) -> TilesByLoc:
+def make_tiles_by_loc(chip: pytrellis.Chip, netlist: pytrellis.ConfiguredNetlist) -> TilesByLoc:
     tiles_by_loc: TilesByLoc = defaultdict(list)
 
     for tilename, tile in chip.tiles.items():
-        locator = pytrellis.TileLocator(chip.info.family, chip.info.name, tile.info.type)
-        tilebitdb = pytrellis.get_tile_bitdata(locator)
-        tilecfg = tilebitdb.tile_cram_to_config(tile.cram)
+        tilecfg = netlist.tile_configs[tilename]
 
         rc = tile.info.get_row_col()
         row, col = rc.first, rc.second
@@ -206,34 +203,9 @@ class ConnectionGraph:
 
 
 # Connection graph generation
-def gen_config_graph(chip: pytrellis.Chip, rgraph: pytrellis.RoutingGraph, tiles_by_loc: TilesByLoc) -> ConnectionGraph:
-    @lru_cache(None)
-    def get_zero_bit_arcs(chip: pytrellis.Chip, tiletype: str) -> Dict[str, List[str]]:
-        """Get configurable zero-bit arcs from the given tile.
-
-        tile_cram_to_config ignores zero-bit arcs when generating the TileConfig,
-        which means that if all bits are unset for a given mux, no connection is
-        generated at all."""
-        locator = pytrellis.TileLocator(chip.info.family, chip.info.name, tiletype)
-        tilebitdb = pytrellis.get_tile_bitdata(locator)
-        arcs: Dict[str, List[str]] = defaultdict(list)
-        for sink in tilebitdb.get_sinks():
-            mux_data = tilebitdb.get_mux_data_for_sink(sink)
-            for arc_name, arc_data in mux_data.arcs.items():
-                if len(arc_data.bits.bits) == 0:
-                    arcs[sink].append(arc_name)
-        return arcs
-
-    def bel_to_node(pos: Tuple[pytrellis.RoutingId, int]) -> Node:
-        rid, bel_pin = pos
-        id = Ident.from_id(rgraph, rid.id)
-        pin = Ident.from_id(rgraph, bel_pin)
-        return Node(x=rid.loc.x, y=rid.loc.y, id=id, pin=pin)
-
-    def wire_to_node(rid: pytrellis.RoutingId) -> Node:
-        id = Ident.from_id(rgraph, rid.id)
-        return Node(x=rid.loc.x, y=rid.loc.y, id=id)
-
+def gen_config_graph(
+    rgraph: pytrellis.RoutingGraph, tiles_by_loc: TilesByLoc, netlist: pytrellis.ConfiguredNetlist
+) -> ConnectionGraph:
     def _get_enum_value(cfg: pytrellis.TileConfig, enum_name: str) -> Optional[str]:
         for cenum in cfg.cenums:
             if cenum.name == enum_name:
@@ -311,129 +283,25 @@ def gen_config_graph(chip: pytrellis.Chip, rgraph: pytrellis.RoutingGraph, tiles
 
         graph.add_edge(sourcenode, sinknode)
 
-    config_graph = ConnectionGraph()
+    # The configured arcs, with the fixed connections, zero-bit arcs, global clock connections and BEL pins they
+    # reach, are found by extract_configured_netlist; only the special cases in add_edge are handled here.
+    wire_nodes = [Node(x=x, y=y, id=Ident.from_id(rgraph, id)) for x, y, id in netlist.wires.tolist()]
 
-    for loc in tiles_by_loc:
-        rtile = rgraph.tiles[pytrellis.Location(loc[0], loc[1])]
-        for tiledata in tiles_by_loc[loc]:
-            tile = tiledata.tile
-            for arc in tiledata.cfg.carcs:
-                rarc = rtile.arcs[rgraph.ident(f"{arc.source}->{arc.sink}")]
-                sourcenode = wire_to_node(rarc.source)
-                sinknode = wire_to_node(rarc.sink)
-                add_edge(config_graph, sourcenode, sinknode)
-
-    # Expand configuration arcs to include BEL connections and zero-bit arcs
     arc_graph = ConnectionGraph()
-    nodes_seen: Set[Node] = set()
-
-    def visit_node(node: Node, bel_func: Callable[[Node], None]) -> None:
-        """ Add unconfigurable or implicit arcs to the given node """
-        if node in nodes_seen:
-            return
-        nodes_seen.add(node)
-
-        try:
-            rtile = rgraph.tiles[node.loc]
-            rwire = rtile.wires[node.id.id]
-        except KeyError:
-            # there's a handful of troublesome cases which are outside of my control.
-            # Example: R0C31_G_ULDDRDEL does not exist; it's actually supposed to be the "fixed"
-            # connection G_ULDDRDEL=>DDRDEL but G_ULDDRDEL is not in the same tile.
-            print(f"Error: failed to find node {str(node)}", file=sys.stderr)
-            return
-
-        if node not in config_graph.edges_rev:
-            # Not configured - possible zero-bit configuration
-            for tiledata in tiles_by_loc[node.x, node.y]:
-                arcs = get_zero_bit_arcs(chip, tiledata.tile.info.type)
-                sources = arcs.get(node.id.label, [])
-                if not sources:
-                    continue
-                for source in sources:
-                    sourceid = Ident.from_label(rgraph, source)
-                    sourcenode = Node(x=node.x, y=node.y, id=sourceid)
-                    add_edge(arc_graph, sourcenode, node)
-                    visit_node(sourcenode, bel_func)
-
-        # Add fixed connections
-        for bel in rwire.belsUphill:
-            add_edge(arc_graph, bel_to_node(bel), node)
-            bel_func(wire_to_node(bel[0]))
-        for bel in rwire.belsDownhill:
-            add_edge(arc_graph, node, bel_to_node(bel))
-            bel_func(wire_to_node(bel[0]))
-        for routes in [rwire.uphill, rwire.downhill]:
-            for rarcrid in routes:
-                rarcname = rgraph.to_str(rarcrid.id)
-                if "=>" in rarcname:
-                    # => means a fixed (unconfigurable) connection
-                    rarc = rgraph.tiles[rarcrid.loc].arcs[rarcrid.id]
-                    sourcenode = wire_to_node(rarc.source)
-                    sinknode = wire_to_node(rarc.sink)
-                    add_edge(arc_graph, sourcenode, sinknode)
-                    visit_node(sourcenode, bel_func)
-                    visit_node(sinknode, bel_func)
-
-        # Add global (clock) connections - Project Trellis omits a lot of these :(
-        if node.name.startswith("G_HPBX"):
-            # TAP_DRIVE -> PLB tile
-            tap = chip.global_data.get_tap_driver(node.y, node.x)
-            if tap.dir == pytrellis.TapDir.LEFT:
-                tap_name = node.name.replace("G_HPBX", "L_HPBX")
-            else:
-                tap_name = node.name.replace("G_HPBX", "R_HPBX")
-            tap_id = Ident.from_label(rgraph, tap_name)
-            tap_node = Node(x=tap.col, y=node.y, id=tap_id)
-            add_edge(arc_graph, tap_node, node)
-            visit_node(tap_node, bel_func)
-
-        elif node.name.startswith("G_VPTX"):
-            # Spine tile -> TAP_DRIVE
-            tap = chip.global_data.get_tap_driver(node.y, node.x)
-            if tap.col == node.x:
-                # Spine output
-                quadrant = chip.global_data.get_quadrant(node.y, node.x)
-                spine = chip.global_data.get_spine_driver(quadrant, node.x)
-                spine_node = Node(x=spine.second, y=spine.first, id=node.id)
-                add_edge(arc_graph, spine_node, node)
-                visit_node(spine_node, bel_func)
-
-        elif node.name.startswith("G_HPRX"):
-            # Center mux -> spine tile (qqPCLKn -> G_HPRXnn00)
-            quadrant = chip.global_data.get_quadrant(node.y, node.x)
-            assert node.name.endswith("00")
-            clkid = int(node.name[6:-2])
-            global_id = Ident.from_label(rgraph, f"G_{quadrant}PCLK{clkid}")
-            global_node = Node(x=0, y=0, id=global_id)
-            add_edge(arc_graph, global_node, node)
-            visit_node(global_node, bel_func)
-
-    # Visit every configured arc and record all BELs seen
-    bels_todo: Set[Node] = set()
-    for sourcenode, nodes in config_graph.edges_fwd.items():
-        for sinknode in nodes:
-            add_edge(arc_graph, sourcenode, sinknode)
-            visit_node(sourcenode, bels_todo.add)
-            visit_node(sinknode, bels_todo.add)
-
-    # Adding *every* fixed connection is too expensive.
-    # As a compromise, add any fixed connection connected
-    # to used BELs. Ignore BELs that don't have any configured
-    # arcs.
-    for node in bels_todo:
-        rtile = rgraph.tiles[node.loc]
-        for _, rwire in rtile.wires.items():
-            wireident = Ident.from_id(rgraph, rwire.id)
-            wirenode = Node(x=node.x, y=node.y, id=wireident)
-            for bel in rwire.belsUphill:
-                if bel[0].id == node.id.id:
-                    add_edge(arc_graph, bel_to_node(bel), wirenode)
-                    visit_node(wirenode, lambda node: None)
-            for bel in rwire.belsDownhill:
-                if bel[0].id == node.id.id:
-                    add_edge(arc_graph, wirenode, bel_to_node(bel))
-                    visit_node(wirenode, lambda node: None)
+    for source, sink in zip(netlist.arc_sources.tolist(), netlist.arc_sinks.tolist()):
+        add_edge(arc_graph, wire_nodes[source], wire_nodes[sink])
+
+    for (x, y, bel), pin, wire, output in zip(
+        netlist.bel_pin_bels.tolist(),
+        netlist.bel_pin_names.tolist(),
+        netlist.bel_pin_wires.tolist(),
+        netlist.bel_pin_outputs.tolist(),
+    ):
+        bel_node = Node(x=x, y=y, id=Ident.from_id(rgraph, bel), pin=Ident.from_id(rgraph, pin))
+        if output:
+            add_edge(arc_graph, bel_node, wire_nodes[wire])
+        else:
+            add_edge(arc_graph, wire_nodes[wire], bel_node)
 
     return arc_graph
 
@@ -1033,8 +901,9 @@ def main(argv: List[str]) -> None:
     rgraph = chip.get_routing_graph()
 
     print("Computing connection graph...", file=sys.stderr)
-    tiles_by_loc = make_tiles_by_loc(chip)
-    graph = gen_config_graph(chip, rgraph, tiles_by_loc)
+    netlist = pytrellis.extract_configured_netlist(chip, rgraph)
+    tiles_by_loc = make_tiles_by_loc(chip, netlist)
+    graph = gen_config_graph(rgraph, tiles_by_loc, netlist)
 
     print("Generating Verilog...", file=sys.stderr)
     print_verilog(graph, tiles_by_loc, args.module_name)
@@ -15,7 +15,6 @@ import isptcl
 import fuzzloops
 import pytrellis
 import nets
-import tiles
 
 
 def fuzz_interconnect(config,
@@ -131,10 +130,6 @@ def fuzz_interconnect_with_netnames(
         # Get a unique prefix from the thread ID
         prefix = "thread{}_".format(threading.get_ident())
         assoc_arcs = net_arcs[net]
-        # Obtain the set of databases
-        tile_dbs = {tile: pytrellis.get_tile_bitdata(
-            pytrellis.TileLocator(config.family, config.device, tiles.type_from_fullname(tile))) for tile in
-            config.tiles}
         # First filter using netname predicate
         if netname_filter_union:
             assoc_arcs = filter(lambda x: netname_predicate(x[0], netnames) and netname_predicate(x[1], netnames),
@@ -144,68 +139,46 @@ def fuzz_interconnect_with_netnames(
                                 assoc_arcs)
         # Then filter using the arc predicate
         fuzz_arcs = list(filter(lambda x: arc_predicate(x, netnames), assoc_arcs))
+        is_full_mux = full_mux_style and len(fuzz_arcs) > 1
 
-        # Ful fullmux mode only
-        changed_bits = set()
-        arc_tiles = {}
-        tiles_changed = set()
-
+        arc_chips = []
         for arc in fuzz_arcs:
             # Route statement containing arc for NCL file
             arc_route = "route\n\t\t\t" + arc[0] + "." + arc[1] + ";"
             # Build a bitstream and load it using libtrellis
             arc_bitf = config.build_design(config.ncl, {"route": arc_route}, prefix)
-            arc_chip = pytrellis.Bitstream.read_bit(arc_bitf).deserialise_chip()
-            # Compare the bitstream with the arc to the baseline bitstream
-            diff = arc_chip - baseline_chip
-            if (not full_mux_style) or len(fuzz_arcs) == 1:
-                if len(diff) == 0:
-                    # No difference means fixed interconnect
-                    # We consider this to be in the first tile if multiple tiles are being analysed
-                    if fc_predicate(arc, netnames):
-                        norm_arc = normalise_arc_in_tile(config.tiles[0], arc)
-                        fc = pytrellis.FixedConnection()
-                        norm_arc = [fc_prefix + _ if not _.startswith("G_") else _ for _ in norm_arc]
-                        norm_arc = [add_nonlocal_prefix(_) for _ in norm_arc]
-                        fc.source, fc.sink = norm_arc
-                        tile_dbs[config.tiles[0]].add_fixed_conn(fc)
-                else:
-                    for tile in config.tiles:
-                        if tile in diff:
-                            # Configurable interconnect in <tile>
-                            norm_arc = normalise_arc_in_tile(tile, arc)
-                            norm_arc = [add_nonlocal_prefix(_) for _ in norm_arc]
-                            ad = pytrellis.ArcData()
-                            ad.source, ad.sink = norm_arc
-                            ad.bits = pytrellis.BitGroup(diff[tile])
-                            tile_dbs[tile].add_mux_arc(ad)
+            arc_chips.append(pytrellis.Bitstream.read_bit(arc_bitf).deserialise_chip())
+
+        # Compare the bitstreams with each arc to the baseline bitstream, to find which tiles the arc needs naming in
+        arc_diffs = [pytrellis.diff_chips(arc_chip, baseline_chip) for arc_chip in arc_chips]
+        tiles_changed = set(tile for diff in arc_diffs for tile in config.tiles if tile in diff)
+
+        arcs = []
+        for arc, diff in zip(fuzz_arcs, arc_diffs):
+            fa = pytrellis.FuzzArc()
+            if is_full_mux:
+                for tile in tiles_changed:
+                    fa.tile_names[tile] = normalise_arc_in_tile(tile, arc)
+            elif len(diff) == 0:
+                # No difference means fixed interconnect
+                # We consider this to be in the first tile if multiple tiles are being analysed
+                if fc_predicate(arc, netnames):
+                    norm_arc = normalise_arc_in_tile(config.tiles[0], arc)
+                    norm_arc = [fc_prefix + _ if not _.startswith("G_") else _ for _ in norm_arc]
+                    norm_arc = [add_nonlocal_prefix(_) for _ in norm_arc]
+                    fc = pytrellis.FixedConnection()
+                    fc.source, fc.sink = norm_arc
+                    fa.fixed_conn = fc
             else:
-                arc_tiles[arc] = {}
                 for tile in config.tiles:
                     if tile in diff:
-                        tiles_changed.add(tile)
-                        for bit in diff[tile]:
-                            changed_bits.add((tile, bit.frame, bit.bit))
-                    arc_tiles[arc][tile] = arc_chip.tiles[tile]
-
-        if full_mux_style and len(fuzz_arcs) > 1:
-            for tile in tiles_changed:
-                for arc in arc_tiles:
-                    bg = pytrellis.BitGroup()
-                    for (btile, bframe, bbit) in changed_bits:
-                        if btile == tile:
-                            state = arc_tiles[arc][tile].cram.bit(bframe, bbit)
-                            cb = pytrellis.ConfigBit()
-                            cb.frame = bframe
-                            cb.bit = bbit
-                            cb.inv = (state == 0)
-                            bg.bits.add(cb)
-                    ad = pytrellis.ArcData()
-                    ad.source, ad.sink = normalise_arc_in_tile(tile, arc)
-                    ad.bits = bg
-                    tile_dbs[tile].add_mux_arc(ad)
-        # Flush database to disk
-        for tile, db in tile_dbs.items():
-            db.save()
+                        # Configurable interconnect in <tile>
+                        norm_arc = normalise_arc_in_tile(tile, arc)
+                        fa.tile_names[tile] = tuple(add_nonlocal_prefix(_) for _ in norm_arc)
+            arcs.append(fa)
+
+        # Solve the bits of each arc, and update the database with the results
+        pytrellis.solve_arcs(baseline_chip, arcs, arc_chips, pytrellis.StringVector(config.tiles),
+                             full_mux_style).commit()
 
     fuzzloops.parallel_foreach(netnames, per_netname)